@@ -1,51 +1,330 @@
 library ieee;
 use ieee.std_logic_1164.all;
 use ieee.numeric_std.all;
+use ieee.math_real.all;
 
 entity led_array is
+	generic (
+		-- clock cycles per PWM count; the PWM period is 4096 counts, so the
+		-- default gives about 1 kHz at 50 MHz
+		PWM_PRESCALE : positive := 12;
+		-- frames the sequencer's pattern RAM holds
+		SEQ_FRAMES : positive range 1 to 512 := 512
+	);
 	port (
 		clk 		: in std_ulogic;
 		rst 	: in std_ulogic;
 		-- avalon memory-mapped slave interface
 		avs_read 		: in std_ulogic;
 		avs_write 		: in std_ulogic;
-		avs_address 	: in std_ulogic;
+		avs_address 	: in std_ulogic_vector(9 downto 0);
 		avs_readdata 	: out std_ulogic_vector(31 downto 0);
 		avs_writedata 	: in std_ulogic_vector(31 downto 0);
+		-- pattern routed by the crossbar; used instead of the register while
+		-- route_valid is set
+		route_led		: in std_ulogic_vector(31 downto 0);
+		route_valid		: in std_ulogic;
 		-- external I/O; export to top-level
 		led 				: out std_ulogic_vector(7 downto 0)
 		);
 end entity led_array;
 
 architecture led_array_arch of led_array is
-	
-	
+
+	-- PWM high time out of 4096 counts for each brightness level
+	type duty_rom_t is array (0 to 255) of unsigned(12 downto 0);
+	type duty_array_t is array (0 to 7) of unsigned(12 downto 0);
+	type level_array_t is array (0 to 7) of std_ulogic_vector(7 downto 0);
+
+	-- Perceived brightness follows the high time to about the power of 1/2.2,
+	-- so the gamma table spreads the levels evenly to the eye
+	function gamma_table return duty_rom_t is
+		variable table : duty_rom_t;
+	begin
+		for i in 0 to 255 loop
+			table(i) := to_unsigned(integer(round(4096.0 * (real(i) / 255.0) ** 2.2)), 13);
+		end loop;
+		return table;
+	end function;
+
+	function linear_table return duty_rom_t is
+		variable table : duty_rom_t;
+	begin
+		for i in 0 to 255 loop
+			table(i) := to_unsigned(integer(round(4096.0 * real(i) / 255.0)), 13);
+		end loop;
+		return table;
+	end function;
+
+	constant GAMMA_ROM	: duty_rom_t := gamma_table;
+	constant LINEAR_ROM	: duty_rom_t := linear_table;
+
+	constant CLK_PERIOD	: time := 20 ns;
+	constant TICK_CYCLES : natural := integer(real(1 ms / CLK_PERIOD));
+
+	-- one frame per word: pattern in bits 7:0, duration in ms in bits 31:16
+	type frame_ram_t is array (0 to SEQ_FRAMES - 1) of std_ulogic_vector(31 downto 0);
+	type seq_state_t is (IDLE, LOAD, FETCH, PLAY, DONE);
+
 	signal led_reg				 		 : std_ulogic_vector(31 downto 0) := (others => '0');
-	
+	-- brightness of each LED, one byte per LED, LED 0 in the low byte of the
+	-- first register; full brightness after reset so the LEDs act as before
+	signal reg_brightness_lo	: std_ulogic_vector(31 downto 0) := (others => '1');
+	signal reg_brightness_hi	: std_ulogic_vector(31 downto 0) := (others => '1');
+	-- bit 0 gamma correction
+	signal gamma_enable			: std_ulogic := '1';
+
+	signal pattern					: std_ulogic_vector(7 downto 0);
+	signal levels					: level_array_t;
+	-- PWM high time per LED, looked up one LED per clock cycle
+	signal duty						: duty_array_t;
+	signal lookup_led				: natural range 0 to 7;
+	signal prescale_count		: natural range 0 to PWM_PRESCALE - 1;
+	signal pwm_count				: unsigned(11 downto 0);
+
+	-- sequencer: bit 0 run, bits 2:1 mode (0 loop, 1 ping-pong, 2 one-shot)
+	signal reg_seq_control		: std_ulogic_vector(31 downto 0) := (others => '0');
+	signal reg_seq_length		: std_ulogic_vector(31 downto 0) := (others => '0');
+	signal frame_ram				: frame_ram_t;
+	signal frame_readdata		: std_ulogic_vector(31 downto 0);
+	signal frame_word				: std_ulogic_vector(31 downto 0);
+	signal seq_state				: seq_state_t;
+	signal seq_run_d				: std_ulogic;
+	signal seq_index				: natural range 0 to SEQ_FRAMES - 1;
+	signal seq_last				: natural range 0 to SEQ_FRAMES - 1;
+	signal seq_up					: boolean;
+	signal seq_ms_left			: unsigned(15 downto 0);
+	signal seq_pattern			: std_ulogic_vector(7 downto 0);
+	signal seq_running			: std_ulogic;
+	signal tick_count				: natural range 0 to TICK_CYCLES - 1;
+	signal tick						: std_ulogic;
+
 begin
 
+	--The pattern RAM's read port takes a clock cycle, so reads have two wait
+	--states and the RAM word is picked up on the second cycle
 	avalon_register_read : process(clk)
 	begin
 		if rising_edge(clk) and avs_read = '1' then
-			case avs_address is
-				when '0'	=> avs_readdata	<= led_reg;
-				when others => avs_readdata 	<= (others => '0');
-			end case;
+			if avs_address(9) = '1' then
+				if to_integer(unsigned(avs_address(8 downto 0))) < SEQ_FRAMES then
+					avs_readdata <= frame_readdata;
+				else
+					avs_readdata <= (others => '0');
+				end if;
+			else
+				case avs_address(8 downto 0) is
+					when "000000000"	=> avs_readdata	<= led_reg;
+					when "000000001"	=> avs_readdata	<= (0 => gamma_enable, others => '0');
+					when "000000010"	=> avs_readdata	<= reg_brightness_lo;
+					when "000000011"	=> avs_readdata	<= reg_brightness_hi;
+					when "000000100"	=> avs_readdata	<= reg_seq_control;
+					when "000000101"	=> avs_readdata	<= reg_seq_length;
+					when "000000110"	=> avs_readdata	<= "000000000000000" & seq_running & std_ulogic_vector(to_unsigned(seq_index, 16));	--Sequencer Status
+					when "000000111"	=> avs_readdata	<= std_ulogic_vector(to_unsigned(SEQ_FRAMES, 32));
+					when others 		=> avs_readdata 	<= (others => '0');
+				end case;
+			end if;
 		end if;
 	end process;
-	
+
 	avalon_register_write : process(clk, rst)
 	begin
 		if rst = '1' then
-			led_reg <= (others => '0');
-		elsif rising_edge(clk) and avs_write = '1' then
-			case avs_address is
-				when '0' 	=> led_reg 	<= avs_writedata;
-				when others => null;
+			led_reg 					<= (others => '0');
+			reg_brightness_lo 	<= (others => '1');
+			reg_brightness_hi 	<= (others => '1');
+			gamma_enable 			<= '1';
+			reg_seq_control 		<= (others => '0');
+			reg_seq_length 		<= (others => '0');
+		elsif rising_edge(clk) and avs_write = '1' and avs_address(9) = '0' then
+			case avs_address(8 downto 0) is
+				when "000000000" 	=> led_reg 				<= avs_writedata;
+				when "000000001" 	=> gamma_enable 		<= avs_writedata(0);
+				when "000000010" 	=> reg_brightness_lo <= avs_writedata;
+				when "000000011" 	=> reg_brightness_hi <= avs_writedata;
+				when "000000100" 	=> reg_seq_control 	<= avs_writedata;
+				when "000000101" 	=> reg_seq_length 	<= avs_writedata;
+				when others 		=> null;
 			end case;
 		end if;
 	end process;
-	
-	led <= led_reg(7 downto 0);
 
-end architecture;
\ No newline at end of file
+	--Pattern RAM with a read/write port for the bus and a read port for the
+	--sequencer; it has no reset so it can be inferred as block RAM
+	FRAME_MEMORY : process(clk)
+		variable bus_index : natural range 0 to 511;
+	begin
+		if rising_edge(clk) then
+			bus_index := to_integer(unsigned(avs_address(8 downto 0)));
+			if avs_write = '1' and avs_address(9) = '1' and bus_index < SEQ_FRAMES then
+				frame_ram(bus_index) <= avs_writedata;
+			end if;
+			if bus_index < SEQ_FRAMES then
+				frame_readdata <= frame_ram(bus_index);
+			end if;
+			frame_word <= frame_ram(seq_index);
+		end if;
+	end process;
+
+	--Index of the last frame; a length of 0 plays the first frame only
+	seq_last <= 0 when unsigned(reg_seq_length) = 0 else
+					SEQ_FRAMES - 1 when unsigned(reg_seq_length) > SEQ_FRAMES else
+					to_integer(unsigned(reg_seq_length)) - 1;
+
+	tick <= '1' when tick_count = 0 else '0';
+
+	MS_TICK : process(clk,rst)
+	begin
+		if rst = '1' then
+			tick_count <= 0;
+		elsif rising_edge(clk) then
+			if tick_count = TICK_CYCLES - 1 then
+				tick_count <= 0;
+			else
+				tick_count <= tick_count + 1;
+			end if;
+		end if;
+	end process;
+
+	--Play the frames in the pattern RAM. Setting the run bit starts from the
+	--first frame; clearing it stops the sequencer. A frame's word is read
+	--in LOAD, arrives in FETCH and is shown for its duration in PLAY.
+	SEQUENCER : process(clk,rst)
+	begin
+		if rst = '1' then
+			seq_state 		<= IDLE;
+			seq_run_d 		<= '0';
+			seq_index 		<= 0;
+			seq_up 			<= true;
+			seq_ms_left 	<= (others => '0');
+			seq_pattern 	<= (others => '0');
+		elsif rising_edge(clk) then
+			seq_run_d <= reg_seq_control(0);
+			if reg_seq_control(0) = '0' then
+				seq_state <= IDLE;
+			elsif seq_run_d = '0' then
+				seq_index 	<= 0;
+				seq_up 		<= true;
+				seq_state 	<= LOAD;
+			else
+				case seq_state is
+					when LOAD =>
+						seq_state <= FETCH;
+					when FETCH =>
+						seq_pattern <= frame_word(7 downto 0);
+						--A duration of 0 is shown for 1 ms
+						if unsigned(frame_word(31 downto 16)) = 0 then
+							seq_ms_left <= to_unsigned(1, 16);
+						else
+							seq_ms_left <= unsigned(frame_word(31 downto 16));
+						end if;
+						seq_state <= PLAY;
+					when PLAY =>
+						if tick = '1' then
+							if seq_ms_left > 1 then
+								seq_ms_left <= seq_ms_left - 1;
+							else
+								seq_state <= LOAD;
+								case reg_seq_control(2 downto 1) is
+									when "01" =>
+										if seq_last = 0 then
+											null;
+										elsif seq_up and seq_index >= seq_last then
+											seq_up 		<= false;
+											seq_index 	<= seq_last - 1;
+										elsif not seq_up and seq_index = 0 then
+											seq_up 		<= true;
+											seq_index 	<= 1;
+										elsif seq_up then
+											seq_index <= seq_index + 1;
+										else
+											seq_index <= seq_index - 1;
+										end if;
+									when "10" =>
+										if seq_index >= seq_last then
+											seq_state <= DONE;
+										else
+											seq_index <= seq_index + 1;
+										end if;
+									when others =>
+										if seq_index >= seq_last then
+											seq_index <= 0;
+										else
+											seq_index <= seq_index + 1;
+										end if;
+								end case;
+							end if;
+						end if;
+					when others =>
+						null;
+				end case;
+			end if;
+		end if;
+	end process;
+
+	seq_running <= '1' when seq_state = LOAD or seq_state = FETCH or seq_state = PLAY else '0';
+
+	LEVEL_BYTES : for i in 0 to 3 generate
+		levels(i) 		<= reg_brightness_lo(8 * i + 7 downto 8 * i);
+		levels(i + 4) 	<= reg_brightness_hi(8 * i + 7 downto 8 * i);
+	end generate;
+
+	--Look up one LED's high time per clock cycle, so a single table serves
+	--all eight; a new brightness takes effect within 8 clock cycles
+	DUTY_LOOKUP : process(clk,rst)
+		variable level : natural range 0 to 255;
+	begin
+		if rst = '1' then
+			duty 			<= (others => to_unsigned(4096, 13));
+			lookup_led 	<= 0;
+		elsif rising_edge(clk) then
+			level := to_integer(unsigned(levels(lookup_led)));
+			if gamma_enable = '1' then
+				duty(lookup_led) <= GAMMA_ROM(level);
+			else
+				duty(lookup_led) <= LINEAR_ROM(level);
+			end if;
+			lookup_led <= (lookup_led + 1) mod 8;
+		end if;
+	end process;
+
+	PWM_COUNTER : process(clk,rst)
+	begin
+		if rst = '1' then
+			prescale_count 	<= 0;
+			pwm_count 			<= (others => '0');
+		elsif rising_edge(clk) then
+			if prescale_count = PWM_PRESCALE - 1 then
+				prescale_count 	<= 0;
+				pwm_count 			<= pwm_count + 1;
+			else
+				prescale_count <= prescale_count + 1;
+			end if;
+		end if;
+	end process;
+
+	--While the run bit is set the sequencer's frame is shown, and a one-shot
+	--animation's last frame stays up once it has finished
+	pattern <= route_led(7 downto 0) when route_valid = '1' else
+				  seq_pattern when reg_seq_control(0) = '1' else
+				  led_reg(7 downto 0);
+
+	--An LED that is on in the pattern is lit for its share of the PWM period;
+	--the outputs are registered so they don't glitch
+	LED_PWM : process(clk,rst)
+	begin
+		if rst = '1' then
+			led <= (others => '0');
+		elsif rising_edge(clk) then
+			for i in 0 to 7 loop
+				if pattern(i) = '1' and resize(pwm_count, 13) < duty(i) then
+					led(i) <= '1';
+				else
+					led(i) <= '0';
+				end if;
+			end loop;
+		end if;
+	end process;
+
+end architecture;
@@ -10,9 +10,15 @@ entity RGB_LED_Control is
 		-- avalon memory-mapped slave interface
 		avs_read 		: in std_ulogic;
 		avs_write 		: in std_ulogic;
-		avs_address 	: in std_ulogic_vector(1 downto 0);
+		avs_address 	: in std_ulogic_vector(2 downto 0);
 		avs_readdata 	: out std_ulogic_vector(31 downto 0);
 		avs_writedata 	: in std_ulogic_vector(31 downto 0);
+		-- duty cycles routed by the crossbar; each is used instead of its
+		-- register while its route_valid bit (0 red, 1 green, 2 blue) is set
+		route_red		: in std_ulogic_vector(31 downto 0);
+		route_green		: in std_ulogic_vector(31 downto 0);
+		route_blue		: in std_ulogic_vector(31 downto 0);
+		route_valid		: in std_ulogic_vector(2 downto 0);
 		-- external I/O; export to top-level
 		red_out 			: out std_ulogic;
 		blue_out			: out std_ulogic;
@@ -22,9 +28,10 @@ end entity RGB_LED_Control;
 
 architecture RGB_LED_Control_arch of RGB_LED_Control is
 
-	component pwm_controller is
+	component pwm_controller_pipelined is
 		generic (
-			CLK_PERIOD : time := 20 ns
+			CLK_PERIOD : time := 20 ns;
+			PERIOD_INT_BITS : natural range 1 to 6 := 6
 		);
 		port (
 			clk : in std_logic;
@@ -35,52 +42,100 @@ architecture RGB_LED_Control_arch of RGB_LED_Control is
 			-- PWM duty cycle between [0 1]; out-of-range values are hard-limited
 			-- datatype (W.F) is individually assigned
 			duty_cycle : in std_logic_vector(20 - 1 downto 0);
-			output : out std_logic
+			output : out std_logic;
+			period_end : out std_logic;
+			period_count : out std_logic_vector(31 downto 0);
+			duty_count : out std_logic_vector(31 downto 0)
 		);
-	end component pwm_controller;
+	end component pwm_controller_pipelined;
 
 	signal reg_period	  		: std_ulogic_vector(31 downto 0) := (26 => '1', others => '0'); --1 ms period
 	signal reg_red_duty 		: std_ulogic_vector(31 downto 0) := (others => '0'); --0% duty cycle
 	signal reg_green_duty	: std_ulogic_vector(31 downto 0) := (others => '0'); --0% duty cycle
 	signal reg_blue_duty	  	: std_ulogic_vector(31 downto 0) := (others => '0'); --0% duty cycle
+	-- CONTROL: bit 0 commit (pending until the period ends), bit 1 double buffer,
+	-- bits 5:4 PWM whose duty count DUTY COUNT shows (0 red, 1 green, 2 blue)
+	signal commit_pending		: std_ulogic := '0';
+	signal double_buffer		: std_ulogic := '0';
+	signal status_select		: std_ulogic_vector(1 downto 0) := "00";
+	-- clock cycles per period and per high time computed by each PWM controller
+	signal period_count		: std_logic_vector(31 downto 0);
+	signal red_duty_count		: std_logic_vector(31 downto 0);
+	signal green_duty_count	: std_logic_vector(31 downto 0);
+	signal blue_duty_count	: std_logic_vector(31 downto 0);
+	-- active set driving the PWM controllers; the registers above are its
+	-- shadow while double buffering is on
+	signal active_period		: std_ulogic_vector(31 downto 0) := (26 => '1', others => '0');
+	signal active_red_duty		: std_ulogic_vector(31 downto 0) := (others => '0');
+	signal active_green_duty	: std_ulogic_vector(31 downto 0) := (others => '0');
+	signal active_blue_duty		: std_ulogic_vector(31 downto 0) := (others => '0');
+	-- the three PWM controllers share a period, so red's boundary is everyone's
+	signal period_end			: std_ulogic;
+	-- duty cycles driving the PWM controllers
+	signal red_duty			: std_ulogic_vector(31 downto 0);
+	signal green_duty			: std_ulogic_vector(31 downto 0);
+	signal blue_duty			: std_ulogic_vector(31 downto 0);
 	
 begin
 
-	RED_CONTROL : component pwm_controller
+	red_duty		<= route_red when route_valid(0) = '1' else active_red_duty;
+	green_duty	<= route_green when route_valid(1) = '1' else active_green_duty;
+	blue_duty	<= route_blue when route_valid(2) = '1' else active_blue_duty;
+
+	RED_CONTROL : component pwm_controller_pipelined
 	port map(
 		clk 				=> clk,
 		rst 				=> rst,
-		period 			=> unsigned(reg_period),
-		duty_cycle 		=> std_logic_vector(reg_red_duty(19 downto 0)),
-		output		 	=> red_out
+		period 			=> unsigned(active_period),
+		duty_cycle 		=> std_logic_vector(red_duty(19 downto 0)),
+		output		 	=> red_out,
+		period_end		=> period_end,
+		period_count	=> period_count,
+		duty_count		=> red_duty_count
 	);
 	
-	GREEN_CONTROL : component pwm_controller
+	GREEN_CONTROL : component pwm_controller_pipelined
 	port map(
 		clk 				=> clk,
 		rst 				=> rst,
-		period 			=> unsigned(reg_period),
-		duty_cycle 		=> std_logic_vector(reg_green_duty(19 downto 0)),
-		output		 	=> green_out
+		period 			=> unsigned(active_period),
+		duty_cycle 		=> std_logic_vector(green_duty(19 downto 0)),
+		output		 	=> green_out,
+		period_end		=> open,
+		period_count	=> open,
+		duty_count		=> green_duty_count
 	);
 	
-	BLUE_CONTROL : component pwm_controller
+	BLUE_CONTROL : component pwm_controller_pipelined
 	port map(
 		clk 				=> clk,
 		rst 				=> rst,
-		period 			=> unsigned(reg_period),
-		duty_cycle 		=> std_logic_vector(reg_blue_duty(19 downto 0)),
-		output		 	=> blue_out
+		period 			=> unsigned(active_period),
+		duty_cycle 		=> std_logic_vector(blue_duty(19 downto 0)),
+		output		 	=> blue_out,
+		period_end		=> open,
+		period_count	=> open,
+		duty_count		=> blue_duty_count
 	);
 
 	rgb_register_read : process(clk)
 	begin
 		if rising_edge(clk) and avs_read = '1' then
 			case avs_address is
-				when "00"	=> avs_readdata	<= reg_period;
-				when "01" 	=> avs_readdata 	<= reg_red_duty;
-				when "10"	=> avs_readdata	<= reg_green_duty;
-				when "11"	=> avs_readdata	<= reg_blue_duty;
+				when "000"	=> avs_readdata	<= reg_period;
+				when "001" 	=> avs_readdata 	<= reg_red_duty;
+				when "010"	=> avs_readdata	<= reg_green_duty;
+				when "011"	=> avs_readdata	<= reg_blue_duty;
+				when "100"	=> avs_readdata	<= (0 => commit_pending, 1 => double_buffer,
+											5 => status_select(1), 4 => status_select(0), others => '0');
+				when "101"	=> avs_readdata	<= std_ulogic_vector(period_count);
+				when "110"	=>
+					case status_select is
+						when "00"	=> avs_readdata	<= std_ulogic_vector(red_duty_count);
+						when "01"	=> avs_readdata	<= std_ulogic_vector(green_duty_count);
+						when "10"	=> avs_readdata	<= std_ulogic_vector(blue_duty_count);
+						when others => avs_readdata	<= (others => '0');
+					end case;
 				when others => avs_readdata 	<= (others => '0');
 			end case;
 		end if;
@@ -93,14 +148,41 @@ begin
 			reg_red_duty		<= (others => '0');	--0% duty cycle
 			reg_green_duty		<= (others => '0');	--0% duty cycle
 			reg_blue_duty		<= (others => '0');	--0% duty cycle
-		elsif rising_edge(clk) and avs_write = '1' then
-			case avs_address is
-				when "00" 	=> reg_period 		<= avs_writedata;
-				when "01" 	=> reg_red_duty	<= avs_writedata;
-				when "10" 	=> reg_green_duty	<= avs_writedata;
-				when "11"	=> reg_blue_duty	<= avs_writedata;
-				when others => null;
-			end case;
+			commit_pending		<= '0';
+			double_buffer		<= '0';
+			status_select		<= "00";
+			active_period 		<= (26 => '1', others => '0');
+			active_red_duty	<= (others => '0');
+			active_green_duty	<= (others => '0');
+			active_blue_duty	<= (others => '0');
+		elsif rising_edge(clk) then
+			-- The shadow registers reach the PWM controllers right away unless
+			-- double buffering is on, in which case a commit moves all four
+			-- of them over together as one period ends and the next begins.
+			if double_buffer = '0' or (commit_pending = '1' and period_end = '1') then
+				active_period 		<= reg_period;
+				active_red_duty	<= reg_red_duty;
+				active_green_duty	<= reg_green_duty;
+				active_blue_duty	<= reg_blue_duty;
+				commit_pending		<= '0';
+			end if;
+			if avs_write = '1' then
+				case avs_address is
+					when "000" 	=> reg_period 		<= avs_writedata;
+					when "001" 	=> reg_red_duty	<= avs_writedata;
+					when "010" 	=> reg_green_duty	<= avs_writedata;
+					when "011"	=> reg_blue_duty	<= avs_writedata;
+					when "100"	=>
+						double_buffer <= avs_writedata(1);
+						status_select <= avs_writedata(5 downto 4);
+						-- A commit written as the period ends waits for the next one,
+						-- so it also picks up the shadow values written with it.
+						if avs_writedata(0) = '1' then
+							commit_pending <= '1';
+						end if;
+					when others => null;
+				end case;
+			end if;
 		end if;
 	end process;
 
@@ -4,15 +4,29 @@ use ieee.numeric_std.all;
 use ieee.math_real.all;
 
 entity buzzer is
+	generic (
+		-- tone generators: the main tone plus NUM_VOICES - 1 mixer voices
+		NUM_VOICES : natural range 1 to 8 := 4;
+		-- words (two samples each) in the PCM sample FIFO; a power of two
+		PCM_FIFO_DEPTH : positive := 1024
+	);
 	port (
 		clk 		: in std_ulogic;
 		rst 		: in std_ulogic;
 		-- avalon memory-mapped slave interface
 		avs_read 		: in std_ulogic;
 		avs_write 		: in std_ulogic;
-		avs_address 	: in std_ulogic;
+		avs_address 	: in std_ulogic_vector(5 downto 0);
 		avs_readdata 	: out std_ulogic_vector(31 downto 0);
 		avs_writedata 	: in std_ulogic_vector(31 downto 0);
+		-- volume and pitch routed by the crossbar; each is used instead of its
+		-- register while its route_valid bit (0 volume, 1 pitch) is set. The
+		-- routed pitch is a tuning word while the DDS tone generator is on.
+		route_volume	: in std_ulogic_vector(31 downto 0);
+		route_pitch		: in std_ulogic_vector(31 downto 0);
+		route_valid		: in std_ulogic_vector(1 downto 0);
+		-- high while the PCM FIFO is at most half full and its interrupt is on
+		irq				: out std_ulogic;
 		-- external I/O; export to top-level
 		buzzer_out 		: out std_ulogic
 		);
@@ -20,9 +34,10 @@ end entity buzzer;
 
 architecture buzzer_arch of buzzer is
 
-	component pwm_controller is
+	component pwm_controller_pipelined is
 		generic (
-			CLK_PERIOD : time := 20 ns
+			CLK_PERIOD : time := 20 ns;
+			PERIOD_INT_BITS : natural range 1 to 6 := 6
 		);
 		port (
 			clk : in std_logic;
@@ -33,9 +48,73 @@ architecture buzzer_arch of buzzer is
 			-- PWM duty cycle between [0 1]; out-of-range values are hard-limited
 			-- datatype (W.F) is individually assigned
 			duty_cycle : in std_logic_vector(20 - 1 downto 0);
-			output : out std_logic
+			output : out std_logic;
+			period_end : out std_logic;
+			period_count : out std_logic_vector(31 downto 0);
+			duty_count : out std_logic_vector(31 downto 0)
+		);
+	end component pwm_controller_pipelined;
+
+	component dds_tone is
+		generic (
+			ACC_WIDTH : natural := 32
+		);
+		port (
+			clk : in std_ulogic;
+			rst : in std_ulogic;
+			ftw : in std_ulogic_vector(ACC_WIDTH - 1 downto 0);
+			duty_cycle : in std_ulogic_vector(20 - 1 downto 0);
+			output : out std_ulogic;
+			cycle_end : out std_ulogic
+		);
+	end component dds_tone;
+
+	component buzzer_envelope is
+		generic (
+			CLK_PERIOD : time := 20 ns
+		);
+		port (
+			clk : in std_ulogic;
+			rst : in std_ulogic;
+			enable : in std_ulogic;
+			gate : in std_ulogic;
+			attack_us : in std_ulogic_vector(31 downto 0);
+			decay_us : in std_ulogic_vector(31 downto 0);
+			sustain : in std_ulogic_vector(19 downto 0);
+			release_us : in std_ulogic_vector(31 downto 0);
+			lfo_ftw : in std_ulogic_vector(31 downto 0);
+			lfo_duty_depth : in std_ulogic_vector(15 downto 0);
+			lfo_pitch_depth : in std_ulogic_vector(15 downto 0);
+			volume_in : in std_ulogic_vector(19 downto 0);
+			pitch_in : in std_ulogic_vector(31 downto 0);
+			ftw_in : in std_ulogic_vector(31 downto 0);
+			volume_out : out std_ulogic_vector(19 downto 0);
+			pitch_out : out std_ulogic_vector(31 downto 0);
+			ftw_out : out std_ulogic_vector(31 downto 0);
+			state : out std_ulogic_vector(2 downto 0);
+			level : out std_ulogic_vector(31 downto 0)
+		);
+	end component buzzer_envelope;
+
+	component pcm_player is
+		generic (
+			FIFO_DEPTH : positive := 1024
+		);
+		port (
+			clk : in std_ulogic;
+			rst : in std_ulogic;
+			enable : in std_ulogic;
+			push : in std_ulogic;
+			push_data : in std_ulogic_vector(31 downto 0);
+			flush : in std_ulogic;
+			sample_period : in std_ulogic_vector(31 downto 0);
+			clear_underruns : in std_ulogic;
+			level : out std_ulogic_vector(15 downto 0);
+			half_empty : out std_ulogic;
+			underruns : out std_ulogic_vector(31 downto 0);
+			output : out std_ulogic
 		);
-	end component pwm_controller;
+	end component pcm_player;
 
 	--signal period		  		: std_ulogic_vector(31 downto 0) := (26 => '1', others => '0'); 	--1 ms period
 	--signal period_ms			: integer range 1 to 31 := 1;
@@ -43,46 +122,347 @@ architecture buzzer_arch of buzzer is
 	signal reg_vol	 			: std_ulogic_vector(31 downto 0) := (others => '0'); 					--0% duty cycle
 	--signal vol_fp				: integer range 0 to 2**19 := 1/2*(2**19);		  					--50% duty cycle
 	signal reg_pitch			: std_ulogic_vector(31 downto 0) := (26 => '1', others => '0'); 	--1000 Hz pitch
+	-- DDS frequency tuning word; f = ftw * 50 MHz / 2**32
+	signal reg_ftw				: std_ulogic_vector(31 downto 0) := x"000057EA";				--262 Hz
+	-- CONTROL: bit 0 commit (pending until the period ends), bit 1 double buffer,
+	-- bit 2 DDS tone generator instead of the PWM period, bit 3 envelope,
+	-- bit 4 envelope gate, bit 5 mix the voices, bit 6 play PCM samples
+	signal commit_pending		: std_ulogic := '0';
+	signal double_buffer		: std_ulogic := '0';
+	signal dds_enable			: std_ulogic := '0';
+	signal envelope_enable		: std_ulogic := '0';
+	signal gate					: std_ulogic := '0';
+	signal mix_enable			: std_ulogic := '0';
+	signal pcm_enable			: std_ulogic := '0';
+	-- envelope times in microseconds, sustain level (1.19) and LFO settings
+	signal reg_attack			: std_ulogic_vector(31 downto 0) := std_ulogic_vector(to_unsigned(10000, 32));		--10 ms
+	signal reg_decay			: std_ulogic_vector(31 downto 0) := std_ulogic_vector(to_unsigned(100000, 32));	--100 ms
+	signal reg_sustain			: std_ulogic_vector(31 downto 0) := (18 => '1', others => '0');						--50%
+	signal reg_release			: std_ulogic_vector(31 downto 0) := std_ulogic_vector(to_unsigned(200000, 32));	--200 ms
+	signal reg_lfo_ftw			: std_ulogic_vector(31 downto 0) := x"000001AE";										--5 Hz
+	signal reg_lfo_duty_depth	: std_ulogic_vector(31 downto 0) := (others => '0');
+	signal reg_lfo_pitch_depth	: std_ulogic_vector(31 downto 0) := (others => '0');
+	signal env_state			: std_ulogic_vector(2 downto 0);
+	signal env_level			: std_ulogic_vector(31 downto 0);
+	-- active volume and pitch; the registers above are their shadow while
+	-- double buffering is on
+	signal active_vol			: std_ulogic_vector(31 downto 0) := (others => '0');
+	signal active_pitch		: std_ulogic_vector(31 downto 0) := (26 => '1', others => '0');
+	signal active_ftw			: std_ulogic_vector(31 downto 0) := x"000057EA";
+	-- end of a PWM period, or of a tone cycle in DDS mode
+	signal period_end			: std_ulogic;
+	signal pwm_period_end		: std_ulogic;
+	signal dds_cycle_end		: std_ulogic;
+	signal pwm_out				: std_ulogic;
+	signal dds_out				: std_ulogic;
+	-- clock cycles per period and per high time computed by the PWM controller
+	signal period_count		: std_logic_vector(31 downto 0);
+	signal duty_count			: std_logic_vector(31 downto 0);
+	-- volume and pitch before and after the envelope and LFO
+	signal volume				: std_ulogic_vector(31 downto 0);
+	signal pitch				: std_ulogic_vector(31 downto 0);
+	signal ftw					: std_ulogic_vector(31 downto 0);
+	signal volume_mod			: std_ulogic_vector(19 downto 0);
+	signal pitch_mod			: std_ulogic_vector(31 downto 0);
+	signal ftw_mod				: std_ulogic_vector(31 downto 0);
+	signal main_out			: std_ulogic;
+
+	-- mixer voices 1 to NUM_VOICES - 1: tuning word and volume registers,
+	-- their active copies (double buffered like the main tone) and outputs
+	type voice_regs_t is array (1 to 7) of std_ulogic_vector(31 downto 0);
+	signal reg_voice_ftw		: voice_regs_t := (others => (others => '0'));
+	signal reg_voice_vol		: voice_regs_t := (others => (others => '0'));
+	signal active_voice_ftw	: voice_regs_t := (others => (others => '0'));
+	signal active_voice_vol	: voice_regs_t := (others => (others => '0'));
+	signal voice_out			: std_ulogic_vector(1 to 7) := (others => '0');
+	constant VOICE_DUTY		: std_ulogic_vector(19 downto 0) := (18 => '1', others => '0');	--50% square
+	-- sum of the voices' levels, and the sigma-delta modulator's accumulator;
+	-- each voice is at most 2**19, so the full scale is NUM_VOICES * 2**19
+	constant MIX_FULL_SCALE	: natural := NUM_VOICES * 2**19;
+	signal mix_sum				: unsigned(22 downto 0);
+	signal mix_acc				: unsigned(23 downto 0);
+	signal mix_out				: std_ulogic;
+
+	-- PCM playback: clock cycles per sample (8 kHz), the half-empty interrupt
+	-- enable and the player's status
+	signal reg_pcm_period		: std_ulogic_vector(31 downto 0) := std_ulogic_vector(to_unsigned(6250, 32));
+	signal pcm_irq_enable		: std_ulogic := '0';
+	signal pcm_push			: std_ulogic;
+	signal pcm_clear			: std_ulogic;
+	signal pcm_flush			: std_ulogic;
+	signal pcm_level			: std_ulogic_vector(15 downto 0);
+	signal pcm_half_empty		: std_ulogic;
+	signal pcm_underruns		: std_ulogic_vector(31 downto 0);
+	signal pcm_out				: std_ulogic;
 	
 begin
 
-	BUZZER_PITCH : component pwm_controller
+	volume	<= route_volume when route_valid(0) = '1' else active_vol;
+	pitch		<= route_pitch when route_valid(1) = '1' else active_pitch;
+	ftw		<= route_pitch when route_valid(1) = '1' else active_ftw;
+
+	main_out		<= dds_out when dds_enable = '1' else pwm_out;
+	buzzer_out	<= pcm_out when pcm_enable = '1' else
+					mix_out when mix_enable = '1' else
+					main_out;
+
+	irq			<= pcm_irq_enable and pcm_half_empty;
+
+	--PCM_DATA pushes a word into the FIFO, writing PCM_LEVEL empties the FIFO
+	--and writing PCM_UNDERRUNS clears it
+	pcm_push		<= '1' when avs_write = '1' and avs_address = "100000" else '0';
+	pcm_flush	<= '1' when avs_write = '1' and avs_address = "100010" else '0';
+	pcm_clear	<= '1' when avs_write = '1' and avs_address = "100100" else '0';
+
+	BUZZER_PCM : component pcm_player
+	generic map(
+		FIFO_DEPTH 		=> PCM_FIFO_DEPTH
+	)
+	port map(
+		clk 					=> clk,
+		rst 					=> rst,
+		enable				=> pcm_enable,
+		push					=> pcm_push,
+		push_data			=> avs_writedata,
+		flush					=> pcm_flush,
+		sample_period		=> reg_pcm_period,
+		clear_underruns	=> pcm_clear,
+		level					=> pcm_level,
+		half_empty			=> pcm_half_empty,
+		underruns			=> pcm_underruns,
+		output				=> pcm_out
+	);
+	period_end	<= dds_cycle_end when dds_enable = '1' else pwm_period_end;
+
+	BUZZER_ENVELOPE : component buzzer_envelope
+	port map(
+		clk 					=> clk,
+		rst 					=> rst,
+		enable				=> envelope_enable,
+		gate					=> gate,
+		attack_us			=> reg_attack,
+		decay_us				=> reg_decay,
+		sustain				=> reg_sustain(19 downto 0),
+		release_us			=> reg_release,
+		lfo_ftw				=> reg_lfo_ftw,
+		lfo_duty_depth		=> reg_lfo_duty_depth(15 downto 0),
+		lfo_pitch_depth	=> reg_lfo_pitch_depth(15 downto 0),
+		volume_in			=> volume(19 downto 0),
+		pitch_in				=> pitch,
+		ftw_in				=> ftw,
+		volume_out			=> volume_mod,
+		pitch_out			=> pitch_mod,
+		ftw_out				=> ftw_mod,
+		state					=> env_state,
+		level					=> env_level
+	);
+
+	BUZZER_PITCH : component pwm_controller_pipelined
 	port map(
 		clk 				=> clk,
 		rst 				=> rst,
-		period 			=> unsigned(reg_pitch),
-		duty_cycle 		=> std_logic_vector(reg_vol(19 downto 0)),
-		output		 	=> buzzer_out
+		period 			=> unsigned(pitch_mod),
+		duty_cycle 		=> std_logic_vector(volume_mod),
+		output		 	=> pwm_out,
+		period_end		=> pwm_period_end,
+		period_count	=> period_count,
+		duty_count		=> duty_count
+	);
+
+	BUZZER_TONE : component dds_tone
+	port map(
+		clk 				=> clk,
+		rst 				=> rst,
+		ftw 				=> ftw_mod,
+		duty_cycle 		=> volume_mod,
+		output		 	=> dds_out,
+		cycle_end		=> dds_cycle_end
 	);
 	
+	--Each mixer voice is a DDS square wave; its volume sets its level in the mix
+	VOICES : for v in 1 to NUM_VOICES - 1 generate
+		VOICE_TONE : component dds_tone
+		port map(
+			clk 				=> clk,
+			rst 				=> rst,
+			ftw 				=> active_voice_ftw(v),
+			duty_cycle 		=> VOICE_DUTY,
+			output		 	=> voice_out(v),
+			cycle_end		=> open
+		);
+	end generate;
+
+	--Sum the levels of the main tone (full level while its output is high, so
+	--its volume still sets its duty cycle) and every voice that is high
+	MIX_SUM : process(clk,rst)
+		variable sum : unsigned(22 downto 0);
+	begin
+		if rst = '1' then
+			mix_sum <= (others => '0');
+		elsif rising_edge(clk) then
+			sum := (others => '0');
+			if main_out = '1' then
+				sum := sum + to_unsigned(2**19, 23);
+			end if;
+			for v in 1 to NUM_VOICES - 1 loop
+				if voice_out(v) = '1' then
+					if active_voice_vol(v)(19) = '1' then
+						sum := sum + to_unsigned(2**19, 23);
+					else
+						sum := sum + unsigned(active_voice_vol(v)(18 downto 0));
+					end if;
+				end if;
+			end loop;
+			mix_sum <= sum;
+		end if;
+	end process;
+
+	--First order sigma-delta modulator; the density of ones on the output
+	--follows the mix, and the buzzer circuit filters out the rest
+	SIGMA_DELTA : process(clk,rst)
+		variable acc : unsigned(23 downto 0);
+	begin
+		if rst = '1' then
+			mix_acc <= (others => '0');
+			mix_out <= '0';
+		elsif rising_edge(clk) then
+			acc := mix_acc + mix_sum;
+			if acc >= MIX_FULL_SCALE then
+				mix_acc <= acc - MIX_FULL_SCALE;
+				mix_out <= '1';
+			else
+				mix_acc <= acc;
+				mix_out <= '0';
+			end if;
+		end if;
+	end process;
+
 	buzzer_register_read : process(clk)
+		variable v : natural range 0 to 7;
 	begin
 		if rising_edge(clk) and avs_read = '1' then
 			case avs_address is
-				when '0'		=> avs_readdata	<= reg_vol;				--Duty Cycle
-				when '1' 	=> avs_readdata 	<= reg_pitch;			--PWM Period
-				when others => avs_readdata 	<= (others => '0');
+				when "000000"	=> avs_readdata	<= reg_vol;				--Duty Cycle
+				when "000001" => avs_readdata 	<= reg_pitch;			--PWM Period
+				when "000010"	=> avs_readdata	<= (0 => commit_pending, 1 => double_buffer, 2 => dds_enable,
+															3 => envelope_enable, 4 => gate, 5 => mix_enable,
+															6 => pcm_enable, others => '0');
+				when "000011"	=> avs_readdata	<= reg_ftw;				--Tuning Word
+				when "000100"	=> avs_readdata	<= std_ulogic_vector(period_count);
+				when "000101"	=> avs_readdata	<= std_ulogic_vector(duty_count);
+				when "000110"	=> avs_readdata	<= reg_attack;
+				when "000111"	=> avs_readdata	<= reg_decay;
+				when "001000"	=> avs_readdata	<= reg_sustain;
+				when "001001"	=> avs_readdata	<= reg_release;
+				when "001010"	=> avs_readdata	<= reg_lfo_ftw;
+				when "001011"	=> avs_readdata	<= reg_lfo_duty_depth;
+				when "001100"	=> avs_readdata	<= reg_lfo_pitch_depth;
+				when "001101"	=> avs_readdata	<= env_level(31 downto 16) & x"000" & '0' & env_state;	--Envelope Status
+				when "001111"	=> avs_readdata	<= std_ulogic_vector(to_unsigned(NUM_VOICES, 32));	--Voice Info
+				when "100001"	=> avs_readdata	<= reg_pcm_period;
+				when "100010"	=> avs_readdata	<= x"0000" & pcm_level;	--PCM FIFO Level
+				when "100011"	=> avs_readdata	<= std_ulogic_vector(to_unsigned(PCM_FIFO_DEPTH, 32));
+				when "100100"	=> avs_readdata	<= pcm_underruns;
+				when "100101"	=> avs_readdata	<= (0 => pcm_irq_enable, 1 => pcm_half_empty, others => '0');
+				when others =>
+					--Voice bank: 0x40 + 8 * voice holds the tuning word, then the volume
+					v := to_integer(unsigned(avs_address(3 downto 1)));
+					if avs_address(5 downto 4) = "01" and v >= 1 and v < NUM_VOICES then
+						if avs_address(0) = '0' then
+							avs_readdata <= reg_voice_ftw(v);
+						else
+							avs_readdata <= reg_voice_vol(v);
+						end if;
+					else
+						avs_readdata <= (others => '0');
+					end if;
 			end case;
 		end if;
 	end process;
 	
 	buzzer_register_write : process(clk, rst)
+		variable v : natural range 0 to 7;
 	begin
 		if rst = '1' then		
 			reg_vol				<= (others => '0');					--0% duty cycle
 			reg_pitch			<= (26 => '1', others => '0');	--1000 Hz
-		elsif rising_edge(clk) and avs_write = '1' then
-			case avs_address is
-				when '0' 	=> reg_vol <= avs_writedata;
-				when '1' 	=> 
-					--Fixed point operations to write buzzer period from frequency in Hz
-					reg_pitch	<= avs_writedata;
-						--period_ms <= 1000/to_integer(unsigned(reg_base_pitch));
-						--period_fp <= period_ms * 2**26;
-						--period <= std_ulogic_vector(to_unsigned(period_fp, 32));
-						--reg_vol <= std_ulogic_vector(to_unsigned(vol_fp, 32)); --50% duty cycle
-				when others => null;
-			end case;
+			reg_ftw				<= x"000057EA";						--262 Hz
+			commit_pending		<= '0';
+			double_buffer		<= '0';
+			dds_enable			<= '0';
+			envelope_enable	<= '0';
+			gate					<= '0';
+			mix_enable			<= '0';
+			pcm_enable			<= '0';
+			reg_pcm_period		<= std_ulogic_vector(to_unsigned(6250, 32));	--8 kHz
+			pcm_irq_enable		<= '0';
+			reg_voice_ftw		<= (others => (others => '0'));
+			reg_voice_vol		<= (others => (others => '0'));
+			active_voice_ftw	<= (others => (others => '0'));
+			active_voice_vol	<= (others => (others => '0'));
+			reg_attack			<= std_ulogic_vector(to_unsigned(10000, 32));
+			reg_decay			<= std_ulogic_vector(to_unsigned(100000, 32));
+			reg_sustain			<= (18 => '1', others => '0');
+			reg_release			<= std_ulogic_vector(to_unsigned(200000, 32));
+			reg_lfo_ftw			<= x"000001AE";
+			reg_lfo_duty_depth	<= (others => '0');
+			reg_lfo_pitch_depth	<= (others => '0');
+			active_vol			<= (others => '0');
+			active_pitch		<= (26 => '1', others => '0');
+			active_ftw			<= x"000057EA";
+		elsif rising_edge(clk) then
+			-- Without double buffering the registers drive the buzzer directly;
+			-- with it, a commit moves volume and pitch over together at the end
+			-- of a PWM period (or tone cycle) so a note change can't click.
+			if double_buffer = '0' or (commit_pending = '1' and period_end = '1') then
+				active_vol			<= reg_vol;
+				active_pitch		<= reg_pitch;
+				active_ftw			<= reg_ftw;
+				active_voice_ftw	<= reg_voice_ftw;
+				active_voice_vol	<= reg_voice_vol;
+				commit_pending		<= '0';
+			end if;
+			if avs_write = '1' then
+				case avs_address is
+					when "000000" => reg_vol <= avs_writedata;
+					when "000001" => 
+						--Fixed point operations to write buzzer period from frequency in Hz
+						reg_pitch	<= avs_writedata;
+							--period_ms <= 1000/to_integer(unsigned(reg_base_pitch));
+							--period_fp <= period_ms * 2**26;
+							--period <= std_ulogic_vector(to_unsigned(period_fp, 32));
+							--reg_vol <= std_ulogic_vector(to_unsigned(vol_fp, 32)); --50% duty cycle
+					when "000010"	=>
+						double_buffer <= avs_writedata(1);
+						dds_enable <= avs_writedata(2);
+						envelope_enable <= avs_writedata(3);
+						gate <= avs_writedata(4);
+						mix_enable <= avs_writedata(5);
+						pcm_enable <= avs_writedata(6);
+						if avs_writedata(0) = '1' then
+							commit_pending <= '1';
+						end if;
+					when "000011"	=> reg_ftw <= avs_writedata;
+					when "000110"	=> reg_attack <= avs_writedata;
+					when "000111"	=> reg_decay <= avs_writedata;
+					when "001000"	=> reg_sustain <= avs_writedata;
+					when "001001"	=> reg_release <= avs_writedata;
+					when "001010"	=> reg_lfo_ftw <= avs_writedata;
+					when "001011"	=> reg_lfo_duty_depth <= avs_writedata;
+					when "001100"	=> reg_lfo_pitch_depth <= avs_writedata;
+					when "100001"	=> reg_pcm_period <= avs_writedata;
+					when "100101"	=> pcm_irq_enable <= avs_writedata(0);
+					when others =>
+						v := to_integer(unsigned(avs_address(3 downto 1)));
+						if avs_address(5 downto 4) = "01" and v >= 1 and v < NUM_VOICES then
+							if avs_address(0) = '0' then
+								reg_voice_ftw(v) <= avs_writedata;
+							else
+								reg_voice_vol(v) <= avs_writedata;
+							end if;
+						end if;
+				end case;
+			end if;
 		end if;
 	end process;
 
@@ -0,0 +1,302 @@
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+-- ADSR envelope and LFO for the buzzer. The envelope scales the volume by a
+-- level that ramps up over the attack time when gate rises, falls to the
+-- sustain level over the decay time, holds there while gate is high and
+-- falls to 0 over the release time once gate drops. The times are for a
+-- full-scale ramp in microseconds, so a decay to a high sustain level is
+-- shorter than the decay time. A triangle LFO lowers the volume by up to
+-- lfo_duty_depth (tremolo) and moves the pitch and tuning word up and down by
+-- up to lfo_pitch_depth (vibrato). The outputs are updated once a
+-- microsecond; with the envelope off and both depths 0 the inputs pass
+-- straight through.
+entity buzzer_envelope is
+	generic (
+		CLK_PERIOD : time := 20 ns
+	);
+	port (
+		clk 					: in std_ulogic;
+		rst 					: in std_ulogic;
+		enable				: in std_ulogic;
+		-- rising edge starts the attack, falling edge the release
+		gate					: in std_ulogic;
+		attack_us			: in std_ulogic_vector(31 downto 0);
+		decay_us				: in std_ulogic_vector(31 downto 0);
+		-- sustain level as a fraction of the volume (1.19)
+		sustain				: in std_ulogic_vector(19 downto 0);
+		release_us			: in std_ulogic_vector(31 downto 0);
+		-- LFO frequency tuning word; f = lfo_ftw * f_clk / 2**32
+		lfo_ftw				: in std_ulogic_vector(31 downto 0);
+		-- modulation depths as fractions of 2**16
+		lfo_duty_depth		: in std_ulogic_vector(15 downto 0);
+		lfo_pitch_depth	: in std_ulogic_vector(15 downto 0);
+		volume_in			: in std_ulogic_vector(19 downto 0);
+		pitch_in				: in std_ulogic_vector(31 downto 0);
+		ftw_in				: in std_ulogic_vector(31 downto 0);
+		volume_out			: out std_ulogic_vector(19 downto 0);
+		pitch_out			: out std_ulogic_vector(31 downto 0);
+		ftw_out				: out std_ulogic_vector(31 downto 0);
+		-- 0 idle, 1 attack, 2 decay, 3 sustain, 4 release
+		state					: out std_ulogic_vector(2 downto 0);
+		-- envelope level as a fraction of 2**32
+		level					: out std_ulogic_vector(31 downto 0)
+	);
+end entity buzzer_envelope;
+
+architecture buzzer_envelope_arch of buzzer_envelope is
+
+	constant TICK_CYCLES : natural := integer(real(1 us / CLK_PERIOD));
+	constant FULL			: unsigned(31 downto 0) := (others => '1');
+
+	type env_state_t is (IDLE, ATTACK, DECAY, SUSTAINING, RELEASE);
+
+	signal env_state		: env_state_t;
+	signal env_level		: unsigned(31 downto 0);
+	signal sustain_level	: unsigned(31 downto 0);
+	signal gate_d			: std_ulogic;
+
+	-- microsecond tick, and the tick delayed by one clock for stage 2
+	signal tick_count		: natural range 0 to TICK_CYCLES - 1;
+	signal tick				: std_ulogic;
+	signal tick_d			: std_ulogic;
+
+	-- level change per microsecond for each stage, 2**32 - 1 / time
+	signal step_attack	: unsigned(31 downto 0);
+	signal step_decay		: unsigned(31 downto 0);
+	signal step_release	: unsigned(31 downto 0);
+	signal div_sel			: natural range 0 to 2;
+	signal div_count		: natural range 0 to 32;
+	signal div_den			: unsigned(31 downto 0);
+	signal div_rem			: unsigned(31 downto 0);
+	signal div_quot		: unsigned(31 downto 0);
+
+	signal lfo_phase		: unsigned(31 downto 0);
+	signal lfo_tri			: unsigned(15 downto 0);
+
+	-- stage 1: enveloped volume, tremolo amount and the vibrato spans
+	signal env_vol			: unsigned(19 downto 0);
+	signal trem				: unsigned(31 downto 0);
+	signal pitch_r			: unsigned(31 downto 0);
+	signal ftw_r			: unsigned(31 downto 0);
+	signal pitch_span		: unsigned(47 downto 0);
+	signal ftw_span		: unsigned(47 downto 0);
+	signal vib				: signed(15 downto 0);
+
+	-- stage 2: modulated outputs
+	signal volume_mod		: std_ulogic_vector(19 downto 0);
+	signal pitch_mod		: std_ulogic_vector(31 downto 0);
+	signal ftw_mod			: std_ulogic_vector(31 downto 0);
+
+	signal bypass			: std_ulogic;
+
+	-- value + span * vib / 2**15, clamped to 32 bits
+	function vibrato(value : unsigned(31 downto 0); span : unsigned(47 downto 0);
+		vib : signed(15 downto 0)) return std_ulogic_vector is
+		variable dev : signed(48 downto 0);
+		variable sum : signed(34 downto 0);
+	begin
+		dev := signed('0' & span(47 downto 16)) * vib;
+		sum := signed(resize(value, 35)) + resize(dev(48 downto 15), 35);
+		if sum < 0 then
+			return std_ulogic_vector(to_unsigned(0, 32));
+		elsif sum(34 downto 32) /= "000" then
+			return std_ulogic_vector(FULL);
+		end if;
+		return std_ulogic_vector(unsigned(sum(31 downto 0)));
+	end function;
+
+begin
+
+	sustain_level <= FULL when sustain(19) = '1' else unsigned(sustain(18 downto 0)) & to_unsigned(0, 13);
+
+	tick <= '1' when tick_count = 0 else '0';
+
+	TICK_COUNTER : process(clk,rst)
+	begin
+		if rst = '1' then
+			tick_count 	<= 0;
+			tick_d 		<= '0';
+		elsif rising_edge(clk) then
+			tick_d <= tick;
+			if tick_count = TICK_CYCLES - 1 then
+				tick_count <= 0;
+			else
+				tick_count <= tick_count + 1;
+			end if;
+		end if;
+	end process;
+
+	--Work out the attack, decay and release steps in turn with a serial
+	--divider, one quotient bit per clock cycle; the dividend is all ones
+	STEP_DIVIDER : process(clk,rst)
+		variable r : unsigned(32 downto 0);
+		variable q : unsigned(31 downto 0);
+	begin
+		if rst = '1' then
+			step_attack 	<= FULL;
+			step_decay 		<= FULL;
+			step_release 	<= FULL;
+			div_sel 			<= 0;
+			div_count 		<= 0;
+			div_den 			<= (others => '0');
+			div_rem 			<= (others => '0');
+			div_quot 		<= (others => '0');
+		elsif rising_edge(clk) then
+			if div_count = 0 then
+				case div_sel is
+					when 0		=> div_den <= unsigned(attack_us);
+					when 1		=> div_den <= unsigned(decay_us);
+					when others	=> div_den <= unsigned(release_us);
+				end case;
+				div_rem 		<= (others => '0');
+				div_count 	<= 32;
+			else
+				r := div_rem & '1';
+				q := div_quot(30 downto 0) & '0';
+				if r >= resize(div_den, 33) then
+					r := r - resize(div_den, 33);
+					q(0) := '1';
+				end if;
+				div_rem 		<= r(31 downto 0);
+				div_quot 	<= q;
+				div_count 	<= div_count - 1;
+				if div_count = 1 then
+					case div_sel is
+						when 0 =>
+							step_attack <= q;
+							div_sel <= 1;
+						when 1 =>
+							step_decay <= q;
+							div_sel <= 2;
+						when others =>
+							step_release <= q;
+							div_sel <= 0;
+					end case;
+				end if;
+			end if;
+		end if;
+	end process;
+
+	ENVELOPE : process(clk,rst)
+		variable sum : unsigned(32 downto 0);
+	begin
+		if rst = '1' then
+			env_state 	<= IDLE;
+			env_level 	<= (others => '0');
+			gate_d 		<= '0';
+		elsif rising_edge(clk) then
+			gate_d <= gate and enable;
+			if enable = '0' then
+				env_state <= IDLE;
+				env_level <= (others => '0');
+			elsif gate = '1' and gate_d = '0' then
+				--Start from the current level so a retrigger doesn't click
+				env_state <= ATTACK;
+			elsif gate = '0' and gate_d = '1' then
+				env_state <= RELEASE;
+			elsif tick = '1' then
+				case env_state is
+					when ATTACK =>
+						sum := resize(env_level, 33) + step_attack;
+						if sum(32) = '1' then
+							env_level <= FULL;
+							env_state <= DECAY;
+						else
+							env_level <= sum(31 downto 0);
+						end if;
+					when DECAY =>
+						if resize(env_level, 33) <= resize(sustain_level, 33) + step_decay then
+							env_level <= sustain_level;
+							env_state <= SUSTAINING;
+						else
+							env_level <= env_level - step_decay;
+						end if;
+					when SUSTAINING =>
+						env_level <= sustain_level;
+					when RELEASE =>
+						if env_level <= step_release then
+							env_level <= (others => '0');
+							env_state <= IDLE;
+						else
+							env_level <= env_level - step_release;
+						end if;
+					when IDLE =>
+						env_level <= (others => '0');
+				end case;
+			end if;
+		end if;
+	end process;
+
+	with env_state select state <=
+		"001" when ATTACK,
+		"010" when DECAY,
+		"011" when SUSTAINING,
+		"100" when RELEASE,
+		"000" when others;
+	level <= std_ulogic_vector(env_level);
+
+	--Triangle wave from the LFO phase, rising over the first half
+	lfo_tri <= lfo_phase(30 downto 15) when lfo_phase(31) = '0' else not lfo_phase(30 downto 15);
+
+	LFO : process(clk,rst)
+	begin
+		if rst = '1' then
+			lfo_phase <= (others => '0');
+		elsif rising_edge(clk) then
+			lfo_phase <= lfo_phase + unsigned(lfo_ftw);
+		end if;
+	end process;
+
+	--Two registered multiply stages, started by the microsecond tick so the
+	--PWM controller's limit pipeline always settles between updates
+	MODULATION : process(clk,rst)
+		variable vol_scaled 	: unsigned(35 downto 0);
+		variable trem_gain	: unsigned(16 downto 0);
+		variable vol_trem		: unsigned(36 downto 0);
+	begin
+		if rst = '1' then
+			env_vol 		<= (others => '0');
+			trem 			<= (others => '0');
+			pitch_r 		<= (others => '0');
+			ftw_r 		<= (others => '0');
+			pitch_span 	<= (others => '0');
+			ftw_span 	<= (others => '0');
+			vib 			<= (others => '0');
+			volume_mod 	<= (others => '0');
+			pitch_mod 	<= (others => '0');
+			ftw_mod 		<= (others => '0');
+		elsif rising_edge(clk) then
+			if tick = '1' then
+				if enable = '1' then
+					vol_scaled := unsigned(volume_in) * env_level(31 downto 16);
+					env_vol <= vol_scaled(35 downto 16);
+				else
+					env_vol <= unsigned(volume_in);
+				end if;
+				trem 			<= unsigned(lfo_duty_depth) * lfo_tri;
+				pitch_r 		<= unsigned(pitch_in);
+				ftw_r 		<= unsigned(ftw_in);
+				pitch_span 	<= unsigned(pitch_in) * unsigned(lfo_pitch_depth);
+				ftw_span 	<= unsigned(ftw_in) * unsigned(lfo_pitch_depth);
+				vib 			<= signed(lfo_tri xor x"8000");
+			end if;
+
+			if tick_d = '1' then
+				trem_gain 	:= to_unsigned(65536, 17) - trem(31 downto 16);
+				vol_trem 	:= env_vol * trem_gain;
+				volume_mod 	<= std_ulogic_vector(vol_trem(35 downto 16));
+				pitch_mod 	<= vibrato(pitch_r, pitch_span, vib);
+				ftw_mod 		<= vibrato(ftw_r, ftw_span, vib);
+			end if;
+		end if;
+	end process;
+
+	bypass <= '1' when enable = '0' and unsigned(lfo_duty_depth) = 0 and unsigned(lfo_pitch_depth) = 0 else '0';
+
+	volume_out 	<= volume_in when bypass = '1' else volume_mod;
+	pitch_out 	<= pitch_in when bypass = '1' else pitch_mod;
+	ftw_out 		<= ftw_in when bypass = '1' else ftw_mod;
+
+end architecture;
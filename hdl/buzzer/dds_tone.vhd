@@ -0,0 +1,60 @@
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+-- Direct digital synthesis tone generator. A phase accumulator advances by
+-- the frequency tuning word every clock cycle, so the tone frequency is
+-- ftw * f_clk / 2**ACC_WIDTH (about 0.0116 Hz per step at 50 MHz with the
+-- default 32 bits). The output is a pulse wave whose high time is the duty
+-- cycle's fraction of each tone cycle, like pwm_controller's. A new tuning
+-- word changes the rate of the accumulator, never its phase, so frequency
+-- changes and sweeps are continuous.
+entity dds_tone is
+	generic (
+		ACC_WIDTH : natural := 32
+	);
+	port (
+		clk 			: in std_ulogic;
+		rst 			: in std_ulogic;
+		-- frequency tuning word
+		ftw 			: in std_ulogic_vector(ACC_WIDTH - 1 downto 0);
+		-- high time as a fraction of the tone cycle (1.19); 0x80000 and up is
+		-- always high
+		duty_cycle 	: in std_ulogic_vector(20 - 1 downto 0);
+		output 		: out std_ulogic;
+		-- high in the last clock cycle of each tone cycle, and all the time
+		-- while the tuning word is 0 and the accumulator stands still
+		cycle_end	: out std_ulogic
+	);
+end entity dds_tone;
+
+architecture dds_tone_arch of dds_tone is
+
+	signal phase 		: unsigned(ACC_WIDTH - 1 downto 0);
+	signal phase_next	: unsigned(ACC_WIDTH downto 0);
+
+begin
+
+	phase_next <= resize(phase, ACC_WIDTH + 1) + resize(unsigned(ftw), ACC_WIDTH + 1);
+
+	--The accumulator wraps on the next edge
+	cycle_end <= '1' when phase_next(ACC_WIDTH) = '1' or unsigned(ftw) = 0 else '0';
+
+	PHASE_ACCUMULATOR : process(clk,rst)
+	begin
+		if rst = '1' then
+			phase 	<= (others => '0');
+			output 	<= '0';
+		elsif rising_edge(clk) then
+			phase <= phase_next(ACC_WIDTH - 1 downto 0);
+			--Compare the top 19 bits of the phase against the duty cycle's fraction
+			if duty_cycle(19) = '1' or
+				phase(ACC_WIDTH - 1 downto ACC_WIDTH - 19) < unsigned(duty_cycle(18 downto 0)) then
+				output <= '1';
+			else
+				output <= '0';
+			end if;
+		end if;
+	end process;
+
+end architecture;
@@ -0,0 +1,178 @@
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+-- PCM sample player for the buzzer. Each word pushed into the FIFO holds two
+-- signed 16-bit samples, played low half first, one every sample_period
+-- clock cycles. The current sample drives a first-order sigma-delta
+-- modulator whose bitstream the buzzer circuit filters back into audio. A
+-- sample time that finds the FIFO empty plays silence and counts an
+-- underrun.
+entity pcm_player is
+	generic (
+		-- words in the sample FIFO; a power of two
+		FIFO_DEPTH : positive := 1024
+	);
+	port (
+		clk 				: in std_ulogic;
+		rst 				: in std_ulogic;
+		-- play samples; while clear the FIFO keeps its words and output is low
+		enable			: in std_ulogic;
+		-- push a word of two samples; ignored while the FIFO is full
+		push				: in std_ulogic;
+		push_data		: in std_ulogic_vector(31 downto 0);
+		-- drop every word in the FIFO
+		flush				: in std_ulogic;
+		-- clock cycles per sample, at least 2
+		sample_period	: in std_ulogic_vector(31 downto 0);
+		clear_underruns	: in std_ulogic;
+		-- words in the FIFO
+		level				: out std_ulogic_vector(15 downto 0);
+		-- high while the FIFO is at most half full
+		half_empty		: out std_ulogic;
+		underruns		: out std_ulogic_vector(31 downto 0);
+		output			: out std_ulogic
+	);
+end entity pcm_player;
+
+architecture pcm_player_arch of pcm_player is
+
+	type fifo_t is array (0 to FIFO_DEPTH - 1) of std_ulogic_vector(31 downto 0);
+	signal fifo				: fifo_t;
+	signal wr_ptr			: natural range 0 to FIFO_DEPTH - 1;
+	signal rd_ptr			: natural range 0 to FIFO_DEPTH - 1;
+	signal count			: natural range 0 to FIFO_DEPTH;
+	signal count_d			: natural range 0 to FIFO_DEPTH;
+	-- word at rd_ptr, read one clock cycle late like a block RAM
+	signal head_word		: std_ulogic_vector(31 downto 0);
+	signal high_half		: std_ulogic;
+
+	signal tick_count		: unsigned(31 downto 0);
+	signal tick				: std_ulogic;
+	signal pop				: std_ulogic;
+	signal sample			: unsigned(15 downto 0);
+	signal sd_acc			: unsigned(15 downto 0);
+	signal underrun_count	: unsigned(31 downto 0);
+
+begin
+
+	level 		<= std_ulogic_vector(to_unsigned(count, 16));
+	half_empty 	<= '1' when count <= FIFO_DEPTH / 2 else '0';
+	underruns 	<= std_ulogic_vector(underrun_count);
+
+	tick <= '1' when enable = '1' and tick_count = 0 else '0';
+	--The second half of a word is played; the word leaves the FIFO
+	pop <= '1' when tick = '1' and high_half = '1' and count /= 0 and count_d /= 0 else '0';
+
+	SAMPLE_CLOCK : process(clk,rst)
+	begin
+		if rst = '1' then
+			tick_count <= (others => '0');
+		elsif rising_edge(clk) then
+			if enable = '0' or tick_count = 0 then
+				if unsigned(sample_period) < 2 then
+					tick_count <= to_unsigned(1, 32);
+				else
+					tick_count <= unsigned(sample_period) - 1;
+				end if;
+			else
+				tick_count <= tick_count - 1;
+			end if;
+		end if;
+	end process;
+
+	--The memory has no reset so it can be inferred as block RAM
+	FIFO_RAM : process(clk)
+	begin
+		if rising_edge(clk) then
+			if push = '1' and count /= FIFO_DEPTH then
+				fifo(wr_ptr) <= push_data;
+			end if;
+			head_word <= fifo(rd_ptr);
+		end if;
+	end process;
+
+	FIFO_CONTROL : process(clk,rst)
+		variable pushed : boolean;
+	begin
+		if rst = '1' then
+			wr_ptr 	<= 0;
+			rd_ptr 	<= 0;
+			count 	<= 0;
+			count_d 	<= 0;
+		elsif rising_edge(clk) then
+			pushed := push = '1' and count /= FIFO_DEPTH;
+			if flush = '1' then
+				wr_ptr 	<= 0;
+				rd_ptr 	<= 0;
+				count 	<= 0;
+			else
+				if pushed then
+					wr_ptr <= (wr_ptr + 1) mod FIFO_DEPTH;
+				end if;
+				if pop = '1' then
+					rd_ptr <= (rd_ptr + 1) mod FIFO_DEPTH;
+				end if;
+				if pushed and pop = '0' then
+					count <= count + 1;
+				elsif pop = '1' and not pushed then
+					count <= count - 1;
+				end if;
+			end if;
+			--A word counts as there one cycle after it is pushed, once
+			--head_word can have picked it up
+			count_d <= count;
+		end if;
+	end process;
+
+	PLAYBACK : process(clk,rst)
+	begin
+		if rst = '1' then
+			high_half 		<= '0';
+			sample 			<= (others => '0');
+			underrun_count <= (others => '0');
+		elsif rising_edge(clk) then
+			if clear_underruns = '1' then
+				underrun_count <= (others => '0');
+			end if;
+			if enable = '0' or flush = '1' then
+				high_half 	<= '0';
+				sample 		<= (others => '0');
+			elsif tick = '1' then
+				if count = 0 or count_d = 0 then
+					sample <= (others => '0');
+					if clear_underruns = '0' then
+						underrun_count <= underrun_count + 1;
+					end if;
+				elsif high_half = '0' then
+					sample 		<= unsigned(head_word(15 downto 0));
+					high_half 	<= '1';
+				else
+					sample 		<= unsigned(head_word(31 downto 16));
+					high_half 	<= '0';
+				end if;
+			end if;
+		end if;
+	end process;
+
+	--Offset the signed sample to unsigned; the carry out of the accumulator
+	--is the bitstream
+	SIGMA_DELTA : process(clk,rst)
+		variable acc : unsigned(16 downto 0);
+	begin
+		if rst = '1' then
+			sd_acc <= (others => '0');
+			output <= '0';
+		elsif rising_edge(clk) then
+			if enable = '0' then
+				sd_acc <= (others => '0');
+				output <= '0';
+			else
+				acc := ('0' & sd_acc) + ((not sample(15)) & sample(14 downto 0));
+				sd_acc <= acc(15 downto 0);
+				output <= acc(16);
+			end if;
+		end if;
+	end process;
+
+end architecture;
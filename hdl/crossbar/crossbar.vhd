@@ -0,0 +1,315 @@
+-- EELE467 Final Project Routing Crossbar
+-- Routes the rotary count and the ADC channels to the PWM and LED sinks in the fabric
+-- altera vhdl_input_version vhdl_2008
+
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+
+entity crossbar is
+generic (
+-- clock cycles between ADC sweeps after reset; 10 kHz at 50 MHz
+ADC_PERIOD_RESET : natural := 5000
+);
+port (
+clk : in std_ulogic;
+rst : in std_ulogic;
+-- avalon memory-mapped slave interface
+avs_read : in std_ulogic;
+avs_write : in std_ulogic;
+avs_address : in std_ulogic_vector(7 downto 0);
+avs_readdata : out std_ulogic_vector(31 downto 0);
+avs_writedata : in std_ulogic_vector(31 downto 0);
+-- avalon memory-mapped master that reads the ADC's channel registers
+avm_address : out std_ulogic_vector(4 downto 0);
+avm_read : out std_ulogic;
+avm_readdata : in std_ulogic_vector(31 downto 0);
+avm_waitrequest : in std_ulogic;
+-- sign-extended count from the rotary encoder
+rotary_count : in std_ulogic_vector(31 downto 0);
+-- routed sink values; each sink uses its value instead of its own
+-- register while the matching valid bit is set
+rgb_red : out std_ulogic_vector(31 downto 0);
+rgb_green : out std_ulogic_vector(31 downto 0);
+rgb_blue : out std_ulogic_vector(31 downto 0);
+rgb_valid : out std_ulogic_vector(2 downto 0);
+buzzer_volume : out std_ulogic_vector(31 downto 0);
+buzzer_pitch : out std_ulogic_vector(31 downto 0);
+buzzer_valid : out std_ulogic_vector(1 downto 0);
+led_pattern : out std_ulogic_vector(31 downto 0);
+led_valid : out std_ulogic
+);
+end entity crossbar;
+
+architecture crossbar_arch of crossbar is
+
+-- source 0 is the rotary count, sources 1 to 8 are ADC channels 0 to 7
+constant NUM_SOURCES : natural := 9;
+-- one route per sink: red, green, blue, volume, pitch, LED array
+constant NUM_ROUTES : natural := 6;
+constant NUM_ADC_CHANNELS : natural := 8;
+constant LUT_SIZE : natural := 16;
+
+-- route control register fields
+constant MODE_OFF : std_ulogic_vector(1 downto 0) := "00";
+constant MODE_LINEAR : std_ulogic_vector(1 downto 0) := "01";
+constant MODE_LUT : std_ulogic_vector(1 downto 0) := "10";
+
+subtype word is std_ulogic_vector(31 downto 0);
+type word_array is array(natural range <>) of word;
+
+-- global registers
+signal enable : std_ulogic := '0';
+signal adc_period : unsigned(31 downto 0) := to_unsigned(ADC_PERIOD_RESET, 32);
+
+-- per-route registers: bits 3:0 of route_ctrl select the source, bits 5:4
+-- the mode and bits 12:8 the right shift applied after scaling
+signal route_ctrl : word_array(0 to NUM_ROUTES - 1) := (others => (others => '0'));
+signal in_offset : word_array(0 to NUM_ROUTES - 1) := (others => (others => '0'));
+signal scale : word_array(0 to NUM_ROUTES - 1) := (others => (0 => '1', others => '0'));
+signal out_offset : word_array(0 to NUM_ROUTES - 1) := (others => (others => '0'));
+signal out_min : word_array(0 to NUM_ROUTES - 1) := (others => (others => '0'));
+signal out_max : word_array(0 to NUM_ROUTES - 1) := (others => (others => '1'));
+
+signal sources : word_array(0 to NUM_SOURCES - 1);
+signal outputs : word_array(0 to NUM_ROUTES - 1);
+-- route r drives its sink
+signal active : std_ulogic_vector(NUM_ROUTES - 1 downto 0);
+
+-- ADC master; sweeps all channels every adc_period cycles while any
+-- active route reads an ADC channel
+type adc_state_type is (ADC_IDLE, ADC_READ);
+signal adc_state : adc_state_type := ADC_IDLE;
+signal adc_channel : unsigned(2 downto 0) := (others => '0');
+signal adc_timer : unsigned(31 downto 0) := (others => '0');
+signal adc_values : word_array(0 to NUM_ADC_CHANNELS - 1) := (others => (others => '0'));
+signal adc_wanted : std_ulogic;
+
+begin
+
+sources(0) <= rotary_count;
+ADC_SOURCES : for i in 0 to NUM_ADC_CHANNELS - 1 generate
+	sources(i + 1) <= adc_values(i);
+end generate;
+
+ACTIVE_ROUTES : for r in 0 to NUM_ROUTES - 1 generate
+	active(r) <= '1' when enable = '1' and route_ctrl(r)(5 downto 4) /= MODE_OFF
+		and unsigned(route_ctrl(r)(3 downto 0)) < NUM_SOURCES else '0';
+end generate;
+
+adc_demand : process(all)
+	begin
+		adc_wanted <= '0';
+		for r in 0 to NUM_ROUTES - 1 loop
+			if active(r) = '1' and unsigned(route_ctrl(r)(3 downto 0)) /= 0 then
+				adc_wanted <= '1';
+			end if;
+		end loop;
+	end process;
+
+-- The ADC controller converts a channel as it is read, so a sweep is just
+-- eight reads, each held off by waitrequest until its conversion is done.
+-- An ADC route's source is therefore up to one sweep plus adc_period cycles
+-- old, far more than the route's own pipeline. The reads share the ADC with
+-- the CPU's, so each sweep delays /dev/adc. Without an ADC route the master
+-- stays off the bus.
+adc_master : process(clk,rst)
+	begin
+		if rst = '1' then
+			adc_state <= ADC_IDLE;
+			adc_channel <= (others => '0');
+			adc_timer <= (others => '0');
+			adc_values <= (others => (others => '0'));
+		elsif rising_edge(clk) then
+			case adc_state is
+				when ADC_IDLE =>
+					if adc_timer /= 0 then
+						adc_timer <= adc_timer - 1;
+					elsif adc_wanted = '1' then
+						adc_channel <= (others => '0');
+						adc_state <= ADC_READ;
+					end if;
+				when ADC_READ =>
+					if avm_waitrequest = '0' then
+						adc_values(to_integer(adc_channel)) <= x"00000" & avm_readdata(11 downto 0);
+						if adc_channel = NUM_ADC_CHANNELS - 1 then
+							adc_timer <= adc_period;
+							adc_state <= ADC_IDLE;
+						else
+							adc_channel <= adc_channel + 1;
+						end if;
+					end if;
+			end case;
+		end if;
+	end process;
+
+avm_read <= '1' when adc_state = ADC_READ else '0';
+avm_address <= std_ulogic_vector(adc_channel) & "00";
+
+-- Each route is a pipeline: select the source and subtract the input
+-- offset, multiply by the signed 18-bit scale, shift right, then either add
+-- the output offset and clamp, or look the result up in the route's 16-entry
+-- table. The table read takes one more stage than the clamp, so a source
+-- change reaches its sink 5 clock cycles (100 ns at 50 MHz) later in linear
+-- mode and 6 (120 ns) in LUT mode.
+ROUTES : for r in 0 to NUM_ROUTES - 1 generate
+	signal lut : word_array(0 to LUT_SIZE - 1);
+	signal lut_index : unsigned(3 downto 0) := (others => '0');
+	signal lut_value : word;
+	signal diff : signed(32 downto 0) := (others => '0');
+	signal product : signed(50 downto 0) := (others => '0');
+	signal shifted : signed(50 downto 0) := (others => '0');
+	signal linear : word := (others => '0');
+begin
+
+	-- no reset, so Quartus can infer memory for the table
+	lut_ram : process(clk)
+		begin
+			if rising_edge(clk) then
+				if avs_write = '1' and avs_address(7) = '1'
+					and to_integer(unsigned(avs_address(6 downto 4))) = r then
+					lut(to_integer(unsigned(avs_address(3 downto 0)))) <= avs_writedata;
+				end if;
+				lut_value <= lut(to_integer(lut_index));
+			end if;
+		end process;
+
+	datapath : process(clk,rst)
+		variable sel : natural;
+		variable sum : signed(51 downto 0);
+		variable lo : signed(51 downto 0);
+		variable hi : signed(51 downto 0);
+		begin
+			if rst = '1' then
+				diff <= (others => '0');
+				product <= (others => '0');
+				shifted <= (others => '0');
+				linear <= (others => '0');
+				lut_index <= (others => '0');
+				outputs(r) <= (others => '0');
+			elsif rising_edge(clk) then
+				sel := to_integer(unsigned(route_ctrl(r)(3 downto 0)));
+				if sel < NUM_SOURCES then
+					diff <= resize(signed(sources(sel)), 33) - resize(signed(in_offset(r)), 33);
+				else
+					diff <= (others => '0');
+				end if;
+
+				product <= diff * signed(scale(r)(17 downto 0));
+
+				shifted <= shift_right(product, to_integer(unsigned(route_ctrl(r)(12 downto 8))));
+
+				sum := resize(shifted, 52) + resize(signed(out_offset(r)), 52);
+				lo := signed(resize(unsigned(out_min(r)), 52));
+				hi := signed(resize(unsigned(out_max(r)), 52));
+				if sum < lo then
+					linear <= out_min(r);
+				elsif sum > hi then
+					linear <= out_max(r);
+				else
+					linear <= std_ulogic_vector(sum(31 downto 0));
+				end if;
+
+				if shifted < 0 then
+					lut_index <= (others => '0');
+				elsif shifted > LUT_SIZE - 1 then
+					lut_index <= (others => '1');
+				else
+					lut_index <= unsigned(shifted(3 downto 0));
+				end if;
+
+				if route_ctrl(r)(5 downto 4) = MODE_LUT then
+					outputs(r) <= lut_value;
+				else
+					outputs(r) <= linear;
+				end if;
+			end if;
+		end process;
+
+end generate;
+
+avalon_register_write : process(clk,rst)
+	variable route : natural;
+	begin
+		if rst = '1' then
+			enable <= '0';
+			adc_period <= to_unsigned(ADC_PERIOD_RESET, 32);
+			route_ctrl <= (others => (others => '0'));
+			in_offset <= (others => (others => '0'));
+			scale <= (others => (0 => '1', others => '0'));
+			out_offset <= (others => (others => '0'));
+			out_min <= (others => (others => '0'));
+			out_max <= (others => (others => '1'));
+		elsif rising_edge(clk) and avs_write = '1' then
+			route := to_integer(unsigned(avs_address(5 downto 3)));
+			if avs_address = x"00" then
+				enable <= avs_writedata(0);
+			elsif avs_address = x"02" then
+				adc_period <= unsigned(avs_writedata);
+			elsif avs_address(7 downto 6) = "01" and route < NUM_ROUTES then
+				case avs_address(2 downto 0) is
+					when "000" => route_ctrl(route) <= avs_writedata;
+					when "001" => in_offset(route) <= avs_writedata;
+					when "010" => scale(route) <= avs_writedata;
+					when "011" => out_offset(route) <= avs_writedata;
+					when "100" => out_min(route) <= avs_writedata;
+					when "101" => out_max(route) <= avs_writedata;
+					when others => null;
+				end case;
+			end if;
+		end if;
+	end process;
+
+-- The lookup tables are write-only; reads of them return 0.
+avalon_register_read : process(clk)
+	variable index : natural;
+	begin
+		if rising_edge(clk) and avs_read = '1' then
+			avs_readdata <= (others => '0');
+			if avs_address = x"00" then
+				avs_readdata(0) <= enable;
+			elsif avs_address = x"01" then
+				avs_readdata <= std_ulogic_vector(to_unsigned(NUM_ROUTES * 256 + NUM_SOURCES, 32));
+			elsif avs_address = x"02" then
+				avs_readdata <= std_ulogic_vector(adc_period);
+			elsif avs_address = x"03" then
+				avs_readdata(NUM_ROUTES - 1 downto 0) <= active;
+			elsif avs_address(7 downto 4) = "0001" then
+				index := to_integer(unsigned(avs_address(3 downto 0)));
+				if index < NUM_SOURCES then
+					avs_readdata <= sources(index);
+				end if;
+			elsif avs_address(7 downto 4) = "0010" then
+				index := to_integer(unsigned(avs_address(3 downto 0)));
+				if index < NUM_ROUTES then
+					avs_readdata <= outputs(index);
+				end if;
+			elsif avs_address(7 downto 6) = "01" then
+				index := to_integer(unsigned(avs_address(5 downto 3)));
+				if index < NUM_ROUTES then
+					case avs_address(2 downto 0) is
+						when "000" => avs_readdata <= route_ctrl(index);
+						when "001" => avs_readdata <= in_offset(index);
+						when "010" => avs_readdata <= scale(index);
+						when "011" => avs_readdata <= out_offset(index);
+						when "100" => avs_readdata <= out_min(index);
+						when "101" => avs_readdata <= out_max(index);
+						when others => null;
+					end case;
+				end if;
+			end if;
+		end if;
+	end process;
+
+rgb_red <= outputs(0);
+rgb_green <= outputs(1);
+rgb_blue <= outputs(2);
+rgb_valid <= active(2 downto 0);
+buzzer_volume <= outputs(3);
+buzzer_pitch <= outputs(4);
+buzzer_valid <= active(4 downto 3);
+led_pattern <= outputs(5);
+led_valid <= active(5);
+
+end architecture;
@@ -16,7 +16,10 @@ entity pwm_controller is
 		-- PWM duty cycle between [0 1]; out-of-range values are hard-limited
 		-- datatype (W.F) is individually assigned
 		duty_cycle 	: in std_logic_vector(20 - 1 downto 0);
-		output 		: out std_logic
+		output 		: out std_logic;
+		-- high in the last clock cycle of each PWM period; period and duty
+		-- cycle values that change on the next edge start a clean period
+		period_end	: out std_logic
 	);
 end entity pwm_controller;
 
@@ -50,6 +53,9 @@ begin
 	period_limit 	<= to_integer(period_clk);
 	duty_limit		<= to_integer(duty_clk(N_BITS_CLK_CYCLES + 19 downto 19));
 
+	--The counters restart on the next edge
+	period_end		<= '1' when count_period >= period_limit else '0';
+
 
 	--Turn output on until the duty cycle percentage is reached
 	--Turn output off until the period limit is reached
@@ -0,0 +1,148 @@
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+use ieee.math_real.all;
+
+-- Drop-in replacement for pwm_controller. The period and duty cycle limits
+-- are computed by a registered multiplier pipeline that only runs when an
+-- input changes, instead of by wide combinational multiplies every cycle,
+-- and the counters are sized from the generics. New limits are ready 5 clock
+-- cycles after an input changes and take effect at the start of the next PWM
+-- period, so a period is never cut short or stretched by a change.
+entity pwm_controller_pipelined is
+	generic (
+		CLK_PERIOD : time := 20 ns;
+		-- integer bits of the period input (W in W.F, at most 6); the default
+		-- matches pwm_controller's 6.26 period and allows periods up to 64 ms
+		PERIOD_INT_BITS : natural range 1 to 6 := 6
+	);
+	port (
+		clk 			: in std_logic;
+		rst 			: in std_logic;
+		-- PWM repetition period in milliseconds;
+		-- datatype (W.F) is individually assigned
+		period 		: in unsigned(32 - 1 downto 0);
+		-- PWM duty cycle between [0 1]; out-of-range values are hard-limited
+		-- datatype (W.F) is individually assigned
+		duty_cycle 	: in std_logic_vector(20 - 1 downto 0);
+		output 		: out std_logic;
+		-- high in the last clock cycle of each PWM period; period and duty
+		-- cycle values that change on the next edge start a clean period
+		period_end	: out std_logic;
+		-- clock cycles per period and per high time currently in use
+		period_count	: out std_logic_vector(31 downto 0);
+		duty_count		: out std_logic_vector(31 downto 0)
+	);
+end entity pwm_controller_pipelined;
+
+architecture pwm_controller_pipelined_arch of pwm_controller_pipelined is
+
+	constant SYSTEM_CLOCK_FREQ   : natural := integer(real(1 ms / CLK_PERIOD));
+	constant N_BITS_SYS_CLK_FREQ : natural := natural(ceil(log2(real(SYSTEM_CLOCK_FREQ))));
+	constant SYS_CLK_FREQ 		  : unsigned(N_BITS_SYS_CLK_FREQ - 1 downto 0) := to_unsigned(SYSTEM_CLOCK_FREQ, N_BITS_SYS_CLK_FREQ);
+
+	-- clock cycles in the longest period, and in the longest high time
+	-- (the duty cycle has one integer bit)
+	constant N_BITS_CLK_CYCLES : natural := N_BITS_SYS_CLK_FREQ + PERIOD_INT_BITS;
+	constant N_BITS_DUTY_CYCLES : natural := N_BITS_CLK_CYCLES + 1;
+
+	-- inputs captured for the pipeline, and the stage valid flags
+	signal period_in		: unsigned(31 downto 0);
+	signal duty_in			: unsigned(19 downto 0);
+	signal stage_valid	: std_logic_vector(3 downto 0);
+
+	-- stage 1: the period multiply split in two halves that each fit a DSP block
+	signal period_lo		: unsigned(N_BITS_SYS_CLK_FREQ + 15 downto 0);
+	signal period_hi		: unsigned(N_BITS_SYS_CLK_FREQ + 15 downto 0);
+	-- stage 2: period in clock cycles
+	signal period_clk		: unsigned(N_BITS_CLK_CYCLES - 1 downto 0);
+	-- stage 3: high time in clock cycles
+	signal duty_clk		: unsigned(N_BITS_CLK_CYCLES + 19 downto 0);
+
+	-- limits for the next period, and for the current one
+	signal period_limit_next	: unsigned(N_BITS_CLK_CYCLES - 1 downto 0);
+	signal duty_limit_next		: unsigned(N_BITS_DUTY_CYCLES - 1 downto 0);
+	signal period_limit			: unsigned(N_BITS_CLK_CYCLES - 1 downto 0);
+	signal duty_limit				: unsigned(N_BITS_DUTY_CYCLES - 1 downto 0);
+
+	signal count_period 	: unsigned(N_BITS_CLK_CYCLES - 1 downto 0);
+
+begin
+
+	--Calculate the counting limits, one registered step per clock cycle, but
+	--only after the period or duty cycle input changed
+	LIMIT_PIPELINE : process(clk,rst)
+		variable period_full : unsigned(N_BITS_SYS_CLK_FREQ + 31 downto 0);
+	begin
+		if rst = '1' then
+			period_in 			<= (others => '0');
+			duty_in 				<= (others => '0');
+			stage_valid 		<= (others => '0');
+			period_lo 			<= (others => '0');
+			period_hi 			<= (others => '0');
+			period_clk 			<= (others => '0');
+			duty_clk 			<= (others => '0');
+			period_limit_next <= (others => '0');
+			duty_limit_next 	<= (others => '0');
+		elsif rising_edge(clk) then
+			stage_valid <= stage_valid(2 downto 0) & '0';
+			if period /= period_in or unsigned(duty_cycle) /= duty_in then
+				period_in 		<= period;
+				duty_in 			<= unsigned(duty_cycle);
+				-- restart the pipeline so it never mixes old and new inputs
+				stage_valid 	<= "0001";
+			end if;
+
+			if stage_valid(0) = '1' then
+				period_lo <= SYS_CLK_FREQ * period_in(15 downto 0);
+				period_hi <= SYS_CLK_FREQ * period_in(31 downto 16);
+			end if;
+
+			if stage_valid(1) = '1' then
+				period_full := resize(period_lo, period_full'length)
+					+ shift_left(resize(period_hi, period_full'length), 16);
+				period_clk <= period_full(N_BITS_CLK_CYCLES + 25 downto 26);
+			end if;
+
+			if stage_valid(2) = '1' then
+				duty_clk <= duty_in * period_clk;
+			end if;
+
+			if stage_valid(3) = '1' then
+				period_limit_next <= period_clk;
+				duty_limit_next 	<= duty_clk(N_BITS_CLK_CYCLES + 19 downto 19);
+			end if;
+		end if;
+	end process;
+
+	--The counters restart on the next edge
+	period_end		<= '1' when count_period >= period_limit else '0';
+
+	period_count	<= std_logic_vector(resize(period_limit, 32));
+	duty_count		<= std_logic_vector(resize(duty_limit, 32));
+
+	--Turn output on until the duty cycle count is reached
+	--Turn output off until the period limit is reached
+	PWM_CONTROL : process(clk,rst)
+	begin
+		if rst = '1' then
+			output 			<= '1';
+			count_period 	<= (others => '0');
+			period_limit 	<= (others => '0');
+			duty_limit 		<= (others => '0');
+		elsif rising_edge(clk) then
+			if count_period < period_limit then
+				count_period <= count_period + 1;
+				if resize(count_period, N_BITS_DUTY_CYCLES) >= duty_limit then
+					output <= '0';
+				end if;
+			else
+				count_period <= (others => '0');
+				period_limit <= period_limit_next;
+				duty_limit 	 <= duty_limit_next;
+				output 		 <= '1';
+			end if;
+		end if;
+	end process;
+
+end architecture;
@@ -0,0 +1,127 @@
+-- EELE467 Final Project Quadrature Decoder
+-- Synchronous 4x decoder for the rotary encoder's A and B outputs
+-- altera vhdl_input_version vhdl_2008
+
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+
+entity quadrature_decoder is
+generic (
+-- width of the signed position counter
+COUNT_WIDTH : positive := 32
+);
+port (
+clk : in std_ulogic;
+rst : in std_ulogic;
+-- encoder outputs; must already be synchronized to clk
+a : in std_ulogic;
+b : in std_ulogic;
+-- '1' wraps from count_max to count_min and back, '0' saturates at them
+wrap : in std_ulogic;
+count_min : in signed(COUNT_WIDTH - 1 downto 0);
+count_max : in signed(COUNT_WIDTH - 1 downto 0);
+-- set the count to 0 (clamped to the range) / the error count to 0
+clear : in std_ulogic;
+clear_errors : in std_ulogic;
+count : out signed(COUNT_WIDTH - 1 downto 0);
+-- high for one cycle when the count changes; up gives the direction
+step : out std_ulogic;
+up : out std_ulogic;
+-- number of illegal transitions (both A and B changed at once); saturates
+error_count : out unsigned(31 downto 0)
+);
+end entity quadrature_decoder;
+
+architecture quadrature_decoder_arch of quadrature_decoder is
+
+-- A and B in the previous cycle
+signal prev_ab : std_ulogic_vector(1 downto 0) := "00";
+-- prev_ab holds a real sample; false for the first cycle after reset
+signal primed : boolean := false;
+
+signal count_reg : signed(COUNT_WIDTH - 1 downto 0) := (others => '0');
+signal errors : unsigned(31 downto 0) := (others => '0');
+
+begin
+
+-- Every edge of A or B moves the count by one, so one full quadrature cycle
+-- (one detent on the encoder) counts 4. A and B step through the Gray code
+-- 00 -> 01 -> 11 -> 10 -> 00 when counting up and the reverse counting down,
+-- which matches the old rising_edge(A) and B = '1' rule for the up direction.
+-- A transition that changes both bits means an edge was missed; it is
+-- counted as an error and leaves the count alone.
+decode : process(clk,rst)
+	variable ab : std_ulogic_vector(1 downto 0);
+	variable inc : boolean;
+	variable dec : boolean;
+	begin
+		if rst = '1' then
+			prev_ab <= "00";
+			primed <= false;
+			count_reg <= (others => '0');
+			errors <= (others => '0');
+			step <= '0';
+			up <= '0';
+		elsif rising_edge(clk) then
+			ab := a & b;
+			prev_ab <= ab;
+			primed <= true;
+			step <= '0';
+
+			inc := false;
+			dec := false;
+			if primed then
+				case std_ulogic_vector'(prev_ab & ab) is
+					when "0001" | "0111" | "1110" | "1000" => inc := true;
+					when "0010" | "1011" | "1101" | "0100" => dec := true;
+					when "0011" | "1100" | "0110" | "1001" =>
+						if errors /= x"FFFFFFFF" then
+							errors <= errors + 1;
+						end if;
+					when others => null;
+				end case;
+			end if;
+
+			if inc then
+				if count_reg < count_max then
+					count_reg <= count_reg + 1;
+					step <= '1';
+				elsif wrap = '1' then
+					count_reg <= count_min;
+					step <= '1';
+				end if;
+				up <= '1';
+			elsif dec then
+				if count_reg > count_min then
+					count_reg <= count_reg - 1;
+					step <= '1';
+				elsif wrap = '1' then
+					count_reg <= count_max;
+					step <= '1';
+				end if;
+				up <= '0';
+			end if;
+
+			if clear = '1' then
+				if count_min > 0 then
+					count_reg <= count_min;
+				elsif count_max < 0 then
+					count_reg <= count_max;
+				else
+					count_reg <= (others => '0');
+				end if;
+				step <= '0';
+			end if;
+
+			if clear_errors = '1' then
+				errors <= (others => '0');
+			end if;
+		end if;
+	end process;
+
+count <= count_reg;
+error_count <= errors;
+
+end architecture;
@@ -9,13 +9,26 @@ use ieee.numeric_std.all;
 
 
 entity rotary_avalon is
+generic (
+-- number of events the event FIFO holds; must be a power of two
+FIFO_DEPTH : positive := 64;
+-- width of the signed encoder count, 16 to 32 bits
+COUNT_WIDTH : positive := 32
+);
 port (
 clk : in std_ulogic;
 rst : in std_ulogic;
 -- avalon memory-mapped slave interface
 avs_read : in std_ulogic;
-avs_address : in std_ulogic_vector(1 downto 0);
+avs_write : in std_ulogic;
+-- word address; bit 10 selects the page holding EVENT_DATA
+avs_address : in std_ulogic_vector(10 downto 0);
 avs_readdata : out std_ulogic_vector(31 downto 0);
+avs_writedata : in std_ulogic_vector(31 downto 0);
+-- interrupt sender; raised while an enabled IRQ status bit is set
+irq : out std_ulogic;
+-- sign-extended count, as in the COUNT register, for the routing crossbar
+count_out : out std_ulogic_vector(31 downto 0);
 -- external input pins from rotary encoder; import from top-level
 A : in std_ulogic;
 B : in std_ulogic;
@@ -35,20 +48,103 @@ component async_conditioner is
 		);
 end component async_conditioner;
 
+component synchronizer is
+	port (
+		clk		: in std_ulogic;
+		async	: in std_ulogic;
+		sync	: out std_ulogic
+		);
+end component synchronizer;
+
+component quadrature_decoder is
+	generic (
+		COUNT_WIDTH : positive
+		);
+	port (
+		clk				: in std_ulogic;
+		rst				: in std_ulogic;
+		a				: in std_ulogic;
+		b				: in std_ulogic;
+		wrap			: in std_ulogic;
+		count_min		: in signed(COUNT_WIDTH - 1 downto 0);
+		count_max		: in signed(COUNT_WIDTH - 1 downto 0);
+		clear			: in std_ulogic;
+		clear_errors	: in std_ulogic;
+		count			: out signed(COUNT_WIDTH - 1 downto 0);
+		step			: out std_ulogic;
+		up				: out std_ulogic;
+		error_count		: out unsigned(31 downto 0)
+		);
+end component quadrature_decoder;
+
 ------------------------ Signal Declearations ----------------------------
 -- creating registers
 signal output_reg : std_ulogic_vector(31 downto 0) := (others => '0');
 signal enable_reg : std_ulogic_vector(31 downto 0) := (others => '0');
 
--- counting variable for encoder state
-signal int : integer range 0 to 63 := 0;
+-- A and B synchronized to clk
+signal a_sync : std_ulogic;
+signal b_sync : std_ulogic;
+
+-- decoder outputs
+signal count : signed(COUNT_WIDTH - 1 downto 0);
+signal count_up : std_ulogic;
+signal error_count : unsigned(31 downto 0);
+
+-- control register; bit 0 = wrap instead of saturating. Writing bit 1
+-- clears the count and writing bit 2 clears the error count.
+signal wrap : std_ulogic := '0';
+signal clear_count : std_ulogic := '0';
+signal clear_errors : std_ulogic := '0';
+
+-- count range; the reset values keep the old 64 detents at 4 counts each
+signal count_min : signed(COUNT_WIDTH - 1 downto 0) := to_signed(0, COUNT_WIDTH);
+signal count_max : signed(COUNT_WIDTH - 1 downto 0) := to_signed(255, COUNT_WIDTH);
 
 -- pushbutton signal
 signal pb : std_ulogic;
 
+-- push button level synchronized to clk, for the input status register
+signal pb_level : std_ulogic;
+
 -- signal for counting enable state
 signal en : std_ulogic := '0';
 
+-- the count changed this cycle
+signal count_changed : std_ulogic;
+
+-- interrupt registers; bit 0 = count changed, bit 1 = push button toggled
+signal irq_status : std_ulogic_vector(1 downto 0) := (others => '0');
+signal irq_enable : std_ulogic_vector(1 downto 0) := (others => '0');
+
+-- free-running clk cycle counter used to timestamp events
+signal cycles : unsigned(31 downto 0) := (others => '0');
+
+-- event FIFO; an event is the count (low 16 bits), what happened (bit 16 set for
+-- the push button), the direction or new enable state (bit 17) and whether
+-- events were dropped just before this one (bit 31)
+type event_array is array (0 to FIFO_DEPTH - 1) of std_ulogic_vector(31 downto 0);
+signal fifo_data : event_array;
+signal fifo_time : event_array;
+signal fifo_wr : natural range 0 to FIFO_DEPTH - 1 := 0;
+signal fifo_rd : natural range 0 to FIFO_DEPTH - 1 := 0;
+signal fifo_level : natural range 0 to FIFO_DEPTH := 0;
+signal fifo_overflow : std_ulogic := '0';
+
+-- event to push this cycle, and whether it fits
+signal event_data : std_ulogic_vector(31 downto 0);
+signal event_valid : std_ulogic;
+signal push : std_ulogic;
+
+-- EVENT_DATA is being read this cycle
+signal pop : std_ulogic;
+
+-- a push button event waiting for a cycle without a count event
+signal pb_pending : std_ulogic := '0';
+
+-- timestamp of the event last popped from EVENT_DATA
+signal event_time : std_ulogic_vector(31 downto 0) := (others => '0');
+
 --------------------------------------------------------------------------
 
 begin
@@ -62,6 +158,13 @@ CONDITIONER : component async_conditioner
 		sync => pb
 		);
 
+PB_SYNCHRONIZER : component synchronizer
+	port map (
+		clk => clk,
+		async => push_button,
+		sync => pb_level
+		);
+
 enable : process(clk,rst)
 	begin
 		if rst = '1' then
@@ -75,28 +178,208 @@ enable : process(clk,rst)
 	end process;
 	
 ------------------------- Rotary Encoder ---------------------------------
-quadrature : process(A,B,rst)
+-- A and B are only two-flop synchronized, not debounced: contact bounce is a
+-- back-and-forth Gray code sequence that the decoder nets out exactly.
+A_SYNCHRONIZER : component synchronizer
+	port map (
+		clk => clk,
+		async => A,
+		sync => a_sync
+		);
+
+B_SYNCHRONIZER : component synchronizer
+	port map (
+		clk => clk,
+		async => B,
+		sync => b_sync
+		);
+
+DECODER : component quadrature_decoder
+	generic map (
+		COUNT_WIDTH => COUNT_WIDTH
+		)
+	port map (
+		clk => clk,
+		rst => rst,
+		a => a_sync,
+		b => b_sync,
+		wrap => wrap,
+		count_min => count_min,
+		count_max => count_max,
+		clear => clear_count,
+		clear_errors => clear_errors,
+		count => count,
+		step => count_changed,
+		up => count_up,
+		error_count => error_count
+		);
+
+output_reg <= std_ulogic_vector(resize(count, 32));
+count_out <= output_reg;
+
+control : process(clk,rst)
+	begin
+		if rst = '1' then
+			wrap <= '0';
+			clear_count <= '0';
+			clear_errors <= '0';
+			count_min <= to_signed(0, COUNT_WIDTH);
+			count_max <= to_signed(255, COUNT_WIDTH);
+		elsif rising_edge(clk) then
+			clear_count <= '0';
+			clear_errors <= '0';
+			if avs_write = '1' and avs_address(10) = '0' then
+				case avs_address(3 downto 0) is
+					when "1000" =>
+						wrap <= avs_writedata(0);
+						clear_count <= avs_writedata(1);
+						clear_errors <= avs_writedata(2);
+					when "1010" => count_min <= resize(signed(avs_writedata), COUNT_WIDTH);
+					when "1011" => count_max <= resize(signed(avs_writedata), COUNT_WIDTH);
+					when others => null;
+				end case;
+			end if;
+		end if;
+	end process;
+
+------------------------- Interrupts --------------------------------------
+-- IRQ status bits are set by events and cleared by writing 1 to them. An
+-- event in the same cycle as the clearing write wins, so none are lost.
+interrupts : process(clk,rst)
+	begin
+		if rst = '1' then
+			irq_status <= (others => '0');
+			irq_enable <= (others => '0');
+		elsif rising_edge(clk) then
+			if avs_write = '1' and avs_address(10) = '0' then
+				case avs_address(3 downto 0) is
+					when "0010" => irq_status <= irq_status and not avs_writedata(1 downto 0);
+					when "0011" => irq_enable <= avs_writedata(1 downto 0);
+					when others => null;
+				end case;
+			end if;
+			if count_changed = '1' then
+				irq_status(0) <= '1';
+			end if;
+			if pb = '1' then
+				irq_status(1) <= '1';
+			end if;
+		end if;
+	end process;
+
+irq <= '1' when (irq_status and irq_enable) /= "00" else '0';
+
+------------------------- Event FIFO --------------------------------------
+cycle_counter : process(clk,rst)
 	begin
 		if rst = '1' then
-			int <= 0;
-		elsif rising_edge(A) and B = '1' and int < 63 then
-			int <= int + 1;
-		elsif rising_edge(A) and B = '0' and int > 0 then
-			int <= int - 1;
+			cycles <= (others => '0');
+		elsif rising_edge(clk) then
+			cycles <= cycles + 1;
 		end if;
 	end process;
 
-output_reg <= std_ulogic_vector(to_unsigned(int,32));
+-- Reading EVENT_DATA pops the oldest event. The bus holds avs_read for a
+-- single cycle (readLatency 1, readWaitTime 0), so each read pops once.
+-- EVENT_DATA sits alone in the second 4 KiB page, so a user-space mapping of
+-- the other registers can't pop events by reading them.
+pop <= '1' when avs_read = '1' and avs_address(10) = '1' and fifo_level /= 0 else '0';
+
+-- Only one event is pushed per cycle. A count change takes priority and a
+-- push button event in the same cycle is held back until the next free one.
+event_word : process(all)
+	begin
+		event_data <= (others => '0');
+		event_valid <= '0';
+		event_data(15 downto 0) <= std_ulogic_vector(resize(count, 16));
+		if count_changed = '1' then
+			event_data(17) <= count_up;
+			event_valid <= '1';
+		elsif pb_pending = '1' then
+			event_data(16) <= '1';
+			event_data(17) <= en;
+			event_valid <= '1';
+		end if;
+	end process;
+
+-- When the FIFO is full the event is dropped and the next event pushed has
+-- its overflow bit set.
+push <= '1' when event_valid = '1' and (fifo_level /= FIFO_DEPTH or pop = '1') else '0';
+
+-- no reset, so the storage can be inferred as block RAM
+fifo_ram : process(clk)
+	begin
+		if rising_edge(clk) then
+			if push = '1' then
+				fifo_data(fifo_wr) <= fifo_overflow & event_data(30 downto 0);
+				fifo_time(fifo_wr) <= std_ulogic_vector(cycles);
+			end if;
+		end if;
+	end process;
+
+event_fifo : process(clk,rst)
+	begin
+		if rst = '1' then
+			fifo_wr <= 0;
+			fifo_rd <= 0;
+			fifo_level <= 0;
+			fifo_overflow <= '0';
+			pb_pending <= '0';
+			event_time <= (others => '0');
+		elsif rising_edge(clk) then
+			if pb = '1' then
+				pb_pending <= '1';
+			elsif count_changed = '0' then
+				pb_pending <= '0';
+			end if;
+
+			if push = '1' then
+				fifo_wr <= (fifo_wr + 1) mod FIFO_DEPTH;
+				fifo_overflow <= '0';
+			elsif event_valid = '1' then
+				fifo_overflow <= '1';
+			end if;
+
+			if pop = '1' then
+				event_time <= fifo_time(fifo_rd);
+				fifo_rd <= (fifo_rd + 1) mod FIFO_DEPTH;
+			end if;
+
+			if push = '1' and pop = '0' then
+				fifo_level <= fifo_level + 1;
+			elsif pop = '1' and push = '0' then
+				fifo_level <= fifo_level - 1;
+			end if;
+		end if;
+	end process;
 
 ------------------------- Avalon Bus --------------------------------------
 avalon_register_read : process(clk)
 	begin
 		if rising_edge(clk) and avs_read = '1' then
-			case avs_address is
-				when "00" => avs_readdata <= output_reg;
-				when "01" => avs_readdata <= enable_reg;
-				when others => avs_readdata <= (others => '0');
-			end case;
+			if avs_address(10) = '1' then
+				if fifo_level /= 0 then
+					avs_readdata <= fifo_data(fifo_rd);
+				else
+					avs_readdata <= (others => '0');
+				end if;
+			else
+				case avs_address(3 downto 0) is
+					when "0000" => avs_readdata <= output_reg;
+					when "0001" => avs_readdata <= enable_reg;
+					when "0010" => avs_readdata <= std_ulogic_vector(resize(unsigned(irq_status), 32));
+					when "0011" => avs_readdata <= std_ulogic_vector(resize(unsigned(irq_enable), 32));
+					when "0100" => avs_readdata <= std_ulogic_vector(to_unsigned(fifo_level, 32));
+					when "0101" => avs_readdata <= event_time;
+					when "0110" => avs_readdata <= std_ulogic_vector(cycles);
+					when "1000" => avs_readdata <= (0 => wrap, others => '0');
+					when "1001" => avs_readdata <= std_ulogic_vector(error_count);
+					when "1010" => avs_readdata <= std_ulogic_vector(resize(count_min, 32));
+					when "1011" => avs_readdata <= std_ulogic_vector(resize(count_max, 32));
+					when "1100" => avs_readdata <= (0 => a_sync, 1 => b_sync, 2 => pb_level, others => '0');
+					when others => avs_readdata <= (others => '0');
+				end case;
+			end if;
 		end if;
 	end process;
 	
@@ -7,6 +7,19 @@
 #include <linux/mutex.h>
 #include <linux/miscdevice.h>
 #include <linux/fs.h>
+#include <linux/uio.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/poll.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+#include <linux/seqlock.h>
+#include <linux/iopoll.h>
+
+#include "de10nano_xfer.h"
+#include "de10nano_mmap.h"
+#include "de10nano_adc.h"
+#include "de10nano_bind.h"
 
 // ADC channel register addresses
 static u32 CH0 = 0x0;
@@ -29,40 +42,105 @@ static u32 CH7 = 0x1c;
 
 static unsigned long VOLTAGE_SCALE_MV = 1;
 
+// With auto_update on, bit 15 of a channel register flags a refreshed value
+#define ADC_REFRESH_FLAG BIT(15)
+
+// How long to wait for a triggered conversion to finish
+#define ADC_CONVERSION_TIMEOUT_US 1000
+
+// Fastest rate the sampler can be asked to run at
+#define ADC_MAX_SAMPLE_RATE_HZ 100000
+
+/**
+ * struct adc_bind_source - de10nano_bind source for one channel.
+ * @src: The source, named "adc0" to "adc7"
+ * @priv: The channel's device
+ * @ch: Channel number
+ */
+struct adc_bind_source {
+	struct de10nano_bind_source src;
+	struct adc_dev *priv;
+	unsigned int ch;
+};
+
 /**
  * struct adc_dev - Private led patterns device struct.
  * @base_addr: Pointer to the component's base address 
+ * @phys_addr: Physical address of the component's registers
+ * @emulated: The registers are backed by RAM instead of the FPGA
  * @hps_led_control: Pointer to the hps_led_control register 
  * @base_period: Pointer to the base_period register 
  * @led_reg: Pointer to the led_reg register 
  * @miscdev: miscdevice used to create a character device
  * @lock: mutex used to prevent concurrent writes to memory 
+ * @sample_timer: hrtimer that drives the sampler
+ * @sample_period: Time between sampler ticks
+ * @sample_rate_hz: Sampler rate; 0 when the sampler is stopped
+ * @sample_seq: Sampler tick number of the next sample
+ * @ring: Sample ring shared with user space through mmap()
+ * @ring_head: Driver's own copy of @ring->head, which user space can't touch
+ * @ring_wait: Wait queue for poll() on the sample ring
+ * @snap_lock: seqlock protecting @snap; readers never block writers
+ * @snap: Most recent coherent snapshot of all eight channels
+ * @refreshed: The sampler saw CH7's refresh flag since a snapshot cleared it
+ * @bind: de10nano_bind sources for the channels
  *
  * An adc_dev struct gets created for each led patterns component.
  */
 struct adc_dev {
 	void __iomem *base_addr;
+	phys_addr_t phys_addr;
+	bool emulated;
 	bool auto_update;
 	struct miscdevice miscdev;
 	struct mutex lock;
+	struct hrtimer sample_timer;
+	ktime_t sample_period;
+	u32 sample_rate_hz;
+	u32 sample_seq;
+	struct de10nano_adc_ring *ring;
+	u32 ring_head;
+	wait_queue_head_t ring_wait;
+	seqlock_t snap_lock;
+	struct de10nano_adc_snapshot snap;
+	bool refreshed;
+	struct adc_bind_source bind[DE10NANO_ADC_NUM_CHANNELS];
 };
 
+static const char * const adc_bind_names[DE10NANO_ADC_NUM_CHANNELS] = {
+	"adc0", "adc1", "adc2", "adc3", "adc4", "adc5", "adc6", "adc7",
+};
+
+/*
+ * When emulate is set, the module registers its own platform device whose
+ * registers are backed by a page of ordinary RAM instead of the FPGA. This
+ * lets the driver be loaded and exercised on a stock x86 kernel.
+ */
+static bool emulate;
+module_param(emulate, bool, 0444);
+MODULE_PARM_DESC(emulate, "Back the registers with RAM instead of the FPGA");
+
 /**
- * adc_read() - Read method for the adc char device
- * @file: Pointer to the char device file struct.
- * @buf: User-space buffer to read the value into.
- * @count: The number of bytes being requested.
- * @offset: The byte offset in the file being read from.
+ * adc_read_iter() - Read method for the adc char device
+ * @iocb: I/O control block; holds the file struct and the byte offset
+ *        being read from.
+ * @to: User-space buffer(s) to read the channel values into.
  *
- * Return: On success, the number of bytes written is returned and the
- * offset @offset is advanced by this number. On error, a negative error
+ * As many whole channel registers as fit in @to are read, up to the end of
+ * the component's span, so read(), readv() and preadv() can fetch all eight
+ * channels with one syscall and one lock acquisition.
+ *
+ * Return: On success, the number of bytes read is returned and the
+ * offset is advanced by this number. On error, a negative error
  * value is returned.
  */
-static ssize_t adc_read(struct file *file, char __user *buf,
-	size_t count, loff_t *offset)
+static ssize_t adc_read_iter(struct kiocb *iocb, struct iov_iter *to)
 {
-	size_t ret;
-	u32 val;
+	u32 vals[SPAN / sizeof(u32)];
+	loff_t pos = iocb->ki_pos;
+	size_t count;
+	size_t copied;
+	size_t i;
 
 	/*
 	 * Get the device's private data from the file struct's private_data
@@ -70,108 +148,425 @@ static ssize_t adc_read(struct file *file, char __user *buf,
 	 * adc_dev struct. container_of returns the 
      * adc_dev struct that contains the miscdev in private_data.
 	 */
-	struct adc_dev *priv = container_of(file->private_data,
+	struct adc_dev *priv = container_of(iocb->ki_filp->private_data,
 	                            struct adc_dev, miscdev);
 
 	// Check file offset to make sure we are reading from a valid location.
-	if (*offset < 0) {
+	if (pos < 0) {
 		// We can't read from a negative file position.
 		return -EINVAL;
 	}
-	if (*offset >= SPAN) {
+	if (pos >= SPAN) {
 		// We can't read from a position past the end of our device.
 		return 0;
 	}
-	if ((*offset % 0x4) != 0) {
+	if ((pos % 0x4) != 0) {
 		// Prevent unaligned access.
 		pr_warn("adc_read: unaligned access\n");
 		return -EFAULT;
 	}
 
-	val = ioread32(priv->base_addr + *offset) & ADC_VALUE_BITMASK;
+	// Only move whole registers, and never past the end of our device.
+	count = min_t(size_t, iov_iter_count(to), SPAN - pos);
+	count = round_down(count, sizeof(u32));
+	if (count == 0) {
+		return -EINVAL;
+	}
+
+	mutex_lock(&priv->lock);
+	for (i = 0; i < count / sizeof(u32); i++) {
+		vals[i] = ioread32(priv->base_addr + pos + i * sizeof(u32))
+			& ADC_VALUE_BITMASK;
+	}
+	mutex_unlock(&priv->lock);
 
-	// Copy the value to userspace.
-	ret = copy_to_user(buf, &val, sizeof(val));
-	if (ret == sizeof(val)) {
+	// Copy the values to userspace.
+	copied = round_down(copy_to_iter(vals, count, to), sizeof(u32));
+	if (copied == 0) {
 		pr_warn("adc_read: nothing copied\n");
 		return -EFAULT;
 	}
 
 	// Increment the file offset by the number of bytes we read.
-	*offset = *offset + sizeof(val);
+	iocb->ki_pos = pos + copied;
 
-	return sizeof(val);
+	return copied;
 }
 
 /**
- * adc_write() - Write method for the adc char device
- * @file: Pointer to the char device file struct.
- * @buf: User-space buffer to read the value from.
- * @count: The number of bytes being written.
- * @offset: The byte offset in the file being written to.
+ * adc_write_iter() - Write method for the adc char device
+ * @iocb: I/O control block; holds the file struct and the byte offset
+ *        being written to.
+ * @from: User-space buffer(s) to read the values from.
+ *
+ * Only the update register is writable, so at most one register is moved.
+ * write(), writev() and pwritev() are all handled here.
  *
  * Return: On success, the number of bytes written is returned and the
- * offset @offset is advanced by this number. On error, a negative error
+ * offset is advanced by this number. On error, a negative error
  * value is returned.
  */
-static ssize_t adc_write(struct file *file, const char __user *buf,
-	size_t count, loff_t *offset)
+static ssize_t adc_write_iter(struct kiocb *iocb, struct iov_iter *from)
 {
-	size_t ret;
-	u32 val;
+	u32 vals[AUTO_UPDATE / sizeof(u32)];
+	loff_t pos = iocb->ki_pos;
+	size_t count;
+	size_t copied;
+	size_t i;
 
-	struct adc_dev *priv = container_of(file->private_data,
+	struct adc_dev *priv = container_of(iocb->ki_filp->private_data,
 	                              struct adc_dev, miscdev);
 
-	if (*offset < 0) {
+	if (pos < 0) {
 		return -EINVAL;
 	}
-	if (*offset >= AUTO_UPDATE) {
+	if (pos >= AUTO_UPDATE) {
 		// can't write past to the read-only adc channel registers
 		return -EINVAL;
 	}
-	if ((*offset % 0x4) != 0) {
+	if ((pos % 0x4) != 0) {
 		pr_warn("adc_write: unaligned access\n");
 		return -EFAULT;
 	}
 
+	count = min_t(size_t, iov_iter_count(from), AUTO_UPDATE - pos);
+	count = round_down(count, sizeof(u32));
+	if (count == 0) {
+		return -EINVAL;
+	}
+
+	// Get the values from userspace before taking the lock.
+	copied = round_down(copy_from_iter(vals, count, from), sizeof(u32));
+	if (copied == 0) {
+		pr_warn("adc_write: nothing copied from user space\n");
+		return -EFAULT;
+	}
+
 	mutex_lock(&priv->lock);
+	for (i = 0; i < copied / sizeof(u32); i++) {
+		iowrite32(vals[i], priv->base_addr + pos + i * sizeof(u32));
+	}
+	mutex_unlock(&priv->lock);
 
-	// Get the value from userspace.
-	ret = copy_from_user(&val, buf, sizeof(val));
-	if (ret != sizeof(val)) {
-		iowrite32(val, priv->base_addr + *offset);
+	// Increment the file offset by the number of bytes we wrote.
+	iocb->ki_pos = pos + copied;
 
-		// Increment the file offset by the number of bytes we wrote.
-		*offset = *offset + sizeof(val);
+	// Return the number of bytes we wrote.
+	return copied;
+}
 
-		// Return the number of bytes we wrote.
-		ret = sizeof(val);
+/**
+ * adc_publish_snapshot() - Make a set of channel values the latest snapshot.
+ * @priv: Private adc device struct.
+ * @ch: Value of each channel.
+ * @timestamp_ns: Time the channels were read.
+ *
+ * The caller holds the device lock and must only publish channels read after
+ * a conversion it triggered, so every snapshot comes from one conversion.
+ */
+static void adc_publish_snapshot(struct adc_dev *priv, const u16 *ch,
+	u64 timestamp_ns)
+{
+	write_seqlock(&priv->snap_lock);
+	priv->snap.seq++;
+	priv->snap.timestamp_ns = timestamp_ns;
+	memcpy(priv->snap.ch, ch, sizeof(priv->snap.ch));
+	write_sequnlock(&priv->snap_lock);
+}
+
+/**
+ * adc_refreshed() - Check for a conversion finished since the flag was cleared.
+ * @priv: Private adc device struct.
+ *
+ * Reading a channel register clears its refresh flag, so the sampler, which
+ * can read CH7 while a snapshot waits, passes on any flag it sees through
+ * @refreshed.
+ *
+ * Return: true once CH7 has been refreshed.
+ */
+static bool adc_refreshed(struct adc_dev *priv)
+{
+	return (ioread32(priv->base_addr + CH7) & ADC_REFRESH_FLAG) ||
+		READ_ONCE(priv->refreshed);
+}
+
+/**
+ * adc_take_snapshot() - Convert and read all eight channels coherently.
+ * @priv: Private adc device struct.
+ * @snap: Where to store the snapshot.
+ *
+ * Triggers a conversion, waits for it to finish, and reads every channel
+ * while holding the device lock so no other reader can start a conversion in
+ * between. When auto_update is on, CH7 is read before the trigger to clear a
+ * refresh flag left over from an earlier conversion, so only the flag set by
+ * this conversion ends the wait. When auto_update is off, the channels
+ * convert as they are read (see the XXX note below), and the emulated
+ * registers have no converter at all, so there is nothing to wait for.
+ *
+ * Return: 0 on success, or a negative error value.
+ */
+static int adc_take_snapshot(struct adc_dev *priv,
+	struct de10nano_adc_snapshot *snap)
+{
+	u16 ch[DE10NANO_ADC_NUM_CHANNELS];
+	u64 timestamp_ns;
+	bool done;
+	int ret = 0;
+	int i;
+
+	mutex_lock(&priv->lock);
+
+	if (priv->auto_update && !priv->emulated) {
+		ioread32(priv->base_addr + CH7);
+		WRITE_ONCE(priv->refreshed, false);
 	}
-	else {
-		pr_warn("adc_write: nothing copied from user space\n");
-		ret = -EFAULT;
+	iowrite32(1, priv->base_addr + UPDATE);
+	if (priv->auto_update && !priv->emulated) {
+		ret = read_poll_timeout(adc_refreshed, done, done,
+		                        1, ADC_CONVERSION_TIMEOUT_US, false, priv);
+	}
+	if (!ret) {
+		for (i = 0; i < DE10NANO_ADC_NUM_CHANNELS; i++) {
+			ch[i] = ioread32(priv->base_addr + i * sizeof(u32))
+				& ADC_VALUE_BITMASK;
+		}
+		timestamp_ns = ktime_get_ns();
+
+		adc_publish_snapshot(priv, ch, timestamp_ns);
+		*snap = priv->snap;
 	}
 
 	mutex_unlock(&priv->lock);
 	return ret;
 }
 
+/**
+ * adc_last_snapshot() - Read the most recent snapshot without locking.
+ * @priv: Private adc device struct.
+ * @snap: Where to store the snapshot.
+ *
+ * If a writer publishes a new snapshot while we copy, the seqcount changes
+ * and we retry, so the copy is never torn.
+ */
+static void adc_last_snapshot(struct adc_dev *priv,
+	struct de10nano_adc_snapshot *snap)
+{
+	unsigned int seq;
+
+	do {
+		seq = read_seqbegin(&priv->snap_lock);
+		*snap = priv->snap;
+	} while (read_seqretry(&priv->snap_lock, seq));
+}
+
+/**
+ * adc_ioctl() - ioctl method for the adc char device
+ * @file: Pointer to the char device file struct.
+ * @cmd: The ioctl command.
+ * @arg: User-space pointer to the command's argument.
+ *
+ * DE10NANO_IOC_REG_XFER runs a batch of read, write, read-modify-write and
+ * wait-for-bit operations while holding the device lock once.
+ *
+ * Only the update register is writable. Values are returned
+ * unmasked so the refresh flag in bit 15 can be waited on.
+ *
+ * DE10NANO_ADC_IOC_SNAPSHOT and DE10NANO_ADC_IOC_LAST_SNAPSHOT return all
+ * eight channels from one conversion; see de10nano_adc.h.
+ *
+ * Return: 0 on success, or a negative error value.
+ */
+static long adc_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+	struct adc_dev *priv = container_of(file->private_data,
+	                            struct adc_dev, miscdev);
+	struct de10nano_adc_snapshot snap;
+	int ret;
+
+	switch (cmd) {
+	case DE10NANO_IOC_REG_XFER:
+		return de10nano_reg_xfer(priv->base_addr, SPAN, AUTO_UPDATE,
+		                         &priv->lock, (void __user *)arg);
+	case DE10NANO_ADC_IOC_SNAPSHOT:
+		ret = adc_take_snapshot(priv, &snap);
+		if (ret) {
+			return ret;
+		}
+		break;
+	case DE10NANO_ADC_IOC_LAST_SNAPSHOT:
+		adc_last_snapshot(priv, &snap);
+		break;
+	default:
+		return -ENOTTY;
+	}
+
+	if (copy_to_user((void __user *)arg, &snap, sizeof(snap))) {
+		return -EFAULT;
+	}
+
+	return 0;
+}
+
+/**
+ * adc_bind_read() - Read a channel for de10nano_bind.
+ * @src: The channel's source.
+ * @val: Where to store the channel value.
+ *
+ * The ADC doesn't signal new conversions, so bindings poll this.
+ *
+ * Return: 0.
+ */
+static int adc_bind_read(struct de10nano_bind_source *src, s32 *val)
+{
+	struct adc_bind_source *bind = container_of(src,
+		struct adc_bind_source, src);
+	struct adc_dev *priv = bind->priv;
+
+	mutex_lock(&priv->lock);
+	*val = ioread32(priv->base_addr + bind->ch * sizeof(u32))
+		& ADC_VALUE_BITMASK;
+	mutex_unlock(&priv->lock);
+
+	return 0;
+}
+
+/**
+ * adc_sample_timer() - Capture every channel into the sample ring.
+ * @timer: The sampler's hrtimer.
+ *
+ * This runs in interrupt context at the configured sample rate. It is the
+ * ring's only producer: it fills the next free slot, publishes it by
+ * advancing the head, and wakes poll() once the watermark is reached. If the
+ * consumer has fallen behind and the ring is full, the sample is dropped and
+ * counted as an overrun instead of overwriting unread data.
+ *
+ * Return: HRTIMER_RESTART; the timer is stopped with hrtimer_cancel().
+ */
+static enum hrtimer_restart adc_sample_timer(struct hrtimer *timer)
+{
+	struct adc_dev *priv = container_of(timer, struct adc_dev, sample_timer);
+	struct de10nano_adc_ring *ring = priv->ring;
+	struct de10nano_adc_sample *sample;
+	u64 ticks;
+	u32 tail;
+	u32 val = 0;
+	int i;
+
+	// Catch up on any ticks we didn't get to run for.
+	ticks = hrtimer_forward_now(timer, priv->sample_period);
+	if (ticks > 1) {
+		WRITE_ONCE(ring->missed, ring->missed + (u32)(ticks - 1));
+		priv->sample_seq += ticks - 1;
+	}
+
+	tail = smp_load_acquire(&ring->tail);
+	if (priv->ring_head - tail >= DE10NANO_ADC_RING_SAMPLES) {
+		WRITE_ONCE(ring->overruns, ring->overruns + 1);
+		priv->sample_seq++;
+		return HRTIMER_RESTART;
+	}
+
+	sample = &ring->samples[priv->ring_head & (DE10NANO_ADC_RING_SAMPLES - 1)];
+	sample->timestamp_ns = ktime_get_ns();
+	sample->seq = priv->sample_seq++;
+	for (i = 0; i < DE10NANO_ADC_NUM_CHANNELS; i++) {
+		val = ioread32(priv->base_addr + i * sizeof(u32));
+		sample->ch[i] = val & ADC_VALUE_BITMASK;
+	}
+	// Reading CH7 cleared its refresh flag; pass it on to adc_take_snapshot().
+	if (val & ADC_REFRESH_FLAG) {
+		WRITE_ONCE(priv->refreshed, true);
+	}
+
+	/*
+	 * The sampler doesn't trigger conversions, so its channels can come from
+	 * different ones; it stays out of the coherent snapshot.
+	 */
+
+	// Publish the sample only once it has been completely written.
+	priv->ring_head++;
+	smp_store_release(&ring->head, priv->ring_head);
+
+	if (priv->ring_head - tail >= READ_ONCE(ring->watermark)) {
+		wake_up_interruptible(&priv->ring_wait);
+	}
+
+	return HRTIMER_RESTART;
+}
+
+/**
+ * adc_poll() - poll method for the adc char device
+ * @file: Pointer to the char device file struct.
+ * @wait: Poll table to register our wait queue with.
+ *
+ * Return: EPOLLIN | EPOLLRDNORM once the sample ring holds at least
+ * watermark unconsumed samples, otherwise 0.
+ */
+static __poll_t adc_poll(struct file *file, poll_table *wait)
+{
+	struct adc_dev *priv = container_of(file->private_data,
+	                            struct adc_dev, miscdev);
+	struct de10nano_adc_ring *ring = priv->ring;
+
+	poll_wait(file, &priv->ring_wait, wait);
+
+	if (smp_load_acquire(&ring->head) - READ_ONCE(ring->tail) >=
+	    READ_ONCE(ring->watermark)) {
+		return EPOLLIN | EPOLLRDNORM;
+	}
+
+	return 0;
+}
+
+/**
+ * adc_mmap() - mmap method for the adc char device
+ * @file: Pointer to the char device file struct.
+ * @vma: The user-space mapping being created.
+ *
+ * Offset 0 maps the register window into user space so the registers can be
+ * accessed with plain loads and stores instead of a syscall each.
+ * The adc registers are read-only, so writable mappings are refused.
+ * DE10NANO_ADC_RING_MMAP_OFFSET maps the sampler's ring buffer instead.
+ *
+ * Return: 0 on success, or a negative error value.
+ */
+static int adc_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct adc_dev *priv = container_of(file->private_data,
+	                            struct adc_dev, miscdev);
+
+	// The sample ring is writable so the consumer can advance the tail.
+	if (vma->vm_pgoff == DE10NANO_ADC_RING_MMAP_OFFSET >> PAGE_SHIFT) {
+		return remap_vmalloc_range(vma, priv->ring, 0);
+	}
+
+	return de10nano_mmap_regs(vma, priv->phys_addr, SPAN, priv->emulated,
+	                          true);
+}
+
 /** 
  *  adc_fops - File operations supported by the  
  *                          adc driver
  * @owner: The adc driver owns the file operations; this 
  *         ensures that the driver can't be removed while the 
  *         character device is still in use.
- * @read: The read function.
- * @write: The write function.
+ * @read_iter: The read function; also handles readv() and preadv().
+ * @write_iter: The write function; also handles writev() and pwritev().
+ * @unlocked_ioctl: The ioctl function; see de10nano_regs.h.
+ * @compat_ioctl: Our ioctl argument is the same for 32-bit callers.
+ * @mmap: Maps the register window or the sample ring into user space.
+ * @poll: Reports when the sample ring reaches its watermark.
  * @llseek: We use the kernel's default_llseek() function; this allows 
  *          users to change what position they are writing/reading to/from.
  */
 static const struct file_operations  adc_fops = {
 	.owner = THIS_MODULE,
-	.read = adc_read,
-	.write = adc_write,
+	.read_iter = adc_read_iter,
+	.write_iter = adc_write_iter,
+	.unlocked_ioctl = adc_ioctl,
+	.compat_ioctl = compat_ptr_ioctl,
+	.mmap = adc_mmap,
+	.poll = adc_poll,
 	.llseek = default_llseek,
 };
 
@@ -261,6 +656,109 @@ static ssize_t auto_update_show(struct device *dev,
 	return scnprintf(buf, PAGE_SIZE, "%u\n", priv->auto_update);
 }
 
+/**
+ * sample_rate_hz_show() - Read the sampler rate.
+ * @dev: Device structure for the adc component. 
+ * @attr: Unused.
+ * @buf: Buffer that gets returned to user-space.
+ *
+ * Return: The number of bytes read.
+ */
+static ssize_t sample_rate_hz_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct adc_dev *priv = dev_get_drvdata(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%u\n", priv->sample_rate_hz);
+}
+
+/**
+ * sample_rate_hz_store() - Start, stop or retune the sampler.
+ *
+ * Writing 0 stops the sampler; any other value (up to
+ * ADC_MAX_SAMPLE_RATE_HZ) starts it at that rate. Samples already in the
+ * ring are kept.
+ *
+ * @dev: Device structure for the adc component. 
+ * @attr: Unused.
+ * @buf: Buffer that contains the value being written.
+ * @size: The number of bytes being written.
+ *
+ * Return: The number of bytes stored.
+ */
+static ssize_t sample_rate_hz_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t size)
+{
+	u32 rate;
+	int ret;
+	struct adc_dev *priv = dev_get_drvdata(dev);
+
+	ret = kstrtou32(buf, 0, &rate);
+	if (ret < 0) {
+		return ret;
+	}
+	if (rate > ADC_MAX_SAMPLE_RATE_HZ) {
+		return -EINVAL;
+	}
+
+	mutex_lock(&priv->lock);
+	hrtimer_cancel(&priv->sample_timer);
+	priv->sample_rate_hz = rate;
+	if (rate) {
+		priv->sample_period = ns_to_ktime(div_u64(NSEC_PER_SEC, rate));
+		hrtimer_start(&priv->sample_timer, priv->sample_period,
+		              HRTIMER_MODE_REL);
+	}
+	mutex_unlock(&priv->lock);
+
+	return size;
+}
+
+/**
+ * ring_watermark_show() - Read the sample ring's poll() watermark.
+ * @dev: Device structure for the adc component. 
+ * @attr: Unused.
+ * @buf: Buffer that gets returned to user-space.
+ *
+ * Return: The number of bytes read.
+ */
+static ssize_t ring_watermark_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct adc_dev *priv = dev_get_drvdata(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%u\n", READ_ONCE(priv->ring->watermark));
+}
+
+/**
+ * ring_watermark_store() - Set how many samples wake up poll().
+ * @dev: Device structure for the adc component. 
+ * @attr: Unused.
+ * @buf: Buffer that contains the value being written.
+ * @size: The number of bytes being written.
+ *
+ * Return: The number of bytes stored.
+ */
+static ssize_t ring_watermark_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t size)
+{
+	u32 watermark;
+	int ret;
+	struct adc_dev *priv = dev_get_drvdata(dev);
+
+	ret = kstrtou32(buf, 0, &watermark);
+	if (ret < 0) {
+		return ret;
+	}
+	if (watermark == 0 || watermark > DE10NANO_ADC_RING_SAMPLES) {
+		return -EINVAL;
+	}
+
+	WRITE_ONCE(priv->ring->watermark, watermark);
+
+	return size;
+}
+
 /**
  * adc_ch_show() - Read ADC channel value.
  * 
@@ -281,7 +779,10 @@ static ssize_t adc_ch_show(struct device *dev,
 
 	u32 ch_offset = *(u32 *)(ch_attr->var);
 
+	// Serialise with snapshots, which wait on CH7's clear-on-read flag.
+	mutex_lock(&priv->lock);
 	adc_value = ioread32(priv->base_addr + ch_offset) & ADC_VALUE_BITMASK;
+	mutex_unlock(&priv->lock);
 
 	return scnprintf(buf, PAGE_SIZE, "%u\n", adc_value);
 }
@@ -303,6 +804,8 @@ static ssize_t adc_ch_show(struct device *dev,
 
 static DEVICE_ATTR_WO(update);
 static DEVICE_ATTR_RW(auto_update);
+static DEVICE_ATTR_RW(sample_rate_hz);
+static DEVICE_ATTR_RW(ring_watermark);
 static DEVICE_ADC_CH_ATTR(ch0_raw, CH0);
 static DEVICE_ADC_CH_ATTR(ch1_raw, CH1);
 static DEVICE_ADC_CH_ATTR(ch2_raw, CH2);
@@ -316,6 +819,8 @@ static DEVICE_ULONG_ATTR_RO(voltage_scale_mv, VOLTAGE_SCALE_MV);
 static struct attribute *adc_attrs[] = {
 	&dev_attr_update.attr,
 	&dev_attr_auto_update.attr,
+	&dev_attr_sample_rate_hz.attr,
+	&dev_attr_ring_watermark.attr,
 	&dev_attr_ch0_raw.attr.attr,
 	&dev_attr_ch1_raw.attr.attr,
 	&dev_attr_ch2_raw.attr.attr,
@@ -342,7 +847,10 @@ ATTRIBUTE_GROUPS(adc);
 static int adc_probe(struct platform_device *pdev)
 {
 	struct adc_dev *priv;
+	struct resource *res;
+	unsigned long emu_page;
 	size_t ret;
+	int i;
 
 	/*
 	 * Allocate kernel memory for the led patterns device and set it to 0.
@@ -363,12 +871,61 @@ static int adc_probe(struct platform_device *pdev)
 	 * into the kernel's virtual address space because we don't have access
 	 * to physical memory locations.
 	 */
-	priv->base_addr = devm_platform_ioremap_resource(pdev, 0);
-	if (IS_ERR(priv->base_addr)) {
-		pr_err("Failed to request/remap platform device resource\n");
-		return PTR_ERR(priv->base_addr);
+	if (emulate && !platform_get_resource(pdev, IORESOURCE_MEM, 0)) {
+		// Our own emulated device has no memory region; use a RAM page.
+		emu_page = devm_get_free_pages(&pdev->dev,
+		                    GFP_KERNEL | __GFP_ZERO, 0);
+		if (!emu_page) {
+			pr_err("Failed to allocate emulated registers\n");
+			return -ENOMEM;
+		}
+		priv->base_addr = (void __iomem *)emu_page;
+		priv->phys_addr = virt_to_phys((void *)emu_page);
+		priv->emulated = true;
+	} else {
+		priv->base_addr = devm_platform_get_and_ioremap_resource(pdev, 0, &res);
+		if (IS_ERR(priv->base_addr)) {
+			pr_err("Failed to request/remap platform device resource\n");
+			return PTR_ERR(priv->base_addr);
+		}
+		priv->phys_addr = res->start;
 	}
 
+	mutex_init(&priv->lock);
+
+	/*
+	 * Allocate the sample ring. vmalloc_user() zeroes it and makes it
+	 * safe to map into user space with remap_vmalloc_range().
+	 */
+	priv->ring = vmalloc_user(DE10NANO_ADC_RING_BYTES);
+	if (!priv->ring) {
+		pr_err("Failed to allocate sample ring\n");
+		return -ENOMEM;
+	}
+	priv->ring->size = DE10NANO_ADC_RING_SAMPLES;
+	priv->ring->watermark = 1;
+	init_waitqueue_head(&priv->ring_wait);
+	seqlock_init(&priv->snap_lock);
+
+	// Let each channel drive a de10nano_bind binding.
+	for (i = 0; i < DE10NANO_ADC_NUM_CHANNELS; i++) {
+		priv->bind[i].src.name = adc_bind_names[i];
+		priv->bind[i].src.read = adc_bind_read;
+		priv->bind[i].priv = priv;
+		priv->bind[i].ch = i;
+		ret = devm_de10nano_bind_add_source(&pdev->dev, &priv->bind[i].src);
+		if (ret) {
+			pr_err("Failed to register bind source %s\n",
+			       adc_bind_names[i]);
+			vfree(priv->ring);
+			return ret;
+		}
+	}
+
+	// The sampler stays stopped until sample_rate_hz is written.
+	hrtimer_init(&priv->sample_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	priv->sample_timer.function = adc_sample_timer;
+
 	// Initialize the misc device parameters
 	priv->miscdev.minor = MISC_DYNAMIC_MINOR;
 	priv->miscdev.name = "adc";
@@ -379,6 +936,7 @@ static int adc_probe(struct platform_device *pdev)
 	ret = misc_register(&priv->miscdev);
 	if (ret) {
 		pr_err("Failed to register misc device");
+		vfree(priv->ring);
 		return ret;
 	}
 
@@ -408,6 +966,10 @@ static int adc_remove(struct platform_device *pdev)
 	// Deregister the misc device and remove the /dev/adc file.
 	misc_deregister(&priv->miscdev);
 
+	// Stop the sampler before freeing the ring it writes to.
+	hrtimer_cancel(&priv->sample_timer);
+	vfree(priv->ring);
+
 	pr_info("adc_remove successful\n");
 
 	return 0;
@@ -445,11 +1007,51 @@ static struct platform_driver adc_driver = {
 	},
 };
 
-/*
- * We don't need to do anything special in module init/exit.
- * This macro automatically handles module init/exit.
+// Emulated platform device, only registered when emulate is set.
+static struct platform_device *adc_emu_pdev;
+
+/**
+ * adc_init() - Register the adc platform driver.
+ *
+ * When the emulate module parameter is set, a RAM-backed adc device is
+ * registered as well so the driver can be tested without the FPGA.
+ *
+ * Return: 0 on success, or a negative error value.
+ */
+static int __init adc_init(void)
+{
+	int ret;
+
+	ret = platform_driver_register(&adc_driver);
+	if (ret) {
+		return ret;
+	}
+
+	if (emulate) {
+		adc_emu_pdev = platform_device_register_simple("adc",
+		                    PLATFORM_DEVID_NONE, NULL, 0);
+		if (IS_ERR(adc_emu_pdev)) {
+			platform_driver_unregister(&adc_driver);
+			return PTR_ERR(adc_emu_pdev);
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * adc_exit() - Remove the emulated device (if any) and the platform driver.
  */
-module_platform_driver(adc_driver);
+static void __exit adc_exit(void)
+{
+	if (adc_emu_pdev) {
+		platform_device_unregister(adc_emu_pdev);
+	}
+	platform_driver_unregister(&adc_driver);
+}
+
+module_init(adc_init);
+module_exit(adc_exit);
 
 MODULE_LICENSE("Dual MIT/GPL");
 MODULE_AUTHOR("Trevor Vannoy");
@@ -0,0 +1,313 @@
+/* SPDX-License-Identifier: GPL-2.0 or MIT */
+#include <linux/module.h>
+#include <linux/platform_device.h>
+#include <linux/mod_devicetable.h>
+#include <linux/io.h>
+#include <linux/types.h>
+#include <linux/bitops.h>
+#include <linux/iio/iio.h>
+#include <linux/iio/buffer.h>
+#include <linux/iio/trigger_consumer.h>
+#include <linux/iio/triggered_buffer.h>
+
+#define SPAN 32
+#define NUM_CHANNELS 8
+
+// ADC values are in the 12 least-significant bits of the registers
+#define ADC_VALUE_BITMASK 0xfff
+#define ADC_RESOLUTION_BITS 12
+
+/*
+ * The LTC2308's unipolar input range is 0--VREFCOMP, which is 4.096 V
+ * (see the README), so one LSB is 4096 mV / 2^12 = 1 mV.
+ */
+#define ADC_VREF_MV 4096
+
+/**
+ * struct adc_iio_dev - Private adc IIO device struct.
+ * @base_addr: Pointer to the component's base address
+ * @emulated: The registers are backed by RAM instead of the FPGA
+ * @scan: Buffer for one scan; enabled channels are packed in channel order,
+ *        followed by the timestamp.
+ *
+ * An adc_iio_dev struct gets created for each adc component.
+ */
+struct adc_iio_dev {
+	void __iomem *base_addr;
+	bool emulated;
+	struct {
+		u16 ch[NUM_CHANNELS];
+		s64 timestamp __aligned(8);
+	} scan;
+};
+
+/*
+ * When emulate is set, the module registers its own platform device whose
+ * registers are backed by a page of ordinary RAM instead of the FPGA. Each
+ * read steps the emulated channel by (channel + 1), so every channel produces
+ * its own ramp and buffered captures can be checked without hardware.
+ */
+static bool emulate;
+module_param(emulate, bool, 0444);
+MODULE_PARM_DESC(emulate, "Back the registers with RAM instead of the FPGA");
+
+/**
+ * adc_iio_read_channel() - Read one channel's 12-bit value.
+ * @priv: Private adc IIO device struct.
+ * @ch: Channel number.
+ *
+ * Return: The channel's value.
+ */
+static u16 adc_iio_read_channel(struct adc_iio_dev *priv, unsigned int ch)
+{
+	void __iomem *reg = priv->base_addr + ch * sizeof(u32);
+	u32 val = ioread32(reg) & ADC_VALUE_BITMASK;
+
+	if (priv->emulated) {
+		iowrite32((val + ch + 1) & ADC_VALUE_BITMASK, reg);
+	}
+
+	return val;
+}
+
+#define ADC_IIO_CHANNEL(_ch) {                                   \
+	.type = IIO_VOLTAGE,                                     \
+	.indexed = 1,                                            \
+	.channel = (_ch),                                        \
+	.info_mask_separate = BIT(IIO_CHAN_INFO_RAW),            \
+	.info_mask_shared_by_type = BIT(IIO_CHAN_INFO_SCALE),    \
+	.scan_index = (_ch),                                     \
+	.scan_type = {                                           \
+		.sign = 'u',                                     \
+		.realbits = ADC_RESOLUTION_BITS,                 \
+		.storagebits = 16,                               \
+		.endianness = IIO_CPU,                           \
+	},                                                       \
+}
+
+static const struct iio_chan_spec adc_iio_channels[] = {
+	ADC_IIO_CHANNEL(0),
+	ADC_IIO_CHANNEL(1),
+	ADC_IIO_CHANNEL(2),
+	ADC_IIO_CHANNEL(3),
+	ADC_IIO_CHANNEL(4),
+	ADC_IIO_CHANNEL(5),
+	ADC_IIO_CHANNEL(6),
+	ADC_IIO_CHANNEL(7),
+	IIO_CHAN_SOFT_TIMESTAMP(NUM_CHANNELS),
+};
+
+/**
+ * adc_iio_read_raw() - Read in_voltageN_raw or in_voltage_scale.
+ * @indio_dev: The IIO device.
+ * @chan: Channel being read.
+ * @val: First part of the value.
+ * @val2: Second part of the value.
+ * @mask: Which IIO_CHAN_INFO_* is being read.
+ *
+ * Return: The IIO_VAL_* format of the value, or a negative error value.
+ */
+static int adc_iio_read_raw(struct iio_dev *indio_dev,
+	struct iio_chan_spec const *chan, int *val, int *val2, long mask)
+{
+	struct adc_iio_dev *priv = iio_priv(indio_dev);
+	int ret;
+
+	switch (mask) {
+	case IIO_CHAN_INFO_RAW:
+		// Sysfs reads and the buffer would both step emulated channels.
+		ret = iio_device_claim_direct_mode(indio_dev);
+		if (ret) {
+			return ret;
+		}
+		*val = adc_iio_read_channel(priv, chan->channel);
+		iio_device_release_direct_mode(indio_dev);
+		return IIO_VAL_INT;
+	case IIO_CHAN_INFO_SCALE:
+		// millivolts per LSB = ADC_VREF_MV / 2^ADC_RESOLUTION_BITS
+		*val = ADC_VREF_MV;
+		*val2 = ADC_RESOLUTION_BITS;
+		return IIO_VAL_FRACTIONAL_LOG2;
+	default:
+		return -EINVAL;
+	}
+}
+
+static const struct iio_info adc_iio_info = {
+	.read_raw = adc_iio_read_raw,
+};
+
+/**
+ * adc_iio_trigger_handler() - Capture the enabled channels into the buffer.
+ * @irq: Unused.
+ * @p: The trigger's poll function.
+ *
+ * Runs on every trigger (hrtimer, sysfs, ...). Only the channels in the
+ * active scan mask are read, and they are pushed into the kfifo-backed
+ * buffer together with the timestamp taken when the trigger fired.
+ *
+ * Return: IRQ_HANDLED.
+ */
+static irqreturn_t adc_iio_trigger_handler(int irq, void *p)
+{
+	struct iio_poll_func *pf = p;
+	struct iio_dev *indio_dev = pf->indio_dev;
+	struct adc_iio_dev *priv = iio_priv(indio_dev);
+	unsigned int bit;
+	int i = 0;
+
+	// Limit the walk to the voltage channels; the timestamp is added below.
+	for_each_set_bit(bit, indio_dev->active_scan_mask, NUM_CHANNELS) {
+		priv->scan.ch[i++] = adc_iio_read_channel(priv, bit);
+	}
+
+	iio_push_to_buffers_with_timestamp(indio_dev, &priv->scan, pf->timestamp);
+
+	iio_trigger_notify_done(indio_dev->trig);
+
+	return IRQ_HANDLED;
+}
+
+/**
+ * adc_iio_probe() - Initialize device when a match is found
+ * @pdev: Platform device structure associated with our adc device;
+ *        pdev is automatically created by the driver core based upon our
+ *        adc device tree node.
+ *
+ * Registers an 8-channel IIO device with a triggered buffer. Any IIO
+ * trigger can drive the buffer, e.g. iio-trig-hrtimer or iio-trig-sysfs.
+ *
+ * Return: 0 on success, or a negative error value.
+ */
+static int adc_iio_probe(struct platform_device *pdev)
+{
+	struct iio_dev *indio_dev;
+	struct adc_iio_dev *priv;
+	unsigned long emu_page;
+	int ret;
+
+	indio_dev = devm_iio_device_alloc(&pdev->dev, sizeof(*priv));
+	if (!indio_dev) {
+		pr_err("Failed to allocate memory\n");
+		return -ENOMEM;
+	}
+	priv = iio_priv(indio_dev);
+
+	if (emulate && !platform_get_resource(pdev, IORESOURCE_MEM, 0)) {
+		// Our own emulated device has no memory region; use a RAM page.
+		emu_page = devm_get_free_pages(&pdev->dev,
+		                    GFP_KERNEL | __GFP_ZERO, 0);
+		if (!emu_page) {
+			pr_err("Failed to allocate emulated registers\n");
+			return -ENOMEM;
+		}
+		priv->base_addr = (void __iomem *)emu_page;
+		priv->emulated = true;
+	} else {
+		priv->base_addr = devm_platform_ioremap_resource(pdev, 0);
+		if (IS_ERR(priv->base_addr)) {
+			pr_err("Failed to request/remap platform device resource\n");
+			return PTR_ERR(priv->base_addr);
+		}
+	}
+
+	indio_dev->name = "de10nano_adc";
+	indio_dev->info = &adc_iio_info;
+	indio_dev->modes = INDIO_DIRECT_MODE;
+	indio_dev->channels = adc_iio_channels;
+	indio_dev->num_channels = ARRAY_SIZE(adc_iio_channels);
+
+	ret = devm_iio_triggered_buffer_setup(&pdev->dev, indio_dev,
+	                                      iio_pollfunc_store_time,
+	                                      adc_iio_trigger_handler, NULL);
+	if (ret) {
+		pr_err("Failed to set up triggered buffer\n");
+		return ret;
+	}
+
+	ret = devm_iio_device_register(&pdev->dev, indio_dev);
+	if (ret) {
+		pr_err("Failed to register IIO device\n");
+		return ret;
+	}
+
+	pr_info("adc_iio_probe successful\n");
+
+	return 0;
+}
+
+/*
+ * This driver binds to the same device tree node as de10nano_adc.ko; load
+ * one or the other.
+ */
+static const struct of_device_id adc_iio_of_match[] = {
+	{ .compatible = "adsd,de10nano_adc", },
+	{ }
+};
+MODULE_DEVICE_TABLE(of, adc_iio_of_match);
+
+/**
+ * struct adc_iio_driver - Platform driver struct for the adc IIO driver
+ * @probe: Function that's called when a device is found
+ * @driver.name: Name of the adc IIO driver
+ * @driver.of_match_table: Device tree match table
+ */
+static struct platform_driver adc_iio_driver = {
+	.probe = adc_iio_probe,
+	.driver = {
+		.owner = THIS_MODULE,
+		.name = "adc_iio",
+		.of_match_table = adc_iio_of_match,
+	},
+};
+
+// Emulated platform device, only registered when emulate is set.
+static struct platform_device *adc_iio_emu_pdev;
+
+/**
+ * adc_iio_init() - Register the adc IIO platform driver.
+ *
+ * When the emulate module parameter is set, a RAM-backed adc device is
+ * registered as well so the driver can be tested without the FPGA.
+ *
+ * Return: 0 on success, or a negative error value.
+ */
+static int __init adc_iio_init(void)
+{
+	int ret;
+
+	ret = platform_driver_register(&adc_iio_driver);
+	if (ret) {
+		return ret;
+	}
+
+	if (emulate) {
+		adc_iio_emu_pdev = platform_device_register_simple("adc_iio",
+		                    PLATFORM_DEVID_NONE, NULL, 0);
+		if (IS_ERR(adc_iio_emu_pdev)) {
+			platform_driver_unregister(&adc_iio_driver);
+			return PTR_ERR(adc_iio_emu_pdev);
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * adc_iio_exit() - Remove the emulated device (if any) and the platform driver.
+ */
+static void __exit adc_iio_exit(void)
+{
+	if (adc_iio_emu_pdev) {
+		platform_device_unregister(adc_iio_emu_pdev);
+	}
+	platform_driver_unregister(&adc_iio_driver);
+}
+
+module_init(adc_iio_init);
+module_exit(adc_iio_exit);
+
+MODULE_LICENSE("Dual MIT/GPL");
+MODULE_AUTHOR("Seth Howard");
+MODULE_DESCRIPTION("adc IIO driver");
+MODULE_VERSION("1.0");
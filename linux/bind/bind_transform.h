@@ -0,0 +1,126 @@
+/* SPDX-License-Identifier: GPL-2.0 or MIT */
+/*
+ * Transforms de10nano_bind applies between a source and a sink. They are
+ * plain integer arithmetic with no kernel dependencies besides the 64-bit
+ * division helpers, so the header also builds on the host.
+ */
+#ifndef BIND_TRANSFORM_H
+#define BIND_TRANSFORM_H
+
+#ifdef __KERNEL__
+#include <linux/math64.h>
+#include <linux/types.h>
+#else
+#include <stdint.h>
+
+typedef int32_t s32;
+typedef uint32_t u32;
+typedef int64_t s64;
+typedef uint64_t u64;
+
+static inline s64 div_s64(s64 dividend, s32 divisor)
+{
+	return dividend / divisor;
+}
+
+static inline u64 div_u64(u64 dividend, u32 divisor)
+{
+	return dividend / divisor;
+}
+#endif
+
+// Most points a lookup table can hold
+#define BIND_LUT_MAX 16
+
+// Widest input range; keeps the scaling products within 64 bits
+#define BIND_MAX_SPAN 0x7fffffff
+
+/**
+ * enum bind_transform_type - How the source value is turned into the sink's.
+ * @BIND_LINEAR: Scale [in_min, in_max] onto [out_min, out_max].
+ * @BIND_BAR: Bar graph on @leds LEDs, filling from the most significant LED
+ *            like sw/rotary-encoder/rotary-to-led does.
+ * @BIND_LUT: Interpolate between @lut_len points spread evenly over
+ *            [in_min, in_max].
+ */
+enum bind_transform_type {
+	BIND_LINEAR,
+	BIND_BAR,
+	BIND_LUT,
+};
+
+/**
+ * struct bind_transform - Transform parameters.
+ * @type: One of enum bind_transform_type.
+ * @in_min: Lowest source value; smaller values are clamped to it.
+ * @in_max: Highest source value; larger values are clamped to it. Must be
+ *          greater than @in_min, by at most BIND_MAX_SPAN.
+ * @out_min: BIND_LINEAR output for @in_min.
+ * @out_max: BIND_LINEAR output for @in_max; may be below @out_min to invert.
+ * @leds: BIND_BAR number of LEDs, 1 to 32.
+ * @lut: BIND_LUT outputs.
+ * @lut_len: Number of points in @lut, 2 to BIND_LUT_MAX.
+ */
+struct bind_transform {
+	enum bind_transform_type type;
+	s32 in_min;
+	s32 in_max;
+	u32 out_min;
+	u32 out_max;
+	u32 leds;
+	u32 lut[BIND_LUT_MAX];
+	u32 lut_len;
+};
+
+/**
+ * bind_transform_apply() - Map a source value to a sink value.
+ * @xf: Transform to apply.
+ * @in: Source value.
+ *
+ * Return: The value to write to the sink.
+ */
+static inline u32 bind_transform_apply(const struct bind_transform *xf, s32 in)
+{
+	u32 span = (u32)((s64)xf->in_max - xf->in_min);
+	u32 pos;
+	u32 lit;
+	u64 scaled;
+	u32 i;
+
+	if (in <= xf->in_min) {
+		pos = 0;
+	}
+	else if (in >= xf->in_max) {
+		pos = span;
+	}
+	else {
+		pos = (u32)((s64)in - xf->in_min);
+	}
+
+	switch (xf->type) {
+	case BIND_LINEAR:
+		if (xf->out_max >= xf->out_min) {
+			return xf->out_min + (u32)div_u64((u64)(xf->out_max - xf->out_min)
+				* pos, span);
+		}
+		return xf->out_min - (u32)div_u64((u64)(xf->out_min - xf->out_max)
+			* pos, span);
+	case BIND_BAR:
+		// Split the range into leds equal bins; the first one lights one LED.
+		lit = 1 + (u32)div_u64((u64)pos * xf->leds, span + 1);
+		return (u32)((((u64)1 << lit) - 1) << (xf->leds - lit));
+	case BIND_LUT:
+		// Position between table points with 8 fractional bits
+		scaled = div_u64(((u64)pos * (xf->lut_len - 1)) << 8, span);
+		i = scaled >> 8;
+		if (i >= xf->lut_len - 1) {
+			return xf->lut[xf->lut_len - 1];
+		}
+		return xf->lut[i] + (u32)div_s64(((s64)xf->lut[i + 1] - xf->lut[i])
+			* (s64)(scaled & 0xff), 256);
+	}
+
+	return 0;
+}
+
+#endif /* BIND_TRANSFORM_H */
@@ -0,0 +1,174 @@
+// SPDX-License-Identifier: GPL-2.0 or MIT
+/*
+ * Host test of the de10nano_bind transforms. Build and run it with
+ * `make test`.
+ */
+#include <stdio.h>
+#include <stdint.h>
+
+#include "bind_transform.h"
+
+static int failures;
+
+#define EXPECT(xf, in, want) expect(__LINE__, (xf), (in), (want))
+
+static void expect(int line, const struct bind_transform *xf, s32 in, u32 want)
+{
+	u32 got = bind_transform_apply(xf, in);
+
+	if (got != want) {
+		printf("line %d: in %d: got 0x%x, want 0x%x\n", line, in, got, want);
+		failures++;
+	}
+}
+
+static void test_linear(void)
+{
+	struct bind_transform xf = {
+		.type = BIND_LINEAR, .in_min = 0, .in_max = 100,
+		.out_min = 0, .out_max = 1000,
+	};
+
+	EXPECT(&xf, 0, 0);
+	EXPECT(&xf, 33, 330);
+	EXPECT(&xf, 50, 500);
+	EXPECT(&xf, 100, 1000);
+
+	// Out of range inputs, including negative ones, are clamped.
+	EXPECT(&xf, -5, 0);
+	EXPECT(&xf, INT32_MIN, 0);
+	EXPECT(&xf, 101, 1000);
+	EXPECT(&xf, INT32_MAX, 1000);
+
+	// out_max below out_min inverts.
+	xf.out_min = 1000;
+	xf.out_max = 0;
+	EXPECT(&xf, 0, 1000);
+	EXPECT(&xf, 25, 750);
+	EXPECT(&xf, 100, 0);
+	EXPECT(&xf, -1, 1000);
+	EXPECT(&xf, 101, 0);
+
+	// Negative input range
+	xf.in_min = -100;
+	xf.in_max = 100;
+	xf.out_min = 0;
+	xf.out_max = 200;
+	EXPECT(&xf, -100, 0);
+	EXPECT(&xf, -50, 50);
+	EXPECT(&xf, 0, 100);
+	EXPECT(&xf, 100, 200);
+	EXPECT(&xf, -101, 0);
+
+	// Widest input range onto the whole output range
+	xf.in_min = 0;
+	xf.in_max = BIND_MAX_SPAN;
+	xf.out_min = 0;
+	xf.out_max = UINT32_MAX;
+	EXPECT(&xf, 0, 0);
+	EXPECT(&xf, BIND_MAX_SPAN, UINT32_MAX);
+	EXPECT(&xf, INT32_MIN, 0);
+
+	xf.in_min = INT32_MIN;
+	xf.in_max = INT32_MIN + BIND_MAX_SPAN;
+	EXPECT(&xf, INT32_MIN, 0);
+	EXPECT(&xf, -1, UINT32_MAX);
+	EXPECT(&xf, INT32_MAX, UINT32_MAX);
+}
+
+static void test_bar(void)
+{
+	struct bind_transform xf = {
+		.type = BIND_BAR, .in_min = 0, .in_max = 7, .leds = 8,
+	};
+	u32 want = 0;
+	s32 i;
+
+	// One more LED per step, filling from the most significant one.
+	for (i = 0; i <= 7; i++) {
+		want |= 0x80 >> i;
+		EXPECT(&xf, i, want);
+	}
+	EXPECT(&xf, -3, 0x80);
+	EXPECT(&xf, 100, 0xff);
+
+	// Equal bins: 0-25 light one LED, 76-100 all four.
+	xf.in_max = 100;
+	xf.leds = 4;
+	EXPECT(&xf, 0, 0x8);
+	EXPECT(&xf, 25, 0x8);
+	EXPECT(&xf, 26, 0xc);
+	EXPECT(&xf, 75, 0xe);
+	EXPECT(&xf, 76, 0xf);
+	EXPECT(&xf, 100, 0xf);
+
+	xf.leds = 1;
+	EXPECT(&xf, -100, 0x1);
+	EXPECT(&xf, 100, 0x1);
+
+	xf.in_min = -1000;
+	xf.in_max = 1000;
+	xf.leds = 32;
+	EXPECT(&xf, INT32_MIN, 0x80000000);
+	EXPECT(&xf, 1000, 0xffffffff);
+	EXPECT(&xf, INT32_MAX, 0xffffffff);
+}
+
+static void test_lut(void)
+{
+	struct bind_transform xf = {
+		.type = BIND_LUT, .in_min = 0, .in_max = 100,
+		.lut = { 0, 100, 400 }, .lut_len = 3,
+	};
+	s32 i;
+
+	// End points and the middle point are hit exactly.
+	EXPECT(&xf, 0, 0);
+	EXPECT(&xf, 50, 100);
+	EXPECT(&xf, 100, 400);
+
+	// Interpolation between points
+	EXPECT(&xf, 25, 50);
+	EXPECT(&xf, 75, 250);
+
+	EXPECT(&xf, -10, 0);
+	EXPECT(&xf, INT32_MIN, 0);
+	EXPECT(&xf, 1000, 400);
+
+	// Decreasing table with a negative input range
+	xf.in_min = -50;
+	xf.in_max = 50;
+	xf.lut[0] = 400;
+	xf.lut[1] = 0;
+	xf.lut_len = 2;
+	EXPECT(&xf, -50, 400);
+	EXPECT(&xf, 0, 200);
+	EXPECT(&xf, 50, 0);
+	EXPECT(&xf, 51, 0);
+
+	// Full table: every point is reached at its own input.
+	xf.in_min = 0;
+	xf.in_max = (BIND_LUT_MAX - 1) * 10;
+	xf.lut_len = BIND_LUT_MAX;
+	for (i = 0; i < BIND_LUT_MAX; i++) {
+		xf.lut[i] = 0xffffffff - i;
+	}
+	for (i = 0; i < BIND_LUT_MAX; i++) {
+		EXPECT(&xf, i * 10, 0xffffffff - i);
+	}
+	EXPECT(&xf, INT32_MAX, 0xffffffff - (BIND_LUT_MAX - 1));
+}
+
+int main(void)
+{
+	test_linear();
+	test_bar();
+	test_lut();
+
+	if (failures) {
+		printf("bind_transform: %d failures\n", failures);
+		return 1;
+	}
+	printf("bind_transform: all tests passed\n");
+	return 0;
+}
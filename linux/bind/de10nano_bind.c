@@ -0,0 +1,615 @@
+/* SPDX-License-Identifier: GPL-2.0 or MIT */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/kobject.h>
+#include <linux/sysfs.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/jiffies.h>
+
+#include "de10nano_bind.h"
+#include "bind_transform.h"
+
+// How often a binding polls a source that doesn't notify
+#define BIND_DEFAULT_PERIOD_MS 50
+
+// Longest poll period a binding can be given
+#define BIND_MAX_PERIOD_MS 60000
+
+// Most words a bind command can have: source, sink, "lut", range, table, period
+#define BIND_MAX_ARGS (6 + BIND_LUT_MAX)
+
+/**
+ * struct bind_binding - Connection from a source to a sink.
+ * @node: Entry in bind_bindings
+ * @src_node: Entry in the source's bindings list
+ * @sink_node: Entry in the sink's binding list
+ * @src: Source the value is read from
+ * @sink: Sink the transformed value is written to
+ * @xf: Transform applied to the source value
+ * @period_ms: Poll period, or 0 to update only when the source notifies
+ * @work: Reads the source and updates the sink
+ * @last: Last value written to the sink
+ * @written: @last holds a value
+ */
+struct bind_binding {
+	struct list_head node;
+	struct list_head src_node;
+	struct list_head sink_node;
+	struct de10nano_bind_source *src;
+	struct de10nano_bind_sink *sink;
+	struct bind_transform xf;
+	unsigned int period_ms;
+	struct delayed_work work;
+	u32 last;
+	bool written;
+};
+
+// Serialises every change to the lists below
+static DEFINE_MUTEX(bind_lock);
+// Protects the sources' bindings lists, which notifications walk from IRQs
+static DEFINE_SPINLOCK(bind_notify_lock);
+
+static LIST_HEAD(bind_sources);
+static LIST_HEAD(bind_sinks);
+static LIST_HEAD(bind_bindings);
+
+static struct workqueue_struct *bind_wq;
+static struct kobject *bind_kobj;
+
+static const char * const bind_transform_names[] = {
+	[BIND_LINEAR] = "linear",
+	[BIND_BAR] = "bar",
+	[BIND_LUT] = "lut",
+};
+
+/**
+ * bind_work() - Copy a binding's source to its sink.
+ * @work: The binding's work item.
+ *
+ * The sink is only written when the transformed value changes, so a source
+ * that is polled costs a register read per period and nothing more.
+ */
+static void bind_work(struct work_struct *work)
+{
+	struct bind_binding *b = container_of(to_delayed_work(work),
+		struct bind_binding, work);
+	s32 in;
+	u32 out;
+
+	if (!b->src->read(b->src, &in)) {
+		out = bind_transform_apply(&b->xf, in);
+		if (!b->written || out != b->last) {
+			if (!b->sink->write(b->sink, out)) {
+				b->last = out;
+				b->written = true;
+			}
+		}
+	}
+
+	if (b->period_ms) {
+		queue_delayed_work(bind_wq, &b->work,
+			msecs_to_jiffies(b->period_ms));
+	}
+}
+
+static struct de10nano_bind_source *bind_find_source(const char *name)
+{
+	struct de10nano_bind_source *src;
+
+	list_for_each_entry(src, &bind_sources, node) {
+		if (!strcmp(src->name, name)) {
+			return src;
+		}
+	}
+	return NULL;
+}
+
+static struct de10nano_bind_sink *bind_find_sink(const char *name)
+{
+	struct de10nano_bind_sink *sink;
+
+	list_for_each_entry(sink, &bind_sinks, node) {
+		if (!strcmp(sink->name, name)) {
+			return sink;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * bind_destroy() - Remove a binding and wait for its work to finish.
+ * @b: Binding to remove.
+ *
+ * Called with bind_lock held.
+ */
+static void bind_destroy(struct bind_binding *b)
+{
+	spin_lock_irq(&bind_notify_lock);
+	list_del(&b->src_node);
+	spin_unlock_irq(&bind_notify_lock);
+	list_del(&b->sink_node);
+	list_del(&b->node);
+
+	cancel_delayed_work_sync(&b->work);
+	kfree(b);
+}
+
+/**
+ * de10nano_bind_add_source() - Make a register available to bind from.
+ * @src: Source to register; @src->name and @src->read must be set.
+ *
+ * Return: 0 on success, or -EEXIST if a source with the same name exists.
+ */
+int de10nano_bind_add_source(struct de10nano_bind_source *src)
+{
+	int ret = 0;
+
+	mutex_lock(&bind_lock);
+	if (bind_find_source(src->name)) {
+		ret = -EEXIST;
+	}
+	else {
+		INIT_LIST_HEAD(&src->bindings);
+		list_add_tail(&src->node, &bind_sources);
+	}
+	mutex_unlock(&bind_lock);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(de10nano_bind_add_source);
+
+/**
+ * de10nano_bind_remove_source() - Remove a source and its bindings.
+ * @src: Source to remove.
+ *
+ * Returns once no binding can call @src->read any more.
+ */
+void de10nano_bind_remove_source(struct de10nano_bind_source *src)
+{
+	struct bind_binding *b, *tmp;
+
+	mutex_lock(&bind_lock);
+	list_for_each_entry_safe(b, tmp, &src->bindings, src_node) {
+		bind_destroy(b);
+	}
+	list_del(&src->node);
+	mutex_unlock(&bind_lock);
+}
+EXPORT_SYMBOL_GPL(de10nano_bind_remove_source);
+
+/**
+ * de10nano_bind_source_changed() - Tell the bindings of a source to update.
+ * @src: Source whose value changed.
+ *
+ * Safe to call from any context, including hard IRQ handlers. The sinks are
+ * updated from a workqueue shortly after.
+ */
+void de10nano_bind_source_changed(struct de10nano_bind_source *src)
+{
+	struct bind_binding *b;
+	unsigned long flags;
+
+	spin_lock_irqsave(&bind_notify_lock, flags);
+	list_for_each_entry(b, &src->bindings, src_node) {
+		if (!b->period_ms) {
+			mod_delayed_work(bind_wq, &b->work, 0);
+		}
+	}
+	spin_unlock_irqrestore(&bind_notify_lock, flags);
+}
+EXPORT_SYMBOL_GPL(de10nano_bind_source_changed);
+
+/**
+ * de10nano_bind_add_sink() - Make a register available to bind to.
+ * @sink: Sink to register; @sink->name and @sink->write must be set.
+ *
+ * Return: 0 on success, or -EEXIST if a sink with the same name exists.
+ */
+int de10nano_bind_add_sink(struct de10nano_bind_sink *sink)
+{
+	int ret = 0;
+
+	mutex_lock(&bind_lock);
+	if (bind_find_sink(sink->name)) {
+		ret = -EEXIST;
+	}
+	else {
+		INIT_LIST_HEAD(&sink->binding);
+		list_add_tail(&sink->node, &bind_sinks);
+	}
+	mutex_unlock(&bind_lock);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(de10nano_bind_add_sink);
+
+/**
+ * de10nano_bind_remove_sink() - Remove a sink and its binding.
+ * @sink: Sink to remove.
+ *
+ * Returns once no binding can call @sink->write any more.
+ */
+void de10nano_bind_remove_sink(struct de10nano_bind_sink *sink)
+{
+	struct bind_binding *b, *tmp;
+
+	mutex_lock(&bind_lock);
+	list_for_each_entry_safe(b, tmp, &sink->binding, sink_node) {
+		bind_destroy(b);
+	}
+	list_del(&sink->node);
+	mutex_unlock(&bind_lock);
+}
+EXPORT_SYMBOL_GPL(de10nano_bind_remove_sink);
+
+/**
+ * bind_parse_transform() - Parse the transform part of a bind command.
+ * @xf: Transform to fill in.
+ * @argv: Transform name followed by its parameters.
+ * @argc: Number of words in @argv.
+ *
+ * Return: 0 on success, or -EINVAL if the transform is malformed.
+ */
+static int bind_parse_transform(struct bind_transform *xf, char **argv,
+	int argc)
+{
+	int type;
+	int i;
+
+	if (argc < 3) {
+		return -EINVAL;
+	}
+	type = match_string(bind_transform_names,
+		ARRAY_SIZE(bind_transform_names), argv[0]);
+	if (type < 0) {
+		return -EINVAL;
+	}
+	xf->type = type;
+
+	if (kstrtos32(argv[1], 0, &xf->in_min) ||
+		kstrtos32(argv[2], 0, &xf->in_max)) {
+		return -EINVAL;
+	}
+	if (xf->in_max <= xf->in_min ||
+		(s64)xf->in_max - xf->in_min > BIND_MAX_SPAN) {
+		return -EINVAL;
+	}
+	argv += 3;
+	argc -= 3;
+
+	switch (xf->type) {
+	case BIND_LINEAR:
+		if (argc != 2 || kstrtou32(argv[0], 0, &xf->out_min) ||
+			kstrtou32(argv[1], 0, &xf->out_max)) {
+			return -EINVAL;
+		}
+		break;
+	case BIND_BAR:
+		if (argc != 1 || kstrtou32(argv[0], 0, &xf->leds) ||
+			xf->leds < 1 || xf->leds > 32) {
+			return -EINVAL;
+		}
+		break;
+	case BIND_LUT:
+		if (argc < 2 || argc > BIND_LUT_MAX) {
+			return -EINVAL;
+		}
+		for (i = 0; i < argc; i++) {
+			if (kstrtou32(argv[i], 0, &xf->lut[i])) {
+				return -EINVAL;
+			}
+		}
+		xf->lut_len = argc;
+		break;
+	}
+
+	return 0;
+}
+
+/**
+ * bind_store() - Create a binding.
+ * @kobj: The de10nano_bind kobject.
+ * @attr: The bind attribute.
+ * @buf: "<source> <sink> <transform> <params...> [period=<ms>]"
+ * @count: Length of @buf.
+ *
+ * A sink takes one binding at a time. Without period=, a binding updates
+ * whenever a notifying source changes and polls any other source every
+ * BIND_DEFAULT_PERIOD_MS. The sink is written once straight away.
+ *
+ * Return: @count on success, or a negative error value.
+ */
+static ssize_t bind_store(struct kobject *kobj, struct kobj_attribute *attr,
+	const char *buf, size_t count)
+{
+	char *argv[BIND_MAX_ARGS];
+	struct de10nano_bind_source *src;
+	struct de10nano_bind_sink *sink;
+	struct bind_binding *b;
+	unsigned int period_ms = 0;
+	char *copy, *cur, *tok;
+	int argc = 0;
+	int ret;
+
+	b = kzalloc(sizeof(*b), GFP_KERNEL);
+	copy = kstrndup(buf, count, GFP_KERNEL);
+	if (!b || !copy) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	cur = copy;
+	while ((tok = strsep(&cur, " \t\n"))) {
+		if (!*tok) {
+			continue;
+		}
+		if (argc == BIND_MAX_ARGS) {
+			ret = -E2BIG;
+			goto out;
+		}
+		argv[argc++] = tok;
+	}
+
+	if (argc && !strncmp(argv[argc - 1], "period=", 7)) {
+		ret = kstrtouint(argv[argc - 1] + 7, 0, &period_ms);
+		if (ret) {
+			goto out;
+		}
+		if (period_ms < 1 || period_ms > BIND_MAX_PERIOD_MS) {
+			ret = -EINVAL;
+			goto out;
+		}
+		argc--;
+	}
+
+	if (argc < 2) {
+		ret = -EINVAL;
+		goto out;
+	}
+	ret = bind_parse_transform(&b->xf, argv + 2, argc - 2);
+	if (ret) {
+		goto out;
+	}
+
+	mutex_lock(&bind_lock);
+
+	src = bind_find_source(argv[0]);
+	sink = bind_find_sink(argv[1]);
+	if (!src || !sink) {
+		ret = -ENODEV;
+		goto out_unlock;
+	}
+	if (!list_empty(&sink->binding)) {
+		ret = -EBUSY;
+		goto out_unlock;
+	}
+
+	if (!period_ms && !src->notifies) {
+		period_ms = BIND_DEFAULT_PERIOD_MS;
+	}
+	b->src = src;
+	b->sink = sink;
+	b->period_ms = period_ms;
+	INIT_DELAYED_WORK(&b->work, bind_work);
+
+	list_add_tail(&b->node, &bind_bindings);
+	list_add_tail(&b->sink_node, &sink->binding);
+	spin_lock_irq(&bind_notify_lock);
+	list_add_tail(&b->src_node, &src->bindings);
+	spin_unlock_irq(&bind_notify_lock);
+
+	queue_delayed_work(bind_wq, &b->work, 0);
+	b = NULL;
+	ret = count;
+
+out_unlock:
+	mutex_unlock(&bind_lock);
+out:
+	kfree(copy);
+	kfree(b);
+	return ret;
+}
+
+/**
+ * unbind_store() - Remove the binding of a sink.
+ * @kobj: The de10nano_bind kobject.
+ * @attr: The unbind attribute.
+ * @buf: Name of the sink.
+ * @count: Length of @buf.
+ *
+ * The sink keeps the last value the binding wrote.
+ *
+ * Return: @count on success, or a negative error value.
+ */
+static ssize_t unbind_store(struct kobject *kobj, struct kobj_attribute *attr,
+	const char *buf, size_t count)
+{
+	struct de10nano_bind_sink *sink;
+	struct bind_binding *b, *tmp;
+	char *name;
+	int ret = count;
+
+	name = kstrndup(buf, count, GFP_KERNEL);
+	if (!name) {
+		return -ENOMEM;
+	}
+
+	mutex_lock(&bind_lock);
+	sink = bind_find_sink(strim(name));
+	if (!sink || list_empty(&sink->binding)) {
+		ret = -ENOENT;
+	}
+	else {
+		list_for_each_entry_safe(b, tmp, &sink->binding, sink_node) {
+			bind_destroy(b);
+		}
+	}
+	mutex_unlock(&bind_lock);
+
+	kfree(name);
+	return ret;
+}
+
+/**
+ * sources_show() - List the registered sources, one per line.
+ * @kobj: The de10nano_bind kobject.
+ * @attr: The sources attribute.
+ * @buf: Buffer to write the list to.
+ *
+ * Sources that notify their changes are marked with " notify".
+ *
+ * Return: Number of bytes written to @buf.
+ */
+static ssize_t sources_show(struct kobject *kobj, struct kobj_attribute *attr,
+	char *buf)
+{
+	struct de10nano_bind_source *src;
+	int len = 0;
+
+	mutex_lock(&bind_lock);
+	list_for_each_entry(src, &bind_sources, node) {
+		len += sysfs_emit_at(buf, len, "%s%s\n", src->name,
+			src->notifies ? " notify" : "");
+	}
+	mutex_unlock(&bind_lock);
+
+	return len;
+}
+
+/**
+ * sinks_show() - List the registered sinks, one per line.
+ * @kobj: The de10nano_bind kobject.
+ * @attr: The sinks attribute.
+ * @buf: Buffer to write the list to.
+ *
+ * Return: Number of bytes written to @buf.
+ */
+static ssize_t sinks_show(struct kobject *kobj, struct kobj_attribute *attr,
+	char *buf)
+{
+	struct de10nano_bind_sink *sink;
+	int len = 0;
+
+	mutex_lock(&bind_lock);
+	list_for_each_entry(sink, &bind_sinks, node) {
+		len += sysfs_emit_at(buf, len, "%s\n", sink->name);
+	}
+	mutex_unlock(&bind_lock);
+
+	return len;
+}
+
+/**
+ * bindings_show() - List the bindings, one per line.
+ * @kobj: The de10nano_bind kobject.
+ * @attr: The bindings attribute.
+ * @buf: Buffer to write the list to.
+ *
+ * Each line has the same format as a bind command, with period= giving the
+ * poll period of polled bindings.
+ *
+ * Return: Number of bytes written to @buf.
+ */
+static ssize_t bindings_show(struct kobject *kobj, struct kobj_attribute *attr,
+	char *buf)
+{
+	struct bind_binding *b;
+	int len = 0;
+	u32 i;
+
+	mutex_lock(&bind_lock);
+	list_for_each_entry(b, &bind_bindings, node) {
+		len += sysfs_emit_at(buf, len, "%s %s %s %d %d", b->src->name,
+			b->sink->name, bind_transform_names[b->xf.type],
+			b->xf.in_min, b->xf.in_max);
+		switch (b->xf.type) {
+		case BIND_LINEAR:
+			len += sysfs_emit_at(buf, len, " %u %u", b->xf.out_min,
+				b->xf.out_max);
+			break;
+		case BIND_BAR:
+			len += sysfs_emit_at(buf, len, " %u", b->xf.leds);
+			break;
+		case BIND_LUT:
+			for (i = 0; i < b->xf.lut_len; i++) {
+				len += sysfs_emit_at(buf, len, " %u", b->xf.lut[i]);
+			}
+			break;
+		}
+		if (b->period_ms) {
+			len += sysfs_emit_at(buf, len, " period=%u", b->period_ms);
+		}
+		len += sysfs_emit_at(buf, len, "\n");
+	}
+	mutex_unlock(&bind_lock);
+
+	return len;
+}
+
+static struct kobj_attribute bind_attr = __ATTR_WO(bind);
+static struct kobj_attribute unbind_attr = __ATTR_WO(unbind);
+static struct kobj_attribute sources_attr = __ATTR_RO(sources);
+static struct kobj_attribute sinks_attr = __ATTR_RO(sinks);
+static struct kobj_attribute bindings_attr = __ATTR_RO(bindings);
+
+static struct attribute *bind_attrs[] = {
+	&bind_attr.attr,
+	&unbind_attr.attr,
+	&sources_attr.attr,
+	&sinks_attr.attr,
+	&bindings_attr.attr,
+	NULL,
+};
+
+static const struct attribute_group bind_group = {
+	.attrs = bind_attrs,
+};
+
+static int __init de10nano_bind_init(void)
+{
+	int ret;
+
+	bind_wq = alloc_workqueue("de10nano_bind", 0, 0);
+	if (!bind_wq) {
+		return -ENOMEM;
+	}
+
+	// Creates /sys/kernel/de10nano_bind
+	bind_kobj = kobject_create_and_add("de10nano_bind", kernel_kobj);
+	if (!bind_kobj) {
+		destroy_workqueue(bind_wq);
+		return -ENOMEM;
+	}
+
+	ret = sysfs_create_group(bind_kobj, &bind_group);
+	if (ret) {
+		kobject_put(bind_kobj);
+		destroy_workqueue(bind_wq);
+		return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * The drivers that register endpoints depend on this module, so by the time
+ * it is unloaded they have removed their endpoints and every binding with
+ * them.
+ */
+static void __exit de10nano_bind_exit(void)
+{
+	kobject_put(bind_kobj);
+	destroy_workqueue(bind_wq);
+}
+
+module_init(de10nano_bind_init);
+module_exit(de10nano_bind_exit);
+
+MODULE_LICENSE("Dual MIT/GPL");
+MODULE_AUTHOR("Seth Howard");
+MODULE_DESCRIPTION("source-to-sink binding driver");
@@ -6,44 +6,533 @@
 #include <linux/miscdevice.h>               // miscdevice definitions
 #include <linux/types.h>                    // data types
 #include <linux/fs.h>                       // copy_to_user
+#include <linux/uio.h>                      // iov_iter, copy_to_iter/copy_from_iter
 #include <linux/kstrtox.h>                  // kstrtou32
+#include <linux/hrtimer.h>                  // hrtimer for the note queue
+#include <linux/ktime.h>                    // us_to_ktime
+#include <linux/kfifo.h>                    // kfifo for the note queue
+#include <linux/math64.h>                   // div_u64_rem
+#include <linux/poll.h>                     // poll_wait, EPOLL* flags
+#include <linux/spinlock.h>                 // spinlock definitions
+#include <linux/wait.h>                     // wait queues
+#include <linux/string.h>                   // memset
+#include <linux/uaccess.h>                  // copy_from_user
+#include <linux/bitops.h>                   // for_each_set_bit
+#include <linux/interrupt.h>                // request_irq, irqreturn_t
+
+#include "de10nano_xfer.h"                 // DE10NANO_IOC_REG_XFER
+#include "de10nano_mmap.h"                 // de10nano_mmap_regs
+#include "de10nano_regcache.h"             // de10nano_regcache_*
+#include "de10nano_buzzer.h"               // struct de10nano_buzzer_note
+#include "de10nano_bind.h"                 // struct de10nano_bind_sink
+#include "buzzer_parse.h"                  // buzzer_parse_mhz
 
 #define VOLUME_OFFSET   0x00            // 0 byte offset for the volume register
 #define PITCH_OFFSET    0x04            // 4 byte offset for the base pitch register
-#define SPAN 16                         // Span of the components memory space
+#define CONTROL_OFFSET  0x08            // 8 byte offset for the control register
+#define FTW_OFFSET      0x0C            // 12 byte offset for the DDS tuning word
+#define PERIOD_COUNT_OFFSET 0x10        // 16 byte offset for the period length in clock cycles
+#define DUTY_COUNT_OFFSET   0x14        // 20 byte offset for the high time in clock cycles
+#define ATTACK_OFFSET   0x18            // Envelope attack time in microseconds
+#define DECAY_OFFSET    0x1C            // Envelope decay time in microseconds
+#define SUSTAIN_OFFSET  0x20            // Envelope sustain level
+#define RELEASE_OFFSET  0x24            // Envelope release time in microseconds
+#define LFO_FTW_OFFSET  0x28            // LFO tuning word
+#define LFO_DUTY_DEPTH_OFFSET  0x2C     // LFO tremolo depth
+#define LFO_PITCH_DEPTH_OFFSET 0x30     // LFO vibrato depth
+#define ENV_STATUS_OFFSET      0x34     // Envelope state and level (read-only)
+#define VOICE_INFO_OFFSET      0x3C     // Number of voices (read-only)
+#define VOICE_FTW_OFFSET(v)    (0x40 + 8 * (v))    // Mixer voice tuning words, voices 1 and up
+#define VOICE_VOLUME_OFFSET(v) (0x44 + 8 * (v))    // Mixer voice levels
+#define PCM_DATA_OFFSET        0x80     // Pushes a word of two samples into the PCM FIFO
+#define PCM_PERIOD_OFFSET      0x84     // Clock cycles per PCM sample
+#define PCM_LEVEL_OFFSET       0x88     // Words in the PCM FIFO; writing empties it
+#define PCM_DEPTH_OFFSET       0x8C     // Size of the PCM FIFO in words (read-only)
+#define PCM_UNDERRUNS_OFFSET   0x90     // Samples played from an empty FIFO; writing clears it
+#define PCM_IRQ_OFFSET         0x94     // Half-empty interrupt enable and status
+#define SPAN 256                        // Span of the components memory space
+
+#define CONTROL_COMMIT          BIT(0)  // Latch the shadow registers at the period's end
+#define CONTROL_DOUBLE_BUFFER   BIT(1)  // Register writes only reach the PWM on a commit
+#define CONTROL_DDS             BIT(2)  // Play the DDS tuning word instead of the PWM period
+#define CONTROL_ENVELOPE        BIT(3)  // Shape the volume with the envelope
+#define CONTROL_GATE            BIT(4)  // Envelope gate; rising starts the attack
+#define CONTROL_MIX             BIT(5)  // Sigma-delta mix of every voice on the output
+#define CONTROL_PCM             BIT(6)  // Play the PCM FIFO instead of the tones
+
+#define ENV_STATUS_STATE_MASK   0x7     // 0 idle, 1 attack, 2 decay, 3 sustain, 4 release
+#define ENV_STATUS_LEVEL_SHIFT  16      // Top 16 bits of the envelope level
+
+#define PCM_IRQ_ENABLE          BIT(0)  // Interrupt while the FIFO is at most half full
+#define PCM_LEVEL_MASK          0xffff
+#define PCM_MIN_DEPTH           4       // Smallest FIFO the driver can stream through
+#define PCM_EMU_DEPTH           1024    // FIFO size the emulated device simulates
+#define PCM_RING_WORDS          8192    // Words in the kernel ring in front of the FIFO
+
+/**
+* struct buzzer_note - A queued note, converted to register values.
+* @ftw: Tuning word register value, or 0 for a rest
+* @volume: Volume register value
+* @duration_us: How long the note plays
+*/
+struct buzzer_note {
+    u32 ftw;
+    u32 volume;
+    u32 duration_us;
+};
+
+struct buzzer_dev;
+
+/**
+* struct buzzer_bind_sink - de10nano_bind sink for one buzzer register.
+* @sink: The sink, named "buzzer_volume" or "buzzer_pitch"
+* @priv: The register's device
+* @offset: Offset of the register
+*/
+struct buzzer_bind_sink {
+    struct de10nano_bind_sink sink;
+    struct buzzer_dev *priv;
+    unsigned int offset;
+};
+
 /**
 * struct buzzer_dev - Private buzzer controller device struct.
-* @volume: Address of the volume register
-* @pitch: Address of the pitch register
+* @base_addr: Pointer to the component's base address
+* @phys_addr: Physical address of the component's registers
+* @emulated: The registers are backed by RAM instead of the FPGA
+* @cache: Register cache; every register is host-owned, so reads come from
+* RAM and writes of unchanged values never reach the bridge
 * @miscdev: miscdevice used to create a character device
 * @lock: mutex used to prevent concurrent writes to memory
+* @queue_miscdev: miscdevice for /dev/buzzer_queue
+* @queue_write_lock: Serialises writers of the note queue
+* @queue_lock: Protects @queue_playing against the note timer
+* @queue_wait: Woken when the note timer frees space in the queue
+* @note_timer: hrtimer that starts each queued note
+* @notes: Queued notes; written by one writer at a time, read by the timer
+* @queue_playing: The note timer is running
+* @bind_volume: de10nano_bind sink for the volume register
+* @bind_pitch: de10nano_bind sink for the tuning word register
+* @control_lock: Serialises the control register. Every change to
+* @double_buffer, @dds, @envelope, @gate, @mix and @pcm, and every write of
+* the register built from them, happens under it, whether from a syscall,
+* the note timer or the PCM refill
+* @double_buffer: Register writes are held in the shadow registers until
+* the driver commits them
+* @dds: The buzzer plays the DDS tuning word instead of the PWM period. Set
+* by a tuning word write (frequency_hz, a note, voice 0 or the pitch bind
+* sink) and cleared by a pitch write
+* @envelope: The envelope shapes the volume
+* @gate: The envelope's gate is on
+* @num_voices: Number of voices the component has, including the main tone
+* @mix: Every voice is mixed into the output
+* @irq: The component's half-empty interrupt, or a negative value if it has
+* none and the PCM timer polls the FIFO instead
+* @pcm_miscdev: miscdevice for /dev/buzzer_pcm
+* @pcm_write_lock: Serialises writers of the PCM ring
+* @pcm_lock: Protects the PCM playback state against the IRQ and timer
+* @pcm_wait: Woken when a refill frees space in the PCM ring
+* @pcm_timer: hrtimer that refills the FIFO when there is no IRQ, and
+* waits for the FIFO to play out after the last writer closes
+* @pcm_ring: Words waiting for room in the FIFO; written by one writer at a
+* time, read by the refill
+* @pcm_depth: Size of the FIFO in words
+* @pcm_rate: Sample rate in Hz
+* @pcm_writers: Open files of /dev/buzzer_pcm
+* @pcm: PCM playback is on
+* @pcm_irq_armed: The half-empty interrupt is enabled
+* @pcm_written: Samples written to /dev/buzzer_pcm
+* @pcm_pushed: Samples moved from the ring into the FIFO
+* @pcm_refills: Number of refills
+* @pcm_emu_level: Words in the emulated device's simulated FIFO
+* @pcm_emu_stamp: When the simulated FIFO last played a word
+* @pcm_emu_underruns: Underruns of the simulated FIFO
 *
 * An buzzer_led struct gets created for each buzzer controller component.
 */
 struct buzzer_dev {
     void __iomem *base_addr;
-    void __iomem *volume;
-    void __iomem *pitch;
+    phys_addr_t phys_addr;
+    bool emulated;
+    struct de10nano_regcache cache;
     struct miscdevice miscdev;
     struct mutex lock;
+    struct miscdevice queue_miscdev;
+    struct mutex queue_write_lock;
+    spinlock_t queue_lock;
+    wait_queue_head_t queue_wait;
+    struct hrtimer note_timer;
+    DECLARE_KFIFO(notes, struct buzzer_note, DE10NANO_BUZZER_QUEUE_LEN);
+    bool queue_playing;
+    struct buzzer_bind_sink bind_volume;
+    struct buzzer_bind_sink bind_pitch;
+    spinlock_t control_lock;
+    bool double_buffer;
+    bool dds;
+    bool envelope;
+    bool gate;
+    unsigned int num_voices;
+    bool mix;
+    int irq;
+    struct miscdevice pcm_miscdev;
+    struct mutex pcm_write_lock;
+    spinlock_t pcm_lock;
+    wait_queue_head_t pcm_wait;
+    struct hrtimer pcm_timer;
+    DECLARE_KFIFO_PTR(pcm_ring, u32);
+    unsigned int pcm_depth;
+    u32 pcm_rate;
+    unsigned int pcm_writers;
+    bool pcm;
+    bool pcm_irq_armed;
+    u64 pcm_written;
+    u64 pcm_pushed;
+    u64 pcm_refills;
+    unsigned int pcm_emu_level;
+    ktime_t pcm_emu_stamp;
+    u32 pcm_emu_underruns;
 };
 
+/*
+* When emulate is set, the module registers its own platform device whose
+* registers are backed by a page of ordinary RAM instead of the FPGA. This
+* lets the driver be loaded and exercised on a stock x86 kernel.
+*/
+static bool emulate;
+module_param(emulate, bool, 0444);
+MODULE_PARM_DESC(emulate, "Back the registers with RAM instead of the FPGA");
+
 /**
-* buzzer_read() - Read method for the buzzer char device
-* @file: Pointer to the char device file struct.
-* @buf: User-space buffer to read the value into.
-* @count: The number of bytes being requested.
-* @offset: The byte offset in the file being read from.
+* buzzer_volatile_reg() - Tell the register cache which registers the
+* hardware changes.
+* @dev: Unused.
+* @reg: Register offset.
 *
-* Return: On success, the number of bytes written is returned and the
-* offset @offset is advanced by this number. On error, a negative error
+* Return: true for the control register, whose commit bit clears itself,
+* the PWM count, envelope status and voice info registers, and every PCM
+* register but the sample period.
+*/
+static bool buzzer_volatile_reg(struct device *dev, unsigned int reg)
+{
+    return reg == CONTROL_OFFSET || reg == PERIOD_COUNT_OFFSET ||
+           reg == DUTY_COUNT_OFFSET || reg == ENV_STATUS_OFFSET ||
+           reg == VOICE_INFO_OFFSET ||
+           (reg >= PCM_DATA_OFFSET && reg <= PCM_IRQ_OFFSET &&
+            reg != PCM_PERIOD_OFFSET);
+}
+
+/**
+* buzzer_control_write_locked() - Write the control register from the
+* driver's state.
+* @priv: Private buzzer device struct.
+* @commit: Also commit the shadow registers.
+*
+* The caller must hold priv->control_lock.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int buzzer_control_write_locked(struct buzzer_dev *priv, bool commit)
+{
+    u32 control = 0;
+
+    if (READ_ONCE(priv->dds)) {
+        control |= CONTROL_DDS;
+    }
+    if (READ_ONCE(priv->envelope)) {
+        control |= CONTROL_ENVELOPE;
+    }
+    if (READ_ONCE(priv->gate)) {
+        control |= CONTROL_GATE;
+    }
+    if (READ_ONCE(priv->mix)) {
+        control |= CONTROL_MIX;
+    }
+    if (READ_ONCE(priv->pcm)) {
+        control |= CONTROL_PCM;
+    }
+
+    if (READ_ONCE(priv->double_buffer)) {
+        control |= CONTROL_DOUBLE_BUFFER;
+        if (commit) {
+            control |= CONTROL_COMMIT;
+        }
+    }
+
+    return regmap_write(priv->cache.map, CONTROL_OFFSET, control);
+}
+
+/**
+* buzzer_control_write() - Write the control register from the driver's state.
+* @priv: Private buzzer device struct.
+* @commit: Also commit the shadow registers.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int buzzer_control_write(struct buzzer_dev *priv, bool commit)
+{
+    unsigned long flags;
+    int ret;
+
+    spin_lock_irqsave(&priv->control_lock, flags);
+    ret = buzzer_control_write_locked(priv, commit);
+    spin_unlock_irqrestore(&priv->control_lock, flags);
+
+    return ret;
+}
+
+/**
+* buzzer_control_set() - Change one control flag and write the control
+* register.
+* @priv: Private buzzer device struct.
+* @flag: The flag; one of the control state fields of struct buzzer_dev.
+* @val: The flag's new value.
+* @commit: Also commit the shadow registers.
+*
+* The change and the write happen under priv->control_lock, so a concurrent
+* writer can't put back the old value of the flag.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int buzzer_control_set(struct buzzer_dev *priv, bool *flag, bool val,
+    bool commit)
+{
+    unsigned long flags;
+    int ret;
+
+    spin_lock_irqsave(&priv->control_lock, flags);
+    WRITE_ONCE(*flag, val);
+    ret = buzzer_control_write_locked(priv, commit);
+    spin_unlock_irqrestore(&priv->control_lock, flags);
+
+    return ret;
+}
+
+/**
+* buzzer_control_store() - Apply a control register value from user space.
+* @priv: Private buzzer device struct.
+* @val: The value user space wrote.
+*
+* The double buffer, DDS, envelope, gate and mix bits become the driver's
+* flags, and the register is written from them with the commit bit as
+* given, all under priv->control_lock, so the next commit, gate change or
+* note keeps what user space wrote. The PCM bit belongs to /dev/buzzer_pcm
+* and has to match whether PCM playback is on.
+*
+* Return: 0 on success, -EPERM if the PCM bit doesn't match, or another
+* negative error value.
+*/
+static int buzzer_control_store(struct buzzer_dev *priv, u32 val)
+{
+    unsigned long flags;
+    int ret = -EPERM;
+
+    spin_lock_irqsave(&priv->control_lock, flags);
+    if (!!(val & CONTROL_PCM) == priv->pcm) {
+        WRITE_ONCE(priv->double_buffer, val & CONTROL_DOUBLE_BUFFER);
+        WRITE_ONCE(priv->dds, val & CONTROL_DDS);
+        WRITE_ONCE(priv->envelope, val & CONTROL_ENVELOPE);
+        WRITE_ONCE(priv->gate, val & CONTROL_GATE);
+        WRITE_ONCE(priv->mix, val & CONTROL_MIX);
+        ret = buzzer_control_write_locked(priv, val & CONTROL_COMMIT);
+    }
+    spin_unlock_irqrestore(&priv->control_lock, flags);
+
+    return ret;
+}
+
+/**
+* buzzer_user_write() - Write a register for /dev/buzzer or
+* DE10NANO_IOC_REG_XFER.
+* @cache: The buzzer's register cache.
+* @reg: Register offset.
+* @val: Value to write.
+*
+* Control register writes go through buzzer_control_store(); the other
+* registers are written through the cache.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int buzzer_user_write(struct de10nano_regcache *cache, unsigned int reg,
+    unsigned int val)
+{
+    struct buzzer_dev *priv = container_of(cache, struct buzzer_dev, cache);
+
+    if (reg == CONTROL_OFFSET) {
+        return buzzer_control_store(priv, val);
+    }
+
+    return de10nano_regcache_write(cache, reg, val);
+}
+
+/**
+* buzzer_commit() - Commit the shadow registers, if double buffering is on.
+* @priv: Private buzzer device struct.
+*
+* Volume and pitch move to the PWM together at the end of the current PWM
+* period, so a note change can't click. Without double buffering the writes
+* have already reached the PWM and there is nothing to do.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int buzzer_commit(struct buzzer_dev *priv)
+{
+    unsigned long flags;
+    int ret = 0;
+
+    spin_lock_irqsave(&priv->control_lock, flags);
+    if (priv->double_buffer) {
+        ret = buzzer_control_write_locked(priv, true);
+    }
+    spin_unlock_irqrestore(&priv->control_lock, flags);
+
+    return ret;
+}
+
+/**
+* buzzer_gate() - Turn the envelope's gate on or off.
+* @priv: Private buzzer device struct.
+* @gate: true to start the attack, false to start the release.
+*
+* Turning the gate on while it is already on retriggers the attack from the
+* current level. The write also commits the shadow registers. The whole
+* sequence runs under priv->control_lock, so the note timer and a syscall
+* can't interleave their gate changes.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int buzzer_gate(struct buzzer_dev *priv, bool gate)
+{
+    unsigned long flags;
+    int ret = 0;
+
+    spin_lock_irqsave(&priv->control_lock, flags);
+    if (gate && priv->gate) {
+        WRITE_ONCE(priv->gate, false);
+        ret = buzzer_control_write_locked(priv, false);
+    }
+    if (!ret) {
+        WRITE_ONCE(priv->gate, gate);
+        ret = buzzer_control_write_locked(priv, true);
+    }
+    spin_unlock_irqrestore(&priv->control_lock, flags);
+
+    return ret;
+}
+
+/**
+* buzzer_voice_write() - Write one voice's tuning word and volume.
+* @priv: Private buzzer device struct.
+* @voice: Voice number; 0 is the main tone.
+* @settings: Frequency and volume.
+*
+* The caller must hold priv->lock and commit the write.
+*
+* Return: 0 on success, -EINVAL if a setting is out of range, or another
+* negative error value.
+*/
+static int buzzer_voice_write(struct buzzer_dev *priv, unsigned int voice,
+    const struct de10nano_buzzer_voice *settings)
+{
+    int ret;
+    u32 ftw;
+
+    if (voice >= priv->num_voices ||
+        settings->freq_mhz > DE10NANO_BUZZER_MAX_FREQ_HZ * 1000 ||
+        settings->volume > DE10NANO_BUZZER_MAX_VOLUME) {
+        return -EINVAL;
+    }
+
+    ftw = de10nano_buzzer_mhz_to_ftw(settings->freq_mhz);
+    if (voice == 0) {
+        ret = de10nano_regcache_write(&priv->cache, FTW_OFFSET, ftw);
+        if (!ret) {
+            ret = de10nano_regcache_write(&priv->cache, VOLUME_OFFSET,
+                                          settings->volume);
+        }
+        return ret;
+    }
+
+    ret = de10nano_regcache_write(&priv->cache, VOICE_FTW_OFFSET(voice), ftw);
+    if (!ret) {
+        ret = de10nano_regcache_write(&priv->cache, VOICE_VOLUME_OFFSET(voice),
+                                      settings->volume);
+    }
+    return ret;
+}
+
+/**
+* buzzer_voices_set() - Update several voices with one commit.
+* @priv: Private buzzer device struct.
+* @voices: The voices to update and their settings; see
+* struct de10nano_buzzer_voices.
+*
+* Every setting is checked before any register is written. The mix flag is
+* applied together with the commit, so with double buffering on the new
+* voices and the mix start at the end of the same tone cycle.
+*
+* The caller must hold priv->lock.
+*
+* Return: 0 on success, -EINVAL if a setting is out of range, or another
+* negative error value.
+*/
+static int buzzer_voices_set(struct buzzer_dev *priv,
+    const struct de10nano_buzzer_voices *voices)
+{
+    unsigned long mask = voices->mask;
+    unsigned int voice;
+    int ret;
+
+    if ((voices->flags & ~DE10NANO_BUZZER_VOICES_MIX) ||
+        (mask & ~GENMASK(priv->num_voices - 1, 0))) {
+        return -EINVAL;
+    }
+    for_each_set_bit(voice, &mask, DE10NANO_BUZZER_MAX_VOICES) {
+        if (voices->voice[voice].freq_mhz > DE10NANO_BUZZER_MAX_FREQ_HZ * 1000 ||
+            voices->voice[voice].volume > DE10NANO_BUZZER_MAX_VOLUME) {
+            return -EINVAL;
+        }
+    }
+
+    for_each_set_bit(voice, &mask, DE10NANO_BUZZER_MAX_VOICES) {
+        ret = buzzer_voice_write(priv, voice, &voices->voice[voice]);
+        if (ret) {
+            return ret;
+        }
+    }
+    // The main tone's tuning word is only heard from the DDS tone generator.
+    if (mask & BIT(0)) {
+        ret = buzzer_control_set(priv, &priv->dds, true, false);
+        if (ret) {
+            return ret;
+        }
+    }
+
+    return buzzer_control_set(priv, &priv->mix,
+                              voices->flags & DE10NANO_BUZZER_VOICES_MIX, true);
+}
+
+/**
+* buzzer_read_iter() - Read method for the buzzer char device
+* @iocb: I/O control block; holds the file struct and the byte offset
+* being read from.
+* @to: User-space buffer(s) to read the register values into.
+*
+* As many whole registers as fit in @to are read, up to the end of the
+* component's span, so read(), readv() and preadv() can fetch the whole
+* register bank with one syscall and one lock acquisition.
+*
+* Return: On success, the number of bytes read is returned and the
+* offset is advanced by this number. On error, a negative error
 * value is returned.
 */
-static ssize_t buzzer_read(struct file *file, char __user *buf,
-    size_t count, loff_t *offset)
+static ssize_t buzzer_read_iter(struct kiocb *iocb, struct iov_iter *to)
 {
-    size_t ret;
-    u32 val;
+    u32 vals[SPAN / sizeof(u32)];
+    loff_t pos = iocb->ki_pos;
+    size_t count;
+    size_t copied;
+    size_t i;
+    int ret = 0;
 
     /*
     * Get the device's private data from the file struct's private_data
@@ -51,90 +540,262 @@ static ssize_t buzzer_read(struct file *file, char __user *buf,
     * buzzer_dev struct. container_of returns the
     * buzzer_dev struct that contains the miscdev in private_data.
     */
-    struct buzzer_dev *priv = container_of(file->private_data,
+    struct buzzer_dev *priv = container_of(iocb->ki_filp->private_data,
                                 struct buzzer_dev, miscdev);
 
     // Check file offset to make sure we are reading from a valid location.
-    if (*offset < 0) {
+    if (pos < 0) {
         // We can't read from a negative file position.
         return -EINVAL;
     }
-    if (*offset >= SPAN) {
+    if (pos >= SPAN) {
         // We can't read from a position past the end of our device.
         return 0;
     }
-    if ((*offset % 0x4) != 0) {
+    if ((pos % 0x4) != 0) {
         // Prevent unaligned access.
         pr_warn("buzzer_read: unaligned access\n");
         return -EFAULT;
     }
 
-    val = ioread32(priv->base_addr + *offset);
+    // Only move whole registers, and never past the end of our device.
+    count = min_t(size_t, iov_iter_count(to), SPAN - pos);
+    count = round_down(count, sizeof(u32));
+    if (count == 0) {
+        return -EINVAL;
+    }
+
+    mutex_lock(&priv->lock);
+    for (i = 0; i < count / sizeof(u32) && !ret; i++) {
+        ret = de10nano_regcache_read(&priv->cache, pos + i * sizeof(u32),
+                                     &vals[i]);
+    }
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
 
-    // Copy the value to userspace.
-    ret = copy_to_user(buf, &val, sizeof(val));
-    if (ret == sizeof(val)) {
+    // Copy the values to userspace.
+    copied = round_down(copy_to_iter(vals, count, to), sizeof(u32));
+    if (copied == 0) {
         pr_warn("buzzer_read: nothing copied\n");
         return -EFAULT;
     }
 
     // Increment the file offset by the number of bytes we read.
-    *offset = *offset + sizeof(val);
+    iocb->ki_pos = pos + copied;
 
-    return sizeof(val);
+    return copied;
 }
 
 /**
-* buzzer_write() - Write method for the buzzer char device
-* @file: Pointer to the char device file struct.
-* @buf: User-space buffer to read the value from.
-* @count: The number of bytes being written.
-* @offset: The byte offset in the file being written to.
+* buzzer_write_iter() - Write method for the buzzer char device
+* @iocb: I/O control block; holds the file struct and the byte offset
+* being written to.
+* @from: User-space buffer(s) to read the register values from.
+*
+* As many whole registers as @from holds are written, up to the end of the
+* component's span, so write(), writev() and pwritev() can update the whole
+* register bank with one syscall and one lock acquisition. With double
+* buffering on, the registers are committed together afterwards, unless the
+* write covers the control register and so does its own committing.
 *
 * Return: On success, the number of bytes written is returned and the
-* offset @offset is advanced by this number. On error, a negative error
+* offset is advanced by this number. On error, a negative error
 * value is returned.
 */
-static ssize_t buzzer_write(struct file *file, const char __user *buf,
-    size_t count, loff_t *offset)
+static ssize_t buzzer_write_iter(struct kiocb *iocb, struct iov_iter *from)
 {
-    size_t ret;
-    u32 val;
+    u32 vals[SPAN / sizeof(u32)];
+    loff_t pos = iocb->ki_pos;
+    size_t count;
+    size_t copied;
+    size_t i;
+    int ret = 0;
 
-    struct buzzer_dev *priv = container_of(file->private_data,
+    struct buzzer_dev *priv = container_of(iocb->ki_filp->private_data,
                                 struct buzzer_dev, miscdev);
 
-    if (*offset < 0) {
+    if (pos < 0) {
         return -EINVAL;
     }
-    if (*offset >= SPAN) {
+    if (pos >= SPAN) {
         return 0;
     }
-    if ((*offset % 0x4) != 0) {
+    if ((pos % 0x4) != 0) {
         pr_warn("buzzer_write: unaligned access\n");
         return -EFAULT;
     }
 
+    count = min_t(size_t, iov_iter_count(from), SPAN - pos);
+    count = round_down(count, sizeof(u32));
+    if (count == 0) {
+        return -EINVAL;
+    }
+
+    // Get the values from userspace before taking the lock.
+    copied = round_down(copy_from_iter(vals, count, from), sizeof(u32));
+    if (copied == 0) {
+        pr_warn("buzzer_write: nothing copied from user space\n");
+        return -EFAULT;
+    }
+
+    /*
+    * Cached registers that already hold the value aren't written again.
+    * Volatile ones, like the PCM push and FIFO flush registers, always are,
+    * and the control register updates the driver's copy of its flags.
+    */
     mutex_lock(&priv->lock);
+    for (i = 0; i < copied / sizeof(u32) && !ret; i++) {
+        ret = buzzer_user_write(&priv->cache, pos + i * sizeof(u32), vals[i]);
+    }
+    if (!ret && (pos > CONTROL_OFFSET || pos + copied <= CONTROL_OFFSET)) {
+        ret = buzzer_commit(priv);
+    }
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    // Increment the file offset by the number of bytes we wrote.
+    iocb->ki_pos = pos + copied;
 
-    // Get the value from userspace.
-    ret = copy_from_user(&val, buf, sizeof(val));
-    if (ret != sizeof(val)) {
-        iowrite32(val, priv->base_addr + *offset);
+    // Return the number of bytes we wrote.
+    return copied;
+}
+
+/**
+* buzzer_envelope_set() - Program every envelope and LFO register.
+* @priv: Private buzzer device struct.
+* @env: The settings; see struct de10nano_buzzer_envelope.
+*
+* The caller must hold priv->lock.
+*
+* Return: 0 on success, -EINVAL if a setting is out of range, or another
+* negative error value.
+*/
+static int buzzer_envelope_set(struct buzzer_dev *priv,
+    const struct de10nano_buzzer_envelope *env)
+{
+    int ret;
 
-        // Increment the file offset by the number of bytes we wrote.
-        *offset = *offset + sizeof(val);
+    if ((env->flags & ~DE10NANO_BUZZER_ENV_ENABLE) ||
+        env->sustain > DE10NANO_BUZZER_MAX_VOLUME ||
+        env->lfo_mhz > DE10NANO_BUZZER_MAX_FREQ_HZ * 1000 ||
+        env->lfo_duty_depth > DE10NANO_BUZZER_MAX_DEPTH ||
+        env->lfo_pitch_depth > DE10NANO_BUZZER_MAX_DEPTH ||
+        env->reserved) {
+        return -EINVAL;
+    }
 
-        // Return the number of bytes we wrote.
-        ret = sizeof(val);
+    ret = de10nano_regcache_write(&priv->cache, ATTACK_OFFSET, env->attack_us);
+    if (!ret) {
+        ret = de10nano_regcache_write(&priv->cache, DECAY_OFFSET,
+                                      env->decay_us);
     }
-    else {
-        pr_warn("buzzer_write: nothing copied from user space\n");
-        ret = -EFAULT;
+    if (!ret) {
+        ret = de10nano_regcache_write(&priv->cache, SUSTAIN_OFFSET,
+                                      env->sustain);
+    }
+    if (!ret) {
+        ret = de10nano_regcache_write(&priv->cache, RELEASE_OFFSET,
+                                      env->release_us);
+    }
+    if (!ret) {
+        ret = de10nano_regcache_write(&priv->cache, LFO_FTW_OFFSET,
+                                      de10nano_buzzer_mhz_to_ftw(env->lfo_mhz));
+    }
+    if (!ret) {
+        ret = de10nano_regcache_write(&priv->cache, LFO_DUTY_DEPTH_OFFSET,
+                                      env->lfo_duty_depth);
+    }
+    if (!ret) {
+        ret = de10nano_regcache_write(&priv->cache, LFO_PITCH_DEPTH_OFFSET,
+                                      env->lfo_pitch_depth);
+    }
+    if (ret) {
+        return ret;
     }
 
-    mutex_unlock(&priv->lock);
-    return ret;
+    return buzzer_control_set(priv, &priv->envelope,
+                              env->flags & DE10NANO_BUZZER_ENV_ENABLE, false);
+}
+
+/**
+* buzzer_ioctl() - ioctl method for the buzzer char device
+* @file: Pointer to the char device file struct.
+* @cmd: The ioctl command.
+* @arg: User-space pointer to the command's argument.
+*
+* DE10NANO_IOC_REG_XFER runs a batch of read, write, read-modify-write and
+* wait-for-bit operations while holding the device lock once. The batch
+* goes through the register cache like every other access path.
+* DE10NANO_BUZZER_IOC_SET_ENVELOPE sets every envelope and LFO register in
+* one call, and DE10NANO_BUZZER_IOC_SET_VOICES updates several voices with a
+* single commit; see de10nano_buzzer.h.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static long buzzer_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    struct de10nano_buzzer_envelope env;
+    struct de10nano_buzzer_voices voices;
+    int ret;
+    struct buzzer_dev *priv = container_of(file->private_data,
+                                struct buzzer_dev, miscdev);
+
+    switch (cmd) {
+    case DE10NANO_IOC_REG_XFER:
+        return de10nano_regmap_xfer(&priv->cache, SPAN, SPAN,
+                                    (void __user *)arg);
+    case DE10NANO_BUZZER_IOC_SET_ENVELOPE:
+        if (copy_from_user(&env, (void __user *)arg, sizeof(env))) {
+            return -EFAULT;
+        }
+        mutex_lock(&priv->lock);
+        ret = buzzer_envelope_set(priv, &env);
+        mutex_unlock(&priv->lock);
+        return ret;
+    case DE10NANO_BUZZER_IOC_SET_VOICES:
+        if (copy_from_user(&voices, (void __user *)arg, sizeof(voices))) {
+            return -EFAULT;
+        }
+        mutex_lock(&priv->lock);
+        ret = buzzer_voices_set(priv, &voices);
+        mutex_unlock(&priv->lock);
+        return ret;
+    default:
+        return -ENOTTY;
+    }
+}
+
+/**
+* buzzer_mmap() - mmap method for the buzzer char device
+* @file: Pointer to the char device file struct.
+* @vma: The user-space mapping being created.
+*
+* Maps the register window into user space so the registers can be
+* accessed with plain loads and stores instead of a syscall each. The
+* register cache can't see those stores, so it is bypassed until the last
+* mapping is gone.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int buzzer_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    int ret;
+    struct buzzer_dev *priv = container_of(file->private_data,
+                                struct buzzer_dev, miscdev);
+
+    ret = de10nano_mmap_regs(vma, priv->phys_addr, SPAN, priv->emulated,
+                             false);
+    if (ret) {
+        return ret;
+    }
+
+    de10nano_regcache_mmap(&priv->cache, vma);
+
+    return 0;
 }
 
 /**
@@ -143,123 +804,1845 @@ static ssize_t buzzer_write(struct file *file, const char __user *buf,
 * @owner: The buzzer driver owns the file operations; this
 * ensures that the driver can't be removed while the
 * character device is still in use.
-* @read: The read function.
-* @write: The write function.
+* @read_iter: The read function; also handles readv() and preadv().
+* @write_iter: The write function; also handles writev() and pwritev().
+* @unlocked_ioctl: The ioctl function; see de10nano_regs.h and
+* de10nano_buzzer.h.
+* @compat_ioctl: Our ioctl arguments are the same for 32-bit callers.
+* @mmap: Maps the register window into user space.
 * @llseek: We use the kernel's default_llseek() function; this allows
 * users to change what position they are writing/reading to/from.
 */
 static const struct file_operations buzzer_fops = {
     .owner = THIS_MODULE,
-    .read = buzzer_read,
-    .write = buzzer_write,
+    .read_iter = buzzer_read_iter,
+    .write_iter = buzzer_write_iter,
+    .unlocked_ioctl = buzzer_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
+    .mmap = buzzer_mmap,
     .llseek = default_llseek,
 };
 
 /**
-* buzzer_probe() - Initialize device when a match is found
-* @pdev: Platform device structure associated with our buzzer control device;
-* pdev is automatically created by the driver core based upon our
-* buzzer control device tree node.
+* buzzer_note_timer() - Start the next queued note.
+* @timer: The note queue's hrtimer.
+*
+* Each note's end is scheduled from the previous note's end rather than from
+* when the callback ran, so notes follow each other without gaps and timer
+* latency doesn't accumulate over a melody. When the queue runs dry the
+* buzzer is silenced. With the envelope on, each note retriggers it instead,
+* and rests and the end of the queue release it so the release is heard.
+*
+* Return: HRTIMER_RESTART while there are notes to play.
+*/
+static enum hrtimer_restart buzzer_note_timer(struct hrtimer *timer)
+{
+    struct buzzer_dev *priv = container_of(timer, struct buzzer_dev,
+                                note_timer);
+    struct buzzer_note note;
+
+    spin_lock(&priv->queue_lock);
+    if (!kfifo_get(&priv->notes, &note)) {
+        if (READ_ONCE(priv->envelope)) {
+            buzzer_gate(priv, false);
+        } else {
+            de10nano_regcache_write(&priv->cache, VOLUME_OFFSET, 0);
+            buzzer_commit(priv);
+        }
+        priv->queue_playing = false;
+        spin_unlock(&priv->queue_lock);
+        return HRTIMER_NORESTART;
+    }
+    spin_unlock(&priv->queue_lock);
+
+    if (READ_ONCE(priv->envelope)) {
+        if (note.ftw) {
+            de10nano_regcache_write(&priv->cache, FTW_OFFSET, note.ftw);
+            de10nano_regcache_write(&priv->cache, VOLUME_OFFSET, note.volume);
+        }
+        buzzer_gate(priv, note.ftw != 0);
+    } else {
+        if (note.ftw) {
+            de10nano_regcache_write(&priv->cache, FTW_OFFSET, note.ftw);
+        }
+        de10nano_regcache_write(&priv->cache, VOLUME_OFFSET, note.volume);
+        buzzer_commit(priv);
+    }
+    hrtimer_add_expires(timer, us_to_ktime(note.duration_us));
+
+    wake_up_interruptible(&priv->queue_wait);
+
+    return HRTIMER_RESTART;
+}
+
+/**
+* buzzer_queue_flush() - Drop every queued note and silence the buzzer.
+* @priv: Private buzzer device struct.
+*
+* The caller must hold priv->queue_write_lock.
+*/
+static void buzzer_queue_flush(struct buzzer_dev *priv)
+{
+    unsigned long flags;
+
+    hrtimer_cancel(&priv->note_timer);
+
+    spin_lock_irqsave(&priv->queue_lock, flags);
+    kfifo_reset(&priv->notes);
+    priv->queue_playing = false;
+    spin_unlock_irqrestore(&priv->queue_lock, flags);
+
+    mutex_lock(&priv->lock);
+    de10nano_regcache_write(&priv->cache, VOLUME_OFFSET, 0);
+    buzzer_control_set(priv, &priv->gate, false, true);
+    mutex_unlock(&priv->lock);
+
+    wake_up_interruptible(&priv->queue_wait);
+}
+
+/**
+* buzzer_queue_write_iter() - Write method for the buzzer_queue char device
+* @iocb: I/O control block; holds the file struct.
+* @from: User-space buffer(s) holding struct de10nano_buzzer_note records.
+*
+* Queues as many whole notes as @from holds. If the queue fills up, the
+* writer sleeps until the note timer makes room, unless the file was opened
+* with O_NONBLOCK. Playback starts as soon as the first note is queued.
+*
+* Return: The number of bytes queued, or a negative error value if no note
+* was queued.
+*/
+static ssize_t buzzer_queue_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+    struct de10nano_buzzer_note req;
+    struct buzzer_note note;
+    unsigned long flags;
+    ssize_t queued = 0;
+    bool start;
+    int ret = 0;
+
+    struct buzzer_dev *priv = container_of(iocb->ki_filp->private_data,
+                                struct buzzer_dev, queue_miscdev);
+
+    if (iov_iter_count(from) < sizeof(req)) {
+        return -EINVAL;
+    }
+
+    mutex_lock(&priv->queue_write_lock);
+    while (iov_iter_count(from) >= sizeof(req)) {
+        if (kfifo_is_full(&priv->notes)) {
+            if (queued) {
+                break;
+            }
+            if (iocb->ki_filp->f_flags & O_NONBLOCK) {
+                ret = -EAGAIN;
+                break;
+            }
+            ret = wait_event_interruptible(priv->queue_wait,
+                                           !kfifo_is_full(&priv->notes));
+            if (ret) {
+                break;
+            }
+        }
+
+        if (copy_from_iter(&req, sizeof(req), from) != sizeof(req)) {
+            ret = -EFAULT;
+            break;
+        }
+        if ((req.freq_hz && (req.freq_hz < DE10NANO_BUZZER_MIN_FREQ_HZ ||
+                             req.freq_hz > DE10NANO_BUZZER_MAX_FREQ_HZ)) ||
+            req.volume > DE10NANO_BUZZER_MAX_VOLUME ||
+            req.duration_us == 0 ||
+            req.duration_us > DE10NANO_BUZZER_MAX_NOTE_US ||
+            req.reserved) {
+            ret = -EINVAL;
+            break;
+        }
+
+        note.ftw = de10nano_buzzer_mhz_to_ftw(req.freq_hz * 1000);
+        note.volume = req.freq_hz ? req.volume : 0;
+        note.duration_us = req.duration_us;
+
+        spin_lock_irqsave(&priv->queue_lock, flags);
+        kfifo_put(&priv->notes, note);
+        start = !priv->queue_playing;
+        priv->queue_playing = true;
+        spin_unlock_irqrestore(&priv->queue_lock, flags);
+
+        if (start) {
+            // Notes are tuning words, played by the DDS tone generator.
+            buzzer_control_set(priv, &priv->dds, true, false);
+            hrtimer_start(&priv->note_timer, 0, HRTIMER_MODE_REL);
+        }
+
+        queued += sizeof(req);
+    }
+    mutex_unlock(&priv->queue_write_lock);
+
+    return queued ? queued : ret;
+}
+
+/**
+* buzzer_queue_poll() - poll method for the buzzer_queue char device
+* @file: Pointer to the char device file struct.
+* @wait: Poll table.
+*
+* Return: EPOLLOUT when at least one more note fits in the queue.
+*/
+static __poll_t buzzer_queue_poll(struct file *file, poll_table *wait)
+{
+    struct buzzer_dev *priv = container_of(file->private_data,
+                                struct buzzer_dev, queue_miscdev);
+
+    poll_wait(file, &priv->queue_wait, wait);
+
+    if (!kfifo_is_full(&priv->notes)) {
+        return EPOLLOUT | EPOLLWRNORM;
+    }
+
+    return 0;
+}
+
+/**
+* buzzer_queue_ioctl() - ioctl method for the buzzer_queue char device
+* @file: Pointer to the char device file struct.
+* @cmd: The ioctl command.
+* @arg: Unused.
+*
+* DE10NANO_BUZZER_IOC_QUEUE_FLUSH drops every queued note and silences the
+* buzzer; see de10nano_buzzer.h.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static long buzzer_queue_ioctl(struct file *file, unsigned int cmd,
+    unsigned long arg)
+{
+    struct buzzer_dev *priv = container_of(file->private_data,
+                                struct buzzer_dev, queue_miscdev);
+
+    switch (cmd) {
+    case DE10NANO_BUZZER_IOC_QUEUE_FLUSH:
+        mutex_lock(&priv->queue_write_lock);
+        buzzer_queue_flush(priv);
+        mutex_unlock(&priv->queue_write_lock);
+        return 0;
+    default:
+        return -ENOTTY;
+    }
+}
+
+/**
+* buzzer_queue_fops - File operations supported by /dev/buzzer_queue
+* @owner: The buzzer driver owns the file operations.
+* @write_iter: Queues notes; also handles writev().
+* @poll: Reports when there is room in the queue.
+* @unlocked_ioctl: The ioctl function; see de10nano_buzzer.h.
+* @compat_ioctl: Our ioctls take no argument, so 32-bit callers are the same.
+* @llseek: The queue is a stream; seeking makes no sense.
+*/
+static const struct file_operations buzzer_queue_fops = {
+    .owner = THIS_MODULE,
+    .write_iter = buzzer_queue_write_iter,
+    .poll = buzzer_queue_poll,
+    .unlocked_ioctl = buzzer_queue_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
+    .llseek = noop_llseek,
+};
+
+/**
+* buzzer_pcm_word_ns() - How long one FIFO word plays.
+* @priv: Private buzzer device struct.
+*
+* Return: The time two samples take at the current rate, in nanoseconds.
+*/
+static u64 buzzer_pcm_word_ns(struct buzzer_dev *priv)
+{
+    return div_u64(2ULL * NSEC_PER_SEC, priv->pcm_rate);
+}
+
+/**
+* buzzer_pcm_poll_period() - How often the PCM timer refills the FIFO.
+* @priv: Private buzzer device struct.
+*
+* The timer tops the FIFO up each time a quarter of it has played, so it
+* never gets below three quarters full while the ring has samples.
+*
+* Return: The timer period.
+*/
+static ktime_t buzzer_pcm_poll_period(struct buzzer_dev *priv)
+{
+    return ns_to_ktime(priv->pcm_depth / 4 * buzzer_pcm_word_ns(priv));
+}
+
+/**
+* buzzer_pcm_fifo_level() - Count the words in the FIFO.
+* @priv: Private buzzer device struct.
+*
+* The emulated device has no FIFO that drains, so it simulates one: while
+* playback is on, a word leaves the simulated FIFO every word period, and
+* each sample that finds it empty counts as an underrun, just as in the
+* hardware. This lets the refill path be benchmarked without the FPGA.
+*
+* The caller must hold priv->pcm_lock.
+*
+* Return: The number of words in the FIFO.
+*/
+static unsigned int buzzer_pcm_fifo_level(struct buzzer_dev *priv)
+{
+    ktime_t now;
+    u64 word_ns;
+    u64 words;
+
+    if (!priv->emulated) {
+        return min_t(unsigned int, priv->pcm_depth,
+                     ioread32(priv->base_addr + PCM_LEVEL_OFFSET) &
+                     PCM_LEVEL_MASK);
+    }
+
+    now = ktime_get();
+    if (!priv->pcm) {
+        priv->pcm_emu_stamp = now;
+        return priv->pcm_emu_level;
+    }
+
+    word_ns = buzzer_pcm_word_ns(priv);
+    words = div64_u64(ktime_to_ns(ktime_sub(now, priv->pcm_emu_stamp)),
+                      word_ns);
+    priv->pcm_emu_stamp = ktime_add_ns(priv->pcm_emu_stamp, words * word_ns);
+    if (words > priv->pcm_emu_level) {
+        priv->pcm_emu_underruns += 2 * (words - priv->pcm_emu_level);
+        priv->pcm_emu_level = 0;
+    } else {
+        priv->pcm_emu_level -= words;
+    }
+
+    return priv->pcm_emu_level;
+}
+
+/**
+* buzzer_pcm_set_irq() - Enable or disable the half-empty interrupt.
+* @priv: Private buzzer device struct.
+* @armed: true to enable it.
+*
+* The caller must hold priv->pcm_lock.
+*/
+static void buzzer_pcm_set_irq(struct buzzer_dev *priv, bool armed)
+{
+    if (priv->irq > 0) {
+        iowrite32(armed ? PCM_IRQ_ENABLE : 0,
+                  priv->base_addr + PCM_IRQ_OFFSET);
+    }
+    priv->pcm_irq_armed = armed;
+}
+
+/**
+* buzzer_pcm_stop() - Turn PCM playback off.
+* @priv: Private buzzer device struct.
+*
+* The tones are heard again. The caller must hold priv->pcm_lock.
+*/
+static void buzzer_pcm_stop(struct buzzer_dev *priv)
+{
+    buzzer_pcm_set_irq(priv, false);
+    buzzer_control_set(priv, &priv->pcm, false, false);
+}
+
+/**
+* buzzer_pcm_refill() - Move words from the ring into the FIFO.
+* @priv: Private buzzer device struct.
+*
+* Fills the FIFO as far as the ring allows. The words are written straight
+* to the data register, not through the register cache, which would drop
+* every word equal to the one before. Once the ring is empty the half-empty
+* interrupt is disabled, since it would keep firing with nothing to send,
+* and once the last writer has closed the file and the FIFO has played out,
+* playback stops.
+*
+* The caller must hold priv->pcm_lock.
+*/
+static void buzzer_pcm_refill(struct buzzer_dev *priv)
+{
+    unsigned int level = buzzer_pcm_fifo_level(priv);
+    unsigned int pushed = 0;
+    u32 word;
+
+    while (level + pushed < priv->pcm_depth &&
+           kfifo_get(&priv->pcm_ring, &word)) {
+        iowrite32(word, priv->base_addr + PCM_DATA_OFFSET);
+        pushed++;
+    }
+    if (priv->emulated) {
+        priv->pcm_emu_level += pushed;
+    }
+    priv->pcm_pushed += 2 * pushed;
+    priv->pcm_refills++;
+
+    if (kfifo_is_empty(&priv->pcm_ring)) {
+        if (priv->pcm_irq_armed) {
+            buzzer_pcm_set_irq(priv, false);
+        }
+        if (priv->pcm && !priv->pcm_writers && level + pushed == 0) {
+            buzzer_pcm_stop(priv);
+        }
+    }
+
+    if (pushed) {
+        wake_up_interruptible(&priv->pcm_wait);
+    }
+}
+
+/**
+* buzzer_pcm_kick() - Refill the FIFO and keep it refilled.
+* @priv: Private buzzer device struct.
+*
+* Starts playback once the FIFO has words, so it doesn't begin with an
+* underrun. While the ring has words, the half-empty interrupt calls for
+* the next refill; without an IRQ, or to wait for the FIFO to play out once
+* the ring is empty, the PCM timer does.
+*
+* The caller must hold priv->pcm_lock.
+*/
+static void buzzer_pcm_kick(struct buzzer_dev *priv)
+{
+    buzzer_pcm_refill(priv);
+
+    if (!priv->pcm) {
+        if (!buzzer_pcm_fifo_level(priv)) {
+            return;
+        }
+        buzzer_control_set(priv, &priv->pcm, true, false);
+    }
+
+    if (priv->irq > 0 && !kfifo_is_empty(&priv->pcm_ring)) {
+        if (!priv->pcm_irq_armed) {
+            buzzer_pcm_set_irq(priv, true);
+        }
+    } else if (!hrtimer_active(&priv->pcm_timer)) {
+        hrtimer_start(&priv->pcm_timer, buzzer_pcm_poll_period(priv),
+                      HRTIMER_MODE_REL);
+    }
+}
+
+/**
+* buzzer_pcm_timer() - Refill the FIFO from the PCM timer.
+* @timer: The PCM hrtimer.
+*
+* Return: HRTIMER_RESTART while playback is on and the half-empty interrupt
+* isn't doing the refills.
+*/
+static enum hrtimer_restart buzzer_pcm_timer(struct hrtimer *timer)
+{
+    struct buzzer_dev *priv = container_of(timer, struct buzzer_dev,
+                                pcm_timer);
+    bool restart;
+
+    spin_lock(&priv->pcm_lock);
+    if (priv->pcm) {
+        buzzer_pcm_refill(priv);
+    }
+    restart = priv->pcm && !priv->pcm_irq_armed;
+    if (restart) {
+        hrtimer_forward_now(timer, buzzer_pcm_poll_period(priv));
+    }
+    spin_unlock(&priv->pcm_lock);
+
+    return restart ? HRTIMER_RESTART : HRTIMER_NORESTART;
+}
+
+/**
+* buzzer_pcm_irq() - Interrupt handler for the PCM FIFO.
+* @irq: Unused.
+* @dev_id: Private buzzer device struct.
+*
+* The interrupt is level-triggered: it stays up while the FIFO is at most
+* half full, so the refill either fills the FIFO past half or, with the ring
+* empty, disables the interrupt and hands over to the PCM timer.
+*
+* Return: IRQ_HANDLED, or IRQ_NONE if the interrupt wasn't enabled.
+*/
+static irqreturn_t buzzer_pcm_irq(int irq, void *dev_id)
+{
+    struct buzzer_dev *priv = dev_id;
+
+    spin_lock(&priv->pcm_lock);
+    if (!priv->pcm_irq_armed) {
+        spin_unlock(&priv->pcm_lock);
+        return IRQ_NONE;
+    }
+
+    buzzer_pcm_refill(priv);
+    if (priv->pcm && !priv->pcm_irq_armed &&
+        !hrtimer_active(&priv->pcm_timer)) {
+        hrtimer_start(&priv->pcm_timer, buzzer_pcm_poll_period(priv),
+                      HRTIMER_MODE_REL);
+    }
+    spin_unlock(&priv->pcm_lock);
+
+    return IRQ_HANDLED;
+}
+
+/**
+* buzzer_pcm_flush() - Drop every sample waiting to play and stop playback.
+* @priv: Private buzzer device struct.
+*
+* Only empties the ring from the reading side, so it is safe against a
+* writer that is filling it.
+*/
+static void buzzer_pcm_flush(struct buzzer_dev *priv)
+{
+    unsigned long flags;
+
+    spin_lock_irqsave(&priv->pcm_lock, flags);
+    kfifo_reset_out(&priv->pcm_ring);
+    if (priv->pcm) {
+        buzzer_pcm_stop(priv);
+    }
+    if (priv->emulated) {
+        priv->pcm_emu_level = 0;
+    } else {
+        iowrite32(0, priv->base_addr + PCM_LEVEL_OFFSET);
+    }
+    spin_unlock_irqrestore(&priv->pcm_lock, flags);
+
+    hrtimer_cancel(&priv->pcm_timer);
+
+    wake_up_interruptible(&priv->pcm_wait);
+}
+
+/**
+* buzzer_pcm_set_rate() - Set the PCM sample rate.
+* @priv: Private buzzer device struct.
+* @rate: Sample rate in Hz.
+*
+* Return: 0 on success, -EINVAL if @rate is out of range, or another
+* negative error value.
+*/
+static int buzzer_pcm_set_rate(struct buzzer_dev *priv, u32 rate)
+{
+    unsigned long flags;
+    int ret;
+
+    if (rate < DE10NANO_BUZZER_PCM_MIN_RATE ||
+        rate > DE10NANO_BUZZER_PCM_MAX_RATE) {
+        return -EINVAL;
+    }
+
+    spin_lock_irqsave(&priv->pcm_lock, flags);
+    // Account for the simulated FIFO's playback at the old rate first
+    buzzer_pcm_fifo_level(priv);
+    priv->pcm_rate = rate;
+    ret = regmap_write(priv->cache.map, PCM_PERIOD_OFFSET,
+                       DIV_ROUND_CLOSEST(DE10NANO_BUZZER_CLK_HZ, rate));
+    spin_unlock_irqrestore(&priv->pcm_lock, flags);
+
+    return ret;
+}
+
+/**
+* buzzer_pcm_get_stats() - Read the PCM throughput and underrun counters.
+* @priv: Private buzzer device struct.
+* @stats: Filled in with the counters.
+*/
+static void buzzer_pcm_get_stats(struct buzzer_dev *priv,
+    struct de10nano_buzzer_pcm_stats *stats)
+{
+    unsigned long flags;
+
+    memset(stats, 0, sizeof(*stats));
+
+    spin_lock_irqsave(&priv->pcm_lock, flags);
+    stats->written = priv->pcm_written;
+    stats->pushed = priv->pcm_pushed;
+    stats->refills = priv->pcm_refills;
+    stats->fifo = 2 * buzzer_pcm_fifo_level(priv);
+    if (priv->emulated) {
+        stats->underruns = priv->pcm_emu_underruns;
+    } else {
+        stats->underruns = ioread32(priv->base_addr + PCM_UNDERRUNS_OFFSET);
+    }
+    stats->ring = 2 * kfifo_len(&priv->pcm_ring);
+    stats->rate = priv->pcm_rate;
+    spin_unlock_irqrestore(&priv->pcm_lock, flags);
+}
+
+/**
+* buzzer_pcm_open() - Open method for the buzzer_pcm char device
+* @inode: Unused.
+* @file: Pointer to the char device file struct.
+*
+* Return: 0.
+*/
+static int buzzer_pcm_open(struct inode *inode, struct file *file)
+{
+    struct buzzer_dev *priv = container_of(file->private_data,
+                                struct buzzer_dev, pcm_miscdev);
+
+    spin_lock_irq(&priv->pcm_lock);
+    priv->pcm_writers++;
+    spin_unlock_irq(&priv->pcm_lock);
+
+    return 0;
+}
+
+/**
+* buzzer_pcm_release() - Release method for the buzzer_pcm char device
+* @inode: Unused.
+* @file: Pointer to the char device file struct.
+*
+* Samples already written keep playing; playback stops once they have
+* played out and no other file has the device open.
+*
+* Return: 0.
+*/
+static int buzzer_pcm_release(struct inode *inode, struct file *file)
+{
+    struct buzzer_dev *priv = container_of(file->private_data,
+                                struct buzzer_dev, pcm_miscdev);
+
+    spin_lock_irq(&priv->pcm_lock);
+    priv->pcm_writers--;
+    if (priv->pcm) {
+        buzzer_pcm_kick(priv);
+    }
+    spin_unlock_irq(&priv->pcm_lock);
+
+    return 0;
+}
+
+/**
+* buzzer_pcm_write_iter() - Write method for the buzzer_pcm char device
+* @iocb: I/O control block; holds the file struct.
+* @from: User-space buffer(s) holding pairs of signed 16-bit samples.
+*
+* Copies as many whole pairs as @from holds into the ring, a chunk at a
+* time, and refills the FIFO after each chunk. If the ring fills up, the
+* writer sleeps until a refill makes room, unless the file was opened with
+* O_NONBLOCK. Playback starts as soon as the first samples reach the FIFO.
+*
+* Return: The number of bytes written, or a negative error value if nothing
+* was written.
+*/
+static ssize_t buzzer_pcm_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+    u32 words[64];
+    unsigned long flags;
+    unsigned int count;
+    ssize_t written = 0;
+    int ret = 0;
+
+    struct buzzer_dev *priv = container_of(iocb->ki_filp->private_data,
+                                struct buzzer_dev, pcm_miscdev);
+
+    if (iov_iter_count(from) < sizeof(u32)) {
+        return -EINVAL;
+    }
+
+    mutex_lock(&priv->pcm_write_lock);
+    while (iov_iter_count(from) >= sizeof(u32)) {
+        if (kfifo_is_full(&priv->pcm_ring)) {
+            if (iocb->ki_filp->f_flags & O_NONBLOCK) {
+                ret = -EAGAIN;
+                break;
+            }
+            ret = wait_event_interruptible(priv->pcm_wait,
+                                           !kfifo_is_full(&priv->pcm_ring));
+            if (ret) {
+                break;
+            }
+        }
+
+        count = min3(kfifo_avail(&priv->pcm_ring),
+                     (unsigned int)ARRAY_SIZE(words),
+                     (unsigned int)(iov_iter_count(from) / sizeof(u32)));
+        if (copy_from_iter(words, count * sizeof(u32), from) !=
+            count * sizeof(u32)) {
+            ret = -EFAULT;
+            break;
+        }
+        kfifo_in(&priv->pcm_ring, words, count);
+        written += count * sizeof(u32);
+
+        spin_lock_irqsave(&priv->pcm_lock, flags);
+        priv->pcm_written += 2 * count;
+        buzzer_pcm_kick(priv);
+        spin_unlock_irqrestore(&priv->pcm_lock, flags);
+    }
+    mutex_unlock(&priv->pcm_write_lock);
+
+    return written ? written : ret;
+}
+
+/**
+* buzzer_pcm_poll() - poll method for the buzzer_pcm char device
+* @file: Pointer to the char device file struct.
+* @wait: Poll table.
+*
+* Return: EPOLLOUT when at least one more pair of samples fits in the ring.
+*/
+static __poll_t buzzer_pcm_poll(struct file *file, poll_table *wait)
+{
+    struct buzzer_dev *priv = container_of(file->private_data,
+                                struct buzzer_dev, pcm_miscdev);
+
+    poll_wait(file, &priv->pcm_wait, wait);
+
+    if (!kfifo_is_full(&priv->pcm_ring)) {
+        return EPOLLOUT | EPOLLWRNORM;
+    }
+
+    return 0;
+}
+
+/**
+* buzzer_pcm_ioctl() - ioctl method for the buzzer_pcm char device
+* @file: Pointer to the char device file struct.
+* @cmd: The ioctl command.
+* @arg: The command's argument.
+*
+* DE10NANO_BUZZER_IOC_PCM_SET_RATE sets the sample rate,
+* DE10NANO_BUZZER_IOC_PCM_FLUSH drops the samples waiting to play and
+* DE10NANO_BUZZER_IOC_PCM_GET_STATS reads the counters; see
+* de10nano_buzzer.h.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static long buzzer_pcm_ioctl(struct file *file, unsigned int cmd,
+    unsigned long arg)
+{
+    struct de10nano_buzzer_pcm_stats stats;
+    u32 rate;
+
+    struct buzzer_dev *priv = container_of(file->private_data,
+                                struct buzzer_dev, pcm_miscdev);
+
+    switch (cmd) {
+    case DE10NANO_BUZZER_IOC_PCM_SET_RATE:
+        if (get_user(rate, (u32 __user *)arg)) {
+            return -EFAULT;
+        }
+        return buzzer_pcm_set_rate(priv, rate);
+    case DE10NANO_BUZZER_IOC_PCM_FLUSH:
+        buzzer_pcm_flush(priv);
+        return 0;
+    case DE10NANO_BUZZER_IOC_PCM_GET_STATS:
+        buzzer_pcm_get_stats(priv, &stats);
+        if (copy_to_user((void __user *)arg, &stats, sizeof(stats))) {
+            return -EFAULT;
+        }
+        return 0;
+    default:
+        return -ENOTTY;
+    }
+}
+
+/**
+* buzzer_pcm_fops - File operations supported by /dev/buzzer_pcm
+* @owner: The buzzer driver owns the file operations.
+* @open: Counts the writers, so playback knows when to stop.
+* @release: Lets the samples play out once the last writer is gone.
+* @write_iter: Streams samples; also handles writev().
+* @poll: Reports when there is room in the ring.
+* @unlocked_ioctl: The ioctl function; see de10nano_buzzer.h.
+* @compat_ioctl: Our ioctl arguments have the same layout for 32-bit callers.
+* @llseek: The stream can't be seeked.
+*/
+static const struct file_operations buzzer_pcm_fops = {
+    .owner = THIS_MODULE,
+    .open = buzzer_pcm_open,
+    .release = buzzer_pcm_release,
+    .write_iter = buzzer_pcm_write_iter,
+    .poll = buzzer_pcm_poll,
+    .unlocked_ioctl = buzzer_pcm_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
+    .llseek = noop_llseek,
+};
+
+/**
+* buzzer_bind_write() - Set a register written by de10nano_bind.
+* @sink: The register's sink.
+* @val: Register value.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int buzzer_bind_write(struct de10nano_bind_sink *sink, u32 val)
+{
+    struct buzzer_bind_sink *bind = container_of(sink,
+                                struct buzzer_bind_sink, sink);
+    struct buzzer_dev *priv = bind->priv;
+    int ret;
+
+    mutex_lock(&priv->lock);
+    ret = de10nano_regcache_write(&priv->cache, bind->offset, val);
+    if (!ret && bind->offset == FTW_OFFSET) {
+        ret = buzzer_control_set(priv, &priv->dds, true, true);
+    } else if (!ret) {
+        ret = buzzer_commit(priv);
+    }
+    mutex_unlock(&priv->lock);
+
+    return ret;
+}
+
+/**
+* buzzer_bind_add_sink() - Register one of the buzzer's bind sinks.
+* @pdev: The buzzer's platform device.
+* @priv: Private buzzer device struct.
+* @bind: Sink to register.
+* @name: Name of the sink.
+* @offset: Offset of the register it drives.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int buzzer_bind_add_sink(struct platform_device *pdev,
+    struct buzzer_dev *priv, struct buzzer_bind_sink *bind, const char *name,
+    unsigned int offset)
+{
+    int ret;
+
+    bind->sink.name = name;
+    bind->sink.write = buzzer_bind_write;
+    bind->priv = priv;
+    bind->offset = offset;
+    ret = devm_de10nano_bind_add_sink(&pdev->dev, &bind->sink);
+    if (ret) {
+        pr_err("Failed to register bind sink %s\n", name);
+    }
+    return ret;
+}
+
+/**
+* buzzer_probe() - Initialize device when a match is found
+* @pdev: Platform device structure associated with our buzzer control device;
+* pdev is automatically created by the driver core based upon our
+* buzzer control device tree node.
+*
+* When a device that is compatible with this buzzer control driver is found, the
+* driver's probe function is called. This probe function gets called by the
+* kernel when an buzzer device is found in the device tree.
+*/
+static int buzzer_probe(struct platform_device *pdev)
+{
+    struct buzzer_dev *priv;
+    struct resource *res;
+    unsigned long emu_page;
+    unsigned int voice;
+    u32 *pcm_ring;
+    size_t ret;
+
+    /*
+    * Allocate kernel memory for the buzzer control device and set it to 0.
+    * GFP_KERNEL specifies that we are allocating normal kernel RAM;
+    * see the kmalloc documentation for more info. The allocated memory
+    * is automatically freed when the device is removed.
+    */
+    priv = devm_kzalloc(&pdev->dev, sizeof(struct buzzer_dev),
+                        GFP_KERNEL);
+    if (!priv) {
+        pr_err("Failed to allocate memory\n");
+        return -ENOMEM;
+    }
+
+    /*
+    * Request and remap the device's memory region. Requesting the region
+    * make sure nobody else can use that memory. The memory is remapped
+    * into the kernel's virtual address space because we don't have access
+    * to physical memory locations.
+    */
+    if (emulate && !platform_get_resource(pdev, IORESOURCE_MEM, 0)) {
+        // Our own emulated device has no memory region; use a RAM page.
+        emu_page = devm_get_free_pages(&pdev->dev,
+                            GFP_KERNEL | __GFP_ZERO, 0);
+        if (!emu_page) {
+            pr_err("Failed to allocate emulated registers\n");
+            return -ENOMEM;
+        }
+        priv->base_addr = (void __iomem *)emu_page;
+        priv->phys_addr = virt_to_phys((void *)emu_page);
+        priv->emulated = true;
+    }
+    else {
+        priv->base_addr = devm_platform_get_and_ioremap_resource(pdev, 0, &res);
+        if (IS_ERR(priv->base_addr)) {
+            pr_err("Failed to request/remap platform device resource\n");
+            return PTR_ERR(priv->base_addr);
+        }
+        priv->phys_addr = res->start;
+    }
+
+    mutex_init(&priv->lock);
+
+    mutex_init(&priv->queue_write_lock);
+    spin_lock_init(&priv->queue_lock);
+    spin_lock_init(&priv->control_lock);
+    init_waitqueue_head(&priv->queue_wait);
+    INIT_KFIFO(priv->notes);
+    hrtimer_init(&priv->note_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    priv->note_timer.function = buzzer_note_timer;
+
+    mutex_init(&priv->pcm_write_lock);
+    spin_lock_init(&priv->pcm_lock);
+    init_waitqueue_head(&priv->pcm_wait);
+    hrtimer_init(&priv->pcm_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    priv->pcm_timer.function = buzzer_pcm_timer;
+    priv->pcm_rate = DE10NANO_BUZZER_PCM_DEFAULT_RATE;
+
+    // Put a write-through register cache in front of the registers.
+    ret = de10nano_regcache_init_volatile(&priv->cache, &pdev->dev,
+                                          priv->base_addr, SPAN, &priv->lock,
+                                          buzzer_volatile_reg);
+    if (ret) {
+        pr_err("Failed to create register map\n");
+        return ret;
+    }
+    priv->cache.user_write = buzzer_user_write;
+
+    // Set the pitch to 262 Hz (middle C) and volume to 0 to begin
+    regmap_write(priv->cache.map, VOLUME_OFFSET, 0x0);
+    regmap_write(priv->cache.map, PITCH_OFFSET, 0x0106);
+    regmap_write(priv->cache.map, FTW_OFFSET,
+                 de10nano_buzzer_mhz_to_ftw(262 * 1000));
+    // Envelope off, with a 10 ms attack, 100 ms decay to half volume and
+    // 200 ms release ready for when it is turned on; LFO at 5 Hz, depth 0
+    regmap_write(priv->cache.map, ATTACK_OFFSET, 10000);
+    regmap_write(priv->cache.map, DECAY_OFFSET, 100000);
+    regmap_write(priv->cache.map, SUSTAIN_OFFSET, DE10NANO_BUZZER_MAX_VOLUME / 2);
+    regmap_write(priv->cache.map, RELEASE_OFFSET, 200000);
+    regmap_write(priv->cache.map, LFO_FTW_OFFSET,
+                 de10nano_buzzer_mhz_to_ftw(5 * 1000));
+    regmap_write(priv->cache.map, LFO_DUTY_DEPTH_OFFSET, 0);
+    regmap_write(priv->cache.map, LFO_PITCH_DEPTH_OFFSET, 0);
+    // Find out how many voices the component was built with and silence the
+    // mixer voices; the emulated registers read 0, which leaves the main tone
+    de10nano_regcache_read(&priv->cache, VOICE_INFO_OFFSET, &priv->num_voices);
+    priv->num_voices = clamp_t(unsigned int, priv->num_voices, 1,
+                               DE10NANO_BUZZER_MAX_VOICES);
+    for (voice = 1; voice < priv->num_voices; voice++) {
+        regmap_write(priv->cache.map, VOICE_FTW_OFFSET(voice), 0);
+        regmap_write(priv->cache.map, VOICE_VOLUME_OFFSET(voice), 0);
+    }
+    // Play the PWM period, as the pitch attribute expects, until a tuning
+    // word is written; writes reach it right away until double buffering is
+    // turned on.
+    regmap_write(priv->cache.map, CONTROL_OFFSET, 0);
+
+    /*
+    * Find out how big the PCM FIFO is; the emulated device simulates one.
+    * Without a usable FIFO there is no /dev/buzzer_pcm.
+    */
+    if (priv->emulated) {
+        priv->pcm_depth = PCM_EMU_DEPTH;
+    } else {
+        de10nano_regcache_read(&priv->cache, PCM_DEPTH_OFFSET,
+                               &priv->pcm_depth);
+        if (priv->pcm_depth < PCM_MIN_DEPTH) {
+            priv->pcm_depth = 0;
+        }
+    }
+    if (priv->pcm_depth) {
+        pcm_ring = devm_kmalloc_array(&pdev->dev, PCM_RING_WORDS,
+                                      sizeof(u32), GFP_KERNEL);
+        if (!pcm_ring) {
+            pr_err("Failed to allocate the PCM ring\n");
+            return -ENOMEM;
+        }
+        ret = kfifo_init(&priv->pcm_ring, pcm_ring,
+                         PCM_RING_WORDS * sizeof(u32));
+        if (ret) {
+            return ret;
+        }
+
+        // Empty FIFO, no interrupt, cleared counter, default sample rate
+        regmap_write(priv->cache.map, PCM_IRQ_OFFSET, 0);
+        regmap_write(priv->cache.map, PCM_LEVEL_OFFSET, 0);
+        regmap_write(priv->cache.map, PCM_UNDERRUNS_OFFSET, 0);
+        regmap_write(priv->cache.map, PCM_PERIOD_OFFSET,
+                     DIV_ROUND_CLOSEST(DE10NANO_BUZZER_CLK_HZ, priv->pcm_rate));
+
+        /*
+        * The half-empty IRQ is optional; without it the PCM timer polls the
+        * FIFO instead.
+        */
+        priv->irq = platform_get_irq_optional(pdev, 0);
+        if (priv->irq < 0 && priv->irq != -ENXIO) {
+            return priv->irq;
+        }
+        if (priv->irq > 0) {
+            ret = devm_request_irq(&pdev->dev, priv->irq, buzzer_pcm_irq, 0,
+                                   "buzzer", priv);
+            if (ret) {
+                pr_err("Failed to request IRQ %d\n", priv->irq);
+                return ret;
+            }
+        }
+    }
+
+    // Let de10nano_bind bindings drive the volume and pitch.
+    ret = buzzer_bind_add_sink(pdev, priv, &priv->bind_volume,
+                               "buzzer_volume", VOLUME_OFFSET);
+    if (ret) {
+        return ret;
+    }
+    ret = buzzer_bind_add_sink(pdev, priv, &priv->bind_pitch,
+                               "buzzer_pitch", FTW_OFFSET);
+    if (ret) {
+        return ret;
+    }
+
+    // Initialize the misc device parameters
+    priv->miscdev.minor = MISC_DYNAMIC_MINOR;
+    priv->miscdev.name = "buzzer";
+    priv->miscdev.fops = &buzzer_fops;
+    priv->miscdev.parent = &pdev->dev;
+
+    // Register the misc device; this creates a char dev at /dev/buzzer
+    ret = misc_register(&priv->miscdev);
+    if (ret) {
+        pr_err("Failed to register misc device");
+        return ret;
+    }
+
+    // Register /dev/buzzer_queue for the note queue
+    priv->queue_miscdev.minor = MISC_DYNAMIC_MINOR;
+    priv->queue_miscdev.name = "buzzer_queue";
+    priv->queue_miscdev.fops = &buzzer_queue_fops;
+    priv->queue_miscdev.parent = &pdev->dev;
+
+    ret = misc_register(&priv->queue_miscdev);
+    if (ret) {
+        pr_err("Failed to register queue misc device");
+        misc_deregister(&priv->miscdev);
+        return ret;
+    }
+
+    // Register /dev/buzzer_pcm for PCM streaming
+    if (priv->pcm_depth) {
+        priv->pcm_miscdev.minor = MISC_DYNAMIC_MINOR;
+        priv->pcm_miscdev.name = "buzzer_pcm";
+        priv->pcm_miscdev.fops = &buzzer_pcm_fops;
+        priv->pcm_miscdev.parent = &pdev->dev;
+
+        ret = misc_register(&priv->pcm_miscdev);
+        if (ret) {
+            pr_err("Failed to register PCM misc device");
+            misc_deregister(&priv->queue_miscdev);
+            misc_deregister(&priv->miscdev);
+            return ret;
+        }
+    }
+
+    /* Attach the buzzer controller's private data to the platform device's struct.
+    * This is so we can access our state container in the other functions.
+    */
+    platform_set_drvdata(pdev, priv);
+
+    pr_info("buzzer_probe successful\n");
+
+    return 0;
+}
+
+/**
+*buzzer_remove() - Remove an buzzer control device.
+* @pdev: Platform device structure associated with our buzzer control device.
+*
+* This function is called when an buzzer control device is removed or
+* the driver is removed.
+*/
+static int buzzer_remove(struct platform_device *pdev)
+{
+    // Get the buzzer control's private data from the platform device.
+    struct buzzer_dev *priv = platform_get_drvdata(pdev);
+
+    // Deregister the misc devices and remove the /dev/buzzer* files.
+    if (priv->pcm_depth) {
+        misc_deregister(&priv->pcm_miscdev);
+    }
+    misc_deregister(&priv->queue_miscdev);
+    misc_deregister(&priv->miscdev);
+
+    // Make sure the note timer is no longer running.
+    hrtimer_cancel(&priv->note_timer);
+
+    // Stop PCM playback; this also disables the IRQ and stops the PCM timer.
+    if (priv->pcm_depth) {
+        buzzer_pcm_flush(priv);
+    }
+
+    pr_info("buzzer_remove successful\n");
+
+    return 0;
+}
+
+/*
+* Define the compatible property used for matching devices to this driver,
+* then add our device id structure to the kernel's device table. For a device
+* to be matched with this driver, its device tree node must use the same
+* compatible string as defined here.
+*/
+static const struct of_device_id buzzer_of_match[] = {
+    { .compatible = "Howard,buzzer", },
+    { }
+};
+MODULE_DEVICE_TABLE(of, buzzer_of_match);
+
+/**
+* volume_show() - Return the volume value to user-space via sysfs.
+* @dev: Device structure for the buzzer component. This
+* device struct is embedded in the buzzer platform
+* device struct.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t volume_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    u32 volume;
+    int ret;
+
+    struct buzzer_dev *priv = dev_get_drvdata(dev);
+
+    mutex_lock(&priv->lock);
+    ret = de10nano_regcache_read(&priv->cache, VOLUME_OFFSET, &volume);
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    return scnprintf(buf, PAGE_SIZE, "Volume = %x\n", volume);
+}
+
+/**
+* volume_store() - Store the volume value.
+* @dev: Device structure for the buzzer component. This
+* device struct is embedded in the buzzer platform
+* device struct.
+* @attr: Unused.
+* @buf: Buffer that contains the register value being written.
+* @size: The number of bytes being written.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t volume_store(struct device *dev,
+struct device_attribute *attr, const char *buf, size_t size)
+{
+    u32 volume;
+
+    int ret;
+    struct buzzer_dev *priv = dev_get_drvdata(dev);
+
+    // Parse the string we received as a u32
+    // See https://elixir.bootlin.com/linux/latest/source/lib/kstrtox.c#L289
+    ret = kstrtou32(buf, 0, &volume);
+    if (ret < 0) {
+    return ret;
+    }
+
+    mutex_lock(&priv->lock);
+    ret = de10nano_regcache_write(&priv->cache, VOLUME_OFFSET, volume);
+    if (!ret) {
+        ret = buzzer_commit(priv);
+    }
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    // Write was successful, so we return the number of bytes we wrote.
+    return size;
+}
+
+/**
+* pitch_show() - Return the pitch value to user-space via sysfs.
+* @dev: Device structure for the buzzer component. This
+* device struct is embedded in the buzzer platform
+* device struct.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t pitch_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    u32 pitch;
+    int ret;
+
+    struct buzzer_dev *priv = dev_get_drvdata(dev);
+
+    mutex_lock(&priv->lock);
+    ret = de10nano_regcache_read(&priv->cache, PITCH_OFFSET, &pitch);
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    return scnprintf(buf, PAGE_SIZE, "Pitch = %x\n", pitch);
+}
+
+/**
+* pitch_store() - Store the pitch value.
+* @dev: Device structure for the buzzer component. This
+* device struct is embedded in the buzzer platform
+* device struct.
+* @attr: Unused.
+* @buf: Buffer that contains the register value being written.
+* @size: The number of bytes being written.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t pitch_store(struct device *dev,
+struct device_attribute *attr, const char *buf, size_t size)
+{
+    u32 pitch;
+
+    int ret;
+    struct buzzer_dev *priv = dev_get_drvdata(dev);
+
+    // Parse the string we received as a u32
+    // See https://elixir.bootlin.com/linux/latest/source/lib/kstrtox.c#L289
+    ret = kstrtou32(buf, 0, &pitch);
+    if (ret < 0) {
+    return ret;
+    }
+
+    // The PWM period is only heard with the DDS tone generator off.
+    mutex_lock(&priv->lock);
+    ret = de10nano_regcache_write(&priv->cache, PITCH_OFFSET, pitch);
+    if (!ret) {
+        ret = buzzer_control_set(priv, &priv->dds, false, true);
+    }
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    // Write was successful, so we return the number of bytes we wrote.
+    return size;
+}
+
+/**
+* frequency_hz_show() - Return the DDS tone frequency via sysfs.
+* @dev: Device structure for the buzzer component. This
+* device struct is embedded in the buzzer platform
+* device struct.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Shows the frequency of the tuning word register in hertz, to the nearest
+* millihertz.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t frequency_hz_show(struct device *dev,
+struct device_attribute *attr, char *buf)
+{
+    u32 ftw;
+    u32 milli;
+    u64 hz;
+    int ret;
+    struct buzzer_dev *priv = dev_get_drvdata(dev);
+
+    mutex_lock(&priv->lock);
+    ret = de10nano_regcache_read(&priv->cache, FTW_OFFSET, &ftw);
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    hz = div_u64_rem(de10nano_buzzer_ftw_to_mhz(ftw), 1000, &milli);
+
+    return scnprintf(buf, PAGE_SIZE, "%llu.%03u\n", hz, milli);
+}
+
+/**
+* frequency_hz_store() - Set the DDS tone frequency.
+* @dev: Device structure for the buzzer component. This
+* device struct is embedded in the buzzer platform
+* device struct.
+* @attr: Unused.
+* @buf: Frequency in hertz, 0 to DE10NANO_BUZZER_MAX_FREQ_HZ, with up to
+* three fractional digits.
+* @size: The number of bytes being written.
+*
+* The frequency is converted to the nearest tuning word, about 0.0116 Hz
+* apart. The tone generator changes frequency without a phase jump.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t frequency_hz_store(struct device *dev,
+struct device_attribute *attr, const char *buf, size_t size)
+{
+    u32 mhz;
+    int ret;
+    struct buzzer_dev *priv = dev_get_drvdata(dev);
+
+    ret = buzzer_parse_mhz(buf, &mhz);
+    if (ret < 0) {
+        return ret;
+    }
+
+    mutex_lock(&priv->lock);
+    ret = de10nano_regcache_write(&priv->cache, FTW_OFFSET,
+                                  de10nano_buzzer_mhz_to_ftw(mhz));
+    if (!ret) {
+        ret = buzzer_control_set(priv, &priv->dds, true, true);
+    }
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    return size;
+}
+
+/**
+* buzzer_reg_show() - Show one of the envelope registers via sysfs.
+* @dev: Device structure for the buzzer component.
+* @offset: Offset of the register.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t buzzer_reg_show(struct device *dev, unsigned int offset,
+    char *buf)
+{
+    u32 val;
+    int ret;
+    struct buzzer_dev *priv = dev_get_drvdata(dev);
+
+    mutex_lock(&priv->lock);
+    ret = de10nano_regcache_read(&priv->cache, offset, &val);
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    return scnprintf(buf, PAGE_SIZE, "%u\n", val);
+}
+
+/**
+* buzzer_reg_store() - Store one of the envelope registers.
+* @dev: Device structure for the buzzer component.
+* @offset: Offset of the register.
+* @max: Largest value the register takes.
+* @buf: Buffer that contains the value being written.
+* @size: The number of bytes being written.
+*
+* The envelope registers aren't double buffered, so there is nothing to
+* commit.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t buzzer_reg_store(struct device *dev, unsigned int offset,
+    u32 max, const char *buf, size_t size)
+{
+    u32 val;
+    int ret;
+    struct buzzer_dev *priv = dev_get_drvdata(dev);
+
+    ret = kstrtou32(buf, 0, &val);
+    if (ret < 0) {
+        return ret;
+    }
+    if (val > max) {
+        return -ERANGE;
+    }
+
+    mutex_lock(&priv->lock);
+    ret = de10nano_regcache_write(&priv->cache, offset, val);
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    return size;
+}
+
+// Envelope times in microseconds, sustain level and LFO depths
+static ssize_t attack_us_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    return buzzer_reg_show(dev, ATTACK_OFFSET, buf);
+}
+
+static ssize_t attack_us_store(struct device *dev,
+    struct device_attribute *attr, const char *buf, size_t size)
+{
+    return buzzer_reg_store(dev, ATTACK_OFFSET, U32_MAX, buf, size);
+}
+
+static ssize_t decay_us_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    return buzzer_reg_show(dev, DECAY_OFFSET, buf);
+}
+
+static ssize_t decay_us_store(struct device *dev,
+    struct device_attribute *attr, const char *buf, size_t size)
+{
+    return buzzer_reg_store(dev, DECAY_OFFSET, U32_MAX, buf, size);
+}
+
+static ssize_t sustain_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    return buzzer_reg_show(dev, SUSTAIN_OFFSET, buf);
+}
+
+static ssize_t sustain_store(struct device *dev,
+    struct device_attribute *attr, const char *buf, size_t size)
+{
+    return buzzer_reg_store(dev, SUSTAIN_OFFSET, DE10NANO_BUZZER_MAX_VOLUME,
+                            buf, size);
+}
+
+static ssize_t release_us_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    return buzzer_reg_show(dev, RELEASE_OFFSET, buf);
+}
+
+static ssize_t release_us_store(struct device *dev,
+    struct device_attribute *attr, const char *buf, size_t size)
+{
+    return buzzer_reg_store(dev, RELEASE_OFFSET, U32_MAX, buf, size);
+}
+
+static ssize_t lfo_duty_depth_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    return buzzer_reg_show(dev, LFO_DUTY_DEPTH_OFFSET, buf);
+}
+
+static ssize_t lfo_duty_depth_store(struct device *dev,
+    struct device_attribute *attr, const char *buf, size_t size)
+{
+    return buzzer_reg_store(dev, LFO_DUTY_DEPTH_OFFSET,
+                            DE10NANO_BUZZER_MAX_DEPTH, buf, size);
+}
+
+static ssize_t lfo_pitch_depth_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    return buzzer_reg_show(dev, LFO_PITCH_DEPTH_OFFSET, buf);
+}
+
+static ssize_t lfo_pitch_depth_store(struct device *dev,
+    struct device_attribute *attr, const char *buf, size_t size)
+{
+    return buzzer_reg_store(dev, LFO_PITCH_DEPTH_OFFSET,
+                            DE10NANO_BUZZER_MAX_DEPTH, buf, size);
+}
+
+/**
+* lfo_frequency_hz_show() - Return the LFO frequency via sysfs.
+* @dev: Device structure for the buzzer component. This
+* device struct is embedded in the buzzer platform
+* device struct.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t lfo_frequency_hz_show(struct device *dev,
+struct device_attribute *attr, char *buf)
+{
+    u32 ftw;
+    u32 milli;
+    u64 hz;
+    int ret;
+    struct buzzer_dev *priv = dev_get_drvdata(dev);
+
+    mutex_lock(&priv->lock);
+    ret = de10nano_regcache_read(&priv->cache, LFO_FTW_OFFSET, &ftw);
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    hz = div_u64_rem(de10nano_buzzer_ftw_to_mhz(ftw), 1000, &milli);
+
+    return scnprintf(buf, PAGE_SIZE, "%llu.%03u\n", hz, milli);
+}
+
+/**
+* lfo_frequency_hz_store() - Set the LFO frequency.
+* @dev: Device structure for the buzzer component. This
+* device struct is embedded in the buzzer platform
+* device struct.
+* @attr: Unused.
+* @buf: Frequency in hertz with up to three fractional digits; the LFO runs
+* off the same 50 MHz clock as the tone generator and uses the same tuning
+* word conversion.
+* @size: The number of bytes being written.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t lfo_frequency_hz_store(struct device *dev,
+struct device_attribute *attr, const char *buf, size_t size)
+{
+    u32 mhz;
+    int ret;
+    struct buzzer_dev *priv = dev_get_drvdata(dev);
+
+    ret = buzzer_parse_mhz(buf, &mhz);
+    if (ret < 0) {
+        return ret;
+    }
+
+    mutex_lock(&priv->lock);
+    ret = de10nano_regcache_write(&priv->cache, LFO_FTW_OFFSET,
+                                  de10nano_buzzer_mhz_to_ftw(mhz));
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    return size;
+}
+
+/**
+* envelope_show() - Return whether the envelope shapes the volume.
+* @dev: Device structure for the buzzer component. This
+* device struct is embedded in the buzzer platform
+* device struct.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t envelope_show(struct device *dev,
+struct device_attribute *attr, char *buf)
+{
+    struct buzzer_dev *priv = dev_get_drvdata(dev);
+
+    return scnprintf(buf, PAGE_SIZE, "%d\n", READ_ONCE(priv->envelope));
+}
+
+/**
+* envelope_store() - Turn the envelope on or off.
+* @dev: Device structure for the buzzer component. This
+* device struct is embedded in the buzzer platform
+* device struct.
+* @attr: Unused.
+* @buf: 1 to shape the volume with the envelope, 0 to play the volume
+* register as it is.
+* @size: The number of bytes being written.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t envelope_store(struct device *dev,
+struct device_attribute *attr, const char *buf, size_t size)
+{
+    bool envelope;
+    int ret;
+    struct buzzer_dev *priv = dev_get_drvdata(dev);
+
+    ret = kstrtobool(buf, &envelope);
+    if (ret < 0) {
+        return ret;
+    }
+
+    mutex_lock(&priv->lock);
+    ret = buzzer_control_set(priv, &priv->envelope, envelope, false);
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    return size;
+}
+
+/**
+* gate_show() - Return whether the envelope's gate is on.
+* @dev: Device structure for the buzzer component. This
+* device struct is embedded in the buzzer platform
+* device struct.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t gate_show(struct device *dev,
+struct device_attribute *attr, char *buf)
+{
+    struct buzzer_dev *priv = dev_get_drvdata(dev);
+
+    return scnprintf(buf, PAGE_SIZE, "%d\n", READ_ONCE(priv->gate));
+}
+
+/**
+* gate_store() - Trigger or release the envelope.
+* @dev: Device structure for the buzzer component. This
+* device struct is embedded in the buzzer platform
+* device struct.
+* @attr: Unused.
+* @buf: 1 to start (or restart) the attack, 0 to start the release.
+* @size: The number of bytes being written.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t gate_store(struct device *dev,
+struct device_attribute *attr, const char *buf, size_t size)
+{
+    bool gate;
+    int ret;
+    struct buzzer_dev *priv = dev_get_drvdata(dev);
+
+    ret = kstrtobool(buf, &gate);
+    if (ret < 0) {
+        return ret;
+    }
+
+    mutex_lock(&priv->lock);
+    ret = buzzer_gate(priv, gate);
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    return size;
+}
+
+/**
+* envelope_state_show() - Return the envelope's stage and level via sysfs.
+* @dev: Device structure for the buzzer component. This
+* device struct is embedded in the buzzer platform
+* device struct.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Shows the stage the envelope is in and its level out of 65535.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t envelope_state_show(struct device *dev,
+struct device_attribute *attr, char *buf)
+{
+    static const char * const stages[] = {
+        "idle", "attack", "decay", "sustain", "release",
+    };
+    u32 status;
+    u32 stage;
+    int ret;
+    struct buzzer_dev *priv = dev_get_drvdata(dev);
+
+    mutex_lock(&priv->lock);
+    ret = de10nano_regcache_read(&priv->cache, ENV_STATUS_OFFSET, &status);
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    stage = status & ENV_STATUS_STATE_MASK;
+
+    return scnprintf(buf, PAGE_SIZE, "stage %s\nlevel %u\n",
+                     stage < ARRAY_SIZE(stages) ? stages[stage] : "unknown",
+                     status >> ENV_STATUS_LEVEL_SHIFT);
+}
+
+/**
+* num_voices_show() - Return the number of voices via sysfs.
+* @dev: Device structure for the buzzer component. This
+* device struct is embedded in the buzzer platform
+* device struct.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t num_voices_show(struct device *dev,
+struct device_attribute *attr, char *buf)
+{
+    struct buzzer_dev *priv = dev_get_drvdata(dev);
+
+    return scnprintf(buf, PAGE_SIZE, "%u\n", priv->num_voices);
+}
+
+/**
+* mix_show() - Return whether every voice is mixed into the output.
+* @dev: Device structure for the buzzer component. This
+* device struct is embedded in the buzzer platform
+* device struct.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t mix_show(struct device *dev,
+struct device_attribute *attr, char *buf)
+{
+    struct buzzer_dev *priv = dev_get_drvdata(dev);
+
+    return scnprintf(buf, PAGE_SIZE, "%d\n", READ_ONCE(priv->mix));
+}
+
+/**
+* mix_store() - Turn the voice mixer on or off.
+* @dev: Device structure for the buzzer component. This
+* device struct is embedded in the buzzer platform
+* device struct.
+* @attr: Unused.
+* @buf: 1 to mix every voice into the output, 0 to play only the main tone.
+* @size: The number of bytes being written.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t mix_store(struct device *dev,
+struct device_attribute *attr, const char *buf, size_t size)
+{
+    bool mix;
+    int ret;
+    struct buzzer_dev *priv = dev_get_drvdata(dev);
+
+    ret = kstrtobool(buf, &mix);
+    if (ret < 0) {
+        return ret;
+    }
+
+    mutex_lock(&priv->lock);
+    ret = buzzer_control_set(priv, &priv->mix, mix, false);
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    return size;
+}
+
+/**
+* voices_show() - Return every voice's frequency and volume via sysfs.
+* @dev: Device structure for the buzzer component. This
+* device struct is embedded in the buzzer platform
+* device struct.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Shows one "voice frequency_hz volume" line per voice; voice 0 is the main
+* tone.
 *
-* When a device that is compatible with this buzzer control driver is found, the
-* driver's probe function is called. This probe function gets called by the
-* kernel when an buzzer device is found in the device tree.
+* Return: The number of bytes read.
 */
-static int buzzer_probe(struct platform_device *pdev)
+static ssize_t voices_show(struct device *dev,
+struct device_attribute *attr, char *buf)
 {
-    struct buzzer_dev *priv;
-    size_t ret;
+    unsigned int voice;
+    u32 ftw;
+    u32 volume;
+    u32 milli;
+    u64 hz;
+    int ret = 0;
+    ssize_t len = 0;
+    struct buzzer_dev *priv = dev_get_drvdata(dev);
 
-    /*
-    * Allocate kernel memory for the buzzer control device and set it to 0.
-    * GFP_KERNEL specifies that we are allocating normal kernel RAM;
-    * see the kmalloc documentation for more info. The allocated memory
-    * is automatically freed when the device is removed.
-    */
-    priv = devm_kzalloc(&pdev->dev, sizeof(struct buzzer_dev),
-                        GFP_KERNEL);
-    if (!priv) {
-        pr_err("Failed to allocate memory\n");
-        return -ENOMEM;
+    mutex_lock(&priv->lock);
+    for (voice = 0; voice < priv->num_voices && !ret; voice++) {
+        ret = de10nano_regcache_read(&priv->cache,
+                                     voice ? VOICE_FTW_OFFSET(voice) : FTW_OFFSET,
+                                     &ftw);
+        if (!ret) {
+            ret = de10nano_regcache_read(&priv->cache,
+                                         voice ? VOICE_VOLUME_OFFSET(voice) :
+                                         VOLUME_OFFSET, &volume);
+        }
+        if (!ret) {
+            hz = div_u64_rem(de10nano_buzzer_ftw_to_mhz(ftw), 1000, &milli);
+            len += scnprintf(buf + len, PAGE_SIZE - len, "%u %llu.%03u %u\n",
+                             voice, hz, milli, volume);
+        }
     }
-
-    /*
-    * Request and remap the device's memory region. Requesting the region
-    * make sure nobody else can use that memory. The memory is remapped
-    * into the kernel's virtual address space because we don't have access
-    * to physical memory locations.
-    */
-    priv->base_addr = devm_platform_ioremap_resource(pdev, 0);
-    if (IS_ERR(priv->base_addr)) {
-        pr_err("Failed to request/remap platform device resource\n");
-        return PTR_ERR(priv->base_addr);
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
     }
 
-    // Set the memory addresses for each register.
-    priv->volume = priv->base_addr + VOLUME_OFFSET;
-    priv->pitch = priv->base_addr + PITCH_OFFSET;
+    return len;
+}
 
-    // Set the pitch to 262 Hz (middle C) and volume to 0 to begin
-    iowrite32(0x0, priv->volume);
-    iowrite32(0x0106, priv->pitch);
+/**
+* voices_store() - Set one voice's frequency and volume.
+* @dev: Device structure for the buzzer component. This
+* device struct is embedded in the buzzer platform
+* device struct.
+* @attr: Unused.
+* @buf: "voice frequency_hz volume", e.g. "2 659.255 0x40000"; the
+* frequency takes up to three fractional digits.
+* @size: The number of bytes being written.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t voices_store(struct device *dev,
+struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct de10nano_buzzer_voice settings;
+    unsigned int voice;
+    char freq[16];
+    char volume[16];
+    int ret;
+    struct buzzer_dev *priv = dev_get_drvdata(dev);
 
-    // Initialize the misc device parameters
-    priv->miscdev.minor = MISC_DYNAMIC_MINOR;
-    priv->miscdev.name = "buzzer";
-    priv->miscdev.fops = &buzzer_fops;
-    priv->miscdev.parent = &pdev->dev;
+    if (sscanf(buf, "%u %15s %15s", &voice, freq, volume) != 3) {
+        return -EINVAL;
+    }
+    ret = buzzer_parse_mhz(freq, &settings.freq_mhz);
+    if (ret < 0) {
+        return ret;
+    }
+    ret = kstrtou32(volume, 0, &settings.volume);
+    if (ret < 0) {
+        return ret;
+    }
 
-    // Register the misc device; this creates a char dev at /dev/buzzer
-    ret = misc_register(&priv->miscdev);
+    mutex_lock(&priv->lock);
+    ret = buzzer_voice_write(priv, voice, &settings);
+    if (!ret) {
+        ret = buzzer_commit(priv);
+    }
+    mutex_unlock(&priv->lock);
     if (ret) {
-        pr_err("Failed to register misc device");
         return ret;
     }
 
-    /* Attach the buzzer controller's private data to the platform device's struct.
-    * This is so we can access our state container in the other functions.
-    */
-    platform_set_drvdata(pdev, priv);
-
-    pr_info("buzzer_probe successful\n");
-
-    return 0;
+    return size;
 }
 
 /**
-*buzzer_remove() - Remove an buzzer control device.
-* @pdev: Platform device structure associated with our buzzer control device.
+* pwm_counts_show() - Return the PWM controller's limits via sysfs.
+* @dev: Device structure for the buzzer component. This
+* device struct is embedded in the buzzer platform
+* device struct.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
 *
-* This function is called when an buzzer control device is removed or
-* the driver is removed.
+* Shows the period and high time in clock cycles, as computed by the
+* hardware from the registers and in use for the current period.
+*
+* Return: The number of bytes read.
 */
-static int buzzer_remove(struct platform_device *pdev)
+static ssize_t pwm_counts_show(struct device *dev,
+struct device_attribute *attr, char *buf)
 {
-    // Get the buzzer control's private data from the platform device.
-    struct buzzer_dev *priv = platform_get_drvdata(pdev);
-
-    // Deregister the misc device and remove the /dev/buzzer file.
-    misc_deregister(&priv->miscdev);
+    u32 period;
+    u32 duty;
+    int ret;
+    struct buzzer_dev *priv = dev_get_drvdata(dev);
 
-    pr_info("buzzer_remove successful\n");
+    mutex_lock(&priv->lock);
+    ret = de10nano_regcache_read(&priv->cache, PERIOD_COUNT_OFFSET, &period);
+    if (!ret) {
+        ret = de10nano_regcache_read(&priv->cache, DUTY_COUNT_OFFSET, &duty);
+    }
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
 
-    return 0;
+    return scnprintf(buf, PAGE_SIZE, "period %u\nduty %u\n", period, duty);
 }
 
-/*
-* Define the compatible property used for matching devices to this driver,
-* then add our device id structure to the kernel's device table. For a device
-* to be matched with this driver, its device tree node must use the same
-* compatible string as defined here.
-*/
-static const struct of_device_id buzzer_of_match[] = {
-    { .compatible = "Howard,buzzer", },
-    { }
-};
-MODULE_DEVICE_TABLE(of, buzzer_of_match);
-
 /**
-* volume_show() - Return the volume value to user-space via sysfs.
+* double_buffer_show() - Return whether register writes are double buffered.
 * @dev: Device structure for the buzzer component. This
 * device struct is embedded in the buzzer platform
 * device struct.
@@ -268,117 +2651,273 @@ MODULE_DEVICE_TABLE(of, buzzer_of_match);
 *
 * Return: The number of bytes read.
 */
-static ssize_t volume_show(struct device *dev,
-    struct device_attribute *attr, char *buf)
+static ssize_t double_buffer_show(struct device *dev,
+struct device_attribute *attr, char *buf)
 {
-    u32 volume;
-
     struct buzzer_dev *priv = dev_get_drvdata(dev);
 
-    volume = ioread32(priv->volume);
-
-    return scnprintf(buf, PAGE_SIZE, "Volume = %x\n", volume);
+    return scnprintf(buf, PAGE_SIZE, "%d\n", READ_ONCE(priv->double_buffer));
 }
 
 /**
-* volume_store() - Store the volume value.
+* double_buffer_store() - Turn double buffering on or off.
 * @dev: Device structure for the buzzer component. This
 * device struct is embedded in the buzzer platform
 * device struct.
 * @attr: Unused.
-* @buf: Buffer that contains the register value being written.
+* @buf: 1 to hold register writes until they are committed at the end of a
+* PWM period, 0 to let them reach the PWM right away.
 * @size: The number of bytes being written.
 *
 * Return: The number of bytes stored.
 */
-static ssize_t volume_store(struct device *dev,
+static ssize_t double_buffer_store(struct device *dev,
 struct device_attribute *attr, const char *buf, size_t size)
 {
-    u32 volume;
-
+    bool double_buffer;
     int ret;
     struct buzzer_dev *priv = dev_get_drvdata(dev);
 
-    // Parse the string we received as a u32
-    // See https://elixir.bootlin.com/linux/latest/source/lib/kstrtox.c#L289
-    ret = kstrtou32(buf, 0, &volume);
+    ret = kstrtobool(buf, &double_buffer);
     if (ret < 0) {
-    return ret;
+        return ret;
     }
 
-    iowrite32(volume, priv->volume);
+    mutex_lock(&priv->lock);
+    ret = buzzer_control_set(priv, &priv->double_buffer, double_buffer, true);
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
 
-    // Write was successful, so we return the number of bytes we wrote.
     return size;
 }
 
 /**
-* pitch_show() - Return the pitch value to user-space via sysfs.
+* cache_sync_store() - Write the cached register values back to the hardware.
 * @dev: Device structure for the buzzer component. This
 * device struct is embedded in the buzzer platform
 * device struct.
 * @attr: Unused.
-* @buf: Buffer that gets returned to user-space.
+* @buf: Unused; any write triggers the sync.
+* @size: The number of bytes being written.
 *
-* Return: The number of bytes read.
+* Reloading the FPGA bitstream resets the component's registers behind the
+* cache's back; write to this attribute afterwards to restore them.
+*
+* Return: The number of bytes stored.
 */
-static ssize_t pitch_show(struct device *dev,
-    struct device_attribute *attr, char *buf)
+static ssize_t cache_sync_store(struct device *dev,
+struct device_attribute *attr, const char *buf, size_t size)
 {
-    u32 pitch;
+    int ret;
+    struct buzzer_dev *priv = dev_get_drvdata(dev);
+
+    mutex_lock(&priv->lock);
+    ret = de10nano_regcache_sync(&priv->cache);
+    if (!ret) {
+        ret = buzzer_control_write(priv, true);
+    }
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    return size;
+}
 
+/**
+* pcm_rate_show() - Return the PCM sample rate via sysfs.
+* @dev: Device structure for the buzzer component. This
+* device struct is embedded in the buzzer platform
+* device struct.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read, or -ENODEV without a PCM FIFO.
+*/
+static ssize_t pcm_rate_show(struct device *dev,
+struct device_attribute *attr, char *buf)
+{
     struct buzzer_dev *priv = dev_get_drvdata(dev);
 
-    pitch = ioread32(priv->pitch);
+    if (!priv->pcm_depth) {
+        return -ENODEV;
+    }
 
-    return scnprintf(buf, PAGE_SIZE, "Pitch = %x\n", pitch);
+    return scnprintf(buf, PAGE_SIZE, "%u\n", READ_ONCE(priv->pcm_rate));
 }
 
 /**
-* pitch_store() - Store the pitch value.
+* pcm_rate_store() - Set the PCM sample rate via sysfs.
 * @dev: Device structure for the buzzer component. This
 * device struct is embedded in the buzzer platform
 * device struct.
 * @attr: Unused.
-* @buf: Buffer that contains the register value being written.
+* @buf: Sample rate in Hz, DE10NANO_BUZZER_PCM_MIN_RATE to
+* DE10NANO_BUZZER_PCM_MAX_RATE.
 * @size: The number of bytes being written.
 *
 * Return: The number of bytes stored.
 */
-static ssize_t pitch_store(struct device *dev,
+static ssize_t pcm_rate_store(struct device *dev,
 struct device_attribute *attr, const char *buf, size_t size)
 {
-    u32 pitch;
-
+    u32 rate;
     int ret;
     struct buzzer_dev *priv = dev_get_drvdata(dev);
 
-    // Parse the string we received as a u32
-    // See https://elixir.bootlin.com/linux/latest/source/lib/kstrtox.c#L289
-    ret = kstrtou32(buf, 0, &pitch);
+    if (!priv->pcm_depth) {
+        return -ENODEV;
+    }
+
+    ret = kstrtou32(buf, 0, &rate);
     if (ret < 0) {
-    return ret;
+        return ret;
     }
 
-    iowrite32(pitch, priv->pitch);
+    ret = buzzer_pcm_set_rate(priv, rate);
+    if (ret) {
+        return ret;
+    }
 
-    // Write was successful, so we return the number of bytes we wrote.
     return size;
 }
 
+/**
+* pcm_stats_show() - Return the PCM throughput and underrun counters.
+* @dev: Device structure for the buzzer component. This
+* device struct is embedded in the buzzer platform
+* device struct.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Shows the fields of struct de10nano_buzzer_pcm_stats, one per line.
+*
+* Return: The number of bytes read, or -ENODEV without a PCM FIFO.
+*/
+static ssize_t pcm_stats_show(struct device *dev,
+struct device_attribute *attr, char *buf)
+{
+    struct de10nano_buzzer_pcm_stats stats;
+    struct buzzer_dev *priv = dev_get_drvdata(dev);
+
+    if (!priv->pcm_depth) {
+        return -ENODEV;
+    }
+
+    buzzer_pcm_get_stats(priv, &stats);
+
+    return scnprintf(buf, PAGE_SIZE,
+                     "written %llu\npushed %llu\nrefills %llu\n"
+                     "underruns %u\nring %u\nfifo %u\nrate %u\n",
+                     stats.written, stats.pushed, stats.refills,
+                     stats.underruns, stats.ring, stats.fifo, stats.rate);
+}
+
 // Define sysfs attributes
 static DEVICE_ATTR_RW(volume);
 static DEVICE_ATTR_RW(pitch);
+static DEVICE_ATTR_RW(frequency_hz);
+static DEVICE_ATTR_RW(envelope);
+static DEVICE_ATTR_RW(gate);
+static DEVICE_ATTR_RW(attack_us);
+static DEVICE_ATTR_RW(decay_us);
+static DEVICE_ATTR_RW(sustain);
+static DEVICE_ATTR_RW(release_us);
+static DEVICE_ATTR_RW(lfo_frequency_hz);
+static DEVICE_ATTR_RW(lfo_duty_depth);
+static DEVICE_ATTR_RW(lfo_pitch_depth);
+static DEVICE_ATTR_RO(envelope_state);
+static DEVICE_ATTR_RO(num_voices);
+static DEVICE_ATTR_RW(mix);
+static DEVICE_ATTR_RW(voices);
+static DEVICE_ATTR_RW(pcm_rate);
+static DEVICE_ATTR_RO(pcm_stats);
+static DEVICE_ATTR_RW(double_buffer);
+static DEVICE_ATTR_RO(pwm_counts);
+static DEVICE_ATTR_WO(cache_sync);
 
 // Create an attribute group so the device core can
 // export the attributes for us.
 static struct attribute *buzzer_attrs[] = {
     &dev_attr_volume.attr,
     &dev_attr_pitch.attr,
+    &dev_attr_frequency_hz.attr,
+    &dev_attr_envelope.attr,
+    &dev_attr_gate.attr,
+    &dev_attr_attack_us.attr,
+    &dev_attr_decay_us.attr,
+    &dev_attr_sustain.attr,
+    &dev_attr_release_us.attr,
+    &dev_attr_lfo_frequency_hz.attr,
+    &dev_attr_lfo_duty_depth.attr,
+    &dev_attr_lfo_pitch_depth.attr,
+    &dev_attr_envelope_state.attr,
+    &dev_attr_num_voices.attr,
+    &dev_attr_mix.attr,
+    &dev_attr_voices.attr,
+    &dev_attr_pcm_rate.attr,
+    &dev_attr_pcm_stats.attr,
+    &dev_attr_double_buffer.attr,
+    &dev_attr_pwm_counts.attr,
+    &dev_attr_cache_sync.attr,
     NULL,
 };
 ATTRIBUTE_GROUPS(buzzer);
 
+/**
+* buzzer_suspend() - Hold register writes in the cache while suspended.
+* @dev: Device structure for the buzzer component.
+*
+* Queued notes and PCM samples are dropped so the buzzer is silent while
+* suspended.
+*
+* Return: 0.
+*/
+static int buzzer_suspend(struct device *dev)
+{
+    struct buzzer_dev *priv = dev_get_drvdata(dev);
+
+    mutex_lock(&priv->queue_write_lock);
+    buzzer_queue_flush(priv);
+    mutex_unlock(&priv->queue_write_lock);
+
+    if (priv->pcm_depth) {
+        buzzer_pcm_flush(priv);
+    }
+
+    de10nano_regcache_suspend(&priv->cache);
+
+    return 0;
+}
+
+/**
+* buzzer_resume() - Restore the registers from the cache after a resume.
+* @dev: Device structure for the buzzer component.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int buzzer_resume(struct device *dev)
+{
+    struct buzzer_dev *priv = dev_get_drvdata(dev);
+    int ret;
+
+    ret = de10nano_regcache_resume(&priv->cache);
+    if (ret) {
+        return ret;
+    }
+
+    // The control register isn't cached, so restore it by hand.
+    mutex_lock(&priv->lock);
+    ret = buzzer_control_write(priv, true);
+    mutex_unlock(&priv->lock);
+
+    return ret;
+}
+
+static DEFINE_SIMPLE_DEV_PM_OPS(buzzer_pm_ops, buzzer_suspend, buzzer_resume);
+
 /*
 * struct buzzer_driver - Platform driver struct for the buzzer driver
 * @probe: Function that's called when a device is found
@@ -386,6 +2925,7 @@ ATTRIBUTE_GROUPS(buzzer);
 * @driver.owner: Which module owns this driver
 * @driver.name: Name of the buzzer driver
 * @driver.of_match_table: Device tree match table
+* @driver.pm: Suspend/resume callbacks
 */
 static struct platform_driver buzzer_driver = {
     .probe = buzzer_probe,
@@ -395,14 +2935,55 @@ static struct platform_driver buzzer_driver = {
         .name = "buzzer",
         .of_match_table = buzzer_of_match,
         .dev_groups = buzzer_groups,
+        .pm = pm_sleep_ptr(&buzzer_pm_ops),
     },
 };
 
-/*
-* We don't need to do anything special in module init/exit.
-* This macro automatically handles module init/exit.
+// Emulated platform device, only registered when emulate is set.
+static struct platform_device *buzzer_emu_pdev;
+
+/**
+* buzzer_init() - Register the buzzer platform driver.
+*
+* When the emulate module parameter is set, a RAM-backed buzzer device is
+* registered as well so the driver can be tested without the FPGA.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int __init buzzer_init(void)
+{
+    int ret;
+
+    ret = platform_driver_register(&buzzer_driver);
+    if (ret) {
+        return ret;
+    }
+
+    if (emulate) {
+        buzzer_emu_pdev = platform_device_register_simple("buzzer",
+                            PLATFORM_DEVID_NONE, NULL, 0);
+        if (IS_ERR(buzzer_emu_pdev)) {
+            platform_driver_unregister(&buzzer_driver);
+            return PTR_ERR(buzzer_emu_pdev);
+        }
+    }
+
+    return 0;
+}
+
+/**
+* buzzer_exit() - Remove the emulated device (if any) and the platform driver.
 */
-module_platform_driver(buzzer_driver);
+static void __exit buzzer_exit(void)
+{
+    if (buzzer_emu_pdev) {
+        platform_device_unregister(buzzer_emu_pdev);
+    }
+    platform_driver_unregister(&buzzer_driver);
+}
+
+module_init(buzzer_init);
+module_exit(buzzer_exit);
 
 MODULE_LICENSE("Dual MIT/GPL");
 MODULE_AUTHOR("Seth Howard");
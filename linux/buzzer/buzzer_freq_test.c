@@ -0,0 +1,163 @@
+// SPDX-License-Identifier: GPL-2.0 or MIT
+/*
+* Host test of the buzzer's frequency handling: the millihertz to tuning word
+* conversions in de10nano_buzzer.h and buzzer_parse_mhz(). Build and run it
+* with `make test`.
+*/
+#include <stdio.h>
+#include <stdint.h>
+
+#include "buzzer_parse.h"
+
+static int failures;
+
+#define EXPECT_EQ(got, want) expect_eq(__LINE__, #got, (got), (want))
+
+static void expect_eq(int line, const char *what, int64_t got, int64_t want)
+{
+    if (got != want) {
+        printf("line %d: %s: got %lld, want %lld\n", line, what,
+               (long long)got, (long long)want);
+        failures++;
+    }
+}
+
+// Exact round-to-nearest reference: mhz * 2^32 / (1000 * clk)
+static uint32_t ref_mhz_to_ftw(uint32_t mhz)
+{
+    unsigned __int128 num = (unsigned __int128)mhz << 32;
+    uint64_t den = 1000ULL * DE10NANO_BUZZER_CLK_HZ;
+
+    return (num + den / 2) / den;
+}
+
+// Exact round-to-nearest reference: ftw * 1000 * clk / 2^32
+static uint64_t ref_ftw_to_mhz(uint32_t ftw)
+{
+    unsigned __int128 num = (unsigned __int128)ftw * 1000 *
+        DE10NANO_BUZZER_CLK_HZ;
+
+    return (num + (1ULL << 31)) >> 32;
+}
+
+static void test_conversions(void)
+{
+    uint32_t max_mhz = DE10NANO_BUZZER_MAX_FREQ_HZ * 1000;
+    uint32_t max_ftw = de10nano_buzzer_mhz_to_ftw(max_mhz);
+    uint32_t prev = 0;
+    uint32_t ftw;
+    uint32_t mhz;
+    uint32_t bad = 0;
+
+    EXPECT_EQ(de10nano_buzzer_mhz_to_ftw(0), 0);
+    EXPECT_EQ(de10nano_buzzer_ftw_to_mhz(0), 0);
+
+    // A4 and the range limits
+    EXPECT_EQ(de10nano_buzzer_mhz_to_ftw(440000), 37796);
+    EXPECT_EQ(de10nano_buzzer_mhz_to_ftw(max_mhz), ref_mhz_to_ftw(max_mhz));
+    EXPECT_EQ(de10nano_buzzer_mhz_to_ftw(DE10NANO_BUZZER_MIN_FREQ_HZ * 1000),
+              ref_mhz_to_ftw(DE10NANO_BUZZER_MIN_FREQ_HZ * 1000));
+
+    // Half the clock is the top of the accumulator; all ones stays in 64 bits.
+    EXPECT_EQ(de10nano_buzzer_ftw_to_mhz(1U << 31),
+              DE10NANO_BUZZER_CLK_HZ / 2 * 1000ULL);
+    EXPECT_EQ(de10nano_buzzer_ftw_to_mhz(UINT32_MAX),
+              ref_ftw_to_mhz(UINT32_MAX));
+
+    /*
+    * Every millihertz in range: the tuning word is the nearest one (the
+    * reciprocal is rounded down, so it may only differ from the exact
+    * rounding by one where the exact value is within a hair of a half) and
+    * never goes down as the frequency goes up.
+    */
+    for (mhz = 0; mhz <= max_mhz; mhz++) {
+        ftw = de10nano_buzzer_mhz_to_ftw(mhz);
+        if (ftw < prev || ftw + 1 < ref_mhz_to_ftw(mhz) ||
+            ftw > ref_mhz_to_ftw(mhz) + 1) {
+            if (bad++ < 10) {
+                printf("mhz %u: ftw %u, want %u\n", mhz, ftw,
+                       ref_mhz_to_ftw(mhz));
+            }
+        }
+        prev = ftw;
+    }
+    EXPECT_EQ(bad, 0);
+
+    // Every tuning word in range: exact conversion back, and a round trip.
+    bad = 0;
+    for (ftw = 0; ftw <= max_ftw; ftw++) {
+        if (de10nano_buzzer_ftw_to_mhz(ftw) != ref_ftw_to_mhz(ftw) ||
+            de10nano_buzzer_mhz_to_ftw(de10nano_buzzer_ftw_to_mhz(ftw)) != ftw) {
+            if (bad++ < 10) {
+                printf("ftw %u: mhz %llu, want %llu\n", ftw,
+                       (unsigned long long)de10nano_buzzer_ftw_to_mhz(ftw),
+                       (unsigned long long)ref_ftw_to_mhz(ftw));
+            }
+        }
+    }
+    EXPECT_EQ(bad, 0);
+}
+
+#define EXPECT_PARSE(buf, ret, want) expect_parse(__LINE__, (buf), (ret), (want))
+
+static void expect_parse(int line, const char *buf, int want_ret,
+    uint32_t want_mhz)
+{
+    uint32_t mhz = 0xdeadbeef;
+    int ret = buzzer_parse_mhz(buf, &mhz);
+
+    if (ret != want_ret || (!ret && mhz != want_mhz)) {
+        printf("line %d: \"%s\": got %d/%u, want %d/%u\n", line, buf, ret, mhz,
+               want_ret, want_mhz);
+        failures++;
+    }
+}
+
+static void test_parse(void)
+{
+    EXPECT_PARSE("440", 0, 440000);
+    EXPECT_PARSE("440\n", 0, 440000);
+    EXPECT_PARSE("440.5", 0, 440500);
+    EXPECT_PARSE("440.5\n", 0, 440500);
+    EXPECT_PARSE("440.05", 0, 440050);
+    EXPECT_PARSE("440.123", 0, 440123);
+    EXPECT_PARSE("440.", 0, 440000);
+    EXPECT_PARSE("0", 0, 0);
+    EXPECT_PARSE("0.001", 0, 1);
+    EXPECT_PARSE("+440", 0, 440000);
+    EXPECT_PARSE("20000", 0, 20000000);
+    EXPECT_PARSE("20000.000", 0, 20000000);
+
+    // Above the highest frequency
+    EXPECT_PARSE("20000.001", -ERANGE, 0);
+    EXPECT_PARSE("20001", -ERANGE, 0);
+    EXPECT_PARSE("4294967295", -ERANGE, 0);
+    EXPECT_PARSE("4294967296", -ERANGE, 0);
+    EXPECT_PARSE("4294967296.5", -ERANGE, 0);
+
+    // Not a frequency
+    EXPECT_PARSE("", -EINVAL, 0);
+    EXPECT_PARSE("\n", -EINVAL, 0);
+    EXPECT_PARSE(".5", -EINVAL, 0);
+    EXPECT_PARSE("440.1234", -EINVAL, 0);
+    EXPECT_PARSE("440.5x", -EINVAL, 0);
+    EXPECT_PARSE("440.5\n\n", -EINVAL, 0);
+    EXPECT_PARSE("440x", -EINVAL, 0);
+    EXPECT_PARSE("-440", -EINVAL, 0);
+    EXPECT_PARSE("x.5", -EINVAL, 0);
+    EXPECT_PARSE("1.2.3", -EINVAL, 0);
+    EXPECT_PARSE("12345678901.5", -EINVAL, 0);
+}
+
+int main(void)
+{
+    test_conversions();
+    test_parse();
+
+    if (failures) {
+        printf("buzzer_freq: %d failures\n", failures);
+        return 1;
+    }
+    printf("buzzer_freq: all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,114 @@
+/* SPDX-License-Identifier: GPL-2.0 or MIT */
+/*
+* Parsing of the buzzer driver's sysfs frequencies. It has no kernel
+* dependencies besides kstrtou32, so the header also builds on the host.
+*/
+#ifndef BUZZER_PARSE_H
+#define BUZZER_PARSE_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/errno.h>
+#include <linux/kstrtox.h>
+#include <linux/ctype.h>
+#include <linux/string.h>
+#else
+#include <stdint.h>
+#include <errno.h>
+#include <ctype.h>
+#include <string.h>
+
+typedef uint32_t u32;
+
+// Like the kernel's: an optional '+', decimal digits, an optional trailing
+// newline, and no overflow
+static inline int kstrtou32(const char *s, unsigned int base, u32 *res)
+{
+    uint64_t val = 0;
+
+    if (*s == '+') {
+        s++;
+    }
+    if (base != 10 || !isdigit((unsigned char)*s)) {
+        return -EINVAL;
+    }
+    for (; isdigit((unsigned char)*s); s++) {
+        val = val * 10 + (*s - '0');
+        if (val > UINT32_MAX) {
+            return -ERANGE;
+        }
+    }
+    if (*s == '\n') {
+        s++;
+    }
+    if (*s) {
+        return -EINVAL;
+    }
+
+    *res = val;
+    return 0;
+}
+#endif
+
+#include "de10nano_buzzer.h"               // DE10NANO_BUZZER_MAX_FREQ_HZ
+
+/**
+* buzzer_parse_mhz() - Parse a frequency in hertz into millihertz.
+* @buf: Decimal frequency with up to three fractional digits, e.g. "440.5".
+* @mhz: Parsed frequency.
+*
+* Return: 0 on success, -EINVAL if @buf isn't a frequency, or -ERANGE if it
+* is above DE10NANO_BUZZER_MAX_FREQ_HZ.
+*/
+static inline int buzzer_parse_mhz(const char *buf, u32 *mhz)
+{
+    const char *frac = strchr(buf, '.');
+    char whole[11];
+    size_t len;
+    unsigned int digits = 0;
+    u32 hz;
+    u32 milli = 0;
+    int ret;
+
+    if (!frac) {
+        ret = kstrtou32(buf, 10, &hz);
+    } else {
+        len = frac - buf;
+        if (len == 0 || len >= sizeof(whole)) {
+            return -EINVAL;
+        }
+        memcpy(whole, buf, len);
+        whole[len] = '\0';
+        ret = kstrtou32(whole, 10, &hz);
+
+        for (frac++; isdigit(*frac); frac++) {
+            if (digits == 3) {
+                return -EINVAL;
+            }
+            milli = milli * 10 + (*frac - '0');
+            digits++;
+        }
+        for (; digits < 3; digits++) {
+            milli *= 10;
+        }
+        if (*frac == '\n') {
+            frac++;
+        }
+        if (*frac) {
+            return -EINVAL;
+        }
+    }
+    if (ret < 0) {
+        return ret;
+    }
+
+    if (hz > DE10NANO_BUZZER_MAX_FREQ_HZ ||
+        (hz == DE10NANO_BUZZER_MAX_FREQ_HZ && milli)) {
+        return -ERANGE;
+    }
+
+    *mhz = hz * 1000 + milli;
+    return 0;
+}
+
+#endif /* BUZZER_PARSE_H */
@@ -0,0 +1,1113 @@
+#include <linux/module.h>                   // Basic kernel module definitions
+#include <linux/platform_device.h>          // Platfrom driver/device definitions
+#include <linux/mod_devicetable.h>          // of_device_id and MODULE_DEVICE_TABLE
+#include <linux/io.h>                       // iowrite32/ioread32 functions
+#include <linux/mutex.h>                    // mutex definitions
+#include <linux/miscdevice.h>               // miscdevice definitions
+#include <linux/types.h>                    // data types
+#include <linux/fs.h>                       // copy_to_user
+#include <linux/uio.h>                      // iov_iter, copy_to_iter/copy_from_iter
+#include <linux/kstrtox.h>                  // kstrtouint
+#include <linux/string.h>                   // match_string, argv_split
+
+#include "de10nano_xfer.h"                 // DE10NANO_IOC_REG_XFER
+#include "de10nano_mmap.h"                 // de10nano_mmap_regs
+#include "de10nano_regcache.h"             // de10nano_regcache_*
+#include "de10nano_crossbar.h"             // DE10NANO_CROSSBAR_IOC_SET_ROUTE
+
+#define CONTROL_OFFSET          0x00            // Bit 0 enables the routes
+#define INFO_OFFSET             0x04            // Number of routes and sources (read-only)
+#define ADC_PERIOD_OFFSET       0x08            // Clock cycles between ADC sweeps
+#define ACTIVE_OFFSET           0x0C            // One bit per route driving its sink (read-only)
+#define SOURCE_OFFSET(i)        (0x40 + 4 * (i))    // Latest source values (read-only)
+#define OUTPUT_OFFSET(r)        (0x80 + 4 * (r))    // Route outputs (read-only)
+#define ROUTE_OFFSET(r)         (0x100 + 0x20 * (r))    // Start of a route's registers
+#define ROUTE_CTRL              0x00            // Source, mode and shift
+#define ROUTE_IN_OFFSET         0x04
+#define ROUTE_SCALE             0x08
+#define ROUTE_OUT_OFFSET        0x0C
+#define ROUTE_OUT_MIN           0x10
+#define ROUTE_OUT_MAX           0x14
+#define LUT_OFFSET(r, i)        (0x200 + 0x40 * (r) + 4 * (i))  // Lookup tables (write-only)
+#define SPAN 1024                               // Span of the components memory space
+
+#define CTRL_SOURCE_MASK        0x0f
+#define CTRL_MODE_SHIFT         4
+#define CTRL_MODE_MASK          0x03
+#define CTRL_SHIFT_SHIFT        8
+#define CTRL_SHIFT_MASK         0x1f
+
+#define CROSSBAR_CLK_HZ         50000000        // Fabric clock the ADC period counts
+#define CROSSBAR_ADC_RATE_HZ    10000           // Default ADC sweeps per second
+#define CROSSBAR_MAX_ADC_RATE_HZ 100000         // The eight reads add about 20 us more
+
+/**
+* struct crossbar_dev - Private crossbar device struct.
+* @base_addr: Pointer to the component's base address
+* @phys_addr: Physical address of the component's registers
+* @emulated: The registers are backed by RAM instead of the FPGA
+* @cache: Register cache; the configuration registers are host-owned, and
+* the cache also remembers the lookup tables, which can't be read back
+* @miscdev: miscdevice used to create a character device
+* @lock: mutex used to prevent concurrent writes to memory
+*
+* A crossbar_dev struct gets created for each crossbar component.
+*/
+struct crossbar_dev {
+    void __iomem *base_addr;
+    phys_addr_t phys_addr;
+    bool emulated;
+    struct de10nano_regcache cache;
+    struct miscdevice miscdev;
+    struct mutex lock;
+};
+
+// Names of the sources, indexed by de10nano_crossbar_source
+static const char * const crossbar_source_names[] = {
+    "rotary",
+    "adc0", "adc1", "adc2", "adc3", "adc4", "adc5", "adc6", "adc7",
+};
+
+// Names used by the route sysfs attributes, indexed by de10nano_crossbar_mode
+static const char * const crossbar_mode_names[] = {
+    [DE10NANO_CROSSBAR_MODE_OFF] = "off",
+    [DE10NANO_CROSSBAR_MODE_LINEAR] = "linear",
+    [DE10NANO_CROSSBAR_MODE_LUT] = "lut",
+};
+
+/*
+* When emulate is set, the module registers its own platform device whose
+* registers are backed by a page of ordinary RAM instead of the FPGA. This
+* lets the driver be loaded and exercised on a stock x86 kernel.
+*/
+static bool emulate;
+module_param(emulate, bool, 0444);
+MODULE_PARM_DESC(emulate, "Back the registers with RAM instead of the FPGA");
+
+/**
+* crossbar_volatile_reg() - Tell the register cache which registers the
+* hardware changes.
+* @dev: Unused.
+* @reg: Register offset.
+*
+* Return: true for the ACTIVE, source and output registers.
+*/
+static bool crossbar_volatile_reg(struct device *dev, unsigned int reg)
+{
+    return reg == ACTIVE_OFFSET ||
+           (reg >= SOURCE_OFFSET(0) && reg < OUTPUT_OFFSET(0) + 0x40);
+}
+
+/**
+* crossbar_writeonly_reg() - Tell the register cache which registers can't
+* be read back.
+* @dev: Unused.
+* @reg: Register offset.
+*
+* Return: true for the lookup tables, which read back as 0. The cache holds
+* the only copy of their contents, so it must never be reloaded from the
+* hardware.
+*/
+static bool crossbar_writeonly_reg(struct device *dev, unsigned int reg)
+{
+    return reg >= LUT_OFFSET(0, 0) &&
+           reg < LUT_OFFSET(DE10NANO_CROSSBAR_NUM_SINKS, 0);
+}
+
+/**
+* crossbar_route_set() - Program one sink's route.
+* @priv: The crossbar.
+* @route: The new route.
+*
+* The parameters and the lookup table are written before the control
+* register, so the sink never sees a half-programmed route: it keeps the
+* old source and mode until the last write. The caller must hold the lock.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int crossbar_route_set(struct crossbar_dev *priv,
+                              const struct de10nano_crossbar_route *route)
+{
+    unsigned int base;
+    u32 ctrl;
+    size_t i;
+    int ret;
+
+    if (route->sink >= DE10NANO_CROSSBAR_NUM_SINKS ||
+        route->source >= DE10NANO_CROSSBAR_NUM_SOURCES ||
+        route->mode >= ARRAY_SIZE(crossbar_mode_names) ||
+        route->shift > DE10NANO_CROSSBAR_MAX_SHIFT ||
+        route->scale < DE10NANO_CROSSBAR_SCALE_MIN ||
+        route->scale > DE10NANO_CROSSBAR_SCALE_MAX ||
+        route->reserved) {
+        return -EINVAL;
+    }
+
+    base = ROUTE_OFFSET(route->sink);
+    ret = de10nano_regcache_write(&priv->cache, base + ROUTE_IN_OFFSET,
+                                  route->in_offset);
+    if (!ret) {
+        ret = de10nano_regcache_write(&priv->cache, base + ROUTE_SCALE,
+                                      route->scale);
+    }
+    if (!ret) {
+        ret = de10nano_regcache_write(&priv->cache, base + ROUTE_OUT_OFFSET,
+                                      route->out_offset);
+    }
+    if (!ret) {
+        ret = de10nano_regcache_write(&priv->cache, base + ROUTE_OUT_MIN,
+                                      route->out_min);
+    }
+    if (!ret) {
+        ret = de10nano_regcache_write(&priv->cache, base + ROUTE_OUT_MAX,
+                                      route->out_max);
+    }
+    for (i = 0; i < DE10NANO_CROSSBAR_LUT_SIZE && !ret; i++) {
+        ret = de10nano_regcache_write(&priv->cache,
+                                      LUT_OFFSET(route->sink, i), route->lut[i]);
+    }
+    if (ret) {
+        return ret;
+    }
+
+    ctrl = route->source | (route->mode << CTRL_MODE_SHIFT) |
+           (route->shift << CTRL_SHIFT_SHIFT);
+    return de10nano_regcache_write(&priv->cache, base + ROUTE_CTRL, ctrl);
+}
+
+/**
+* crossbar_route_get() - Read back one sink's route.
+* @priv: The crossbar.
+* @route: Route to fill in; @route->sink selects the sink.
+*
+* Everything comes from the register cache, including the lookup table,
+* which the hardware can't read back. The caller must hold the lock.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int crossbar_route_get(struct crossbar_dev *priv,
+                              struct de10nano_crossbar_route *route)
+{
+    unsigned int base;
+    unsigned int val;
+    u32 sink = route->sink;
+    size_t i;
+    int ret;
+
+    if (sink >= DE10NANO_CROSSBAR_NUM_SINKS) {
+        return -EINVAL;
+    }
+
+    memset(route, 0, sizeof(*route));
+    route->sink = sink;
+    base = ROUTE_OFFSET(sink);
+
+    ret = de10nano_regcache_read(&priv->cache, base + ROUTE_CTRL, &val);
+    if (ret) {
+        return ret;
+    }
+    route->source = val & CTRL_SOURCE_MASK;
+    route->mode = (val >> CTRL_MODE_SHIFT) & CTRL_MODE_MASK;
+    route->shift = (val >> CTRL_SHIFT_SHIFT) & CTRL_SHIFT_MASK;
+
+    ret = de10nano_regcache_read(&priv->cache, base + ROUTE_IN_OFFSET, &val);
+    route->in_offset = val;
+    if (!ret) {
+        ret = de10nano_regcache_read(&priv->cache, base + ROUTE_SCALE, &val);
+        route->scale = val;
+    }
+    if (!ret) {
+        ret = de10nano_regcache_read(&priv->cache, base + ROUTE_OUT_OFFSET,
+                                     &val);
+        route->out_offset = val;
+    }
+    if (!ret) {
+        ret = de10nano_regcache_read(&priv->cache, base + ROUTE_OUT_MIN, &val);
+        route->out_min = val;
+    }
+    if (!ret) {
+        ret = de10nano_regcache_read(&priv->cache, base + ROUTE_OUT_MAX, &val);
+        route->out_max = val;
+    }
+    for (i = 0; i < DE10NANO_CROSSBAR_LUT_SIZE && !ret; i++) {
+        ret = de10nano_regcache_read(&priv->cache, LUT_OFFSET(sink, i), &val);
+        route->lut[i] = val;
+    }
+
+    return ret;
+}
+
+/**
+* crossbar_read_iter() - Read method for the crossbar char device
+* @iocb: I/O control block; holds the file struct and the byte offset
+* being read from.
+* @to: User-space buffer(s) to read the register values into.
+*
+* As many whole registers as fit in @to are read, up to the end of the
+* component's span. The lookup tables read back the values last written
+* through the driver.
+*
+* Return: On success, the number of bytes read is returned and the
+* offset is advanced by this number. On error, a negative error
+* value is returned.
+*/
+static ssize_t crossbar_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+    u32 vals[SPAN / sizeof(u32)];
+    loff_t pos = iocb->ki_pos;
+    size_t count;
+    size_t copied;
+    size_t i;
+    int ret = 0;
+
+    struct crossbar_dev *priv = container_of(iocb->ki_filp->private_data,
+                                struct crossbar_dev, miscdev);
+
+    if (pos < 0) {
+        return -EINVAL;
+    }
+    if (pos >= SPAN) {
+        return 0;
+    }
+    if ((pos % 0x4) != 0) {
+        pr_warn("crossbar_read: unaligned access\n");
+        return -EFAULT;
+    }
+
+    count = min_t(size_t, iov_iter_count(to), SPAN - pos);
+    count = round_down(count, sizeof(u32));
+    if (count == 0) {
+        return -EINVAL;
+    }
+
+    mutex_lock(&priv->lock);
+    for (i = 0; i < count / sizeof(u32) && !ret; i++) {
+        ret = de10nano_regcache_read(&priv->cache, pos + i * sizeof(u32),
+                                     &vals[i]);
+    }
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    copied = round_down(copy_to_iter(vals, count, to), sizeof(u32));
+    if (copied == 0) {
+        pr_warn("crossbar_read: nothing copied\n");
+        return -EFAULT;
+    }
+
+    iocb->ki_pos = pos + copied;
+
+    return copied;
+}
+
+/**
+* crossbar_write_iter() - Write method for the crossbar char device
+* @iocb: I/O control block; holds the file struct and the byte offset
+* being written to.
+* @from: User-space buffer(s) to read the register values from.
+*
+* As many whole registers as @from holds are written, up to the end of the
+* component's span.
+*
+* Return: On success, the number of bytes written is returned and the
+* offset is advanced by this number. On error, a negative error
+* value is returned.
+*/
+static ssize_t crossbar_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+    u32 vals[SPAN / sizeof(u32)];
+    loff_t pos = iocb->ki_pos;
+    size_t count;
+    size_t copied;
+    size_t i;
+    int ret = 0;
+
+    struct crossbar_dev *priv = container_of(iocb->ki_filp->private_data,
+                                struct crossbar_dev, miscdev);
+
+    if (pos < 0) {
+        return -EINVAL;
+    }
+    if (pos >= SPAN) {
+        return 0;
+    }
+    if ((pos % 0x4) != 0) {
+        pr_warn("crossbar_write: unaligned access\n");
+        return -EFAULT;
+    }
+
+    count = min_t(size_t, iov_iter_count(from), SPAN - pos);
+    count = round_down(count, sizeof(u32));
+    if (count == 0) {
+        return -EINVAL;
+    }
+
+    copied = round_down(copy_from_iter(vals, count, from), sizeof(u32));
+    if (copied == 0) {
+        pr_warn("crossbar_write: nothing copied from user space\n");
+        return -EFAULT;
+    }
+
+    mutex_lock(&priv->lock);
+    for (i = 0; i < copied / sizeof(u32) && !ret; i++) {
+        ret = de10nano_regcache_write(&priv->cache, pos + i * sizeof(u32),
+                                      vals[i]);
+    }
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    iocb->ki_pos = pos + copied;
+
+    return copied;
+}
+
+/**
+* crossbar_ioctl() - ioctl method for the crossbar char device
+* @file: Pointer to the char device file struct.
+* @cmd: The ioctl command.
+* @arg: User-space pointer to the command's argument.
+*
+* DE10NANO_IOC_REG_XFER runs a batch of register operations while holding
+* the device lock once. DE10NANO_CROSSBAR_IOC_SET_ROUTE and _GET_ROUTE
+* program and read back one sink's route; see de10nano_crossbar.h.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static long crossbar_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    struct de10nano_crossbar_route route;
+    int ret;
+    struct crossbar_dev *priv = container_of(file->private_data,
+                                struct crossbar_dev, miscdev);
+
+    switch (cmd) {
+    case DE10NANO_IOC_REG_XFER:
+        return de10nano_regmap_xfer(&priv->cache, SPAN, SPAN,
+                                    (void __user *)arg);
+    case DE10NANO_CROSSBAR_IOC_SET_ROUTE:
+        if (copy_from_user(&route, (void __user *)arg, sizeof(route))) {
+            return -EFAULT;
+        }
+        mutex_lock(&priv->lock);
+        ret = crossbar_route_set(priv, &route);
+        mutex_unlock(&priv->lock);
+        return ret;
+    case DE10NANO_CROSSBAR_IOC_GET_ROUTE:
+        if (copy_from_user(&route.sink, (void __user *)arg,
+                           sizeof(route.sink))) {
+            return -EFAULT;
+        }
+        mutex_lock(&priv->lock);
+        ret = crossbar_route_get(priv, &route);
+        mutex_unlock(&priv->lock);
+        if (ret) {
+            return ret;
+        }
+        if (copy_to_user((void __user *)arg, &route, sizeof(route))) {
+            return -EFAULT;
+        }
+        return 0;
+    default:
+        return -ENOTTY;
+    }
+}
+
+/**
+* crossbar_mmap() - mmap method for the crossbar char device
+* @file: Pointer to the char device file struct.
+* @vma: The user-space mapping being created.
+*
+* Maps the register window into user space. The register cache can't see
+* stores through the mapping, so it is bypassed until the last mapping is
+* gone; the lookup tables read back as 0 after that.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int crossbar_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    int ret;
+    struct crossbar_dev *priv = container_of(file->private_data,
+                                struct crossbar_dev, miscdev);
+
+    ret = de10nano_mmap_regs(vma, priv->phys_addr, SPAN, priv->emulated,
+                             false);
+    if (ret) {
+        return ret;
+    }
+
+    de10nano_regcache_mmap(&priv->cache, vma);
+
+    return 0;
+}
+
+/**
+* crossbar_fops - File operations supported by the crossbar driver
+* @owner: The crossbar driver owns the file operations; this
+* ensures that the driver can't be removed while the
+* character device is still in use.
+* @read_iter: The read function; also handles readv() and preadv().
+* @write_iter: The write function; also handles writev() and pwritev().
+* @unlocked_ioctl: The ioctl function; see de10nano_crossbar.h.
+* @compat_ioctl: Our ioctl arguments are the same for 32-bit callers.
+* @mmap: Maps the register window into user space.
+* @llseek: We use the kernel's default_llseek() function; this allows
+* users to change what position they are writing/reading to/from.
+*/
+static const struct file_operations crossbar_fops = {
+    .owner = THIS_MODULE,
+    .read_iter = crossbar_read_iter,
+    .write_iter = crossbar_write_iter,
+    .unlocked_ioctl = crossbar_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
+    .mmap = crossbar_mmap,
+    .llseek = default_llseek,
+};
+
+/**
+* crossbar_probe() - Initialize device when a match is found
+* @pdev: Platform device structure associated with our crossbar device;
+* pdev is automatically created by the driver core based upon our
+* crossbar device tree node.
+*
+* Every route starts off, so each sink is driven by its own registers
+* until a route is programmed.
+*/
+static int crossbar_probe(struct platform_device *pdev)
+{
+    struct crossbar_dev *priv;
+    struct resource *res;
+    unsigned long emu_page;
+    unsigned int sink;
+    unsigned int i;
+    int ret;
+
+    priv = devm_kzalloc(&pdev->dev, sizeof(struct crossbar_dev),
+                        GFP_KERNEL);
+    if (!priv) {
+        pr_err("Failed to allocate memory\n");
+        return -ENOMEM;
+    }
+
+    if (emulate && !platform_get_resource(pdev, IORESOURCE_MEM, 0)) {
+        // Our own emulated device has no memory region; use a RAM page.
+        emu_page = devm_get_free_pages(&pdev->dev,
+                            GFP_KERNEL | __GFP_ZERO, 0);
+        if (!emu_page) {
+            pr_err("Failed to allocate emulated registers\n");
+            return -ENOMEM;
+        }
+        priv->base_addr = (void __iomem *)emu_page;
+        priv->phys_addr = virt_to_phys((void *)emu_page);
+        priv->emulated = true;
+    }
+    else {
+        priv->base_addr = devm_platform_get_and_ioremap_resource(pdev, 0, &res);
+        if (IS_ERR(priv->base_addr)) {
+            pr_err("Failed to request/remap platform device resource\n");
+            return PTR_ERR(priv->base_addr);
+        }
+        priv->phys_addr = res->start;
+    }
+
+    mutex_init(&priv->lock);
+
+    /*
+    * The source and output registers change on their own; never cache them.
+    * The lookup tables are cached but never reloaded from the hardware.
+    */
+    ret = de10nano_regcache_init_regs(&priv->cache, &pdev->dev,
+                                      priv->base_addr, SPAN, &priv->lock,
+                                      crossbar_volatile_reg,
+                                      crossbar_writeonly_reg);
+    if (ret) {
+        pr_err("Failed to create register map\n");
+        return ret;
+    }
+
+    /*
+    * The lookup tables read back as 0, so the cache was seeded with zeros
+    * rather than their contents. Writing every route, table included, makes
+    * the cache and the hardware agree. Each route starts off.
+    */
+    regmap_write(priv->cache.map, CONTROL_OFFSET, 0);
+    regmap_write(priv->cache.map, ADC_PERIOD_OFFSET,
+                 CROSSBAR_CLK_HZ / CROSSBAR_ADC_RATE_HZ);
+    for (sink = 0; sink < DE10NANO_CROSSBAR_NUM_SINKS; sink++) {
+        regmap_write(priv->cache.map, ROUTE_OFFSET(sink) + ROUTE_CTRL, 0);
+        regmap_write(priv->cache.map, ROUTE_OFFSET(sink) + ROUTE_IN_OFFSET, 0);
+        regmap_write(priv->cache.map, ROUTE_OFFSET(sink) + ROUTE_SCALE, 1);
+        regmap_write(priv->cache.map, ROUTE_OFFSET(sink) + ROUTE_OUT_OFFSET, 0);
+        regmap_write(priv->cache.map, ROUTE_OFFSET(sink) + ROUTE_OUT_MIN, 0);
+        regmap_write(priv->cache.map, ROUTE_OFFSET(sink) + ROUTE_OUT_MAX,
+                     U32_MAX);
+        for (i = 0; i < DE10NANO_CROSSBAR_LUT_SIZE; i++) {
+            regmap_write(priv->cache.map, LUT_OFFSET(sink, i), 0);
+        }
+    }
+    regmap_write(priv->cache.map, CONTROL_OFFSET, 1);
+
+    priv->miscdev.minor = MISC_DYNAMIC_MINOR;
+    priv->miscdev.name = "crossbar";
+    priv->miscdev.fops = &crossbar_fops;
+    priv->miscdev.parent = &pdev->dev;
+
+    // Register the misc device; this creates a char dev at /dev/crossbar
+    ret = misc_register(&priv->miscdev);
+    if (ret) {
+        pr_err("Failed to register misc device");
+        return ret;
+    }
+
+    platform_set_drvdata(pdev, priv);
+
+    pr_info("crossbar_probe successful\n");
+
+    return 0;
+}
+
+/**
+* crossbar_remove() - Remove a crossbar device.
+* @pdev: Platform device structure associated with our crossbar device.
+*
+* The routes are switched off so the sinks go back to their own registers.
+*/
+static int crossbar_remove(struct platform_device *pdev)
+{
+    struct crossbar_dev *priv = platform_get_drvdata(pdev);
+
+    misc_deregister(&priv->miscdev);
+
+    mutex_lock(&priv->lock);
+    regmap_write(priv->cache.map, CONTROL_OFFSET, 0);
+    mutex_unlock(&priv->lock);
+
+    pr_info("crossbar_remove successful\n");
+
+    return 0;
+}
+
+/*
+* Define the compatible property used for matching devices to this driver,
+* then add our device id structure to the kernel's device table. For a device
+* to be matched with this driver, its device tree node must use the same
+* compatible string as defined here.
+*/
+static const struct of_device_id crossbar_of_match[] = {
+    { .compatible = "adsd,de10nano_crossbar", },
+    { }
+};
+MODULE_DEVICE_TABLE(of, crossbar_of_match);
+
+/**
+* enable_show() - Return whether the routes are enabled via sysfs.
+* @dev: Device structure for the crossbar component.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t enable_show(struct device *dev,
+struct device_attribute *attr, char *buf)
+{
+    unsigned int control;
+    int ret;
+    struct crossbar_dev *priv = dev_get_drvdata(dev);
+
+    mutex_lock(&priv->lock);
+    ret = de10nano_regcache_read(&priv->cache, CONTROL_OFFSET, &control);
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    return scnprintf(buf, PAGE_SIZE, "%u\n", control & 1);
+}
+
+/**
+* enable_store() - Enable or disable every route at once.
+* @dev: Device structure for the crossbar component.
+* @attr: Unused.
+* @buf: 1 to enable the routes, 0 to hand every sink back to its registers.
+* @size: The number of bytes being written.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t enable_store(struct device *dev,
+struct device_attribute *attr, const char *buf, size_t size)
+{
+    bool enable;
+    int ret;
+    struct crossbar_dev *priv = dev_get_drvdata(dev);
+
+    ret = kstrtobool(buf, &enable);
+    if (ret < 0) {
+        return ret;
+    }
+
+    mutex_lock(&priv->lock);
+    ret = de10nano_regcache_write(&priv->cache, CONTROL_OFFSET, enable);
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    return size;
+}
+
+/**
+* crossbar_route_show() - Print one sink's route.
+* @priv: The crossbar.
+* @sink: One of enum de10nano_crossbar_sink.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t crossbar_route_show(struct crossbar_dev *priv, u32 sink,
+                                   char *buf)
+{
+    struct de10nano_crossbar_route route = { .sink = sink };
+    ssize_t len;
+    size_t i;
+    int ret;
+
+    mutex_lock(&priv->lock);
+    ret = crossbar_route_get(priv, &route);
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    if (route.mode == DE10NANO_CROSSBAR_MODE_OFF ||
+        route.mode >= ARRAY_SIZE(crossbar_mode_names) ||
+        route.source >= ARRAY_SIZE(crossbar_source_names)) {
+        return scnprintf(buf, PAGE_SIZE, "off\n");
+    }
+
+    len = scnprintf(buf, PAGE_SIZE, "%s %s %d %d %u",
+                    crossbar_source_names[route.source],
+                    crossbar_mode_names[route.mode],
+                    route.in_offset, route.scale, route.shift);
+    if (route.mode == DE10NANO_CROSSBAR_MODE_LINEAR) {
+        len += scnprintf(buf + len, PAGE_SIZE - len, " %d 0x%x 0x%x",
+                         route.out_offset, route.out_min, route.out_max);
+    }
+    else {
+        for (i = 0; i < DE10NANO_CROSSBAR_LUT_SIZE; i++) {
+            len += scnprintf(buf + len, PAGE_SIZE - len, " 0x%x",
+                             route.lut[i]);
+        }
+    }
+    len += scnprintf(buf + len, PAGE_SIZE - len, "\n");
+
+    return len;
+}
+
+/**
+* crossbar_route_store() - Program one sink's route from sysfs.
+* @priv: The crossbar.
+* @sink: One of enum de10nano_crossbar_sink.
+* @buf: "off", "<source> linear <in_offset> <scale> <shift> <out_offset>
+* <out_min> <out_max>" or "<source> lut <in_offset> <scale> <shift> <v0>
+* ... <vN>". The source is rotary or adc0 to adc7. A lookup table with fewer
+* than 16 values repeats its last value.
+* @size: The number of bytes being written.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t crossbar_route_store(struct crossbar_dev *priv, u32 sink,
+                                    const char *buf, size_t size)
+{
+    struct de10nano_crossbar_route route = {
+        .sink = sink,
+        .scale = 1,
+        .out_max = U32_MAX,
+    };
+    char **argv;
+    int argc;
+    int i;
+    int ret = -EINVAL;
+
+    argv = argv_split(GFP_KERNEL, buf, &argc);
+    if (!argv) {
+        return -ENOMEM;
+    }
+
+    if (argc == 1 && sysfs_streq(argv[0], "off")) {
+        // Keep the rest of the route so "on" again is one CONTROL write.
+        mutex_lock(&priv->lock);
+        ret = regmap_update_bits(priv->cache.map,
+                                 ROUTE_OFFSET(sink) + ROUTE_CTRL,
+                                 CTRL_MODE_MASK << CTRL_MODE_SHIFT, 0);
+        mutex_unlock(&priv->lock);
+        goto out;
+    }
+    if (argc < 6) {
+        goto out;
+    }
+
+    ret = match_string(crossbar_source_names,
+                       ARRAY_SIZE(crossbar_source_names), argv[0]);
+    if (ret < 0) {
+        goto out;
+    }
+    route.source = ret;
+    ret = match_string(crossbar_mode_names,
+                       ARRAY_SIZE(crossbar_mode_names), argv[1]);
+    if (ret <= DE10NANO_CROSSBAR_MODE_OFF) {
+        ret = -EINVAL;
+        goto out;
+    }
+    route.mode = ret;
+    ret = -EINVAL;
+
+    if (kstrtos32(argv[2], 0, &route.in_offset) ||
+        kstrtos32(argv[3], 0, &route.scale) ||
+        kstrtou32(argv[4], 0, &route.shift)) {
+        goto out;
+    }
+
+    if (route.mode == DE10NANO_CROSSBAR_MODE_LINEAR) {
+        if (argc != 8 || kstrtos32(argv[5], 0, &route.out_offset) ||
+            kstrtou32(argv[6], 0, &route.out_min) ||
+            kstrtou32(argv[7], 0, &route.out_max)) {
+            goto out;
+        }
+    }
+    else {
+        if (argc > 5 + DE10NANO_CROSSBAR_LUT_SIZE) {
+            goto out;
+        }
+        for (i = 0; i < DE10NANO_CROSSBAR_LUT_SIZE; i++) {
+            if (i < argc - 5 && kstrtou32(argv[5 + i], 0, &route.lut[i])) {
+                goto out;
+            }
+            if (i >= argc - 5) {
+                route.lut[i] = route.lut[i - 1];
+            }
+        }
+    }
+
+    mutex_lock(&priv->lock);
+    ret = crossbar_route_set(priv, &route);
+    mutex_unlock(&priv->lock);
+
+out:
+    argv_free(argv);
+    return ret ? ret : size;
+}
+
+/*
+* One route attribute per sink; they all share crossbar_route_show() and
+* crossbar_route_store().
+*/
+#define CROSSBAR_ROUTE_ATTR(_name, _sink)                                   \
+static ssize_t route_##_name##_show(struct device *dev,                     \
+struct device_attribute *attr, char *buf)                                   \
+{                                                                           \
+    return crossbar_route_show(dev_get_drvdata(dev), _sink, buf);           \
+}                                                                           \
+static ssize_t route_##_name##_store(struct device *dev,                    \
+struct device_attribute *attr, const char *buf, size_t size)                \
+{                                                                           \
+    return crossbar_route_store(dev_get_drvdata(dev), _sink, buf, size);    \
+}                                                                           \
+static DEVICE_ATTR_RW(route_##_name)
+
+CROSSBAR_ROUTE_ATTR(red, DE10NANO_CROSSBAR_SINK_RED);
+CROSSBAR_ROUTE_ATTR(green, DE10NANO_CROSSBAR_SINK_GREEN);
+CROSSBAR_ROUTE_ATTR(blue, DE10NANO_CROSSBAR_SINK_BLUE);
+CROSSBAR_ROUTE_ATTR(volume, DE10NANO_CROSSBAR_SINK_VOLUME);
+CROSSBAR_ROUTE_ATTR(pitch, DE10NANO_CROSSBAR_SINK_PITCH);
+CROSSBAR_ROUTE_ATTR(led_array, DE10NANO_CROSSBAR_SINK_LED_ARRAY);
+
+/**
+* sources_show() - Return the latest value of every source via sysfs.
+* @dev: Device structure for the crossbar component.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t sources_show(struct device *dev,
+struct device_attribute *attr, char *buf)
+{
+    unsigned int val;
+    ssize_t len = 0;
+    size_t i;
+    int ret = 0;
+    struct crossbar_dev *priv = dev_get_drvdata(dev);
+
+    mutex_lock(&priv->lock);
+    for (i = 0; i < DE10NANO_CROSSBAR_NUM_SOURCES && !ret; i++) {
+        ret = de10nano_regcache_read(&priv->cache, SOURCE_OFFSET(i), &val);
+        len += scnprintf(buf + len, PAGE_SIZE - len, "%s %d\n",
+                         crossbar_source_names[i], (s32)val);
+    }
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    return len;
+}
+
+/**
+* outputs_show() - Return every route's output via sysfs.
+* @dev: Device structure for the crossbar component.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Routes that aren't driving their sink are marked inactive.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t outputs_show(struct device *dev,
+struct device_attribute *attr, char *buf)
+{
+    static const char * const sink_names[] = {
+        "red", "green", "blue", "volume", "pitch", "led_array",
+    };
+    unsigned int active;
+    unsigned int val;
+    ssize_t len = 0;
+    size_t i;
+    int ret;
+    struct crossbar_dev *priv = dev_get_drvdata(dev);
+
+    mutex_lock(&priv->lock);
+    ret = de10nano_regcache_read(&priv->cache, ACTIVE_OFFSET, &active);
+    for (i = 0; i < ARRAY_SIZE(sink_names) && !ret; i++) {
+        ret = de10nano_regcache_read(&priv->cache, OUTPUT_OFFSET(i), &val);
+        len += scnprintf(buf + len, PAGE_SIZE - len, "%s 0x%x%s\n",
+                         sink_names[i], val,
+                         (active & BIT(i)) ? "" : " (inactive)");
+    }
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    return len;
+}
+
+/**
+* adc_rate_hz_show() - Return the ADC sweep rate via sysfs.
+* @dev: Device structure for the crossbar component.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t adc_rate_hz_show(struct device *dev,
+struct device_attribute *attr, char *buf)
+{
+    unsigned int period;
+    int ret;
+    struct crossbar_dev *priv = dev_get_drvdata(dev);
+
+    mutex_lock(&priv->lock);
+    ret = de10nano_regcache_read(&priv->cache, ADC_PERIOD_OFFSET, &period);
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    return scnprintf(buf, PAGE_SIZE, "%u\n",
+                     CROSSBAR_CLK_HZ / max(period, 1U));
+}
+
+/**
+* adc_rate_hz_store() - Set how often ADC routes see a new sample.
+* @dev: Device structure for the crossbar component.
+* @attr: Unused.
+* @buf: Sweeps of all eight channels per second, 1 to 100000.
+* @size: The number of bytes being written.
+*
+* The ADC is only read while a route uses one of its channels.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t adc_rate_hz_store(struct device *dev,
+struct device_attribute *attr, const char *buf, size_t size)
+{
+    unsigned int rate;
+    int ret;
+    struct crossbar_dev *priv = dev_get_drvdata(dev);
+
+    ret = kstrtouint(buf, 0, &rate);
+    if (ret < 0) {
+        return ret;
+    }
+    if (rate == 0 || rate > CROSSBAR_MAX_ADC_RATE_HZ) {
+        return -EINVAL;
+    }
+
+    mutex_lock(&priv->lock);
+    ret = de10nano_regcache_write(&priv->cache, ADC_PERIOD_OFFSET,
+                                  CROSSBAR_CLK_HZ / rate);
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    return size;
+}
+
+/**
+* cache_sync_store() - Write the cached register values back to the hardware.
+* @dev: Device structure for the crossbar component.
+* @attr: Unused.
+* @buf: Unused; any write triggers the sync.
+* @size: The number of bytes being written.
+*
+* Reloading the FPGA bitstream resets the component's registers and clears
+* the lookup tables behind the cache's back; write to this attribute
+* afterwards to restore them.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t cache_sync_store(struct device *dev,
+struct device_attribute *attr, const char *buf, size_t size)
+{
+    int ret;
+    struct crossbar_dev *priv = dev_get_drvdata(dev);
+
+    mutex_lock(&priv->lock);
+    ret = de10nano_regcache_sync(&priv->cache);
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    return size;
+}
+
+// Define sysfs attributes
+static DEVICE_ATTR_RW(enable);
+static DEVICE_ATTR_RO(sources);
+static DEVICE_ATTR_RO(outputs);
+static DEVICE_ATTR_RW(adc_rate_hz);
+static DEVICE_ATTR_WO(cache_sync);
+
+// Create an attribute group so the device core can
+// export the attributes for us.
+static struct attribute *crossbar_attrs[] = {
+    &dev_attr_enable.attr,
+    &dev_attr_route_red.attr,
+    &dev_attr_route_green.attr,
+    &dev_attr_route_blue.attr,
+    &dev_attr_route_volume.attr,
+    &dev_attr_route_pitch.attr,
+    &dev_attr_route_led_array.attr,
+    &dev_attr_sources.attr,
+    &dev_attr_outputs.attr,
+    &dev_attr_adc_rate_hz.attr,
+    &dev_attr_cache_sync.attr,
+    NULL,
+};
+ATTRIBUTE_GROUPS(crossbar);
+
+/**
+* crossbar_suspend() - Hold register writes in the cache while suspended.
+* @dev: Device structure for the crossbar component.
+*
+* Return: 0.
+*/
+static int crossbar_suspend(struct device *dev)
+{
+    struct crossbar_dev *priv = dev_get_drvdata(dev);
+
+    de10nano_regcache_suspend(&priv->cache);
+
+    return 0;
+}
+
+/**
+* crossbar_resume() - Restore the routes from the cache after a resume.
+* @dev: Device structure for the crossbar component.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int crossbar_resume(struct device *dev)
+{
+    struct crossbar_dev *priv = dev_get_drvdata(dev);
+
+    return de10nano_regcache_resume(&priv->cache);
+}
+
+static DEFINE_SIMPLE_DEV_PM_OPS(crossbar_pm_ops, crossbar_suspend, crossbar_resume);
+
+/*
+* struct crossbar_driver - Platform driver struct for the crossbar driver
+* @probe: Function that's called when a device is found
+* @remove: Function that's called when a device is removed
+* @driver.owner: Which module owns this driver
+* @driver.name: Name of the crossbar driver
+* @driver.of_match_table: Device tree match table
+* @driver.pm: Suspend/resume callbacks
+*/
+static struct platform_driver crossbar_driver = {
+    .probe = crossbar_probe,
+    .remove = crossbar_remove,
+    .driver = {
+        .owner = THIS_MODULE,
+        .name = "crossbar",
+        .of_match_table = crossbar_of_match,
+        .dev_groups = crossbar_groups,
+        .pm = pm_sleep_ptr(&crossbar_pm_ops),
+    },
+};
+
+// Emulated platform device, only registered when emulate is set.
+static struct platform_device *crossbar_emu_pdev;
+
+/**
+* crossbar_init() - Register the crossbar platform driver.
+*
+* When the emulate module parameter is set, a RAM-backed crossbar device is
+* registered as well so the driver can be tested without the FPGA.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int __init crossbar_init(void)
+{
+    int ret;
+
+    ret = platform_driver_register(&crossbar_driver);
+    if (ret) {
+        return ret;
+    }
+
+    if (emulate) {
+        crossbar_emu_pdev = platform_device_register_simple("crossbar",
+                            PLATFORM_DEVID_NONE, NULL, 0);
+        if (IS_ERR(crossbar_emu_pdev)) {
+            platform_driver_unregister(&crossbar_driver);
+            return PTR_ERR(crossbar_emu_pdev);
+        }
+    }
+
+    return 0;
+}
+
+/**
+* crossbar_exit() - Remove the emulated device (if any) and the platform driver.
+*/
+static void __exit crossbar_exit(void)
+{
+    if (crossbar_emu_pdev) {
+        platform_device_unregister(crossbar_emu_pdev);
+    }
+    platform_driver_unregister(&crossbar_driver);
+}
+
+module_init(crossbar_init);
+module_exit(crossbar_exit);
+
+MODULE_LICENSE("Dual MIT/GPL");
+MODULE_AUTHOR("Seth Howard");
+MODULE_DESCRIPTION("crossbar driver");
+MODULE_VERSION("1.0");
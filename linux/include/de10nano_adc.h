@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: GPL-2.0 or MIT */
+/*
+ * User-space interface for the DE10 Nano adc driver (/dev/adc).
+ *
+ * This header is included by both the kernel module and user-space programs.
+ */
+#ifndef DE10NANO_ADC_H
+#define DE10NANO_ADC_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+#include "de10nano_regs.h"
+
+#define DE10NANO_ADC_NUM_CHANNELS 8
+
+/**
+ * struct de10nano_adc_sample - One timestamped capture of every channel.
+ * @timestamp_ns: CLOCK_MONOTONIC time the capture was taken, in nanoseconds.
+ * @seq: Sampler tick number. It advances on every tick, even when a sample is
+ *       dropped, so a jump of more than one means samples were lost.
+ * @ch: 12-bit value of each channel.
+ * @reserved: Padding; always 0.
+ */
+struct de10nano_adc_sample {
+	__u64 timestamp_ns;
+	__u32 seq;
+	__u16 ch[DE10NANO_ADC_NUM_CHANNELS];
+	__u32 reserved;
+};
+
+/**
+ * struct de10nano_adc_ring - Sample ring shared between the driver and user space.
+ * @head: Number of samples the driver has produced. Written only by the driver.
+ * @tail: Number of samples user space has consumed. Written only by user space.
+ * @size: Number of slots in @samples; always a power of two.
+ * @watermark: poll() reports /dev/adc readable once (@head - @tail) reaches this.
+ * @overruns: Samples dropped because the ring was full.
+ * @missed: Timer ticks the driver didn't get to run for (e.g. under heavy load).
+ * @reserved: Padding; always 0.
+ * @samples: The ring itself. Slot (i & (@size - 1)) holds sample i.
+ *
+ * The ring is a lock-free single-producer/single-consumer queue. The driver
+ * fills slots and then publishes them by advancing @head with release
+ * semantics. A consumer loads @head with acquire semantics, processes
+ * samples[tail & (size - 1)] up to @head in place, and then stores the new
+ * @tail with release semantics to give the slots back.
+ *
+ * Map it by calling mmap() on /dev/adc at DE10NANO_ADC_RING_MMAP_OFFSET with
+ * PROT_READ | PROT_WRITE and a length of at least DE10NANO_ADC_RING_BYTES.
+ */
+struct de10nano_adc_ring {
+	__u32 head;
+	__u32 tail;
+	__u32 size;
+	__u32 watermark;
+	__u32 overruns;
+	__u32 missed;
+	__u32 reserved[10];
+	struct de10nano_adc_sample samples[];
+};
+
+#define DE10NANO_ADC_RING_SAMPLES 4096
+#define DE10NANO_ADC_RING_BYTES \
+	(sizeof(struct de10nano_adc_ring) + \
+	 DE10NANO_ADC_RING_SAMPLES * sizeof(struct de10nano_adc_sample))
+
+// mmap() offset of the sample ring; offset 0 maps the registers.
+#define DE10NANO_ADC_RING_MMAP_OFFSET 0x100000
+
+/**
+ * struct de10nano_adc_snapshot - All eight channels from one conversion.
+ * @seq: Snapshot number; increases by one for every DE10NANO_ADC_IOC_SNAPSHOT.
+ * @timestamp_ns: CLOCK_MONOTONIC time the channels were read, in nanoseconds.
+ * @ch: 12-bit value of each channel.
+ */
+struct de10nano_adc_snapshot {
+	__u64 seq;
+	__u64 timestamp_ns;
+	__u16 ch[DE10NANO_ADC_NUM_CHANNELS];
+};
+
+/*
+ * DE10NANO_ADC_IOC_SNAPSHOT triggers a conversion, waits for it to finish and
+ * returns all eight channels. DE10NANO_ADC_IOC_LAST_SNAPSHOT returns the most
+ * recent snapshot without touching the hardware or the device lock, so any
+ * number of readers can fetch consistent channel sets concurrently.
+ */
+#define DE10NANO_ADC_IOC_SNAPSHOT \
+	_IOR(DE10NANO_IOC_MAGIC, 0x10, struct de10nano_adc_snapshot)
+#define DE10NANO_ADC_IOC_LAST_SNAPSHOT \
+	_IOR(DE10NANO_IOC_MAGIC, 0x11, struct de10nano_adc_snapshot)
+
+#endif /* DE10NANO_ADC_H */
@@ -0,0 +1,109 @@
+/* SPDX-License-Identifier: GPL-2.0 or MIT */
+/*
+ * Endpoints of de10nano_bind, which copies a source register of one DE10 Nano
+ * driver (the rotary count, an ADC channel) into a sink register of another
+ * (the LED array, an RGB duty cycle, the buzzer volume) entirely in the
+ * kernel. Drivers register their endpoints here; bindings between them are
+ * made through /sys/kernel/de10nano_bind.
+ */
+#ifndef DE10NANO_BIND_H
+#define DE10NANO_BIND_H
+
+#include <linux/device.h>
+#include <linux/list.h>
+#include <linux/types.h>
+
+/**
+ * struct de10nano_bind_source - Register a binding can read from.
+ * @name: Unique name the source is bound by, e.g. "rotary".
+ * @read: Read the source's current value. Called from a workqueue, so it
+ *        may sleep.
+ * @notifies: The driver calls de10nano_bind_source_changed() whenever the
+ *            value changes, so bindings don't need to poll the source.
+ * @node: Private to de10nano_bind.
+ * @bindings: Private to de10nano_bind.
+ */
+struct de10nano_bind_source {
+	const char *name;
+	int (*read)(struct de10nano_bind_source *src, s32 *val);
+	bool notifies;
+	struct list_head node;
+	struct list_head bindings;
+};
+
+/**
+ * struct de10nano_bind_sink - Register a binding can write to.
+ * @name: Unique name the sink is bound by, e.g. "led_array".
+ * @write: Write a new value to the sink. Called from a workqueue, so it
+ *         may sleep. Only called when the value changes.
+ * @node: Private to de10nano_bind.
+ * @binding: Private to de10nano_bind.
+ */
+struct de10nano_bind_sink {
+	const char *name;
+	int (*write)(struct de10nano_bind_sink *sink, u32 val);
+	struct list_head node;
+	struct list_head binding;
+};
+
+int de10nano_bind_add_source(struct de10nano_bind_source *src);
+void de10nano_bind_remove_source(struct de10nano_bind_source *src);
+void de10nano_bind_source_changed(struct de10nano_bind_source *src);
+int de10nano_bind_add_sink(struct de10nano_bind_sink *sink);
+void de10nano_bind_remove_sink(struct de10nano_bind_sink *sink);
+
+static inline void de10nano_bind_remove_source_action(void *src)
+{
+	de10nano_bind_remove_source(src);
+}
+
+/**
+ * devm_de10nano_bind_add_source() - Device-managed de10nano_bind_add_source().
+ * @dev: Device the source belongs to.
+ * @src: Source to register.
+ *
+ * The source, and every binding that reads it, is removed when @dev is
+ * unbound, before any device-managed resource registered earlier (such as
+ * the register mapping @src->read uses) is released.
+ *
+ * Return: 0 on success, or a negative error value.
+ */
+static inline int devm_de10nano_bind_add_source(struct device *dev,
+	struct de10nano_bind_source *src)
+{
+	int ret;
+
+	ret = de10nano_bind_add_source(src);
+	if (ret) {
+		return ret;
+	}
+	return devm_add_action_or_reset(dev,
+		de10nano_bind_remove_source_action, src);
+}
+
+static inline void de10nano_bind_remove_sink_action(void *sink)
+{
+	de10nano_bind_remove_sink(sink);
+}
+
+/**
+ * devm_de10nano_bind_add_sink() - Device-managed de10nano_bind_add_sink().
+ * @dev: Device the sink belongs to.
+ * @sink: Sink to register.
+ *
+ * Return: 0 on success, or a negative error value.
+ */
+static inline int devm_de10nano_bind_add_sink(struct device *dev,
+	struct de10nano_bind_sink *sink)
+{
+	int ret;
+
+	ret = de10nano_bind_add_sink(sink);
+	if (ret) {
+		return ret;
+	}
+	return devm_add_action_or_reset(dev,
+		de10nano_bind_remove_sink_action, sink);
+}
+
+#endif /* DE10NANO_BIND_H */
@@ -0,0 +1,196 @@
+/* SPDX-License-Identifier: GPL-2.0 or MIT */
+/*
+ * User-space interface for the DE10 Nano buzzer driver (/dev/buzzer,
+ * /dev/buzzer_queue and /dev/buzzer_pcm).
+ *
+ * This header is included by both the kernel module and user-space programs.
+ */
+#ifndef DE10NANO_BUZZER_H
+#define DE10NANO_BUZZER_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+#include "de10nano_regs.h"
+
+/**
+ * struct de10nano_buzzer_note - One note written to /dev/buzzer_queue.
+ * @freq_hz: Pitch, DE10NANO_BUZZER_MIN_FREQ_HZ to DE10NANO_BUZZER_MAX_FREQ_HZ,
+ *           or 0 for a rest.
+ * @volume: Volume register value (PWM duty cycle, 19 fractional bits), at
+ *          most DE10NANO_BUZZER_MAX_VOLUME.
+ * @duration_us: How long the note plays, 1 to DE10NANO_BUZZER_MAX_NOTE_US.
+ * @reserved: Must be 0.
+ */
+struct de10nano_buzzer_note {
+	__u32 freq_hz;
+	__u32 volume;
+	__u32 duration_us;
+	__u32 reserved;
+};
+
+/*
+ * Notes play on the DDS tone generator, whose tuning word reaches well below
+ * and above this range; the limits keep the legacy pitch register (the PWM
+ * period in milliseconds with 26 fractional bits, 1000 << 26 / freq_hz) in
+ * 32 bits so either generator can play any note.
+ */
+#define DE10NANO_BUZZER_MIN_FREQ_HZ  16
+#define DE10NANO_BUZZER_MAX_FREQ_HZ  20000
+#define DE10NANO_BUZZER_MAX_VOLUME   0x80000
+#define DE10NANO_BUZZER_MAX_NOTE_US  10000000
+
+/*
+ * The DDS tone generator's frequency is ftw * DE10NANO_BUZZER_CLK_HZ / 2^32,
+ * a step of about 0.0116 Hz. The conversions below work in millihertz with
+ * precomputed fixed-point reciprocals so that neither the kernel nor a
+ * program needs a division: 2^64 / (1000 * DE10NANO_BUZZER_CLK_HZ) rounded
+ * down, and 1000 * DE10NANO_BUZZER_CLK_HZ / 2^32 = 48828125 / 2^22 exactly.
+ */
+#define DE10NANO_BUZZER_CLK_HZ          50000000
+#define DE10NANO_BUZZER_FTW_PER_MHZ_Q32 368934881ULL
+#define DE10NANO_BUZZER_MHZ_PER_FTW_Q22 48828125ULL
+
+/**
+ * de10nano_buzzer_mhz_to_ftw() - Tuning word for a frequency in millihertz.
+ * @mhz: Frequency, at most DE10NANO_BUZZER_MAX_FREQ_HZ * 1000.
+ */
+static inline __u32 de10nano_buzzer_mhz_to_ftw(__u32 mhz)
+{
+	return ((__u64)mhz * DE10NANO_BUZZER_FTW_PER_MHZ_Q32 + (1ULL << 31)) >> 32;
+}
+
+/**
+ * de10nano_buzzer_ftw_to_mhz() - Frequency in millihertz of a tuning word.
+ * @ftw: Tuning word.
+ */
+static inline __u64 de10nano_buzzer_ftw_to_mhz(__u32 ftw)
+{
+	return ((__u64)ftw * DE10NANO_BUZZER_MHZ_PER_FTW_Q22 + (1ULL << 21)) >> 22;
+}
+
+/**
+ * struct de10nano_buzzer_envelope - Envelope and LFO settings for
+ * DE10NANO_BUZZER_IOC_SET_ENVELOPE.
+ * @flags: DE10NANO_BUZZER_ENV_* flags.
+ * @attack_us: Time for the level to rise from 0 to full.
+ * @decay_us: Time a full-scale fall takes; the decay stops at @sustain.
+ * @sustain: Level held while the gate is on, as a fraction of the volume
+ *           register (19 fractional bits), at most DE10NANO_BUZZER_MAX_VOLUME.
+ * @release_us: Time a full-scale fall takes once the gate is off.
+ * @lfo_mhz: LFO frequency in millihertz, at most
+ *           DE10NANO_BUZZER_MAX_FREQ_HZ * 1000.
+ * @lfo_duty_depth: How far the LFO lowers the volume, as a fraction of
+ *                  65536; 0 turns tremolo off.
+ * @lfo_pitch_depth: How far the LFO moves the pitch either way, as a
+ *                   fraction of 65536; 0 turns vibrato off.
+ * @reserved: Must be 0.
+ */
+struct de10nano_buzzer_envelope {
+	__u32 flags;
+	__u32 attack_us;
+	__u32 decay_us;
+	__u32 sustain;
+	__u32 release_us;
+	__u32 lfo_mhz;
+	__u32 lfo_duty_depth;
+	__u32 lfo_pitch_depth;
+	__u32 reserved;
+};
+
+// Shape the volume with the envelope; queued notes then trigger it
+#define DE10NANO_BUZZER_ENV_ENABLE   (1 << 0)
+#define DE10NANO_BUZZER_MAX_DEPTH    0xffff
+
+/*
+ * Voice 0 is the main tone, with the envelope, LFO and note queue; the
+ * others are plain square waves that are mixed in. The component has between
+ * 1 and DE10NANO_BUZZER_MAX_VOICES voices; the driver's num_voices sysfs
+ * attribute says how many.
+ */
+#define DE10NANO_BUZZER_MAX_VOICES   8
+
+/**
+ * struct de10nano_buzzer_voice - One voice's settings.
+ * @freq_mhz: Frequency in millihertz, at most
+ *            DE10NANO_BUZZER_MAX_FREQ_HZ * 1000; 0 stops the voice.
+ * @volume: Volume, at most DE10NANO_BUZZER_MAX_VOLUME. For voice 0 this is
+ *          the volume register (the tone's duty cycle); for the others it is
+ *          the voice's level in the mix.
+ */
+struct de10nano_buzzer_voice {
+	__u32 freq_mhz;
+	__u32 volume;
+};
+
+/**
+ * struct de10nano_buzzer_voices - Voice settings for
+ * DE10NANO_BUZZER_IOC_SET_VOICES.
+ * @mask: Bit n set updates voice n from @voice[n]; the other voices are
+ *        left alone.
+ * @flags: DE10NANO_BUZZER_VOICES_* flags.
+ * @voice: New settings, indexed by voice.
+ */
+struct de10nano_buzzer_voices {
+	__u32 mask;
+	__u32 flags;
+	struct de10nano_buzzer_voice voice[DE10NANO_BUZZER_MAX_VOICES];
+};
+
+// Mix every voice into the output; without it only voice 0 is heard
+#define DE10NANO_BUZZER_VOICES_MIX   (1 << 0)
+
+/*
+ * /dev/buzzer_pcm plays signed 16-bit mono samples in native (little-endian)
+ * order, written in pairs: every write() is a multiple of 4 bytes. The
+ * sample rate is set with DE10NANO_BUZZER_IOC_PCM_SET_RATE or the driver's
+ * pcm_rate sysfs attribute.
+ */
+#define DE10NANO_BUZZER_PCM_MIN_RATE     1000
+#define DE10NANO_BUZZER_PCM_MAX_RATE     96000
+#define DE10NANO_BUZZER_PCM_DEFAULT_RATE 8000
+
+/**
+ * struct de10nano_buzzer_pcm_stats - Counters for
+ * DE10NANO_BUZZER_IOC_PCM_GET_STATS.
+ * @written: Samples written to /dev/buzzer_pcm since the driver loaded.
+ * @pushed: Samples moved from the driver's ring into the FIFO.
+ * @refills: Times the driver refilled the FIFO.
+ * @underruns: Samples the FIFO had nothing for and played as silence.
+ * @ring: Samples waiting in the driver's ring.
+ * @fifo: Samples waiting in the FIFO.
+ * @rate: Sample rate in Hz.
+ */
+struct de10nano_buzzer_pcm_stats {
+	__u64 written;
+	__u64 pushed;
+	__u64 refills;
+	__u32 underruns;
+	__u32 ring;
+	__u32 fifo;
+	__u32 rate;
+};
+
+// Number of notes /dev/buzzer_queue holds
+#define DE10NANO_BUZZER_QUEUE_LEN    256
+
+// Drop every queued note and silence the buzzer
+#define DE10NANO_BUZZER_IOC_QUEUE_FLUSH _IO(DE10NANO_IOC_MAGIC, 0x40)
+// Set every envelope and LFO register of /dev/buzzer at once
+#define DE10NANO_BUZZER_IOC_SET_ENVELOPE \
+	_IOW(DE10NANO_IOC_MAGIC, 0x41, struct de10nano_buzzer_envelope)
+/*
+ * Update several voices of /dev/buzzer in one call; with double buffering on
+ * they all change at the end of the same tone cycle
+ */
+#define DE10NANO_BUZZER_IOC_SET_VOICES \
+	_IOW(DE10NANO_IOC_MAGIC, 0x42, struct de10nano_buzzer_voices)
+// Set the sample rate of /dev/buzzer_pcm in Hz
+#define DE10NANO_BUZZER_IOC_PCM_SET_RATE _IOW(DE10NANO_IOC_MAGIC, 0x43, __u32)
+// Drop every sample waiting to play and stop playback
+#define DE10NANO_BUZZER_IOC_PCM_FLUSH _IO(DE10NANO_IOC_MAGIC, 0x44)
+// Read the throughput and underrun counters of /dev/buzzer_pcm
+#define DE10NANO_BUZZER_IOC_PCM_GET_STATS \
+	_IOR(DE10NANO_IOC_MAGIC, 0x45, struct de10nano_buzzer_pcm_stats)
+
+#endif /* DE10NANO_BUZZER_H */
@@ -0,0 +1,105 @@
+/* SPDX-License-Identifier: GPL-2.0 or MIT */
+/*
+ * User-space interface for the DE10 Nano crossbar driver (/dev/crossbar).
+ *
+ * The crossbar routes a source (the rotary count or an ADC channel) through
+ * a scale/offset or lookup table stage into a sink (an RGB duty cycle, the
+ * buzzer volume or pitch, or the LED array) entirely in the FPGA fabric.
+ *
+ * This header is included by both the kernel module and user-space programs.
+ */
+#ifndef DE10NANO_CROSSBAR_H
+#define DE10NANO_CROSSBAR_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+#include "de10nano_regs.h"
+
+/**
+ * enum de10nano_crossbar_source - Values a route can read.
+ * @DE10NANO_CROSSBAR_SRC_ROTARY: Rotary encoder count (signed).
+ * @DE10NANO_CROSSBAR_SRC_ADC0: ADC channel 0 (12 bits); channels 1 to 7
+ *                              follow in order.
+ */
+enum de10nano_crossbar_source {
+	DE10NANO_CROSSBAR_SRC_ROTARY = 0,
+	DE10NANO_CROSSBAR_SRC_ADC0   = 1,
+};
+
+#define DE10NANO_CROSSBAR_NUM_SOURCES 9
+
+/**
+ * enum de10nano_crossbar_sink - Registers a route can drive. Each sink has
+ * exactly one route.
+ */
+enum de10nano_crossbar_sink {
+	DE10NANO_CROSSBAR_SINK_RED       = 0,
+	DE10NANO_CROSSBAR_SINK_GREEN     = 1,
+	DE10NANO_CROSSBAR_SINK_BLUE      = 2,
+	DE10NANO_CROSSBAR_SINK_VOLUME    = 3,
+	DE10NANO_CROSSBAR_SINK_PITCH     = 4,
+	DE10NANO_CROSSBAR_SINK_LED_ARRAY = 5,
+};
+
+#define DE10NANO_CROSSBAR_NUM_SINKS 6
+
+/**
+ * enum de10nano_crossbar_mode - What a route does with the scaled value.
+ * @DE10NANO_CROSSBAR_MODE_OFF: The sink is driven by its own registers.
+ * @DE10NANO_CROSSBAR_MODE_LINEAR: Add @out_offset and clamp to
+ *                                 [@out_min, @out_max].
+ * @DE10NANO_CROSSBAR_MODE_LUT: Clamp to 0..15 and look the result up in
+ *                              @lut.
+ */
+enum de10nano_crossbar_mode {
+	DE10NANO_CROSSBAR_MODE_OFF    = 0,
+	DE10NANO_CROSSBAR_MODE_LINEAR = 1,
+	DE10NANO_CROSSBAR_MODE_LUT    = 2,
+};
+
+#define DE10NANO_CROSSBAR_LUT_SIZE  16
+#define DE10NANO_CROSSBAR_MAX_SHIFT 31
+// The scale is an 18-bit signed multiplier
+#define DE10NANO_CROSSBAR_SCALE_MIN (-131072)
+#define DE10NANO_CROSSBAR_SCALE_MAX 131071
+
+/**
+ * struct de10nano_crossbar_route - One sink's route.
+ * @sink: One of enum de10nano_crossbar_sink.
+ * @source: One of enum de10nano_crossbar_source.
+ * @mode: One of enum de10nano_crossbar_mode.
+ * @shift: Right shift applied after scaling, 0 to 31.
+ * @in_offset: Subtracted from the source value first.
+ * @scale: Multiplier, DE10NANO_CROSSBAR_SCALE_MIN to _MAX.
+ * @out_offset: Added to the shifted value in linear mode.
+ * @out_min: Lowest output in linear mode.
+ * @out_max: Highest output in linear mode.
+ * @lut: Outputs in lookup table mode.
+ * @reserved: Must be 0.
+ *
+ * The sink is driven by ((source - in_offset) * scale) >> shift, followed by
+ * the mode's output stage.
+ */
+struct de10nano_crossbar_route {
+	__u32 sink;
+	__u32 source;
+	__u32 mode;
+	__u32 shift;
+	__s32 in_offset;
+	__s32 scale;
+	__s32 out_offset;
+	__u32 out_min;
+	__u32 out_max;
+	__u32 lut[DE10NANO_CROSSBAR_LUT_SIZE];
+	__u32 reserved;
+};
+
+// Program the route of route.sink; the route switches over in one write
+#define DE10NANO_CROSSBAR_IOC_SET_ROUTE \
+	_IOW(DE10NANO_IOC_MAGIC, 0x60, struct de10nano_crossbar_route)
+// Read back the route of route.sink
+#define DE10NANO_CROSSBAR_IOC_GET_ROUTE \
+	_IOWR(DE10NANO_IOC_MAGIC, 0x61, struct de10nano_crossbar_route)
+
+#endif /* DE10NANO_CROSSBAR_H */
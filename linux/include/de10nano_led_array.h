@@ -0,0 +1,84 @@
+/* SPDX-License-Identifier: GPL-2.0 or MIT */
+/*
+ * User-space interface for the DE10 Nano led_array driver (/dev/led_array).
+ *
+ * This header is included by both the kernel module and user-space programs.
+ */
+#ifndef DE10NANO_LED_ARRAY_H
+#define DE10NANO_LED_ARRAY_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+#include "de10nano_regs.h"
+
+/**
+ * struct de10nano_led_frame - One frame of an LED animation.
+ * @pattern: LED pattern; bit n drives LED n.
+ * @duration_ms: How long the frame is shown, 1 to DE10NANO_LED_FRAME_MAX_MS.
+ */
+struct de10nano_led_frame {
+	__u32 pattern;
+	__u32 duration_ms;
+};
+
+/**
+ * enum de10nano_led_seq_mode - What happens after the last frame.
+ * @DE10NANO_LED_SEQ_LOOP: Start again from the first frame.
+ * @DE10NANO_LED_SEQ_PINGPONG: Play the frames backwards, then forwards
+ *                             again, without repeating the end frames.
+ * @DE10NANO_LED_SEQ_ONESHOT: Stop, leaving the last frame on the LEDs.
+ */
+enum de10nano_led_seq_mode {
+	DE10NANO_LED_SEQ_LOOP     = 0,
+	DE10NANO_LED_SEQ_PINGPONG = 1,
+	DE10NANO_LED_SEQ_ONESHOT  = 2,
+};
+
+/**
+ * struct de10nano_led_seq - Animation to play.
+ * @frames: User-space pointer to an array of struct de10nano_led_frame.
+ * @count: Number of frames, 1 to DE10NANO_LED_SEQ_MAX_FRAMES.
+ * @mode: One of enum de10nano_led_seq_mode.
+ * @flags: DE10NANO_LED_SEQ_* flags.
+ * @reserved: Must be 0.
+ *
+ * Loading an animation replaces the one that is playing, if any, and starts
+ * the new one from its first frame.
+ */
+struct de10nano_led_seq {
+	__u64 frames;
+	__u32 count;
+	__u32 mode;
+	__u32 flags;
+	__u32 reserved;
+};
+
+/*
+ * Per-LED brightness, 0 (off) to 255 (full), for the LEDs that are on in the
+ * pattern. The two brightness registers hold one byte per LED, LED 0 in the
+ * lowest byte at DE10NANO_LED_BRIGHTNESS_OFFSET, so on the little-endian HPS
+ * a __u8[DE10NANO_LED_COUNT] (or a __u64) written to /dev/led_array at that
+ * offset with one pwrite() sets every level. The offset is 8-byte aligned, so
+ * a single 64-bit store through mmap() works too.
+ */
+#define DE10NANO_LED_COUNT              8
+#define DE10NANO_LED_BRIGHTNESS_OFFSET  0x08
+
+/*
+ * Upload the frames to the FPGA's pattern RAM and let its sequencer play
+ * them, with no CPU or bus traffic during playback. The animation can have
+ * as many frames as the pattern RAM holds (the driver's fabric_frames sysfs
+ * attribute); only bits 7:0 of each pattern are kept.
+ */
+#define DE10NANO_LED_SEQ_FABRIC     (1 << 0)
+
+#define DE10NANO_LED_SEQ_MAX_FRAMES 1024
+#define DE10NANO_LED_FRAME_MAX_MS   60000
+
+#define DE10NANO_LED_IOC_SEQ_LOAD \
+	_IOW(DE10NANO_IOC_MAGIC, 0x30, struct de10nano_led_seq)
+// Stop the animation, leaving the current frame on the LEDs
+#define DE10NANO_LED_IOC_SEQ_STOP _IO(DE10NANO_IOC_MAGIC, 0x31)
+
+#endif /* DE10NANO_LED_ARRAY_H */
@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: GPL-2.0 or MIT */
+/*
+ * Kernel-side helper for mapping a DE10 Nano component's Avalon register
+ * window into user space, shared by the DE10 Nano char drivers.
+ */
+#ifndef DE10NANO_MMAP_H
+#define DE10NANO_MMAP_H
+
+#include <linux/mm.h>
+#include <linux/types.h>
+
+/**
+ * de10nano_mmap_regs() - Map a component's register window into user space.
+ * @vma: The user-space mapping being created.
+ * @phys_addr: Physical address of the component's registers.
+ * @span: Span of the component's memory space in bytes.
+ * @emulated: The registers are backed by a page of RAM instead of the FPGA.
+ * @read_only: Refuse writable mappings.
+ *
+ * The mapping starts at the page holding the registers, so the first register
+ * lives at offset (@phys_addr & ~PAGE_MASK) into it. Only offset 0 may be
+ * mapped, and the mapping can't be larger than the page(s) holding the
+ * registers. FPGA registers are mapped uncached so every load and store goes
+ * out over the bridge; emulated registers are ordinary cached RAM.
+ *
+ * Return: 0 on success, or a negative error value.
+ */
+static inline int de10nano_mmap_regs(struct vm_area_struct *vma,
+	phys_addr_t phys_addr, size_t span, bool emulated, bool read_only)
+{
+	if (vma->vm_pgoff != 0) {
+		return -EINVAL;
+	}
+
+	if (read_only) {
+		if (vma->vm_flags & VM_WRITE) {
+			return -EPERM;
+		}
+		// Don't let mprotect() turn the mapping writable later on.
+		vm_flags_clear(vma, VM_MAYWRITE);
+	}
+
+	if (!emulated) {
+		vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
+	}
+
+	return vm_iomap_memory(vma, phys_addr, span);
+}
+
+#endif /* DE10NANO_MMAP_H */
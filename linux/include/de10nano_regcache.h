@@ -0,0 +1,371 @@
+/* SPDX-License-Identifier: GPL-2.0 or MIT */
+/*
+ * Register cache for DE10 Nano components whose registers only the host
+ * writes, shared by the DE10 Nano char drivers. Reads of those registers are
+ * served from RAM instead of crossing the lightweight HPS-to-FPGA bridge, and
+ * writes that don't change a register's value are skipped.
+ */
+#ifndef DE10NANO_REGCACHE_H
+#define DE10NANO_REGCACHE_H
+
+#include <linux/device.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/regmap.h>
+#include <linux/types.h>
+
+/**
+ * struct de10nano_regcache - Cached regmap over a component's registers.
+ * @map: regmap-mmio with a maple cache covering the whole span
+ * @span: Span of the component's memory space in bytes
+ * @lock: The driver's lock; held around every cache state change
+ * @dev: Device the regmap belongs to
+ * @volatile_reg: Registers the hardware changes, or NULL
+ * @writeonly_reg: Registers that can't be read back from the hardware, or NULL
+ * @user_write: Writes a register for user space, or NULL to use
+ *              de10nano_regcache_write(); set by drivers that keep their own
+ *              copy of some registers' values
+ * @mappings: Number of live user-space mappings of the registers
+ * @suspended: The cache was put in cache-only mode by a system suspend
+ *
+ * Stores through an mmap()ed register window can't be seen by the cache, so
+ * while any mapping exists de10nano_regcache_read() reads the hardware and
+ * de10nano_regcache_write() always writes it, and when the last mapping goes
+ * away the cached values are dropped so the next reads refill them from the
+ * hardware. Write-only registers are the exception: the cache is the only
+ * copy of their values, so they are always read from it and never dropped.
+ *
+ * The regmap's own cache mode is never switched on a live device. Timers and
+ * IRQ handlers write registers without the driver's lock, and each of these
+ * operations is a single regmap call, atomic under the regmap's lock, so
+ * none of their writes can miss the hardware or the cache.
+ */
+struct de10nano_regcache {
+	struct regmap *map;
+	size_t span;
+	struct mutex *lock;
+	struct device *dev;
+	bool (*volatile_reg)(struct device *dev, unsigned int reg);
+	bool (*writeonly_reg)(struct device *dev, unsigned int reg);
+	int (*user_write)(struct de10nano_regcache *cache, unsigned int reg,
+	                  unsigned int val);
+	unsigned int mappings;
+	bool suspended;
+};
+
+/**
+ * de10nano_regcache_init_regs() - Create the cached regmap for a component
+ * with registers the hardware changes or that can't be read back.
+ * @cache: Cache to initialise.
+ * @dev: Device the regmap belongs to; the regmap is device-managed.
+ * @base: Base address of the component's registers.
+ * @span: Span of the component's memory space in bytes.
+ * @lock: The driver's lock.
+ * @volatile_reg: Returns true for registers that must always be read from
+ *                the hardware, or NULL if every register is host-owned.
+ * @writeonly_reg: Returns true for registers whose reads don't return what
+ *                 was written, or NULL if every register reads back.
+ *
+ * The cache is seeded with the registers' current values, so it is coherent
+ * with the hardware from the start. Write-only registers are seeded with
+ * whatever they read back as, so the driver must write them at probe.
+ *
+ * Return: 0 on success, or a negative error value.
+ */
+static inline int de10nano_regcache_init_regs(struct de10nano_regcache *cache,
+	struct device *dev, void __iomem *base, size_t span, struct mutex *lock,
+	bool (*volatile_reg)(struct device *dev, unsigned int reg),
+	bool (*writeonly_reg)(struct device *dev, unsigned int reg))
+{
+	const struct regmap_config config = {
+		.reg_bits = 32,
+		.val_bits = 32,
+		.reg_stride = 4,
+		.max_register = span - 4,
+		.volatile_reg = volatile_reg,
+		.cache_type = REGCACHE_MAPLE,
+		.num_reg_defaults_raw = span / 4,
+	};
+
+	cache->map = devm_regmap_init_mmio(dev, base, &config);
+	if (IS_ERR(cache->map)) {
+		return PTR_ERR(cache->map);
+	}
+	cache->span = span;
+	cache->lock = lock;
+	cache->dev = dev;
+	cache->volatile_reg = volatile_reg;
+	cache->writeonly_reg = writeonly_reg;
+	cache->user_write = NULL;
+	cache->mappings = 0;
+	cache->suspended = false;
+
+	return 0;
+}
+
+/**
+ * de10nano_regcache_init_volatile() - Create the cached regmap for a component
+ * with some registers the hardware changes.
+ * @cache: Cache to initialise.
+ * @dev: Device the regmap belongs to; the regmap is device-managed.
+ * @base: Base address of the component's registers.
+ * @span: Span of the component's memory space in bytes.
+ * @lock: The driver's lock.
+ * @volatile_reg: Returns true for registers that must always be read from
+ *                the hardware, or NULL if every register is host-owned.
+ *
+ * Every register reads back. See de10nano_regcache_init_regs().
+ *
+ * Return: 0 on success, or a negative error value.
+ */
+static inline int de10nano_regcache_init_volatile(struct de10nano_regcache *cache,
+	struct device *dev, void __iomem *base, size_t span, struct mutex *lock,
+	bool (*volatile_reg)(struct device *dev, unsigned int reg))
+{
+	return de10nano_regcache_init_regs(cache, dev, base, span, lock,
+	                                   volatile_reg, NULL);
+}
+
+/**
+ * de10nano_regcache_init() - Create the cached regmap for a component.
+ * @cache: Cache to initialise.
+ * @dev: Device the regmap belongs to; the regmap is device-managed.
+ * @base: Base address of the component's registers.
+ * @span: Span of the component's memory space in bytes.
+ * @lock: The driver's lock.
+ *
+ * Every register is host-owned. The cache is seeded with the registers'
+ * current values, so it is coherent with the hardware from the start.
+ *
+ * Return: 0 on success, or a negative error value.
+ */
+static inline int de10nano_regcache_init(struct de10nano_regcache *cache,
+	struct device *dev, void __iomem *base, size_t span, struct mutex *lock)
+{
+	return de10nano_regcache_init_volatile(cache, dev, base, span, lock, NULL);
+}
+
+static inline bool de10nano_regcache_volatile(struct de10nano_regcache *cache,
+	unsigned int reg)
+{
+	return cache->volatile_reg && cache->volatile_reg(cache->dev, reg);
+}
+
+static inline bool de10nano_regcache_writeonly(struct de10nano_regcache *cache,
+	unsigned int reg)
+{
+	return cache->writeonly_reg && cache->writeonly_reg(cache->dev, reg);
+}
+
+/**
+ * de10nano_regcache_read() - Read a register.
+ * @cache: The component's cache.
+ * @reg: Register offset.
+ * @val: Where to store the value.
+ *
+ * Same as regmap_read(), except that while the registers are mapped the
+ * hardware is read instead of the cache, since user space may have stored
+ * to it. Write-only registers always come from the cache.
+ *
+ * Return: 0 on success, or a negative error value.
+ */
+static inline int de10nano_regcache_read(struct de10nano_regcache *cache,
+	unsigned int reg, unsigned int *val)
+{
+	if (!READ_ONCE(cache->mappings) || de10nano_regcache_writeonly(cache, reg)) {
+		return regmap_read(cache->map, reg, val);
+	}
+
+	return regmap_read_bypassed(cache->map, reg, val);
+}
+
+/**
+ * de10nano_regcache_write() - Write a register unless it already holds @val.
+ * @cache: The component's cache.
+ * @reg: Register offset.
+ * @val: Value to write.
+ *
+ * Volatile registers are always written, since their value says nothing
+ * about what a write does (a FIFO push, a clear). While the registers are
+ * mapped, every register is written, since the cache can't tell what user
+ * space stored to it; the cache is updated too.
+ *
+ * Return: 0 on success, or a negative error value.
+ */
+static inline int de10nano_regcache_write(struct de10nano_regcache *cache,
+	unsigned int reg, unsigned int val)
+{
+	if (de10nano_regcache_volatile(cache, reg) || READ_ONCE(cache->mappings)) {
+		return regmap_write(cache->map, reg, val);
+	}
+
+	return regmap_update_bits(cache->map, reg, ~0U, val);
+}
+
+/**
+ * de10nano_regcache_user_write() - Write a register on behalf of user space.
+ * @cache: The component's cache.
+ * @reg: Register offset.
+ * @val: Value to write.
+ *
+ * Goes through the driver's @cache->user_write if it has one, so a register
+ * the driver builds from its own state updates that state instead of being
+ * overwritten by the driver's next write of it.
+ *
+ * Return: 0 on success, or a negative error value.
+ */
+static inline int de10nano_regcache_user_write(struct de10nano_regcache *cache,
+	unsigned int reg, unsigned int val)
+{
+	if (cache->user_write) {
+		return cache->user_write(cache, reg, val);
+	}
+
+	return de10nano_regcache_write(cache, reg, val);
+}
+
+/**
+ * de10nano_regcache_sync() - Write every cached value back to the hardware.
+ * @cache: The component's cache.
+ *
+ * Unlike regcache_sync(), registers whose value matches the power-on default
+ * are written too, so this also restores a freshly reconfigured FPGA whose
+ * reset values differ from the ones seen at probe time. Volatile registers
+ * aren't cached and are left alone; writing one back could push a FIFO
+ * word or clear a counter, so the driver restores any state they hold
+ * itself. The caller must hold @cache->lock.
+ *
+ * Return: 0 on success, or a negative error value.
+ */
+static inline int de10nano_regcache_sync(struct de10nano_regcache *cache)
+{
+	unsigned int reg;
+	unsigned int val;
+	int ret;
+
+	for (reg = 0; reg < cache->span; reg += 4) {
+		if (de10nano_regcache_volatile(cache, reg)) {
+			continue;
+		}
+		ret = regmap_read(cache->map, reg, &val);
+		if (!ret) {
+			ret = regmap_write(cache->map, reg, val);
+		}
+		if (ret) {
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * de10nano_regcache_reload() - Forget the cached values user space may have
+ * changed.
+ * @cache: The component's cache.
+ *
+ * Drops the registers the cache holds and the hardware can read back, one
+ * at a time under the regmap's lock, so the next read of each refills it
+ * from the hardware. A concurrent write lands in both, before or after the
+ * drop. Write-only registers keep their cached values. The caller must hold
+ * @cache->lock.
+ */
+static inline void de10nano_regcache_reload(struct de10nano_regcache *cache)
+{
+	unsigned int reg;
+
+	for (reg = 0; reg < cache->span; reg += 4) {
+		if (de10nano_regcache_volatile(cache, reg) ||
+		    de10nano_regcache_writeonly(cache, reg)) {
+			continue;
+		}
+		regcache_drop_region(cache->map, reg, reg);
+	}
+}
+
+static inline void de10nano_regcache_vm_open(struct vm_area_struct *vma)
+{
+	struct de10nano_regcache *cache = vma->vm_private_data;
+
+	mutex_lock(cache->lock);
+	WRITE_ONCE(cache->mappings, cache->mappings + 1);
+	mutex_unlock(cache->lock);
+}
+
+static inline void de10nano_regcache_vm_close(struct vm_area_struct *vma)
+{
+	struct de10nano_regcache *cache = vma->vm_private_data;
+
+	mutex_lock(cache->lock);
+	// Drop before the count goes to 0, so the cache is never read stale.
+	if (cache->mappings == 1) {
+		de10nano_regcache_reload(cache);
+	}
+	WRITE_ONCE(cache->mappings, cache->mappings - 1);
+	mutex_unlock(cache->lock);
+}
+
+static const struct vm_operations_struct de10nano_regcache_vm_ops = {
+	.open = de10nano_regcache_vm_open,
+	.close = de10nano_regcache_vm_close,
+};
+
+/**
+ * de10nano_regcache_mmap() - Track a new user-space mapping of the registers.
+ * @cache: The component's cache.
+ * @vma: The mapping, already set up by de10nano_mmap_regs().
+ *
+ * Reads and writes go to the hardware until the mapping (and every copy of
+ * it made by fork() or a VMA split) is gone.
+ */
+static inline void de10nano_regcache_mmap(struct de10nano_regcache *cache,
+	struct vm_area_struct *vma)
+{
+	vma->vm_private_data = cache;
+	vma->vm_ops = &de10nano_regcache_vm_ops;
+
+	mutex_lock(cache->lock);
+	WRITE_ONCE(cache->mappings, cache->mappings + 1);
+	mutex_unlock(cache->lock);
+}
+
+/**
+ * de10nano_regcache_suspend() - Stop touching the hardware during suspend.
+ * @cache: The component's cache.
+ *
+ * Writes made while suspended only update the cache and are written out by
+ * de10nano_regcache_resume(). If the registers are mapped, user space owns
+ * them and the cache is left alone.
+ */
+static inline void de10nano_regcache_suspend(struct de10nano_regcache *cache)
+{
+	mutex_lock(cache->lock);
+	if (cache->mappings == 0) {
+		regcache_cache_only(cache->map, true);
+		cache->suspended = true;
+	}
+	mutex_unlock(cache->lock);
+}
+
+/**
+ * de10nano_regcache_resume() - Restore the registers after a resume.
+ * @cache: The component's cache.
+ *
+ * Return: 0 on success, or a negative error value.
+ */
+static inline int de10nano_regcache_resume(struct de10nano_regcache *cache)
+{
+	int ret = 0;
+
+	mutex_lock(cache->lock);
+	if (cache->suspended) {
+		regcache_cache_only(cache->map, false);
+		cache->suspended = false;
+		ret = de10nano_regcache_sync(cache);
+	}
+	mutex_unlock(cache->lock);
+
+	return ret;
+}
+
+#endif /* DE10NANO_REGCACHE_H */
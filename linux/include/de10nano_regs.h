@@ -0,0 +1,74 @@
+/* SPDX-License-Identifier: GPL-2.0 or MIT */
+/*
+ * Register transaction interface shared by the DE10 Nano char drivers
+ * (/dev/rgb_led, /dev/buzzer, /dev/led_array, /dev/rotary and /dev/adc).
+ *
+ * This header is included by both the kernel modules and user-space programs.
+ */
+#ifndef DE10NANO_REGS_H
+#define DE10NANO_REGS_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+// ioctl magic number shared by all of the DE10 Nano drivers
+#define DE10NANO_IOC_MAGIC 0xde
+
+/**
+ * enum de10nano_reg_op_type - Operations supported by DE10NANO_IOC_REG_XFER.
+ * @DE10NANO_REG_READ: Read the register. The result is the register value.
+ * @DE10NANO_REG_WRITE: Write @value to the register. The result is @value.
+ * @DE10NANO_REG_RMW: Replace the bits selected by @mask with the same bits
+ *                    of @value. The result is the value written.
+ * @DE10NANO_REG_WAIT: Poll the register until (reg & @mask) == (@value & @mask)
+ *                     or the transaction's timeout expires. The result is the
+ *                     last value read.
+ */
+enum de10nano_reg_op_type {
+	DE10NANO_REG_READ = 0,
+	DE10NANO_REG_WRITE = 1,
+	DE10NANO_REG_RMW = 2,
+	DE10NANO_REG_WAIT = 3,
+};
+
+/**
+ * struct de10nano_reg_op - One register operation.
+ * @offset: Byte offset of the register; must be 32-bit aligned.
+ * @op: One of enum de10nano_reg_op_type.
+ * @value: Value to write, or the value to wait for.
+ * @mask: Bits affected by DE10NANO_REG_RMW and DE10NANO_REG_WAIT.
+ */
+struct de10nano_reg_op {
+	__u32 offset;
+	__u32 op;
+	__u32 value;
+	__u32 mask;
+};
+
+/**
+ * struct de10nano_reg_xfer - A batch of register operations.
+ * @ops: User-space pointer to an array of @count struct de10nano_reg_op.
+ * @results: User-space pointer to an array of @count __u32 that receives one
+ *           result per operation, or 0 if the results aren't needed.
+ * @count: Number of operations; at most DE10NANO_REG_XFER_MAX.
+ * @timeout_us: Timeout for each DE10NANO_REG_WAIT operation in microseconds;
+ *              clamped to [1, DE10NANO_REG_WAIT_MAX_US].
+ *
+ * The operations run in order while the device lock is held once. The results
+ * are copied back to user space in one go after the last operation. If an
+ * operation fails (e.g. a wait times out), the remaining operations are
+ * skipped and no results are copied.
+ */
+struct de10nano_reg_xfer {
+	__u64 ops;
+	__u64 results;
+	__u32 count;
+	__u32 timeout_us;
+};
+
+#define DE10NANO_REG_XFER_MAX     64
+#define DE10NANO_REG_WAIT_MAX_US  1000000
+
+#define DE10NANO_IOC_REG_XFER _IOW(DE10NANO_IOC_MAGIC, 0x00, struct de10nano_reg_xfer)
+
+#endif /* DE10NANO_REGS_H */
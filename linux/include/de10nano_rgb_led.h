@@ -0,0 +1,62 @@
+/* SPDX-License-Identifier: GPL-2.0 or MIT */
+/*
+ * User-space interface for the DE10 Nano rgb_led driver (/dev/rgb_led).
+ *
+ * This header is included by both the kernel module and user-space programs.
+ */
+#ifndef DE10NANO_RGB_LED_H
+#define DE10NANO_RGB_LED_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+#include "de10nano_regs.h"
+
+/**
+ * enum de10nano_rgb_ease - Easing curve of a fade.
+ * @DE10NANO_RGB_EASE_LINEAR: Constant rate.
+ * @DE10NANO_RGB_EASE_IN: Starts slowly and speeds up (quadratic).
+ * @DE10NANO_RGB_EASE_OUT: Starts quickly and slows down (quadratic).
+ * @DE10NANO_RGB_EASE_IN_OUT: Slow at both ends (smoothstep).
+ * @DE10NANO_RGB_EASE_EXPONENTIAL: 2^(10(t - 1)); looks even to the eye
+ *                                 because perceived brightness is roughly
+ *                                 logarithmic.
+ */
+enum de10nano_rgb_ease {
+	DE10NANO_RGB_EASE_LINEAR      = 0,
+	DE10NANO_RGB_EASE_IN          = 1,
+	DE10NANO_RGB_EASE_OUT         = 2,
+	DE10NANO_RGB_EASE_IN_OUT      = 3,
+	DE10NANO_RGB_EASE_EXPONENTIAL = 4,
+};
+
+/**
+ * struct de10nano_rgb_fade - Fade request.
+ * @red: Target red duty cycle register value.
+ * @green: Target green duty cycle register value.
+ * @blue: Target blue duty cycle register value.
+ * @duration_ms: Length of the fade; 0 sets the target immediately.
+ * @ease: Easing curve, one of enum de10nano_rgb_ease.
+ * @reserved: Must be 0.
+ *
+ * The fade starts from the duty cycles the LED shows when the request
+ * arrives, so a new request cleanly pre-empts a fade that is still running.
+ */
+struct de10nano_rgb_fade {
+	__u32 red;
+	__u32 green;
+	__u32 blue;
+	__u32 duration_ms;
+	__u32 ease;
+	__u32 reserved;
+};
+
+// Longest fade the driver accepts
+#define DE10NANO_RGB_FADE_MAX_MS 600000
+
+#define DE10NANO_RGB_IOC_FADE \
+	_IOW(DE10NANO_IOC_MAGIC, 0x20, struct de10nano_rgb_fade)
+// Stop a running fade, leaving the LED at its current colour
+#define DE10NANO_RGB_IOC_FADE_STOP _IO(DE10NANO_IOC_MAGIC, 0x21)
+
+#endif /* DE10NANO_RGB_LED_H */
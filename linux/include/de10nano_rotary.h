@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: GPL-2.0 or MIT */
+/*
+ * User-space interface for the DE10 Nano rotary driver (/dev/rotary and
+ * /dev/rotary_events).
+ *
+ * This header is included by both the kernel module and user-space programs.
+ */
+#ifndef DE10NANO_ROTARY_H
+#define DE10NANO_ROTARY_H
+
+#include <linux/types.h>
+
+/**
+ * struct de10nano_rotary_event - One record read from /dev/rotary_events.
+ * @timestamp_ns: CLOCK_MONOTONIC time of the event, in nanoseconds.
+ * @cycles: FPGA clock cycle counter when the event happened; wraps.
+ * @flags: DE10NANO_ROTARY_EV_* flags.
+ * @count: Encoder count after the event.
+ * @velocity: Smoothed speed of the knob when the event was read, in counts
+ *            per second; negative when counting down. 0 for button events.
+ * @accel_delta: The detent's count step scaled by the acceleration curve at
+ *               @velocity. Fractions are carried over to later events, so
+ *               the sum of @accel_delta is exact. 0 for button events.
+ * @reserved: Always 0.
+ */
+struct de10nano_rotary_event {
+	__u64 timestamp_ns;
+	__u32 cycles;
+	__u32 flags;
+	__s32 count;
+	__s32 velocity;
+	__s32 accel_delta;
+	__u32 reserved;
+};
+
+// The event is a push button press; otherwise it is a detent
+#define DE10NANO_ROTARY_EV_BUTTON   (1 << 0)
+// Detent: the count went up
+#define DE10NANO_ROTARY_EV_UP       (1 << 1)
+// Push button press: the enable state after the press
+#define DE10NANO_ROTARY_EV_ENABLED  (1 << 2)
+// Events were lost just before this one
+#define DE10NANO_ROTARY_EV_OVERFLOW (1 << 3)
+
+/**
+ * enum de10nano_rotary_accel - Acceleration curve applied to count steps.
+ * @DE10NANO_ROTARY_ACCEL_FLAT: No acceleration; every step counts 1.
+ * @DE10NANO_ROTARY_ACCEL_LINEAR: The gain ramps linearly from 1 at the
+ *                                threshold speed to the maximum gain at twice
+ *                                the threshold.
+ * @DE10NANO_ROTARY_ACCEL_QUADRATIC: As linear, but the ramp is squared, so
+ *                                   the gain stays low for longer.
+ * @DE10NANO_ROTARY_ACCEL_STEP: Gain 1 below the threshold speed and the
+ *                              maximum gain above it.
+ */
+enum de10nano_rotary_accel {
+	DE10NANO_ROTARY_ACCEL_FLAT      = 0,
+	DE10NANO_ROTARY_ACCEL_LINEAR    = 1,
+	DE10NANO_ROTARY_ACCEL_QUADRATIC = 2,
+	DE10NANO_ROTARY_ACCEL_STEP      = 3,
+};
+
+// Number of events each open /dev/rotary_events file holds
+#define DE10NANO_ROTARY_EVENT_QUEUE_LEN 256
+
+#endif /* DE10NANO_ROTARY_H */
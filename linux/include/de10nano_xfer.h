@@ -0,0 +1,241 @@
+/* SPDX-License-Identifier: GPL-2.0 or MIT */
+/*
+ * Kernel-side implementation of DE10NANO_IOC_REG_XFER, shared by the
+ * DE10 Nano char drivers. See de10nano_regs.h for the user-space interface.
+ */
+#ifndef DE10NANO_XFER_H
+#define DE10NANO_XFER_H
+
+#include <linux/io.h>
+#include <linux/iopoll.h>
+#include <linux/mutex.h>
+#include <linux/regmap.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+#include <linux/kernel.h>
+
+#include "de10nano_regs.h"
+#include "de10nano_regcache.h"
+
+// How long a DE10NANO_REG_WAIT operation sleeps between polls
+#define DE10NANO_REG_WAIT_SLEEP_US 10
+
+/**
+ * de10nano_reg_xfer_begin() - Fetch and validate a batch from user space.
+ * @arg: User-space pointer to a struct de10nano_reg_xfer.
+ * @span: Span of the component's memory space in bytes.
+ * @write_span: Number of bytes, starting at offset 0, that may be written.
+ * @xfer: Where to store the batch header.
+ * @ops: Where to store the batch's operations.
+ * @results: Where to store the (zeroed) result buffer.
+ *
+ * Every operation is validated before any register is touched, so a bad
+ * offset or op code never leaves a batch half applied. On success the caller
+ * must pass @ops and @results to de10nano_reg_xfer_end().
+ *
+ * Return: 0 on success, or a negative error value.
+ */
+static inline long de10nano_reg_xfer_begin(void __user *arg, size_t span,
+	size_t write_span, struct de10nano_reg_xfer *xfer,
+	struct de10nano_reg_op **ops, u32 **results)
+{
+	u32 i;
+
+	if (copy_from_user(xfer, arg, sizeof(*xfer))) {
+		return -EFAULT;
+	}
+	if (xfer->count == 0 || xfer->count > DE10NANO_REG_XFER_MAX) {
+		return -EINVAL;
+	}
+	xfer->timeout_us = clamp_t(u32, xfer->timeout_us, 1,
+	                           DE10NANO_REG_WAIT_MAX_US);
+
+	*ops = memdup_user(u64_to_user_ptr(xfer->ops),
+	                   xfer->count * sizeof(**ops));
+	if (IS_ERR(*ops)) {
+		return PTR_ERR(*ops);
+	}
+
+	for (i = 0; i < xfer->count; i++) {
+		struct de10nano_reg_op *op = &(*ops)[i];
+
+		if ((op->offset % 0x4) != 0 || op->offset >= span) {
+			goto err_free_ops;
+		}
+		switch (op->op) {
+		case DE10NANO_REG_READ:
+		case DE10NANO_REG_WAIT:
+			break;
+		case DE10NANO_REG_WRITE:
+		case DE10NANO_REG_RMW:
+			if (op->offset >= write_span) {
+				goto err_free_ops;
+			}
+			break;
+		default:
+			goto err_free_ops;
+		}
+	}
+
+	*results = kcalloc(xfer->count, sizeof(**results), GFP_KERNEL);
+	if (!*results) {
+		kfree(*ops);
+		return -ENOMEM;
+	}
+
+	return 0;
+
+err_free_ops:
+	kfree(*ops);
+	return -EINVAL;
+}
+
+/**
+ * de10nano_reg_xfer_end() - Hand a batch's results back and free it.
+ * @xfer: The batch header.
+ * @ops: The batch's operations.
+ * @results: The batch's results.
+ * @ret: Result of running the batch.
+ *
+ * Return: @ret, or -EFAULT if the results couldn't be copied to user space.
+ */
+static inline long de10nano_reg_xfer_end(struct de10nano_reg_xfer *xfer,
+	struct de10nano_reg_op *ops, u32 *results, long ret)
+{
+	// Hand every result back with a single copy.
+	if (!ret && xfer->results &&
+	    copy_to_user(u64_to_user_ptr(xfer->results), results,
+	                 xfer->count * sizeof(*results))) {
+		ret = -EFAULT;
+	}
+
+	kfree(results);
+	kfree(ops);
+	return ret;
+}
+
+/**
+ * de10nano_reg_xfer() - Run a batch of register operations for an ioctl.
+ * @base: Base address of the component's registers.
+ * @span: Span of the component's memory space in bytes.
+ * @write_span: Number of bytes, starting at offset 0, that may be written.
+ * @lock: Lock that serialises register access; held once for the batch.
+ * @arg: User-space pointer to a struct de10nano_reg_xfer.
+ *
+ * Return: 0 on success, or a negative error value.
+ */
+static inline long de10nano_reg_xfer(void __iomem *base, size_t span,
+	size_t write_span, struct mutex *lock, void __user *arg)
+{
+	struct de10nano_reg_xfer xfer;
+	struct de10nano_reg_op *ops;
+	u32 *results;
+	long ret;
+	u32 val;
+	u32 i;
+
+	ret = de10nano_reg_xfer_begin(arg, span, write_span, &xfer, &ops,
+	                              &results);
+	if (ret) {
+		return ret;
+	}
+
+	mutex_lock(lock);
+	for (i = 0; i < xfer.count && !ret; i++) {
+		void __iomem *reg = base + ops[i].offset;
+
+		switch (ops[i].op) {
+		case DE10NANO_REG_READ:
+			results[i] = ioread32(reg);
+			break;
+		case DE10NANO_REG_WRITE:
+			iowrite32(ops[i].value, reg);
+			results[i] = ops[i].value;
+			break;
+		case DE10NANO_REG_RMW:
+			val = ioread32(reg);
+			val = (val & ~ops[i].mask) | (ops[i].value & ops[i].mask);
+			iowrite32(val, reg);
+			results[i] = val;
+			break;
+		case DE10NANO_REG_WAIT:
+			ret = read_poll_timeout(ioread32, val,
+				(val & ops[i].mask) == (ops[i].value & ops[i].mask),
+				DE10NANO_REG_WAIT_SLEEP_US, xfer.timeout_us, false, reg);
+			results[i] = val;
+			break;
+		}
+	}
+	mutex_unlock(lock);
+
+	return de10nano_reg_xfer_end(&xfer, ops, results, ret);
+}
+
+/**
+ * de10nano_regmap_xfer() - Run a batch of register operations through a
+ * register cache.
+ * @cache: The component's register cache; its lock is held once for the
+ *         batch.
+ * @span: Span of the component's memory space in bytes.
+ * @write_span: Number of bytes, starting at offset 0, that may be written.
+ * @arg: User-space pointer to a struct de10nano_reg_xfer.
+ *
+ * Same as de10nano_reg_xfer(), for drivers that keep a register cache: reads
+ * of cached registers don't touch the hardware, and writes and
+ * read-modify-writes that wouldn't change a cached register are skipped.
+ * Writes to volatile registers always reach the hardware. Writes go through
+ * de10nano_regcache_user_write(), so they reach the driver's state too.
+ *
+ * Return: 0 on success, or a negative error value.
+ */
+static inline long de10nano_regmap_xfer(struct de10nano_regcache *cache,
+	size_t span, size_t write_span, void __user *arg)
+{
+	struct de10nano_reg_xfer xfer;
+	struct de10nano_reg_op *ops;
+	u32 *results;
+	long ret;
+	u32 val;
+	u32 i;
+
+	ret = de10nano_reg_xfer_begin(arg, span, write_span, &xfer, &ops,
+	                              &results);
+	if (ret) {
+		return ret;
+	}
+
+	mutex_lock(cache->lock);
+	for (i = 0; i < xfer.count && !ret; i++) {
+		unsigned int reg = ops[i].offset;
+
+		switch (ops[i].op) {
+		case DE10NANO_REG_READ:
+			ret = de10nano_regcache_read(cache, reg, &results[i]);
+			break;
+		case DE10NANO_REG_WRITE:
+			ret = de10nano_regcache_user_write(cache, reg, ops[i].value);
+			results[i] = ops[i].value;
+			break;
+		case DE10NANO_REG_RMW:
+			ret = de10nano_regcache_read(cache, reg, &val);
+			if (!ret) {
+				val = (val & ~ops[i].mask) | (ops[i].value & ops[i].mask);
+				ret = de10nano_regcache_user_write(cache, reg, val);
+			}
+			results[i] = val;
+			break;
+		case DE10NANO_REG_WAIT:
+			ret = regmap_read_poll_timeout(cache->map, reg, val,
+				(val & ops[i].mask) == (ops[i].value & ops[i].mask),
+				DE10NANO_REG_WAIT_SLEEP_US, xfer.timeout_us);
+			results[i] = val;
+			break;
+		}
+	}
+	mutex_unlock(cache->lock);
+
+	return de10nano_reg_xfer_end(&xfer, ops, results, ret);
+}
+
+#endif /* DE10NANO_XFER_H */
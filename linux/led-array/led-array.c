@@ -6,42 +6,391 @@
 #include <linux/miscdevice.h>               // miscdevice definitions
 #include <linux/types.h>                    // data types
 #include <linux/fs.h>                       // copy_to_user
+#include <linux/uio.h>                      // iov_iter, copy_to_iter/copy_from_iter
 #include <linux/kstrtox.h>                  // kstrtou8
+#include <linux/hrtimer.h>                  // hrtimer for the frame sequencer
+#include <linux/ktime.h>                    // ms_to_ktime
+#include <linux/slab.h>                     // kmalloc/kfree
+#include <linux/spinlock.h>                 // spinlock definitions
+#include <linux/overflow.h>                 // struct_size
+#include <linux/bits.h>                     // BIT
+#include <linux/limits.h>                   // U8_MAX
+
+#include "de10nano_xfer.h"                 // DE10NANO_IOC_REG_XFER
+#include "de10nano_mmap.h"                 // de10nano_mmap_regs
+#include "de10nano_regcache.h"             // de10nano_regcache_*
+#include "de10nano_led_array.h"            // DE10NANO_LED_IOC_SEQ_LOAD
+#include "de10nano_bind.h"                 // struct de10nano_bind_sink
 
 #define ARRAY_OFFSET      0x00              // 0 byte offset for the led array register
-#define SPAN 16                             // Span of the components memory space
+#define CONTROL_OFFSET    0x04              // 4 byte offset for the control register
+#define BRIGHTNESS_OFFSET DE10NANO_LED_BRIGHTNESS_OFFSET    // LEDs 0-3, then LEDs 4-7
+#define SEQ_CONTROL_OFFSET  0x10            // Fabric sequencer run bit and mode
+#define SEQ_LENGTH_OFFSET   0x14            // Number of frames the fabric sequencer plays
+#define SEQ_STATUS_OFFSET   0x18            // Current frame and running bit (read-only)
+#define SEQ_CAPACITY_OFFSET 0x1C            // Frames the pattern RAM holds (read-only)
+#define FRAMES_OFFSET     0x800             // Pattern RAM, one frame per register
+#define SPAN 4096                           // Span of the components memory space
+
+#define CONTROL_GAMMA     BIT(0)            // Gamma-correct the brightness levels
+
+#define SEQ_CONTROL_RUN         BIT(0)      // Rising edge starts from the first frame
+#define SEQ_CONTROL_MODE_SHIFT  1           // enum de10nano_led_seq_mode
+#define SEQ_STATUS_INDEX_MASK   0xffff
+#define SEQ_STATUS_RUNNING      BIT(16)
+#define FRAME_DURATION_SHIFT    16          // Frame duration in ms, above the pattern
+#define FABRIC_MAX_FRAMES       ((SPAN - FRAMES_OFFSET) / sizeof(u32))
+
+/**
+* struct led_array_seq - Animation loaded into the frame sequencer.
+* @mode: What happens after the last frame; see de10nano_led_seq_mode
+* @count: Number of frames
+* @frames: The frames, in playing order
+*/
+struct led_array_seq {
+    u32 mode;
+    u32 count;
+    struct de10nano_led_frame frames[];
+};
+
 /**
 * struct led_array_dev - Private led array device struct.
-* @led_array: Address of the led_array register
-* @led_array: Pointer to the led_array register
+* @base_addr: Pointer to the component's base address
+* @phys_addr: Physical address of the component's registers
+* @emulated: The registers are backed by RAM instead of the FPGA
+* @cache: Register cache; every register is host-owned, so reads come from
+* RAM and writes of unchanged values never reach the bridge
 * @miscdev: miscdevice used to create a character device
 * @lock: mutex used to prevent concurrent writes to memory
+* @seq_timer: hrtimer that shows each frame of the animation
+* @seq_lock: Protects the sequencer state below against the timer
+* @seq: The loaded animation, or NULL
+* @seq_pos: Index of the next frame to show
+* @seq_dir: Direction through the frames, 1 or -1 (ping-pong mode)
+* @seq_active: The animation is playing from the hrtimer
+* @seq_fabric: The loaded animation was uploaded to the fabric sequencer
+* @seq_frames: Frames the fabric sequencer's pattern RAM holds, or 0 if the
+* bitstream has none
+* @bind: de10nano_bind sink for the LED pattern
 *
 * An led_array_dev struct gets created for each led array component.
 */
 struct led_array_dev {
     void __iomem *base_addr;
-    void __iomem *led_array;
+    phys_addr_t phys_addr;
+    bool emulated;
+    struct de10nano_regcache cache;
     struct miscdevice miscdev;
     struct mutex lock;
+    struct hrtimer seq_timer;
+    spinlock_t seq_lock;
+    struct led_array_seq *seq;
+    u32 seq_pos;
+    int seq_dir;
+    bool seq_active;
+    bool seq_fabric;
+    u32 seq_frames;
+    struct de10nano_bind_sink bind;
+};
+
+// Names shown by the sequence sysfs attribute, indexed by de10nano_led_seq_mode
+static const char * const led_array_seq_mode_names[] = {
+    [DE10NANO_LED_SEQ_LOOP] = "loop",
+    [DE10NANO_LED_SEQ_PINGPONG] = "pingpong",
+    [DE10NANO_LED_SEQ_ONESHOT] = "oneshot",
 };
 
+/*
+* When emulate is set, the module registers its own platform device whose
+* registers are backed by a page of ordinary RAM instead of the FPGA. This
+* lets the driver be loaded and exercised on a stock x86 kernel.
+*/
+static bool emulate;
+module_param(emulate, bool, 0444);
+MODULE_PARM_DESC(emulate, "Back the registers with RAM instead of the FPGA");
+
 /**
-* led_array_read() - Read method for the led_array char device
-* @file: Pointer to the char device file struct.
-* @buf: User-space buffer to read the value into.
-* @count: The number of bytes being requested.
-* @offset: The byte offset in the file being read from.
+* led_array_volatile_reg() - Tell the register cache which registers the
+* hardware changes.
+* @dev: Unused.
+* @reg: Register offset.
 *
-* Return: On success, the number of bytes written is returned and the
-* offset @offset is advanced by this number. On error, a negative error
-* value is returned.
+* Return: true for the fabric sequencer's status register.
 */
-static ssize_t led_array_read(struct file *file, char __user *buf,
-    size_t count, loff_t *offset)
+static bool led_array_volatile_reg(struct device *dev, unsigned int reg)
+{
+    return reg == SEQ_STATUS_OFFSET;
+}
+
+/**
+* led_array_seq_timer() - Show the next frame of the animation.
+* @timer: The sequencer's hrtimer.
+*
+* Each frame's expiry is scheduled from the previous frame's expiry rather
+* than from when the callback ran, so timer latency doesn't accumulate over
+* a long animation.
+*
+* Return: HRTIMER_RESTART until a one-shot animation reaches its last frame.
+*/
+static enum hrtimer_restart led_array_seq_timer(struct hrtimer *timer)
+{
+    struct led_array_dev *priv = container_of(timer, struct led_array_dev,
+                                seq_timer);
+    const struct de10nano_led_frame *frame;
+    struct led_array_seq *seq;
+    bool done = false;
+
+    spin_lock(&priv->seq_lock);
+
+    seq = priv->seq;
+    frame = &seq->frames[priv->seq_pos];
+    de10nano_regcache_write(&priv->cache, ARRAY_OFFSET, frame->pattern);
+    hrtimer_add_expires(timer, ms_to_ktime(frame->duration_ms));
+
+    switch (seq->mode) {
+    case DE10NANO_LED_SEQ_LOOP:
+        priv->seq_pos = (priv->seq_pos + 1) % seq->count;
+        break;
+    case DE10NANO_LED_SEQ_PINGPONG:
+        if (seq->count == 1) {
+            break;
+        }
+        if (priv->seq_dir > 0 && priv->seq_pos == seq->count - 1) {
+            priv->seq_dir = -1;
+        }
+        else if (priv->seq_dir < 0 && priv->seq_pos == 0) {
+            priv->seq_dir = 1;
+        }
+        priv->seq_pos += priv->seq_dir;
+        break;
+    case DE10NANO_LED_SEQ_ONESHOT:
+        if (priv->seq_pos == seq->count - 1) {
+            done = true;
+            priv->seq_active = false;
+        }
+        else {
+            priv->seq_pos++;
+        }
+        break;
+    }
+
+    spin_unlock(&priv->seq_lock);
+
+    return done ? HRTIMER_NORESTART : HRTIMER_RESTART;
+}
+
+/**
+* led_array_seq_stop() - Stop the animation, if one is playing.
+* @priv: Private led_array device struct.
+*
+* The LEDs keep showing the current frame. For the fabric sequencer, that
+* frame's pattern is copied into the LED register before the sequencer is
+* stopped. The caller must hold priv->lock.
+*/
+static void led_array_seq_stop(struct led_array_dev *priv)
+{
+    unsigned long flags;
+    u32 control;
+    u32 status;
+    u32 pos;
+
+    hrtimer_cancel(&priv->seq_timer);
+
+    spin_lock_irqsave(&priv->seq_lock, flags);
+    priv->seq_active = false;
+    spin_unlock_irqrestore(&priv->seq_lock, flags);
+
+    if (!priv->seq_fabric ||
+        de10nano_regcache_read(&priv->cache, SEQ_CONTROL_OFFSET, &control) ||
+        !(control & SEQ_CONTROL_RUN)) {
+        return;
+    }
+
+    if (!de10nano_regcache_read(&priv->cache, SEQ_STATUS_OFFSET, &status)) {
+        pos = status & SEQ_STATUS_INDEX_MASK;
+        if (pos < priv->seq->count) {
+            de10nano_regcache_write(&priv->cache, ARRAY_OFFSET,
+                                    priv->seq->frames[pos].pattern);
+        }
+    }
+    de10nano_regcache_write(&priv->cache, SEQ_CONTROL_OFFSET, 0);
+}
+
+/**
+* led_array_seq_upload() - Upload an animation to the fabric sequencer and
+* start it.
+* @priv: Private led_array device struct.
+* @seq: The animation; it fits in the pattern RAM.
+*
+* The frames go to the pattern RAM in one bulk write through the register
+* cache, which keeps a copy for resume and cache_sync. The sequencer is then
+* started from the first frame and plays without any help from the CPU. The
+* caller must hold priv->lock and have stopped the sequencer.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int led_array_seq_upload(struct led_array_dev *priv,
+    const struct led_array_seq *seq)
+{
+    u32 *words;
+    u32 i;
+    int ret;
+
+    words = kmalloc_array(seq->count, sizeof(*words), GFP_KERNEL);
+    if (!words) {
+        return -ENOMEM;
+    }
+    for (i = 0; i < seq->count; i++) {
+        words[i] = (seq->frames[i].pattern & 0xff) |
+                   (seq->frames[i].duration_ms << FRAME_DURATION_SHIFT);
+    }
+
+    ret = regmap_bulk_write(priv->cache.map, FRAMES_OFFSET, words, seq->count);
+    kfree(words);
+    if (!ret) {
+        ret = de10nano_regcache_write(&priv->cache, SEQ_LENGTH_OFFSET,
+                                      seq->count);
+    }
+    // The run bit is clear, so setting it starts from the first frame.
+    if (!ret) {
+        ret = de10nano_regcache_write(&priv->cache, SEQ_CONTROL_OFFSET,
+                    (seq->mode << SEQ_CONTROL_MODE_SHIFT) | SEQ_CONTROL_RUN);
+    }
+
+    return ret;
+}
+
+/**
+* led_array_seq_load() - Load an animation and start playing it.
+* @priv: Private led_array device struct.
+* @req: The animation; its frames are still in user space.
+*
+* The frames are copied and checked before the playing animation is
+* touched, so a bad request leaves it running. The new animation then
+* replaces the old one in a single step under the sequencer lock and starts
+* from its first frame, from the hrtimer or, with DE10NANO_LED_SEQ_FABRIC,
+* from the fabric sequencer. The caller must hold priv->lock.
+*
+* Return: 0 on success, -EOPNOTSUPP if the fabric sequencer was asked for
+* but the bitstream has none, or another negative error value.
+*/
+static int led_array_seq_load(struct led_array_dev *priv,
+    const struct de10nano_led_seq *req)
+{
+    struct led_array_seq *seq;
+    struct led_array_seq *old;
+    unsigned long flags;
+    bool fabric;
+    u32 i;
+
+    if (req->count == 0 || req->count > DE10NANO_LED_SEQ_MAX_FRAMES ||
+        req->mode >= ARRAY_SIZE(led_array_seq_mode_names) ||
+        (req->flags & ~DE10NANO_LED_SEQ_FABRIC) || req->reserved) {
+        return -EINVAL;
+    }
+    fabric = req->flags & DE10NANO_LED_SEQ_FABRIC;
+    if (fabric && !priv->seq_frames) {
+        return -EOPNOTSUPP;
+    }
+    if (fabric && req->count > priv->seq_frames) {
+        return -EINVAL;
+    }
+
+    seq = kmalloc(struct_size(seq, frames, req->count), GFP_KERNEL);
+    if (!seq) {
+        return -ENOMEM;
+    }
+    seq->mode = req->mode;
+    seq->count = req->count;
+
+    if (copy_from_user(seq->frames, u64_to_user_ptr(req->frames),
+                       req->count * sizeof(seq->frames[0]))) {
+        kfree(seq);
+        return -EFAULT;
+    }
+    for (i = 0; i < seq->count; i++) {
+        if (seq->frames[i].duration_ms == 0 ||
+            seq->frames[i].duration_ms > DE10NANO_LED_FRAME_MAX_MS) {
+            kfree(seq);
+            return -EINVAL;
+        }
+    }
+
+    led_array_seq_stop(priv);
+
+    spin_lock_irqsave(&priv->seq_lock, flags);
+    old = priv->seq;
+    priv->seq = seq;
+    priv->seq_pos = 0;
+    priv->seq_dir = 1;
+    priv->seq_active = !fabric;
+    priv->seq_fabric = fabric;
+    spin_unlock_irqrestore(&priv->seq_lock, flags);
+
+    kfree(old);
+
+    if (fabric) {
+        return led_array_seq_upload(priv, seq);
+    }
+
+    // Show the first frame right away.
+    hrtimer_start(&priv->seq_timer, 0, HRTIMER_MODE_REL);
+
+    return 0;
+}
+
+/**
+* led_array_brightness_write() - Set the brightness of every LED.
+* @priv: Private led_array device struct.
+* @levels: Brightness of each LED, 0 to 255.
+*
+* The caller must hold priv->lock.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int led_array_brightness_write(struct led_array_dev *priv,
+    const u8 levels[DE10NANO_LED_COUNT])
 {
-    size_t ret;
     u32 val;
+    int ret = 0;
+    int reg;
+    int i;
+
+    for (reg = 0; reg < DE10NANO_LED_COUNT / 4 && !ret; reg++) {
+        val = 0;
+        for (i = 0; i < 4; i++) {
+            val |= (u32)levels[reg * 4 + i] << (8 * i);
+        }
+        ret = de10nano_regcache_write(&priv->cache,
+                                      BRIGHTNESS_OFFSET + reg * sizeof(u32),
+                                      val);
+    }
+
+    return ret;
+}
+
+/**
+* led_array_read_iter() - Read method for the led_array char device
+* @iocb: I/O control block; holds the file struct and the byte offset
+* being read from.
+* @to: User-space buffer(s) to read the register values into.
+*
+* As many whole registers as fit in @to are read, up to the end of the
+* component's span, so read(), readv() and preadv() can fetch the whole
+* register bank with one syscall and one lock acquisition.
+*
+* Return: On success, the number of bytes read is returned and the
+* offset is advanced by this number. On error, a negative error
+* value is returned.
+*/
+static ssize_t led_array_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+    u32 *vals;
+    loff_t pos = iocb->ki_pos;
+    size_t count;
+    size_t copied;
+    size_t i;
+    int ret = 0;
 
     /*
     * Get the device's private data from the file struct's private_data
@@ -49,90 +398,214 @@ static ssize_t led_array_read(struct file *file, char __user *buf,
     * led_array_dev struct. container_of returns the
     * led_array_dev struct that contains the miscdev in private_data.
     */
-    struct led_array_dev *priv = container_of(file->private_data,
+    struct led_array_dev *priv = container_of(iocb->ki_filp->private_data,
                                 struct led_array_dev, miscdev);
 
     // Check file offset to make sure we are reading from a valid location.
-    if (*offset < 0) {
+    if (pos < 0) {
         // We can't read from a negative file position.
         return -EINVAL;
     }
-    if (*offset >= SPAN) {
+    if (pos >= SPAN) {
         // We can't read from a position past the end of our device.
         return 0;
     }
-    if ((*offset % 0x4) != 0) {
+    if ((pos % 0x4) != 0) {
         // Prevent unaligned access.
         pr_warn("led_array_read: unaligned access\n");
         return -EFAULT;
     }
 
-    val = ioread32(priv->base_addr + *offset);
+    // Only move whole registers, and never past the end of our device.
+    count = min_t(size_t, iov_iter_count(to), SPAN - pos);
+    count = round_down(count, sizeof(u32));
+    if (count == 0) {
+        return -EINVAL;
+    }
+
+    // The span, with the pattern RAM, is too big for a buffer on the stack.
+    vals = kmalloc(count, GFP_KERNEL);
+    if (!vals) {
+        return -ENOMEM;
+    }
+
+    mutex_lock(&priv->lock);
+    for (i = 0; i < count / sizeof(u32) && !ret; i++) {
+        ret = de10nano_regcache_read(&priv->cache, pos + i * sizeof(u32),
+                                     &vals[i]);
+    }
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        kfree(vals);
+        return ret;
+    }
 
-    // Copy the value to userspace.
-    ret = copy_to_user(buf, &val, sizeof(val));
-    if (ret == sizeof(val)) {
+    // Copy the values to userspace.
+    copied = round_down(copy_to_iter(vals, count, to), sizeof(u32));
+    kfree(vals);
+    if (copied == 0) {
         pr_warn("led_array_read: nothing copied\n");
         return -EFAULT;
     }
 
     // Increment the file offset by the number of bytes we read.
-    *offset = *offset + sizeof(val);
+    iocb->ki_pos = pos + copied;
 
-    return sizeof(val);
+    return copied;
 }
 
 /**
-* led_array_write() - Write method for the led_array char device
-* @file: Pointer to the char device file struct.
-* @buf: User-space buffer to read the value from.
-* @count: The number of bytes being written.
-* @offset: The byte offset in the file being written to.
+* led_array_write_iter() - Write method for the led_array char device
+* @iocb: I/O control block; holds the file struct and the byte offset
+* being written to.
+* @from: User-space buffer(s) to read the register values from.
+*
+* As many whole registers as @from holds are written, up to the end of the
+* component's span, so write(), writev() and pwritev() can update the whole
+* register bank with one syscall and one lock acquisition.
 *
 * Return: On success, the number of bytes written is returned and the
-* offset @offset is advanced by this number. On error, a negative error
+* offset is advanced by this number. On error, a negative error
 * value is returned.
 */
-static ssize_t led_array_write(struct file *file, const char __user *buf,
-    size_t count, loff_t *offset)
+static ssize_t led_array_write_iter(struct kiocb *iocb, struct iov_iter *from)
 {
-    size_t ret;
-    u32 val;
+    u32 *vals;
+    loff_t pos = iocb->ki_pos;
+    size_t count;
+    size_t copied;
+    size_t i;
+    int ret = 0;
 
-    struct led_array_dev *priv = container_of(file->private_data,
+    struct led_array_dev *priv = container_of(iocb->ki_filp->private_data,
                                 struct led_array_dev, miscdev);
 
-    if (*offset < 0) {
+    if (pos < 0) {
         return -EINVAL;
     }
-    if (*offset >= SPAN) {
+    if (pos >= SPAN) {
         return 0;
     }
-    if ((*offset % 0x4) != 0) {
+    if ((pos % 0x4) != 0) {
         pr_warn("led_array_write: unaligned access\n");
         return -EFAULT;
     }
 
+    count = min_t(size_t, iov_iter_count(from), SPAN - pos);
+    count = round_down(count, sizeof(u32));
+    if (count == 0) {
+        return -EINVAL;
+    }
+
+    vals = kmalloc(count, GFP_KERNEL);
+    if (!vals) {
+        return -ENOMEM;
+    }
+
+    // Get the values from userspace before taking the lock.
+    copied = round_down(copy_from_iter(vals, count, from), sizeof(u32));
+    if (copied == 0) {
+        pr_warn("led_array_write: nothing copied from user space\n");
+        kfree(vals);
+        return -EFAULT;
+    }
+
+    // Registers that already hold the value aren't written again.
     mutex_lock(&priv->lock);
+    // Direct pattern writes take the LEDs back from a playing animation;
+    // brightness writes leave it playing.
+    if (pos == ARRAY_OFFSET) {
+        led_array_seq_stop(priv);
+    }
+    for (i = 0; i < copied / sizeof(u32) && !ret; i++) {
+        ret = de10nano_regcache_write(&priv->cache, pos + i * sizeof(u32),
+                                      vals[i]);
+    }
+    mutex_unlock(&priv->lock);
+    kfree(vals);
+    if (ret) {
+        return ret;
+    }
 
-    // Get the value from userspace.
-    ret = copy_from_user(&val, buf, sizeof(val));
-    if (ret != sizeof(val)) {
-        iowrite32(val, priv->base_addr + *offset);
+    // Increment the file offset by the number of bytes we wrote.
+    iocb->ki_pos = pos + copied;
 
-        // Increment the file offset by the number of bytes we wrote.
-        *offset = *offset + sizeof(val);
+    // Return the number of bytes we wrote.
+    return copied;
+}
+
+/**
+* led_array_ioctl() - ioctl method for the led_array char device
+* @file: Pointer to the char device file struct.
+* @cmd: The ioctl command.
+* @arg: User-space pointer to the command's argument.
+*
+* DE10NANO_IOC_REG_XFER runs a batch of read, write, read-modify-write and
+* wait-for-bit operations while holding the device lock once. The batch
+* goes through the register cache like every other access path.
+*
+* DE10NANO_LED_IOC_SEQ_LOAD loads an animation into the frame sequencer,
+* replacing the one that is playing, and DE10NANO_LED_IOC_SEQ_STOP stops
+* it; see de10nano_led_array.h.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static long led_array_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    struct de10nano_led_seq req;
+    int ret;
+    struct led_array_dev *priv = container_of(file->private_data,
+                                struct led_array_dev, miscdev);
 
-        // Return the number of bytes we wrote.
-        ret = sizeof(val);
+    switch (cmd) {
+    case DE10NANO_IOC_REG_XFER:
+        return de10nano_regmap_xfer(&priv->cache, SPAN, SPAN,
+                                    (void __user *)arg);
+    case DE10NANO_LED_IOC_SEQ_LOAD:
+        if (copy_from_user(&req, (void __user *)arg, sizeof(req))) {
+            return -EFAULT;
+        }
+        mutex_lock(&priv->lock);
+        ret = led_array_seq_load(priv, &req);
+        mutex_unlock(&priv->lock);
+        return ret;
+    case DE10NANO_LED_IOC_SEQ_STOP:
+        mutex_lock(&priv->lock);
+        led_array_seq_stop(priv);
+        mutex_unlock(&priv->lock);
+        return 0;
+    default:
+        return -ENOTTY;
     }
-    else {
-        pr_warn("led_array_write: nothing copied from user space\n");
-        ret = -EFAULT;
+}
+
+/**
+* led_array_mmap() - mmap method for the led_array char device
+* @file: Pointer to the char device file struct.
+* @vma: The user-space mapping being created.
+*
+* Maps the register window into user space so the registers can be
+* accessed with plain loads and stores instead of a syscall each. The
+* register cache can't see those stores, so it is bypassed until the last
+* mapping is gone.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int led_array_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    int ret;
+    struct led_array_dev *priv = container_of(file->private_data,
+                                struct led_array_dev, miscdev);
+
+    ret = de10nano_mmap_regs(vma, priv->phys_addr, SPAN, priv->emulated,
+                             false);
+    if (ret) {
+        return ret;
     }
 
-    mutex_unlock(&priv->lock);
-    return ret;
+    de10nano_regcache_mmap(&priv->cache, vma);
+
+    return 0;
 }
 
 /**
@@ -141,18 +614,46 @@ static ssize_t led_array_write(struct file *file, const char __user *buf,
 * @owner: The led_array driver owns the file operations; this
 * ensures that the driver can't be removed while the
 * character device is still in use.
-* @read: The read function.
-* @write: The write function.
+* @read_iter: The read function; also handles readv() and preadv().
+* @write_iter: The write function; also handles writev() and pwritev().
+* @unlocked_ioctl: The ioctl function; see de10nano_regs.h.
+* @compat_ioctl: Our ioctl argument is the same for 32-bit callers.
+* @mmap: Maps the register window into user space.
 * @llseek: We use the kernel's default_llseek() function; this allows
 * users to change what position they are writing/reading to/from.
 */
 static const struct file_operations led_array_fops = {
     .owner = THIS_MODULE,
-    .read = led_array_read,
-    .write = led_array_write,
+    .read_iter = led_array_read_iter,
+    .write_iter = led_array_write_iter,
+    .unlocked_ioctl = led_array_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
+    .mmap = led_array_mmap,
     .llseek = default_llseek,
 };
 
+/**
+* led_array_bind_write() - Show a pattern written by de10nano_bind.
+* @sink: The device's sink.
+* @val: LED pattern.
+*
+* Like a write to /dev/led_array, this stops the animation.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int led_array_bind_write(struct de10nano_bind_sink *sink, u32 val)
+{
+    struct led_array_dev *priv = container_of(sink, struct led_array_dev, bind);
+    int ret;
+
+    mutex_lock(&priv->lock);
+    led_array_seq_stop(priv);
+    ret = de10nano_regcache_write(&priv->cache, ARRAY_OFFSET, val);
+    mutex_unlock(&priv->lock);
+
+    return ret;
+}
+
 /**
 * led_array_probe() - Initialize device when a match is found
 * @pdev: Platform device structure associated with our led array device;
@@ -166,6 +667,8 @@ static const struct file_operations led_array_fops = {
 static int led_array_probe(struct platform_device *pdev)
 {
     struct led_array_dev *priv;
+    struct resource *res;
+    unsigned long emu_page;
     size_t ret;
 
     /*
@@ -187,17 +690,70 @@ static int led_array_probe(struct platform_device *pdev)
     * into the kernel's virtual address space because we don't have access
     * to physical memory locations.
     */
-    priv->base_addr = devm_platform_ioremap_resource(pdev, 0);
-    if (IS_ERR(priv->base_addr)) {
-        pr_err("Failed to request/remap platform device resource\n");
-        return PTR_ERR(priv->base_addr);
+    if (emulate && !platform_get_resource(pdev, IORESOURCE_MEM, 0)) {
+        // Our own emulated device has no memory region; use a RAM page.
+        emu_page = devm_get_free_pages(&pdev->dev,
+                            GFP_KERNEL | __GFP_ZERO, 0);
+        if (!emu_page) {
+            pr_err("Failed to allocate emulated registers\n");
+            return -ENOMEM;
+        }
+        priv->base_addr = (void __iomem *)emu_page;
+        priv->phys_addr = virt_to_phys((void *)emu_page);
+        priv->emulated = true;
+    }
+    else {
+        priv->base_addr = devm_platform_get_and_ioremap_resource(pdev, 0, &res);
+        if (IS_ERR(priv->base_addr)) {
+            pr_err("Failed to request/remap platform device resource\n");
+            return PTR_ERR(priv->base_addr);
+        }
+        priv->phys_addr = res->start;
     }
 
-    // Set the memory addresses for each register.
-    priv->led_array = priv->base_addr + ARRAY_OFFSET;
+    mutex_init(&priv->lock);
+
+    spin_lock_init(&priv->seq_lock);
+    hrtimer_init(&priv->seq_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    priv->seq_timer.function = led_array_seq_timer;
+
+    // Put a write-through register cache in front of the registers.
+    ret = de10nano_regcache_init_volatile(&priv->cache, &pdev->dev,
+                                          priv->base_addr, SPAN, &priv->lock,
+                                          led_array_volatile_reg);
+    if (ret) {
+        pr_err("Failed to create register map\n");
+        return ret;
+    }
 
     // Enable software-control mode and turn all the LEDs on, just for fun.
-    iowrite32(0xff, priv->led_array);
+    regmap_write(priv->cache.map, ARRAY_OFFSET, 0xff);
+    // Full, gamma-corrected brightness, so the pattern looks as it always did
+    regmap_write(priv->cache.map, CONTROL_OFFSET, CONTROL_GAMMA);
+    regmap_write(priv->cache.map, BRIGHTNESS_OFFSET, 0xffffffff);
+    regmap_write(priv->cache.map, BRIGHTNESS_OFFSET + 4, 0xffffffff);
+
+    // Find out how many frames the fabric sequencer holds, and stop it. The
+    // emulated registers have room for a full pattern RAM, though nothing
+    // plays it.
+    if (priv->emulated) {
+        priv->seq_frames = FABRIC_MAX_FRAMES;
+    } else {
+        de10nano_regcache_read(&priv->cache, SEQ_CAPACITY_OFFSET,
+                               &priv->seq_frames);
+        priv->seq_frames = min_t(u32, priv->seq_frames, FABRIC_MAX_FRAMES);
+    }
+    regmap_write(priv->cache.map, SEQ_CONTROL_OFFSET, 0);
+    regmap_write(priv->cache.map, SEQ_LENGTH_OFFSET, 0);
+
+    // Let a de10nano_bind binding drive the LEDs.
+    priv->bind.name = "led_array";
+    priv->bind.write = led_array_bind_write;
+    ret = devm_de10nano_bind_add_sink(&pdev->dev, &priv->bind);
+    if (ret) {
+        pr_err("Failed to register bind sink %s\n", priv->bind.name);
+        return ret;
+    }
 
     // Initialize the misc device parameters
     priv->miscdev.minor = MISC_DYNAMIC_MINOR;
@@ -237,6 +793,11 @@ static int led_array_remove(struct platform_device *pdev)
     // Deregister the misc device and remove the /dev/led_array file.
     misc_deregister(&priv->miscdev);
 
+    // Stop the sequencers and free the animation.
+    hrtimer_cancel(&priv->seq_timer);
+    regmap_write(priv->cache.map, SEQ_CONTROL_OFFSET, 0);
+    kfree(priv->seq);
+
     pr_info("led_array_remove successful\n");
 
     return 0;
@@ -267,10 +828,16 @@ MODULE_DEVICE_TABLE(of, led_array_of_match);
 static ssize_t led_array_show(struct device *dev,
     struct device_attribute *attr, char *buf)
 {
-    u8 led_array;
+    u32 led_array;
+    int ret;
     struct led_array_dev *priv = dev_get_drvdata(dev);
 
-    led_array = ioread32(priv->led_array);
+    mutex_lock(&priv->lock);
+    ret = de10nano_regcache_read(&priv->cache, ARRAY_OFFSET, &led_array);
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
 
     return scnprintf(buf, PAGE_SIZE, "%u\n", led_array);
 }
@@ -300,23 +867,334 @@ struct device_attribute *attr, const char *buf, size_t size)
     return ret;
     }
 
-    iowrite32(led_array, priv->led_array);
+    mutex_lock(&priv->lock);
+    led_array_seq_stop(priv);
+    ret = de10nano_regcache_write(&priv->cache, ARRAY_OFFSET, led_array);
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
 
     // Write was successful, so we return the number of bytes we wrote.
     return size;
 }
 
+/**
+* brightness_show() - Return the brightness of each LED via sysfs.
+* @dev: Device structure for the led_array component. This
+* device struct is embedded in the led_array' platform
+* device struct.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Shows the eight levels, LED 0 first, separated by spaces.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t brightness_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    u32 vals[DE10NANO_LED_COUNT / 4];
+    ssize_t len = 0;
+    int ret = 0;
+    int i;
+    struct led_array_dev *priv = dev_get_drvdata(dev);
+
+    mutex_lock(&priv->lock);
+    for (i = 0; i < ARRAY_SIZE(vals) && !ret; i++) {
+        ret = de10nano_regcache_read(&priv->cache,
+                                     BRIGHTNESS_OFFSET + i * sizeof(u32),
+                                     &vals[i]);
+    }
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    for (i = 0; i < DE10NANO_LED_COUNT; i++) {
+        len += scnprintf(buf + len, PAGE_SIZE - len, "%u%c",
+                         (vals[i / 4] >> (8 * (i % 4))) & 0xff,
+                         i == DE10NANO_LED_COUNT - 1 ? '\n' : ' ');
+    }
+
+    return len;
+}
+
+/**
+* brightness_store() - Set the brightness of the LEDs.
+* @dev: Device structure for the led_array component. This
+* device struct is embedded in the led_array' platform
+* device struct.
+* @attr: Unused.
+* @buf: Eight levels from 0 to 255, LED 0 first, or a single level for
+* every LED.
+* @size: The number of bytes being written.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t brightness_store(struct device *dev,
+struct device_attribute *attr, const char *buf, size_t size)
+{
+    unsigned int vals[DE10NANO_LED_COUNT];
+    u8 levels[DE10NANO_LED_COUNT];
+    int count;
+    int ret;
+    int i;
+    struct led_array_dev *priv = dev_get_drvdata(dev);
+
+    count = sscanf(buf, "%u %u %u %u %u %u %u %u", &vals[0], &vals[1],
+                   &vals[2], &vals[3], &vals[4], &vals[5], &vals[6], &vals[7]);
+    if (count != 1 && count != DE10NANO_LED_COUNT) {
+        return -EINVAL;
+    }
+    for (i = 0; i < DE10NANO_LED_COUNT; i++) {
+        if (count == 1) {
+            vals[i] = vals[0];
+        }
+        if (vals[i] > U8_MAX) {
+            return -EINVAL;
+        }
+        levels[i] = vals[i];
+    }
+
+    mutex_lock(&priv->lock);
+    ret = led_array_brightness_write(priv, levels);
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    return size;
+}
+
+/**
+* gamma_show() - Return whether the brightness levels are gamma-corrected.
+* @dev: Device structure for the led_array component. This
+* device struct is embedded in the led_array' platform
+* device struct.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t gamma_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    u32 control;
+    int ret;
+    struct led_array_dev *priv = dev_get_drvdata(dev);
+
+    mutex_lock(&priv->lock);
+    ret = de10nano_regcache_read(&priv->cache, CONTROL_OFFSET, &control);
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    return scnprintf(buf, PAGE_SIZE, "%d\n", !!(control & CONTROL_GAMMA));
+}
+
+/**
+* gamma_store() - Turn gamma correction on or off.
+* @dev: Device structure for the led_array component. This
+* device struct is embedded in the led_array' platform
+* device struct.
+* @attr: Unused.
+* @buf: 1 to spread the brightness levels evenly to the eye, 0 to make the
+* LEDs' on-time proportional to the level.
+* @size: The number of bytes being written.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t gamma_store(struct device *dev,
+struct device_attribute *attr, const char *buf, size_t size)
+{
+    bool gamma;
+    int ret;
+    struct led_array_dev *priv = dev_get_drvdata(dev);
+
+    ret = kstrtobool(buf, &gamma);
+    if (ret < 0) {
+        return ret;
+    }
+
+    mutex_lock(&priv->lock);
+    ret = de10nano_regcache_write(&priv->cache, CONTROL_OFFSET,
+                                  gamma ? CONTROL_GAMMA : 0);
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    return size;
+}
+
+/**
+* sequence_show() - Return the frame sequencer's state to user-space via sysfs.
+* @dev: Device structure for the led_array component. This
+* device struct is embedded in the led_array' platform
+* device struct.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t sequence_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    unsigned long flags;
+    u32 count = 0;
+    u32 mode = 0;
+    u32 control = 0;
+    u32 status = 0;
+    u32 pos;
+    bool active;
+    bool fabric;
+    int ret = 0;
+    struct led_array_dev *priv = dev_get_drvdata(dev);
+
+    mutex_lock(&priv->lock);
+    spin_lock_irqsave(&priv->seq_lock, flags);
+    if (priv->seq) {
+        count = priv->seq->count;
+        mode = priv->seq->mode;
+    }
+    pos = priv->seq_pos;
+    active = priv->seq_active;
+    fabric = priv->seq_fabric;
+    spin_unlock_irqrestore(&priv->seq_lock, flags);
+
+    // The fabric sequencer reports its own position.
+    if (fabric) {
+        ret = de10nano_regcache_read(&priv->cache, SEQ_CONTROL_OFFSET,
+                                     &control);
+        if (!ret) {
+            ret = de10nano_regcache_read(&priv->cache, SEQ_STATUS_OFFSET,
+                                         &status);
+        }
+        pos = status & SEQ_STATUS_INDEX_MASK;
+        active = (control & SEQ_CONTROL_RUN) && (status & SEQ_STATUS_RUNNING);
+    }
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    if (count == 0) {
+        return scnprintf(buf, PAGE_SIZE, "Sequence = none\n");
+    }
+
+    return scnprintf(buf, PAGE_SIZE, "Sequence = frame %u of %u, %s (%s)\n",
+                     pos, count, led_array_seq_mode_names[mode],
+                     active ? (fabric ? "playing in the FPGA" : "playing") :
+                     "stopped");
+}
+
+/**
+* fabric_frames_show() - Return how many frames the fabric sequencer holds.
+* @dev: Device structure for the led_array component. This
+* device struct is embedded in the led_array' platform
+* device struct.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t fabric_frames_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    struct led_array_dev *priv = dev_get_drvdata(dev);
+
+    return scnprintf(buf, PAGE_SIZE, "%u\n", priv->seq_frames);
+}
+
+/**
+* cache_sync_store() - Write the cached register values back to the hardware.
+* @dev: Device structure for the led_array component. This
+* device struct is embedded in the led_array platform
+* device struct.
+* @attr: Unused.
+* @buf: Unused; any write triggers the sync.
+* @size: The number of bytes being written.
+*
+* Reloading the FPGA bitstream resets the component's registers behind the
+* cache's back; write to this attribute afterwards to restore them.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t cache_sync_store(struct device *dev,
+struct device_attribute *attr, const char *buf, size_t size)
+{
+    int ret;
+    struct led_array_dev *priv = dev_get_drvdata(dev);
+
+    mutex_lock(&priv->lock);
+    ret = de10nano_regcache_sync(&priv->cache);
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    return size;
+}
+
 // Define sysfs attributes
 static DEVICE_ATTR_RW(led_array);
+static DEVICE_ATTR_RW(brightness);
+static DEVICE_ATTR_RW(gamma);
+static DEVICE_ATTR_RO(sequence);
+static DEVICE_ATTR_RO(fabric_frames);
+static DEVICE_ATTR_WO(cache_sync);
 
 // Create an attribute group so the device core can
 // export the attributes for us.
 static struct attribute *led_array_attrs[] = {
     &dev_attr_led_array.attr,
+    &dev_attr_brightness.attr,
+    &dev_attr_gamma.attr,
+    &dev_attr_sequence.attr,
+    &dev_attr_fabric_frames.attr,
+    &dev_attr_cache_sync.attr,
     NULL,
 };
 ATTRIBUTE_GROUPS(led_array);
 
+/**
+* led_array_suspend() - Hold register writes in the cache while suspended.
+* @dev: Device structure for the led_array component.
+*
+* A playing animation is stopped on its current frame.
+*
+* Return: 0.
+*/
+static int led_array_suspend(struct device *dev)
+{
+    struct led_array_dev *priv = dev_get_drvdata(dev);
+
+    mutex_lock(&priv->lock);
+    led_array_seq_stop(priv);
+    mutex_unlock(&priv->lock);
+
+    de10nano_regcache_suspend(&priv->cache);
+
+    return 0;
+}
+
+/**
+* led_array_resume() - Restore the registers from the cache after a resume.
+* @dev: Device structure for the led_array component.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int led_array_resume(struct device *dev)
+{
+    struct led_array_dev *priv = dev_get_drvdata(dev);
+
+    return de10nano_regcache_resume(&priv->cache);
+}
+
+static DEFINE_SIMPLE_DEV_PM_OPS(led_array_pm_ops, led_array_suspend, led_array_resume);
+
 /*
 * struct led_array_driver - Platform driver struct for the led_array driver
 * @probe: Function that's called when a device is found
@@ -324,6 +1202,7 @@ ATTRIBUTE_GROUPS(led_array);
 * @driver.owner: Which module owns this driver
 * @driver.name: Name of the led_array driver
 * @driver.of_match_table: Device tree match table
+* @driver.pm: Suspend/resume callbacks
 */
 static struct platform_driver led_array_driver = {
     .probe = led_array_probe,
@@ -333,14 +1212,55 @@ static struct platform_driver led_array_driver = {
         .name = "array",
         .of_match_table = led_array_of_match,
         .dev_groups = led_array_groups,
+        .pm = pm_sleep_ptr(&led_array_pm_ops),
     },
 };
 
-/*
-* We don't need to do anything special in module init/exit.
-* This macro automatically handles module init/exit.
+// Emulated platform device, only registered when emulate is set.
+static struct platform_device *led_array_emu_pdev;
+
+/**
+* led_array_init() - Register the led_array platform driver.
+*
+* When the emulate module parameter is set, a RAM-backed led array device is
+* registered as well so the driver can be tested without the FPGA.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int __init led_array_init(void)
+{
+    int ret;
+
+    ret = platform_driver_register(&led_array_driver);
+    if (ret) {
+        return ret;
+    }
+
+    if (emulate) {
+        led_array_emu_pdev = platform_device_register_simple("array",
+                            PLATFORM_DEVID_NONE, NULL, 0);
+        if (IS_ERR(led_array_emu_pdev)) {
+            platform_driver_unregister(&led_array_driver);
+            return PTR_ERR(led_array_emu_pdev);
+        }
+    }
+
+    return 0;
+}
+
+/**
+* led_array_exit() - Remove the emulated device (if any) and the platform driver.
 */
-module_platform_driver(led_array_driver);
+static void __exit led_array_exit(void)
+{
+    if (led_array_emu_pdev) {
+        platform_device_unregister(led_array_emu_pdev);
+    }
+    platform_driver_unregister(&led_array_driver);
+}
+
+module_init(led_array_init);
+module_exit(led_array_exit);
 
 MODULE_LICENSE("Dual MIT/GPL");
 MODULE_AUTHOR("Seth Howard");
@@ -6,50 +6,316 @@
 #include <linux/miscdevice.h>               // miscdevice definitions
 #include <linux/types.h>                    // data types
 #include <linux/fs.h>                       // copy_to_user
+#include <linux/uio.h>                      // iov_iter, copy_to_iter/copy_from_iter
 #include <linux/kstrtox.h>                  // kstrtouint
+#include <linux/hrtimer.h>                  // hrtimer for the fade engine
+#include <linux/ktime.h>                    // ktime_get
+#include <linux/spinlock.h>                 // spinlock definitions
+#include <linux/string.h>                   // sysfs_match_string
+
+#include "de10nano_xfer.h"                 // DE10NANO_IOC_REG_XFER
+#include "de10nano_mmap.h"                 // de10nano_mmap_regs
+#include "de10nano_regcache.h"             // de10nano_regcache_*
+#include "de10nano_rgb_led.h"              // DE10NANO_RGB_IOC_FADE
+#include "de10nano_bind.h"                 // struct de10nano_bind_sink
+#include "rgb_led_fade.h"                  // rgb_led_ease, rgb_led_fade_duty
 
 #define RED_DUTY_OFFSET         0x04            // 0 byte offset for the red duty cycle register
 #define GREEN_DUTY_OFFSET       0x08            // 4 byte offset for the green duty cycle register
 #define BLUE_DUTY_OFFSET        0x0C            // 8 byte offset for the blue duty cycle register
 #define PERIOD_OFFSET           0x00            // 12 byte offset for the period register
-#define SPAN 16                                 // Span of the components memory space
+#define CONTROL_OFFSET          0x10            // 16 byte offset for the control register
+#define PERIOD_COUNT_OFFSET     0x14            // 20 byte offset for the period length in clock cycles
+#define DUTY_COUNT_OFFSET       0x18            // 24 byte offset for the selected high time in clock cycles
+#define SPAN 32                                 // Span of the components memory space
+
+#define CONTROL_COMMIT          BIT(0)          // Latch the shadow registers at the period's end
+#define CONTROL_DOUBLE_BUFFER   BIT(1)          // Register writes only reach the PWM on a commit
+#define CONTROL_STATUS_SHIFT    4               // Bits 5:4 pick the PWM DUTY_COUNT shows
+
+#define RGB_LED_FADE_TICK_HZ    200             // Default fade update rate
+#define RGB_LED_FADE_MAX_TICK_HZ 10000          // Fastest fade update rate
+struct rgb_led_dev;
+
+/**
+* struct rgb_led_bind_sink - de10nano_bind sink for one duty cycle register.
+* @sink: The sink, named "rgb_red", "rgb_green" or "rgb_blue"
+* @priv: The register's device
+* @offset: Offset of the duty cycle register
+*/
+struct rgb_led_bind_sink {
+    struct de10nano_bind_sink sink;
+    struct rgb_led_dev *priv;
+    unsigned int offset;
+};
+
 /**
 * struct rgb_led_dev - Private RGB controller device struct.
-* @red_duty_cycle: Address of the red duty cycle register
-* @green_duty_cycle: Address of the green duty cycle register
-* @blue_duty_cycle: Address of the blue duty cycle register
-* @period: Address of the period register
+* @base_addr: Pointer to the component's base address
+* @phys_addr: Physical address of the component's registers
+* @emulated: The registers are backed by RAM instead of the FPGA
+* @cache: Register cache; every register is host-owned, so reads come from
+* RAM and writes of unchanged values never reach the bridge
 * @miscdev: miscdevice used to create a character device
 * @lock: mutex used to prevent concurrent writes to memory
+* @fade_timer: hrtimer that steps the running fade
+* @fade_lock: Protects the fade state below against the fade timer
+* @fade: Target, duration and easing curve of the current (or last) fade
+* @fade_start: Duty cycles the current fade started from
+* @fade_begin: Time the current fade started
+* @fade_tick: Time between fade steps
+* @fade_tick_hz: Fade steps per second
+* @fade_active: A fade is running
+* @bind: de10nano_bind sinks for the red, green and blue duty cycles
+* @double_buffer: Register writes are held in the shadow registers until
+* the driver commits them
 *
 * An rgb_led struct gets created for each RGB controller component.
 */
 struct rgb_led_dev {
     void __iomem *base_addr;
-    void __iomem *red_duty_cycle;
-    void __iomem *green_duty_cycle;
-    void __iomem *blue_duty_cycle;
-    void __iomem *period;
+    phys_addr_t phys_addr;
+    bool emulated;
+    struct de10nano_regcache cache;
     struct miscdevice miscdev;
     struct mutex lock;
+    struct hrtimer fade_timer;
+    spinlock_t fade_lock;
+    struct de10nano_rgb_fade fade;
+    u32 fade_start[3];
+    ktime_t fade_begin;
+    ktime_t fade_tick;
+    unsigned int fade_tick_hz;
+    bool fade_active;
+    struct rgb_led_bind_sink bind[3];
+    bool double_buffer;
 };
 
+// Duty cycle registers in the order of de10nano_rgb_fade's red, green, blue
+static const unsigned int rgb_led_duty_offsets[] = {
+    RED_DUTY_OFFSET,
+    GREEN_DUTY_OFFSET,
+    BLUE_DUTY_OFFSET,
+};
+
+// Names of the de10nano_bind sinks, in the same order
+static const char * const rgb_led_bind_names[] = {
+    "rgb_red",
+    "rgb_green",
+    "rgb_blue",
+};
+
+// Names accepted by the fade sysfs attribute, indexed by de10nano_rgb_ease
+static const char * const rgb_led_ease_names[] = {
+    [DE10NANO_RGB_EASE_LINEAR] = "linear",
+    [DE10NANO_RGB_EASE_IN] = "ease-in",
+    [DE10NANO_RGB_EASE_OUT] = "ease-out",
+    [DE10NANO_RGB_EASE_IN_OUT] = "ease-in-out",
+    [DE10NANO_RGB_EASE_EXPONENTIAL] = "exponential",
+};
+
+/*
+* When emulate is set, the module registers its own platform device whose
+* registers are backed by a page of ordinary RAM instead of the FPGA. This
+* lets the driver be loaded and exercised on a stock x86 kernel.
+*/
+static bool emulate;
+module_param(emulate, bool, 0444);
+MODULE_PARM_DESC(emulate, "Back the registers with RAM instead of the FPGA");
+
 /**
-* rgb_led_read() - Read method for the rgb_led char device
-* @file: Pointer to the char device file struct.
-* @buf: User-space buffer to read the value into.
-* @count: The number of bytes being requested.
-* @offset: The byte offset in the file being read from.
+* rgb_led_volatile_reg() - Tell the register cache which registers the
+* hardware changes.
+* @dev: Unused.
+* @reg: Register offset.
 *
-* Return: On success, the number of bytes written is returned and the
-* offset @offset is advanced by this number. On error, a negative error
+* Return: true for the control register, whose commit bit clears itself,
+* and the PWM count registers.
+*/
+static bool rgb_led_volatile_reg(struct device *dev, unsigned int reg)
+{
+    return reg == CONTROL_OFFSET || reg == PERIOD_COUNT_OFFSET ||
+           reg == DUTY_COUNT_OFFSET;
+}
+
+/**
+* rgb_led_control_write() - Write the control register from the driver's state.
+* @priv: Private rgb_led device struct.
+* @commit: Also commit the shadow registers.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int rgb_led_control_write(struct rgb_led_dev *priv, bool commit)
+{
+    u32 control = 0;
+
+    if (READ_ONCE(priv->double_buffer)) {
+        control = CONTROL_DOUBLE_BUFFER;
+        if (commit) {
+            control |= CONTROL_COMMIT;
+        }
+    }
+
+    return regmap_write(priv->cache.map, CONTROL_OFFSET, control);
+}
+
+/**
+* rgb_led_commit() - Commit the shadow registers, if double buffering is on.
+* @priv: Private rgb_led device struct.
+*
+* The period and all three duty cycles move to the PWM together at the end
+* of the current PWM period, so a colour change made up of several register
+* writes never shows up half done. Without double buffering the writes have
+* already reached the PWM and there is nothing to do.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int rgb_led_commit(struct rgb_led_dev *priv)
+{
+    if (!READ_ONCE(priv->double_buffer)) {
+        return 0;
+    }
+
+    return rgb_led_control_write(priv, true);
+}
+
+/**
+* rgb_led_fade_timer() - Step the running fade.
+* @timer: The fade's hrtimer.
+*
+* Writes the interpolated duty cycles for the current time; duty cycles that
+* haven't changed since the last step are skipped by the register cache.
+* With double buffering the three of them change together.
+*
+* Return: HRTIMER_RESTART until the fade reaches its target.
+*/
+static enum hrtimer_restart rgb_led_fade_timer(struct hrtimer *timer)
+{
+    struct rgb_led_dev *priv = container_of(timer, struct rgb_led_dev,
+                                fade_timer);
+    u32 target[3];
+    u64 elapsed_ns;
+    u64 duration_ns;
+    bool done;
+    u32 e;
+    int i;
+
+    spin_lock(&priv->fade_lock);
+
+    target[0] = priv->fade.red;
+    target[1] = priv->fade.green;
+    target[2] = priv->fade.blue;
+
+    elapsed_ns = ktime_to_ns(ktime_sub(ktime_get(), priv->fade_begin));
+    duration_ns = (u64)priv->fade.duration_ms * NSEC_PER_MSEC;
+    done = elapsed_ns >= duration_ns;
+    e = rgb_led_ease(priv->fade.ease,
+                     rgb_led_fade_progress(elapsed_ns, duration_ns));
+
+    for (i = 0; i < ARRAY_SIZE(rgb_led_duty_offsets); i++) {
+        de10nano_regcache_write(&priv->cache, rgb_led_duty_offsets[i],
+            rgb_led_fade_duty(priv->fade_start[i], target[i], e));
+    }
+    rgb_led_commit(priv);
+
+    if (done) {
+        priv->fade_active = false;
+    }
+    else {
+        hrtimer_forward_now(timer, priv->fade_tick);
+    }
+
+    spin_unlock(&priv->fade_lock);
+
+    return done ? HRTIMER_NORESTART : HRTIMER_RESTART;
+}
+
+/**
+* rgb_led_fade_stop() - Stop the running fade, if any.
+* @priv: Private rgb_led device struct.
+*
+* The LED keeps the colour of the last step.
+*/
+static void rgb_led_fade_stop(struct rgb_led_dev *priv)
+{
+    unsigned long flags;
+
+    hrtimer_cancel(&priv->fade_timer);
+
+    spin_lock_irqsave(&priv->fade_lock, flags);
+    priv->fade_active = false;
+    spin_unlock_irqrestore(&priv->fade_lock, flags);
+}
+
+/**
+* rgb_led_fade_start() - Start a fade, pre-empting the running one.
+* @priv: Private rgb_led device struct.
+* @fade: Target colour, duration and easing curve.
+*
+* The fade starts from the duty cycles the LED is showing right now, which
+* is wherever the pre-empted fade had got to. The caller must hold
+* priv->lock.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int rgb_led_fade_start(struct rgb_led_dev *priv,
+    const struct de10nano_rgb_fade *fade)
+{
+    unsigned long flags;
+    u32 start[3];
+    int ret;
+    int i;
+
+    if (fade->ease >= ARRAY_SIZE(rgb_led_ease_names) || fade->reserved ||
+        fade->duration_ms > DE10NANO_RGB_FADE_MAX_MS) {
+        return -EINVAL;
+    }
+
+    rgb_led_fade_stop(priv);
+
+    for (i = 0; i < ARRAY_SIZE(rgb_led_duty_offsets); i++) {
+        ret = de10nano_regcache_read(&priv->cache, rgb_led_duty_offsets[i],
+                                     &start[i]);
+        if (ret) {
+            return ret;
+        }
+    }
+
+    spin_lock_irqsave(&priv->fade_lock, flags);
+    priv->fade = *fade;
+    memcpy(priv->fade_start, start, sizeof(start));
+    priv->fade_begin = ktime_get();
+    priv->fade_active = true;
+    spin_unlock_irqrestore(&priv->fade_lock, flags);
+
+    // The first step runs right away; a 0 ms fade is finished by it.
+    hrtimer_start(&priv->fade_timer, 0, HRTIMER_MODE_REL);
+
+    return 0;
+}
+
+/**
+* rgb_led_read_iter() - Read method for the rgb_led char device
+* @iocb: I/O control block; holds the file struct and the byte offset
+* being read from.
+* @to: User-space buffer(s) to read the register values into.
+*
+* As many whole registers as fit in @to are read, up to the end of the
+* component's span, so read(), readv() and preadv() can fetch the whole
+* register bank with one syscall and one lock acquisition.
+*
+* Return: On success, the number of bytes read is returned and the
+* offset is advanced by this number. On error, a negative error
 * value is returned.
 */
-static ssize_t rgb_led_read(struct file *file, char __user *buf,
-    size_t count, loff_t *offset)
+static ssize_t rgb_led_read_iter(struct kiocb *iocb, struct iov_iter *to)
 {
-    size_t ret;
-    u32 val;
+    u32 vals[SPAN / sizeof(u32)];
+    loff_t pos = iocb->ki_pos;
+    size_t count;
+    size_t copied;
+    size_t i;
+    int ret = 0;
 
     /*
     * Get the device's private data from the file struct's private_data
@@ -57,90 +323,201 @@ static ssize_t rgb_led_read(struct file *file, char __user *buf,
     * rgb_led_dev struct. container_of returns the
     * rgb_led_dev struct that contains the miscdev in private_data.
     */
-    struct rgb_led_dev *priv = container_of(file->private_data,
+    struct rgb_led_dev *priv = container_of(iocb->ki_filp->private_data,
                                 struct rgb_led_dev, miscdev);
 
     // Check file offset to make sure we are reading from a valid location.
-    if (*offset < 0) {
+    if (pos < 0) {
         // We can't read from a negative file position.
         return -EINVAL;
     }
-    if (*offset >= SPAN) {
+    if (pos >= SPAN) {
         // We can't read from a position past the end of our device.
         return 0;
     }
-    if ((*offset % 0x4) != 0) {
+    if ((pos % 0x4) != 0) {
         // Prevent unaligned access.
         pr_warn("rgb_led_read: unaligned access\n");
         return -EFAULT;
     }
 
-    val = ioread32(priv->base_addr + *offset);
+    // Only move whole registers, and never past the end of our device.
+    count = min_t(size_t, iov_iter_count(to), SPAN - pos);
+    count = round_down(count, sizeof(u32));
+    if (count == 0) {
+        return -EINVAL;
+    }
+
+    mutex_lock(&priv->lock);
+    for (i = 0; i < count / sizeof(u32) && !ret; i++) {
+        ret = de10nano_regcache_read(&priv->cache, pos + i * sizeof(u32),
+                                     &vals[i]);
+    }
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
 
-    // Copy the value to userspace.
-    ret = copy_to_user(buf, &val, sizeof(val));
-    if (ret == sizeof(val)) {
+    // Copy the values to userspace.
+    copied = round_down(copy_to_iter(vals, count, to), sizeof(u32));
+    if (copied == 0) {
         pr_warn("rgb_led_read: nothing copied\n");
         return -EFAULT;
     }
 
     // Increment the file offset by the number of bytes we read.
-    *offset = *offset + sizeof(val);
+    iocb->ki_pos = pos + copied;
 
-    return sizeof(val);
+    return copied;
 }
 
 /**
-* rgb_led_write() - Write method for the rgb_led char device
-* @file: Pointer to the char device file struct.
-* @buf: User-space buffer to read the value from.
-* @count: The number of bytes being written.
-* @offset: The byte offset in the file being written to.
+* rgb_led_write_iter() - Write method for the rgb_led char device
+* @iocb: I/O control block; holds the file struct and the byte offset
+* being written to.
+* @from: User-space buffer(s) to read the register values from.
+*
+* As many whole registers as @from holds are written, up to the end of the
+* component's span, so write(), writev() and pwritev() can update the whole
+* register bank with one syscall and one lock acquisition. With double
+* buffering on, the registers are committed together afterwards, unless the
+* write covers the control register and so does its own committing.
 *
 * Return: On success, the number of bytes written is returned and the
-* offset @offset is advanced by this number. On error, a negative error
+* offset is advanced by this number. On error, a negative error
 * value is returned.
 */
-static ssize_t rgb_led_write(struct file *file, const char __user *buf,
-    size_t count, loff_t *offset)
+static ssize_t rgb_led_write_iter(struct kiocb *iocb, struct iov_iter *from)
 {
-    size_t ret;
-    u32 val;
-
-    struct rgb_led_dev *priv = container_of(file->private_data,
+    u32 vals[SPAN / sizeof(u32)];
+    loff_t pos = iocb->ki_pos;
+    size_t count;
+    size_t copied;
+    size_t i;
+    int ret = 0;
+
+    struct rgb_led_dev *priv = container_of(iocb->ki_filp->private_data,
                                 struct rgb_led_dev, miscdev);
 
-    if (*offset < 0) {
+    if (pos < 0) {
         return -EINVAL;
     }
-    if (*offset >= SPAN) {
+    if (pos >= SPAN) {
         return 0;
     }
-    if ((*offset % 0x4) != 0) {
+    if ((pos % 0x4) != 0) {
         pr_warn("rgb_led_write: unaligned access\n");
         return -EFAULT;
     }
 
+    count = min_t(size_t, iov_iter_count(from), SPAN - pos);
+    count = round_down(count, sizeof(u32));
+    if (count == 0) {
+        return -EINVAL;
+    }
+
+    // Get the values from userspace before taking the lock.
+    copied = round_down(copy_from_iter(vals, count, from), sizeof(u32));
+    if (copied == 0) {
+        pr_warn("rgb_led_write: nothing copied from user space\n");
+        return -EFAULT;
+    }
+
+    // Registers that already hold the value aren't written again.
     mutex_lock(&priv->lock);
+    // Direct writes take the duty cycles back from a running fade.
+    rgb_led_fade_stop(priv);
+    for (i = 0; i < copied / sizeof(u32) && !ret; i++) {
+        ret = de10nano_regcache_write(&priv->cache, pos + i * sizeof(u32),
+                                      vals[i]);
+    }
+    if (!ret && (pos > CONTROL_OFFSET || pos + copied <= CONTROL_OFFSET)) {
+        ret = rgb_led_commit(priv);
+    }
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
 
-    // Get the value from userspace.
-    ret = copy_from_user(&val, buf, sizeof(val));
-    if (ret != sizeof(val)) {
-        iowrite32(val, priv->base_addr + *offset);
+    // Increment the file offset by the number of bytes we wrote.
+    iocb->ki_pos = pos + copied;
 
-        // Increment the file offset by the number of bytes we wrote.
-        *offset = *offset + sizeof(val);
+    // Return the number of bytes we wrote.
+    return copied;
+}
 
-        // Return the number of bytes we wrote.
-        ret = sizeof(val);
+/**
+* rgb_led_ioctl() - ioctl method for the rgb_led char device
+* @file: Pointer to the char device file struct.
+* @cmd: The ioctl command.
+* @arg: User-space pointer to the command's argument.
+*
+* DE10NANO_IOC_REG_XFER runs a batch of read, write, read-modify-write and
+* wait-for-bit operations while holding the device lock once. The batch
+* goes through the register cache like every other access path.
+*
+* DE10NANO_RGB_IOC_FADE starts a fade to a new colour, pre-empting any fade
+* that is still running, and DE10NANO_RGB_IOC_FADE_STOP stops it; see
+* de10nano_rgb_led.h.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static long rgb_led_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    struct de10nano_rgb_fade fade;
+    int ret;
+    struct rgb_led_dev *priv = container_of(file->private_data,
+                                struct rgb_led_dev, miscdev);
+
+    switch (cmd) {
+    case DE10NANO_IOC_REG_XFER:
+        return de10nano_regmap_xfer(&priv->cache, SPAN, SPAN,
+                                    (void __user *)arg);
+    case DE10NANO_RGB_IOC_FADE:
+        if (copy_from_user(&fade, (void __user *)arg, sizeof(fade))) {
+            return -EFAULT;
+        }
+        mutex_lock(&priv->lock);
+        ret = rgb_led_fade_start(priv, &fade);
+        mutex_unlock(&priv->lock);
+        return ret;
+    case DE10NANO_RGB_IOC_FADE_STOP:
+        mutex_lock(&priv->lock);
+        rgb_led_fade_stop(priv);
+        mutex_unlock(&priv->lock);
+        return 0;
+    default:
+        return -ENOTTY;
     }
-    else {
-        pr_warn("rgb_led_write: nothing copied from user space\n");
-        ret = -EFAULT;
+}
+
+/**
+* rgb_led_mmap() - mmap method for the rgb_led char device
+* @file: Pointer to the char device file struct.
+* @vma: The user-space mapping being created.
+*
+* Maps the register window into user space so the registers can be
+* accessed with plain loads and stores instead of a syscall each. The
+* register cache can't see those stores, so it is bypassed until the last
+* mapping is gone.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int rgb_led_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    int ret;
+    struct rgb_led_dev *priv = container_of(file->private_data,
+                                struct rgb_led_dev, miscdev);
+
+    ret = de10nano_mmap_regs(vma, priv->phys_addr, SPAN, priv->emulated,
+                             false);
+    if (ret) {
+        return ret;
     }
 
-    mutex_unlock(&priv->lock);
-    return ret;
+    de10nano_regcache_mmap(&priv->cache, vma);
+
+    return 0;
 }
 
 /**
@@ -149,18 +526,51 @@ static ssize_t rgb_led_write(struct file *file, const char __user *buf,
 * @owner: The rgb_led driver owns the file operations; this
 * ensures that the driver can't be removed while the
 * character device is still in use.
-* @read: The read function.
-* @write: The write function.
+* @read_iter: The read function; also handles readv() and preadv().
+* @write_iter: The write function; also handles writev() and pwritev().
+* @unlocked_ioctl: The ioctl function; see de10nano_regs.h.
+* @compat_ioctl: Our ioctl argument is the same for 32-bit callers.
+* @mmap: Maps the register window into user space.
 * @llseek: We use the kernel's default_llseek() function; this allows
 * users to change what position they are writing/reading to/from.
 */
 static const struct file_operations rgb_led_fops = {
     .owner = THIS_MODULE,
-    .read = rgb_led_read,
-    .write = rgb_led_write,
+    .read_iter = rgb_led_read_iter,
+    .write_iter = rgb_led_write_iter,
+    .unlocked_ioctl = rgb_led_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
+    .mmap = rgb_led_mmap,
     .llseek = default_llseek,
 };
 
+/**
+* rgb_led_bind_write() - Set a duty cycle written by de10nano_bind.
+* @sink: The duty cycle's sink.
+* @val: Duty cycle register value.
+*
+* Like a write to /dev/rgb_led, this stops a running fade.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int rgb_led_bind_write(struct de10nano_bind_sink *sink, u32 val)
+{
+    struct rgb_led_bind_sink *bind = container_of(sink,
+                                struct rgb_led_bind_sink, sink);
+    struct rgb_led_dev *priv = bind->priv;
+    int ret;
+
+    mutex_lock(&priv->lock);
+    rgb_led_fade_stop(priv);
+    ret = de10nano_regcache_write(&priv->cache, bind->offset, val);
+    if (!ret) {
+        ret = rgb_led_commit(priv);
+    }
+    mutex_unlock(&priv->lock);
+
+    return ret;
+}
+
 /**
 * rgb_led_probe() - Initialize device when a match is found
 * @pdev: Platform device structure associated with our rgb control device;
@@ -174,7 +584,10 @@ static const struct file_operations rgb_led_fops = {
 static int rgb_led_probe(struct platform_device *pdev)
 {
     struct rgb_led_dev *priv;
+    struct resource *res;
+    unsigned long emu_page;
     size_t ret;
+    size_t i;
 
     /*
     * Allocate kernel memory for the rgb control device and set it to 0.
@@ -195,23 +608,64 @@ static int rgb_led_probe(struct platform_device *pdev)
     * into the kernel's virtual address space because we don't have access
     * to physical memory locations.
     */
-    priv->base_addr = devm_platform_ioremap_resource(pdev, 0);
-    if (IS_ERR(priv->base_addr)) {
-        pr_err("Failed to request/remap platform device resource\n");
-        return PTR_ERR(priv->base_addr);
+    if (emulate && !platform_get_resource(pdev, IORESOURCE_MEM, 0)) {
+        // Our own emulated device has no memory region; use a RAM page.
+        emu_page = devm_get_free_pages(&pdev->dev,
+                            GFP_KERNEL | __GFP_ZERO, 0);
+        if (!emu_page) {
+            pr_err("Failed to allocate emulated registers\n");
+            return -ENOMEM;
+        }
+        priv->base_addr = (void __iomem *)emu_page;
+        priv->phys_addr = virt_to_phys((void *)emu_page);
+        priv->emulated = true;
+    }
+    else {
+        priv->base_addr = devm_platform_get_and_ioremap_resource(pdev, 0, &res);
+        if (IS_ERR(priv->base_addr)) {
+            pr_err("Failed to request/remap platform device resource\n");
+            return PTR_ERR(priv->base_addr);
+        }
+        priv->phys_addr = res->start;
     }
 
-    // Set the memory addresses for each register.
-    priv->red_duty_cycle = priv->base_addr + RED_DUTY_OFFSET;
-    priv->green_duty_cycle = priv->base_addr + GREEN_DUTY_OFFSET;
-    priv->blue_duty_cycle = priv->base_addr + BLUE_DUTY_OFFSET;
-    priv->period = priv->base_addr + PERIOD_OFFSET;
+    mutex_init(&priv->lock);
+
+    spin_lock_init(&priv->fade_lock);
+    hrtimer_init(&priv->fade_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    priv->fade_timer.function = rgb_led_fade_timer;
+    priv->fade_tick_hz = RGB_LED_FADE_TICK_HZ;
+    priv->fade_tick = ns_to_ktime(div_u64(NSEC_PER_SEC, priv->fade_tick_hz));
+
+    // Put a write-through register cache in front of the registers.
+    ret = de10nano_regcache_init_volatile(&priv->cache, &pdev->dev,
+                                          priv->base_addr, SPAN, &priv->lock,
+                                          rgb_led_volatile_reg);
+    if (ret) {
+        pr_err("Failed to create register map\n");
+        return ret;
+    }
 
     // Set the period to 1 ms and each duty cycle to 0 to begin
-    iowrite32(0x4000000, priv->period);
-    iowrite32(0x0, priv->red_duty_cycle);
-    iowrite32(0x0, priv->green_duty_cycle);
-    iowrite32(0x0, priv->blue_duty_cycle);
+    regmap_write(priv->cache.map, PERIOD_OFFSET, 0x4000000);
+    regmap_write(priv->cache.map, RED_DUTY_OFFSET, 0x0);
+    regmap_write(priv->cache.map, GREEN_DUTY_OFFSET, 0x0);
+    regmap_write(priv->cache.map, BLUE_DUTY_OFFSET, 0x0);
+    // Writes reach the PWM right away until double buffering is turned on.
+    regmap_write(priv->cache.map, CONTROL_OFFSET, 0x0);
+
+    // Let de10nano_bind bindings drive the duty cycles.
+    for (i = 0; i < ARRAY_SIZE(priv->bind); i++) {
+        priv->bind[i].sink.name = rgb_led_bind_names[i];
+        priv->bind[i].sink.write = rgb_led_bind_write;
+        priv->bind[i].priv = priv;
+        priv->bind[i].offset = rgb_led_duty_offsets[i];
+        ret = devm_de10nano_bind_add_sink(&pdev->dev, &priv->bind[i].sink);
+        if (ret) {
+            pr_err("Failed to register bind sink %s\n", rgb_led_bind_names[i]);
+            return ret;
+        }
+    }
 
     // Initialize the misc device parameters
     priv->miscdev.minor = MISC_DYNAMIC_MINOR;
@@ -251,6 +705,9 @@ static int rgb_led_remove(struct platform_device *pdev)
     // Deregister the misc device and remove the /dev/rgb_led file.
     misc_deregister(&priv->miscdev);
 
+    // Make sure the fade timer is no longer running.
+    hrtimer_cancel(&priv->fade_timer);
+
     pr_info("rgb_led_remove successful\n");
 
     return 0;
@@ -282,10 +739,17 @@ static ssize_t red_duty_cycle_show(struct device *dev,
     struct device_attribute *attr, char *buf)
 {
     u32 red_duty_cycle;
+    int ret;
 
     struct rgb_led_dev *priv = dev_get_drvdata(dev);
 
-    red_duty_cycle = ioread32(priv->red_duty_cycle);
+    mutex_lock(&priv->lock);
+    ret = de10nano_regcache_read(&priv->cache, RED_DUTY_OFFSET,
+                                 &red_duty_cycle);
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
 
     return scnprintf(buf, PAGE_SIZE, "Red duty cycle = %x\n", red_duty_cycle);
 }
@@ -316,7 +780,17 @@ struct device_attribute *attr, const char *buf, size_t size)
     return ret;
     }
 
-    iowrite32(red_duty_cycle, priv->red_duty_cycle);
+    mutex_lock(&priv->lock);
+    rgb_led_fade_stop(priv);
+    ret = de10nano_regcache_write(&priv->cache, RED_DUTY_OFFSET,
+                                  red_duty_cycle);
+    if (!ret) {
+        ret = rgb_led_commit(priv);
+    }
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
 
     // Write was successful, so we return the number of bytes we wrote.
     return size;
@@ -336,10 +810,17 @@ static ssize_t green_duty_cycle_show(struct device *dev,
     struct device_attribute *attr, char *buf)
 {
     u32 green_duty_cycle;
+    int ret;
 
     struct rgb_led_dev *priv = dev_get_drvdata(dev);
 
-    green_duty_cycle = ioread32(priv->green_duty_cycle);
+    mutex_lock(&priv->lock);
+    ret = de10nano_regcache_read(&priv->cache, GREEN_DUTY_OFFSET,
+                                 &green_duty_cycle);
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
 
     return scnprintf(buf, PAGE_SIZE, "Green duty cycle = %x\n", green_duty_cycle);
 }
@@ -370,7 +851,17 @@ struct device_attribute *attr, const char *buf, size_t size)
     return ret;
     }
 
-    iowrite32(green_duty_cycle, priv->green_duty_cycle);
+    mutex_lock(&priv->lock);
+    rgb_led_fade_stop(priv);
+    ret = de10nano_regcache_write(&priv->cache, GREEN_DUTY_OFFSET,
+                                  green_duty_cycle);
+    if (!ret) {
+        ret = rgb_led_commit(priv);
+    }
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
 
     // Write was successful, so we return the number of bytes we wrote.
     return size;
@@ -390,10 +881,17 @@ static ssize_t blue_duty_cycle_show(struct device *dev,
     struct device_attribute *attr, char *buf)
 {
     u32 blue_duty_cycle;
+    int ret;
 
     struct rgb_led_dev *priv = dev_get_drvdata(dev);
 
-    blue_duty_cycle = ioread32(priv->blue_duty_cycle);
+    mutex_lock(&priv->lock);
+    ret = de10nano_regcache_read(&priv->cache, BLUE_DUTY_OFFSET,
+                                 &blue_duty_cycle);
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
 
     return scnprintf(buf, PAGE_SIZE, "Blue duty cycle = %x\n", blue_duty_cycle);
 }
@@ -424,7 +922,17 @@ struct device_attribute *attr, const char *buf, size_t size)
     return ret;
     }
 
-    iowrite32(blue_duty_cycle, priv->blue_duty_cycle);
+    mutex_lock(&priv->lock);
+    rgb_led_fade_stop(priv);
+    ret = de10nano_regcache_write(&priv->cache, BLUE_DUTY_OFFSET,
+                                  blue_duty_cycle);
+    if (!ret) {
+        ret = rgb_led_commit(priv);
+    }
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
 
     // Write was successful, so we return the number of bytes we wrote.
     return size;
@@ -444,9 +952,15 @@ static ssize_t period_show(struct device *dev,
 struct device_attribute *attr, char *buf)
 {
     u32 period;
+    int ret;
     struct rgb_led_dev *priv = dev_get_drvdata(dev);
 
-    period = ioread32(priv->period);
+    mutex_lock(&priv->lock);
+    ret = de10nano_regcache_read(&priv->cache, PERIOD_OFFSET, &period);
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
 
     return scnprintf(buf, PAGE_SIZE, "Period = %u\n", period);
 }
@@ -477,17 +991,305 @@ struct device_attribute *attr, const char *buf, size_t size)
         return ret;
     }
 
-    iowrite32(period, priv->period);
+    mutex_lock(&priv->lock);
+    ret = de10nano_regcache_write(&priv->cache, PERIOD_OFFSET, period);
+    if (!ret) {
+        ret = rgb_led_commit(priv);
+    }
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
 
     // Write was successful, so we return the number of bytes we wrote.
     return size;
 }
 
+/**
+* fade_show() - Return the current (or last) fade to user-space via sysfs.
+* @dev: Device structure for the rgb_led component. This
+* device struct is embedded in the rgb_led platform
+* device struct.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t fade_show(struct device *dev,
+struct device_attribute *attr, char *buf)
+{
+    struct de10nano_rgb_fade fade;
+    unsigned long flags;
+    bool active;
+    struct rgb_led_dev *priv = dev_get_drvdata(dev);
+
+    spin_lock_irqsave(&priv->fade_lock, flags);
+    fade = priv->fade;
+    active = priv->fade_active;
+    spin_unlock_irqrestore(&priv->fade_lock, flags);
+
+    return scnprintf(buf, PAGE_SIZE, "Fade = %x %x %x %u %s (%s)\n",
+                     fade.red, fade.green, fade.blue, fade.duration_ms,
+                     rgb_led_ease_names[fade.ease],
+                     active ? "running" : "done");
+}
+
+/**
+* fade_store() - Start a fade.
+* @dev: Device structure for the rgb_led component. This
+* device struct is embedded in the rgb_led platform
+* device struct.
+* @attr: Unused.
+* @buf: "red green blue duration_ms [curve]", where curve is one of linear
+* (the default), ease-in, ease-out, ease-in-out or exponential. The duty
+* cycles are register values, e.g. 0x40000 for 50 percent.
+* @size: The number of bytes being written.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t fade_store(struct device *dev,
+struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct de10nano_rgb_fade fade = { .ease = DE10NANO_RGB_EASE_LINEAR };
+    char curve[16];
+    int red;
+    int green;
+    int blue;
+    int n;
+    int ret;
+    struct rgb_led_dev *priv = dev_get_drvdata(dev);
+
+    n = sscanf(buf, "%i %i %i %u %15s", &red, &green, &blue,
+               &fade.duration_ms, curve);
+    if (n < 4 || red < 0 || green < 0 || blue < 0) {
+        return -EINVAL;
+    }
+    fade.red = red;
+    fade.green = green;
+    fade.blue = blue;
+    if (n == 5) {
+        ret = sysfs_match_string(rgb_led_ease_names, curve);
+        if (ret < 0) {
+            return ret;
+        }
+        fade.ease = ret;
+    }
+
+    mutex_lock(&priv->lock);
+    ret = rgb_led_fade_start(priv, &fade);
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    return size;
+}
+
+/**
+* fade_tick_hz_show() - Return the fade update rate to user-space via sysfs.
+* @dev: Device structure for the rgb_led component. This
+* device struct is embedded in the rgb_led platform
+* device struct.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t fade_tick_hz_show(struct device *dev,
+struct device_attribute *attr, char *buf)
+{
+    struct rgb_led_dev *priv = dev_get_drvdata(dev);
+
+    return scnprintf(buf, PAGE_SIZE, "%u\n", READ_ONCE(priv->fade_tick_hz));
+}
+
+/**
+* fade_tick_hz_store() - Set how many times per second a fade is stepped.
+* @dev: Device structure for the rgb_led component. This
+* device struct is embedded in the rgb_led platform
+* device struct.
+* @attr: Unused.
+* @buf: Buffer that contains the rate, 1 to RGB_LED_FADE_MAX_TICK_HZ.
+* @size: The number of bytes being written.
+*
+* A running fade switches to the new rate at its next step.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t fade_tick_hz_store(struct device *dev,
+struct device_attribute *attr, const char *buf, size_t size)
+{
+    unsigned int rate;
+    unsigned long flags;
+    int ret;
+    struct rgb_led_dev *priv = dev_get_drvdata(dev);
+
+    ret = kstrtouint(buf, 0, &rate);
+    if (ret < 0) {
+        return ret;
+    }
+    if (rate == 0 || rate > RGB_LED_FADE_MAX_TICK_HZ) {
+        return -EINVAL;
+    }
+
+    spin_lock_irqsave(&priv->fade_lock, flags);
+    priv->fade_tick_hz = rate;
+    priv->fade_tick = ns_to_ktime(div_u64(NSEC_PER_SEC, rate));
+    spin_unlock_irqrestore(&priv->fade_lock, flags);
+
+    return size;
+}
+
+/**
+* pwm_counts_show() - Return the PWM controllers' limits via sysfs.
+* @dev: Device structure for the rgb_led component. This
+* device struct is embedded in the rgb_led platform
+* device struct.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Shows the period and each colour's high time in clock cycles, as computed
+* by the hardware from the registers and in use for the current period.
+*
+* The colour DUTY_COUNT shows is selected through the control register, which
+* the fade timer also writes. Each select and read is done under fade_lock,
+* so a fade step can't change the selection in between.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t pwm_counts_show(struct device *dev,
+struct device_attribute *attr, char *buf)
+{
+    u32 counts[ARRAY_SIZE(rgb_led_duty_offsets)];
+    unsigned long flags;
+    u32 control;
+    u32 period;
+    int ret;
+    int i;
+    struct rgb_led_dev *priv = dev_get_drvdata(dev);
+
+    mutex_lock(&priv->lock);
+    ret = de10nano_regcache_read(&priv->cache, PERIOD_COUNT_OFFSET, &period);
+    for (i = 0; i < ARRAY_SIZE(counts) && !ret; i++) {
+        // Writing 0 to the commit bit leaves a pending commit alone.
+        control = READ_ONCE(priv->double_buffer) ? CONTROL_DOUBLE_BUFFER : 0;
+        control |= i << CONTROL_STATUS_SHIFT;
+        spin_lock_irqsave(&priv->fade_lock, flags);
+        ret = regmap_write(priv->cache.map, CONTROL_OFFSET, control);
+        if (!ret) {
+            ret = de10nano_regcache_read(&priv->cache, DUTY_COUNT_OFFSET,
+                                         &counts[i]);
+        }
+        spin_unlock_irqrestore(&priv->fade_lock, flags);
+    }
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    return scnprintf(buf, PAGE_SIZE, "period %u\nred %u\ngreen %u\nblue %u\n",
+                     period, counts[0], counts[1], counts[2]);
+}
+
+/**
+* double_buffer_show() - Return whether register writes are double buffered.
+* @dev: Device structure for the rgb_led component. This
+* device struct is embedded in the rgb_led platform
+* device struct.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t double_buffer_show(struct device *dev,
+struct device_attribute *attr, char *buf)
+{
+    struct rgb_led_dev *priv = dev_get_drvdata(dev);
+
+    return scnprintf(buf, PAGE_SIZE, "%d\n", READ_ONCE(priv->double_buffer));
+}
+
+/**
+* double_buffer_store() - Turn double buffering on or off.
+* @dev: Device structure for the rgb_led component. This
+* device struct is embedded in the rgb_led platform
+* device struct.
+* @attr: Unused.
+* @buf: 1 to hold register writes until they are committed at the end of a
+* PWM period, 0 to let them reach the PWM right away.
+* @size: The number of bytes being written.
+*
+* Every write the driver makes commits on its own, so only accesses through
+* mmap() and DE10NANO_IOC_REG_XFER need to write the commit bit themselves.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t double_buffer_store(struct device *dev,
+struct device_attribute *attr, const char *buf, size_t size)
+{
+    bool double_buffer;
+    int ret;
+    struct rgb_led_dev *priv = dev_get_drvdata(dev);
+
+    ret = kstrtobool(buf, &double_buffer);
+    if (ret < 0) {
+        return ret;
+    }
+
+    mutex_lock(&priv->lock);
+    WRITE_ONCE(priv->double_buffer, double_buffer);
+    ret = rgb_led_control_write(priv, true);
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    return size;
+}
+
+/**
+* cache_sync_store() - Write the cached register values back to the hardware.
+* @dev: Device structure for the rgb_led component. This
+* device struct is embedded in the rgb_led platform
+* device struct.
+* @attr: Unused.
+* @buf: Unused; any write triggers the sync.
+* @size: The number of bytes being written.
+*
+* Reloading the FPGA bitstream resets the component's registers behind the
+* cache's back; write to this attribute afterwards to restore them.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t cache_sync_store(struct device *dev,
+struct device_attribute *attr, const char *buf, size_t size)
+{
+    int ret;
+    struct rgb_led_dev *priv = dev_get_drvdata(dev);
+
+    mutex_lock(&priv->lock);
+    ret = de10nano_regcache_sync(&priv->cache);
+    if (!ret) {
+        ret = rgb_led_control_write(priv, true);
+    }
+    mutex_unlock(&priv->lock);
+    if (ret) {
+        return ret;
+    }
+
+    return size;
+}
+
 // Define sysfs attributes
 static DEVICE_ATTR_RW(red_duty_cycle);
 static DEVICE_ATTR_RW(green_duty_cycle);
 static DEVICE_ATTR_RW(blue_duty_cycle);
 static DEVICE_ATTR_RW(period);
+static DEVICE_ATTR_RW(fade);
+static DEVICE_ATTR_RW(fade_tick_hz);
+static DEVICE_ATTR_RW(double_buffer);
+static DEVICE_ATTR_RO(pwm_counts);
+static DEVICE_ATTR_WO(cache_sync);
 
 // Create an attribute group so the device core can
 // export the attributes for us.
@@ -496,10 +1298,62 @@ static struct attribute *rgb_led_attrs[] = {
     &dev_attr_green_duty_cycle.attr,
     &dev_attr_blue_duty_cycle.attr,
     &dev_attr_period.attr,
+    &dev_attr_fade.attr,
+    &dev_attr_fade_tick_hz.attr,
+    &dev_attr_double_buffer.attr,
+    &dev_attr_pwm_counts.attr,
+    &dev_attr_cache_sync.attr,
     NULL,
 };
 ATTRIBUTE_GROUPS(rgb_led);
 
+/**
+* rgb_led_suspend() - Hold register writes in the cache while suspended.
+* @dev: Device structure for the rgb_led component.
+*
+* A running fade is stopped where it is.
+*
+* Return: 0.
+*/
+static int rgb_led_suspend(struct device *dev)
+{
+    struct rgb_led_dev *priv = dev_get_drvdata(dev);
+
+    mutex_lock(&priv->lock);
+    rgb_led_fade_stop(priv);
+    mutex_unlock(&priv->lock);
+
+    de10nano_regcache_suspend(&priv->cache);
+
+    return 0;
+}
+
+/**
+* rgb_led_resume() - Restore the registers from the cache after a resume.
+* @dev: Device structure for the rgb_led component.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int rgb_led_resume(struct device *dev)
+{
+    struct rgb_led_dev *priv = dev_get_drvdata(dev);
+    int ret;
+
+    ret = de10nano_regcache_resume(&priv->cache);
+    if (ret) {
+        return ret;
+    }
+
+    // The control register isn't cached, so restore it by hand.
+    mutex_lock(&priv->lock);
+    ret = rgb_led_control_write(priv, true);
+    mutex_unlock(&priv->lock);
+
+    return ret;
+}
+
+static DEFINE_SIMPLE_DEV_PM_OPS(rgb_led_pm_ops, rgb_led_suspend, rgb_led_resume);
+
 /*
 * struct rgb_led_driver - Platform driver struct for the rgb_led driver
 * @probe: Function that's called when a device is found
@@ -507,6 +1361,7 @@ ATTRIBUTE_GROUPS(rgb_led);
 * @driver.owner: Which module owns this driver
 * @driver.name: Name of the rgb_led driver
 * @driver.of_match_table: Device tree match table
+* @driver.pm: Suspend/resume callbacks
 */
 static struct platform_driver rgb_led_driver = {
     .probe = rgb_led_probe,
@@ -516,14 +1371,55 @@ static struct platform_driver rgb_led_driver = {
         .name = "rgb_led",
         .of_match_table = rgb_led_of_match,
         .dev_groups = rgb_led_groups,
+        .pm = pm_sleep_ptr(&rgb_led_pm_ops),
     },
 };
 
-/*
-* We don't need to do anything special in module init/exit.
-* This macro automatically handles module init/exit.
+// Emulated platform device, only registered when emulate is set.
+static struct platform_device *rgb_led_emu_pdev;
+
+/**
+* rgb_led_init() - Register the rgb_led platform driver.
+*
+* When the emulate module parameter is set, a RAM-backed rgb led device is
+* registered as well so the driver can be tested without the FPGA.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int __init rgb_led_init(void)
+{
+    int ret;
+
+    ret = platform_driver_register(&rgb_led_driver);
+    if (ret) {
+        return ret;
+    }
+
+    if (emulate) {
+        rgb_led_emu_pdev = platform_device_register_simple("rgb_led",
+                            PLATFORM_DEVID_NONE, NULL, 0);
+        if (IS_ERR(rgb_led_emu_pdev)) {
+            platform_driver_unregister(&rgb_led_driver);
+            return PTR_ERR(rgb_led_emu_pdev);
+        }
+    }
+
+    return 0;
+}
+
+/**
+* rgb_led_exit() - Remove the emulated device (if any) and the platform driver.
 */
-module_platform_driver(rgb_led_driver);
+static void __exit rgb_led_exit(void)
+{
+    if (rgb_led_emu_pdev) {
+        platform_device_unregister(rgb_led_emu_pdev);
+    }
+    platform_driver_unregister(&rgb_led_driver);
+}
+
+module_init(rgb_led_init);
+module_exit(rgb_led_exit);
 
 MODULE_LICENSE("Dual MIT/GPL");
 MODULE_AUTHOR("Seth Howard");
@@ -0,0 +1,120 @@
+/* SPDX-License-Identifier: GPL-2.0 or MIT */
+/*
+* Fade engine arithmetic of the rgb_led driver: how far along a fade is, its
+* easing curves, and the duty cycle for each step. It is plain integer math
+* with no kernel dependencies besides the 64-bit division helpers, so the
+* header also builds on the host.
+*/
+#ifndef RGB_LED_FADE_H
+#define RGB_LED_FADE_H
+
+#ifdef __KERNEL__
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/types.h>
+#else
+#include <stdint.h>
+
+typedef int32_t s32;
+typedef uint32_t u32;
+typedef int64_t s64;
+typedef uint64_t u64;
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+
+static inline s64 div_s64(s64 dividend, s32 divisor)
+{
+    return dividend / divisor;
+}
+
+static inline u64 div64_u64(u64 dividend, u64 divisor)
+{
+    return dividend / divisor;
+}
+#endif
+
+#include "de10nano_rgb_led.h"              // enum de10nano_rgb_ease
+
+#define RGB_LED_FADE_ONE        (1 << 16)       // 1.0 in the fade engine's Q16 fixed point
+
+/*
+* (2^(10(t - 1)) - 2^-10) / (1 - 2^-10) in Q16 at t = 0, 1/16, ..., 1.
+* Offsetting and rescaling makes the curve start at exactly 0 and end at
+* exactly 1; points in between are interpolated linearly.
+*/
+static const u32 rgb_led_exp_lut[17] = {
+    0, 35, 88, 171, 298, 495, 798, 1265, 1986,
+    3097, 4812, 7455, 11532, 17820, 27517, 42472, 65536,
+};
+
+/**
+* rgb_led_fade_progress() - Fraction of a fade's duration that has elapsed.
+* @elapsed_ns: Time since the fade started.
+* @duration_ns: Length of the fade; may be 0.
+*
+* Return: 0..RGB_LED_FADE_ONE; RGB_LED_FADE_ONE once the fade is over.
+*/
+static inline u32 rgb_led_fade_progress(u64 elapsed_ns, u64 duration_ns)
+{
+    if (elapsed_ns >= duration_ns) {
+        return RGB_LED_FADE_ONE;
+    }
+
+    return div64_u64(elapsed_ns << 16, duration_ns);
+}
+
+/**
+* rgb_led_ease() - Apply an easing curve to a fade's progress.
+* @ease: Easing curve, one of enum de10nano_rgb_ease.
+* @t: Fraction of the fade's duration that has elapsed, 0..RGB_LED_FADE_ONE.
+*
+* Everything is integer math so it can run in the fade timer.
+*
+* Return: Fraction of the way from the start to the target colour,
+* 0..RGB_LED_FADE_ONE.
+*/
+static inline u32 rgb_led_ease(u32 ease, u32 t)
+{
+    u32 inv = RGB_LED_FADE_ONE - t;
+    u32 idx;
+    u32 frac;
+
+    switch (ease) {
+    case DE10NANO_RGB_EASE_IN:
+        return ((u64)t * t) >> 16;
+    case DE10NANO_RGB_EASE_OUT:
+        return RGB_LED_FADE_ONE - (((u64)inv * inv) >> 16);
+    case DE10NANO_RGB_EASE_IN_OUT:
+        // Smoothstep: t^2 (3 - 2t), rounded once so it never steps back
+        return ((u64)t * t * (3 * RGB_LED_FADE_ONE - 2 * t)) >> 32;
+    case DE10NANO_RGB_EASE_EXPONENTIAL:
+        idx = t >> 12;
+        frac = t & 0xfff;
+        if (idx >= ARRAY_SIZE(rgb_led_exp_lut) - 1) {
+            return RGB_LED_FADE_ONE;
+        }
+        return rgb_led_exp_lut[idx] +
+            (((rgb_led_exp_lut[idx + 1] - rgb_led_exp_lut[idx]) * frac) >> 12);
+    case DE10NANO_RGB_EASE_LINEAR:
+    default:
+        return t;
+    }
+}
+
+/**
+* rgb_led_fade_duty() - Duty cycle of one colour at a point of a fade.
+* @start: Duty cycle the fade started from.
+* @target: Duty cycle the fade ends at.
+* @e: Eased progress from rgb_led_ease(), 0..RGB_LED_FADE_ONE.
+*
+* Return: The duty cycle register value; @start at 0 and @target at
+* RGB_LED_FADE_ONE.
+*/
+static inline u32 rgb_led_fade_duty(u32 start, u32 target, u32 e)
+{
+    s64 delta = (s64)target - start;
+
+    return start + div_s64(delta * e, RGB_LED_FADE_ONE);
+}
+
+#endif /* RGB_LED_FADE_H */
@@ -0,0 +1,198 @@
+// SPDX-License-Identifier: GPL-2.0 or MIT
+/*
+* Host test of the rgb_led fade engine arithmetic: the easing curves and the
+* duty cycle sequences a fade produces. Build and run it with `make test`.
+*/
+#include <stdio.h>
+#include <stdint.h>
+
+#include "rgb_led_fade.h"
+
+#define NSEC_PER_MSEC 1000000ULL
+
+static int failures;
+
+#define EXPECT_EQ(got, want) expect_eq(__LINE__, #got, (got), (want))
+
+static void expect_eq(int line, const char *what, u64 got, u64 want)
+{
+    if (got != want) {
+        printf("line %d: %s: got %llu, want %llu\n", line, what,
+               (unsigned long long)got, (unsigned long long)want);
+        failures++;
+    }
+}
+
+static void test_progress(void)
+{
+    EXPECT_EQ(rgb_led_fade_progress(0, 500 * NSEC_PER_MSEC), 0);
+    EXPECT_EQ(rgb_led_fade_progress(250 * NSEC_PER_MSEC, 500 * NSEC_PER_MSEC),
+              RGB_LED_FADE_ONE / 2);
+    EXPECT_EQ(rgb_led_fade_progress(500 * NSEC_PER_MSEC - 1,
+                                    500 * NSEC_PER_MSEC),
+              RGB_LED_FADE_ONE - 1);
+    EXPECT_EQ(rgb_led_fade_progress(500 * NSEC_PER_MSEC, 500 * NSEC_PER_MSEC),
+              RGB_LED_FADE_ONE);
+    EXPECT_EQ(rgb_led_fade_progress(501 * NSEC_PER_MSEC, 500 * NSEC_PER_MSEC),
+              RGB_LED_FADE_ONE);
+
+    // A 0 ms fade is over at its first step.
+    EXPECT_EQ(rgb_led_fade_progress(0, 0), RGB_LED_FADE_ONE);
+
+    // Longest fade the driver accepts, just before it ends
+    EXPECT_EQ(rgb_led_fade_progress(
+                  (u64)DE10NANO_RGB_FADE_MAX_MS * NSEC_PER_MSEC - 1,
+                  (u64)DE10NANO_RGB_FADE_MAX_MS * NSEC_PER_MSEC),
+              RGB_LED_FADE_ONE - 1);
+}
+
+static void test_ease(void)
+{
+    u32 ease;
+    u32 prev;
+    u32 e;
+    u32 t;
+    u32 i;
+
+    // Every curve starts at 0, ends at 1 and never goes backwards.
+    for (ease = DE10NANO_RGB_EASE_LINEAR;
+         ease <= DE10NANO_RGB_EASE_EXPONENTIAL; ease++) {
+        EXPECT_EQ(rgb_led_ease(ease, 0), 0);
+        EXPECT_EQ(rgb_led_ease(ease, RGB_LED_FADE_ONE), RGB_LED_FADE_ONE);
+
+        prev = 0;
+        for (t = 0; t <= RGB_LED_FADE_ONE; t++) {
+            e = rgb_led_ease(ease, t);
+            if (e < prev || e > RGB_LED_FADE_ONE) {
+                printf("ease %u: t %u: %u after %u\n", ease, t, e, prev);
+                failures++;
+                break;
+            }
+            prev = e;
+        }
+    }
+
+    EXPECT_EQ(rgb_led_ease(DE10NANO_RGB_EASE_LINEAR, 12345), 12345);
+    EXPECT_EQ(rgb_led_ease(DE10NANO_RGB_EASE_IN, RGB_LED_FADE_ONE / 2),
+              RGB_LED_FADE_ONE / 4);
+    EXPECT_EQ(rgb_led_ease(DE10NANO_RGB_EASE_OUT, RGB_LED_FADE_ONE / 2),
+              RGB_LED_FADE_ONE * 3 / 4);
+    EXPECT_EQ(rgb_led_ease(DE10NANO_RGB_EASE_IN_OUT, RGB_LED_FADE_ONE / 2),
+              RGB_LED_FADE_ONE / 2);
+
+    // Smoothstep is symmetric about the middle.
+    for (t = 0; t <= RGB_LED_FADE_ONE; t += 256) {
+        e = rgb_led_ease(DE10NANO_RGB_EASE_IN_OUT, t) +
+            rgb_led_ease(DE10NANO_RGB_EASE_IN_OUT, RGB_LED_FADE_ONE - t);
+        if (e < RGB_LED_FADE_ONE - 2 || e > RGB_LED_FADE_ONE) {
+            printf("ease-in-out: t %u: not symmetric (%u)\n", t, e);
+            failures++;
+        }
+    }
+
+    // The exponential curve passes through its table points.
+    for (i = 0; i < ARRAY_SIZE(rgb_led_exp_lut); i++) {
+        EXPECT_EQ(rgb_led_ease(DE10NANO_RGB_EASE_EXPONENTIAL, i << 12),
+                  rgb_led_exp_lut[i]);
+    }
+}
+
+/*
+* Step a fade like the fade timer does, every tick_ms until it is over, and
+* check the sequence of duty cycles: it starts at @start, moves towards
+* @target without going backwards or overshooting, and ends exactly on it.
+* Returns the duty cycle halfway through.
+*/
+static u32 check_fade(u32 ease, u32 start, u32 target, u32 duration_ms,
+    u32 tick_ms)
+{
+    u64 duration_ns = (u64)duration_ms * NSEC_PER_MSEC;
+    u64 elapsed_ns = 0;
+    u32 half = start;
+    u32 prev = start;
+    u32 steps = 0;
+    u32 duty;
+    u32 t;
+
+    for (;;) {
+        t = rgb_led_fade_progress(elapsed_ns, duration_ns);
+        duty = rgb_led_fade_duty(start, target, rgb_led_ease(ease, t));
+
+        if (steps == 0 && duration_ms && duty != start) {
+            printf("ease %u: %u -> %u: first step %u\n", ease, start, target,
+                   duty);
+            failures++;
+        }
+        if ((target >= start && (duty < prev || duty > target)) ||
+            (target < start && (duty > prev || duty < target))) {
+            printf("ease %u: %u -> %u: step %u: %u after %u\n", ease, start,
+                   target, steps, duty, prev);
+            failures++;
+            return half;
+        }
+        if (elapsed_ns * 2 == duration_ns) {
+            half = duty;
+        }
+
+        prev = duty;
+        steps++;
+        if (t == RGB_LED_FADE_ONE) {
+            break;
+        }
+        elapsed_ns += (u64)tick_ms * NSEC_PER_MSEC;
+    }
+
+    EXPECT_EQ(duty, target);
+    EXPECT_EQ(steps, duration_ms / tick_ms + 1);
+
+    return half;
+}
+
+static void test_sequences(void)
+{
+    u32 ease;
+
+    for (ease = DE10NANO_RGB_EASE_LINEAR;
+         ease <= DE10NANO_RGB_EASE_EXPONENTIAL; ease++) {
+        // 500 ms at the default 200 Hz tick, up and down a 20-bit duty cycle
+        check_fade(ease, 0, 0x7ffff, 500, 5);
+        check_fade(ease, 0x7ffff, 0, 500, 5);
+        check_fade(ease, 0x10000, 0x40000, 500, 5);
+        check_fade(ease, 0x40000, 0x10000, 500, 5);
+
+        // Full register range, so the scaling doesn't overflow
+        check_fade(ease, 0, UINT32_MAX, 1000, 1);
+        check_fade(ease, UINT32_MAX, 0, 1000, 1);
+
+        // Nothing to fade, and a fade that is over at its first step
+        check_fade(ease, 0x1234, 0x1234, 100, 5);
+        check_fade(ease, 0x1234, 0x5678, 0, 5);
+    }
+
+    EXPECT_EQ(check_fade(DE10NANO_RGB_EASE_LINEAR, 0, 0x80000, 500, 5),
+              0x40000);
+    EXPECT_EQ(check_fade(DE10NANO_RGB_EASE_LINEAR, 0x80000, 0, 500, 5),
+              0x40000);
+    EXPECT_EQ(check_fade(DE10NANO_RGB_EASE_IN, 0, 0x80000, 500, 5),
+              0x20000);
+    EXPECT_EQ(check_fade(DE10NANO_RGB_EASE_OUT, 0, 0x80000, 500, 5),
+              0x60000);
+    EXPECT_EQ(check_fade(DE10NANO_RGB_EASE_IN_OUT, 0, 0x80000, 500, 5),
+              0x40000);
+    EXPECT_EQ(check_fade(DE10NANO_RGB_EASE_EXPONENTIAL, 0, 0x80000, 500, 5),
+              (u64)0x80000 * rgb_led_exp_lut[8] / RGB_LED_FADE_ONE);
+}
+
+int main(void)
+{
+    test_progress();
+    test_ease();
+    test_sequences();
+
+    if (failures) {
+        printf("rgb_led_fade: %d failures\n", failures);
+        return 1;
+    }
+    printf("rgb_led_fade: all tests passed\n");
+    return 0;
+}
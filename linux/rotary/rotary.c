@@ -6,338 +6,2016 @@
 #include <linux/miscdevice.h>               // miscdevice definitions
 #include <linux/types.h>                    // data types
 #include <linux/fs.h>                       // copy_to_user
+#include <linux/uio.h>                      // iov_iter, copy_to_iter/copy_from_iter
 #include <linux/kstrtox.h>                  // kstrtou32
+#include <linux/interrupt.h>                // request_irq, irqreturn_t
+#include <linux/poll.h>                     // poll_wait, EPOLL* flags
+#include <linux/slab.h>                     // kzalloc/kfree
+#include <linux/wait.h>                     // wait queues
+#include <linux/atomic.h>                   // atomic_t
+#include <linux/spinlock.h>                 // spinlock for the event queues
+#include <linux/list.h>                     // list of open event files
+#include <linux/kfifo.h>                    // kfifo for the event queues
+#include <linux/ktime.h>                    // ktime_get_ns
+#include <linux/math64.h>                   // div_u64, div_s64
+#include <linux/hrtimer.h>                  // hrtimer for the motion sampler
+#include <linux/string.h>                   // sysfs_match_string
+
+#include "de10nano_xfer.h"                 // DE10NANO_IOC_REG_XFER
+#include "de10nano_mmap.h"                 // de10nano_mmap_regs
+#include "de10nano_rotary.h"               // struct de10nano_rotary_event
+#include "de10nano_bind.h"                 // struct de10nano_bind_source
 
 #define OUTPUT_OFFSET         0x00            // 0 byte offset for the rotary encoder state output register
 #define ENABLE_OFFSET       0x04            // 4 byte offset for the enable button register
-#define SPAN 16                                 // Span of the components memory space
+#define IRQ_STATUS_OFFSET   0x08            // 8 byte offset for the IRQ status register (write 1 to clear)
+#define IRQ_ENABLE_OFFSET   0x0C            // 12 byte offset for the IRQ enable register
+#define ROTARY_IRQ_COUNT    BIT(0)          // IRQ status/enable bit: the encoder count changed
+#define ROTARY_IRQ_BUTTON   BIT(1)          // IRQ status/enable bit: the push button toggled
+#define FIFO_LEVEL_OFFSET   0x10            // 16 byte offset for the event FIFO level register
+#define EVENT_TIME_OFFSET   0x14            // 20 byte offset for the timestamp of the last popped event
+#define CYCLE_COUNT_OFFSET  0x18            // 24 byte offset for the free-running cycle counter
+#define CONTROL_OFFSET      0x20            // 32 byte offset for the decoder control register
+#define ERROR_COUNT_OFFSET  0x24            // 36 byte offset for the illegal transition counter
+#define COUNT_MIN_OFFSET    0x28            // 40 byte offset for the lowest count
+#define COUNT_MAX_OFFSET    0x2C            // 44 byte offset for the highest count
+#define INPUT_STATUS_OFFSET 0x30            // 48 byte offset for the A, B and push button levels
+#define EVENT_DATA_OFFSET   0x1000          // Event FIFO head, alone in the second page; reading it pops the event
+#define CONTROL_WRAP        BIT(0)          // Control: wrap between the count limits instead of saturating
+#define CONTROL_CLEAR_COUNT BIT(1)          // Control: set the count to 0 (self-clearing)
+#define CONTROL_CLEAR_ERRORS BIT(2)         // Control: set the error count to 0 (self-clearing)
+#define ROTARY_RESET_COUNT_MAX 255          // Reset value of COUNT_MAX: 64 detents of 4 counts
+#define EVENT_COUNT_MASK    GENMASK(15, 0)  // Event word: encoder count after the event
+#define EVENT_BUTTON        BIT(16)         // Event word: push button press rather than a detent
+#define EVENT_UP            BIT(17)         // Event word: counted up, or the new enable state
+#define EVENT_OVERFLOW      BIT(31)         // Event word: events were dropped just before this one
+#define ROTARY_CLK_NS       20              // The component runs from the 50 MHz fpga_clk
+#define ROTARY_EMU_FIFO_LEN 64              // Depth of the emulated event FIFO, as in the FPGA
+#define ROTARY_DEFAULT_SAMPLE_HZ 100        // Default motion sampling rate
+#define ROTARY_MAX_SAMPLE_HZ 10000          // Highest motion sampling rate
+#define ROTARY_VELOCITY_SHIFT 2             // Velocity smoothing: each sample moves it 1/4 of the way
+#define ROTARY_ACCEL_ONE    256             // Acceleration gain of 1 (8 fractional bits)
+#define ROTARY_MAX_FAKE_RATE 1000000        // Highest fake counter rate, counts/s
+#define SPAN 64                                 // Span of the registers that can be read without side effects
+
+/**
+* struct rotary_hw_event - An event as stored in the component's FIFO.
+* @data: Event word
+* @cycles: Cycle counter value when the event happened
+*/
+struct rotary_hw_event {
+    u32 data;
+    u32 cycles;
+};
 
 /**
 * struct rotary_dev - Private rotary encoder device struct.
+* @base_addr: Pointer to the component's base address
+* @phys_addr: Physical address of the component's registers
+* @emulated: The registers are backed by RAM instead of the FPGA
 * @output: Address of the rotary encoder state output register
 * @enable: Address of the enable register
 * @miscdev: miscdevice used to create a character device
 * @lock: mutex used to prevent concurrent writes to memory
+* @irq: The component's interrupt, or a negative value if it has none
+* @can_wait: Changes are signalled (by the IRQ, or its emulation),
+* so reads can wait for them
+* @events: Number of change notifications so far
+* @wait: Readers and pollers waiting for a change
+* @events_miscdev: miscdevice for /dev/rotary_events
+* @events_lock: Protects @event_files, every file's event queue and
+* @emu_fifo; taken from the IRQ handler
+* @event_files: Open /dev/rotary_events files
+* @event_wait: Event readers and pollers waiting for an event
+* @emu_fifo: Stands in for the component's event FIFO when emulated
+* @emu_overflow: The emulated FIFO dropped an event
+* @sample_timer: Samples the count to track the knob's motion
+* @motion_lock: Protects the motion state below; taken from the sampler
+* and, nested inside @events_lock, from the event drain
+* @sampling: @sample_timer is running. With change notifications it only
+* runs while the knob moves: a count change starts it and it stops itself
+* once the count and the velocity have settled
+* @sample_hz: Motion sampling rate
+* @sample_period: 1 / @sample_hz
+* @last_count: Count at the previous sample
+* @velocity: Smoothed speed in counts per second, 8 fractional bits
+* @accel_curve: One of enum de10nano_rotary_accel
+* @accel_threshold: Speed in counts per second where acceleration starts
+* @accel_max: Highest gain in percent
+* @accel_count: Sum of the acceleration-scaled sample deltas, 8 fractional bits
+* @event_accel_frac: Fraction of a count carried between event accel_deltas,
+* 8 fractional bits
+* @fake_rate: Counts per second the sampler adds to the emulated count
+* @fake_frac: Fraction of a fake count carried between samples, in
+* counts * @sample_hz
+* @bind_count: de10nano_bind source for the count
+* @bind_enable: de10nano_bind source for the enable (push button) state
 *
 * An rotary_dev  struct gets created for each rotary encoder component.
 */
 struct rotary_dev {
     void __iomem *base_addr;
+    phys_addr_t phys_addr;
+    bool emulated;
     void __iomem *output;
     void __iomem *enable;
     struct miscdevice miscdev;
     struct mutex lock;
+    int irq;
+    bool can_wait;
+    atomic_t events;
+    wait_queue_head_t wait;
+    struct miscdevice events_miscdev;
+    spinlock_t events_lock;
+    struct list_head event_files;
+    wait_queue_head_t event_wait;
+    DECLARE_KFIFO(emu_fifo, struct rotary_hw_event, ROTARY_EMU_FIFO_LEN);
+    bool emu_overflow;
+    struct hrtimer sample_timer;
+    spinlock_t motion_lock;
+    bool sampling;
+    unsigned int sample_hz;
+    ktime_t sample_period;
+    s32 last_count;
+    s64 velocity;
+    u32 accel_curve;
+    u32 accel_threshold;
+    u32 accel_max;
+    s64 accel_count;
+    s64 event_accel_frac;
+    s32 fake_rate;
+    s64 fake_frac;
+    struct de10nano_bind_source bind_count;
+    struct de10nano_bind_source bind_enable;
+};
+
+// Names accepted by the accel sysfs attribute, indexed by de10nano_rotary_accel
+static const char * const rotary_accel_names[] = {
+    [DE10NANO_ROTARY_ACCEL_FLAT] = "flat",
+    [DE10NANO_ROTARY_ACCEL_LINEAR] = "linear",
+    [DE10NANO_ROTARY_ACCEL_QUADRATIC] = "quadratic",
+    [DE10NANO_ROTARY_ACCEL_STEP] = "step",
+};
+
+/**
+* struct rotary_file - Per-open state of /dev/rotary.
+* @priv: The rotary device this file was opened on
+* @seen: Value of priv->events at this file's last read
+* @fresh: Nothing has been read through this file yet
+*
+* Each open file tracks which changes it has already read, so several
+* readers can each wait for the next change independently.
+*/
+struct rotary_file {
+    struct rotary_dev *priv;
+    int seen;
+    bool fresh;
+};
+
+/**
+* struct rotary_event_file - Per-open state of /dev/rotary_events.
+* @priv: The rotary device this file was opened on
+* @node: Entry in priv->event_files
+* @overflow: The queue was full when an event arrived
+* @events: Events not read yet
+*
+* Every open file gets its own copy of each event, so several readers
+* each see every event.
+*/
+struct rotary_event_file {
+    struct rotary_dev *priv;
+    struct list_head node;
+    bool overflow;
+    DECLARE_KFIFO(events, struct de10nano_rotary_event,
+                  DE10NANO_ROTARY_EVENT_QUEUE_LEN);
 };
 
 /*
-* rotary_read() - Read method for the rotary char device
-* @file: Pointer to the char device file struct.
-* @buf: User-space buffer to read the value into.
-* @count: The number of bytes being requested.
-* @offset: The byte offset in the file being read from.
+* When emulate is set, the module registers its own platform device whose
+* registers are backed by a page of ordinary RAM instead of the FPGA. This
+* lets the driver be loaded and exercised on a stock x86 kernel.
+*/
+static bool emulate;
+module_param(emulate, bool, 0444);
+MODULE_PARM_DESC(emulate, "Back the registers with RAM instead of the FPGA");
+
+/**
+* rotary_notify() - Tell readers and pollers that the encoder changed.
+* @priv: Private rotary device struct.
+*/
+static void rotary_notify(struct rotary_dev *priv)
+{
+    atomic_inc(&priv->events);
+    wake_up_interruptible(&priv->wait);
+    de10nano_bind_source_changed(&priv->bind_count);
+    de10nano_bind_source_changed(&priv->bind_enable);
+}
+
+/**
+* rotary_changed() - Check for a change the file hasn't read yet.
+* @rf: Per-open state.
 *
-* Return: On success, the number of bytes written is returned and the
-* offset @offset is advanced by this number. On error, a negative error
-* value is returned.
+* The first read through a file never waits.
+*
+* Return: true if a read through @rf would return right away.
 */
-static ssize_t rotary_read(struct file *file, char __user *buf,
-    size_t count, loff_t *offset)
+static bool rotary_changed(struct rotary_file *rf)
 {
-    size_t ret;
+    return rf->fresh || atomic_read(&rf->priv->events) != rf->seen;
+}
+
+/**
+* rotary_cycles() - Read the component's cycle counter.
+* @priv: Private rotary device struct.
+*
+* Return: The cycle counter, or the equivalent count of the monotonic clock
+* when emulated.
+*/
+static u32 rotary_cycles(struct rotary_dev *priv)
+{
+    if (priv->emulated) {
+        return (u32)div_u64(ktime_get_ns(), ROTARY_CLK_NS);
+    }
+
+    return ioread32(priv->base_addr + CYCLE_COUNT_OFFSET);
+}
+
+/**
+* rotary_fifo_level() - Number of events in the component's FIFO.
+* @priv: Private rotary device struct; the caller holds events_lock.
+*
+* Return: The FIFO level.
+*/
+static u32 rotary_fifo_level(struct rotary_dev *priv)
+{
+    return ioread32(priv->base_addr + FIFO_LEVEL_OFFSET);
+}
+
+/**
+* rotary_event_data_read() - Read EVENT_DATA, which pops the oldest event.
+* @priv: Private rotary device struct; the caller holds events_lock.
+*
+* When emulated, the event comes from the emulated FIFO and, like the
+* component, the read latches its timestamp into EVENT_TIME and lowers
+* FIFO_LEVEL. An empty FIFO reads 0 and latches nothing.
+*
+* Return: The event word.
+*/
+static u32 rotary_event_data_read(struct rotary_dev *priv)
+{
+    struct rotary_hw_event hw;
+
+    if (!priv->emulated) {
+        return ioread32(priv->base_addr + EVENT_DATA_OFFSET);
+    }
+
+    if (!kfifo_get(&priv->emu_fifo, &hw)) {
+        return 0;
+    }
+    iowrite32(hw.cycles, priv->base_addr + EVENT_TIME_OFFSET);
+    iowrite32(kfifo_len(&priv->emu_fifo), priv->base_addr + FIFO_LEVEL_OFFSET);
+
+    return hw.data;
+}
+
+/**
+* rotary_fifo_pop() - Pop the oldest event from the component's FIFO.
+* @priv: Private rotary device struct; the caller holds events_lock.
+* @hw: Where to store the event.
+*
+* The FIFO must not be empty.
+*/
+static void rotary_fifo_pop(struct rotary_dev *priv, struct rotary_hw_event *hw)
+{
+    // Reading the data pops the event and latches its timestamp.
+    hw->data = rotary_event_data_read(priv);
+    hw->cycles = ioread32(priv->base_addr + EVENT_TIME_OFFSET);
+}
+
+/**
+* rotary_emu_push() - Push an event into the emulated FIFO.
+* @priv: Private rotary device struct; the caller holds events_lock.
+* @data: Event word, without EVENT_OVERFLOW.
+*
+* Behaves like the component: the event sets its IRQ status bit, and when
+* the FIFO is full the event is dropped and the next one pushed is flagged.
+* Call rotary_emu_irq() afterwards to deliver the interrupt.
+*/
+static void rotary_emu_push(struct rotary_dev *priv, u32 data)
+{
+    struct rotary_hw_event hw = {
+        .data = data,
+        .cycles = rotary_cycles(priv),
+    };
+    u32 status;
+
+    if (priv->emu_overflow) {
+        hw.data |= EVENT_OVERFLOW;
+    }
+    priv->emu_overflow = !kfifo_put(&priv->emu_fifo, hw);
+    iowrite32(kfifo_len(&priv->emu_fifo), priv->base_addr + FIFO_LEVEL_OFFSET);
+
+    status = ioread32(priv->base_addr + IRQ_STATUS_OFFSET);
+    status |= (data & EVENT_BUTTON) ? ROTARY_IRQ_BUTTON : ROTARY_IRQ_COUNT;
+    iowrite32(status, priv->base_addr + IRQ_STATUS_OFFSET);
+}
+
+/**
+* rotary_irq_ack() - Clear IRQ status bits.
+* @priv: Private rotary device struct.
+* @bits: The status bits to clear.
+*
+* The status register is write-1-to-clear. When emulated, the bits are
+* cleared in RAM under events_lock, so an event pushed at the same time
+* keeps its bit as it would on the FPGA.
+*/
+static void rotary_irq_ack(struct rotary_dev *priv, u32 bits)
+{
+    unsigned long flags;
+    u32 status;
+
+    if (!priv->emulated) {
+        iowrite32(bits, priv->base_addr + IRQ_STATUS_OFFSET);
+        return;
+    }
+
+    spin_lock_irqsave(&priv->events_lock, flags);
+    status = ioread32(priv->base_addr + IRQ_STATUS_OFFSET);
+    iowrite32(status & ~bits, priv->base_addr + IRQ_STATUS_OFFSET);
+    spin_unlock_irqrestore(&priv->events_lock, flags);
+}
+
+/**
+* rotary_queue_event() - Add an event to one open file's queue.
+* @ef: Per-open state; the caller holds events_lock.
+* @ev: The event.
+*/
+static void rotary_queue_event(struct rotary_event_file *ef,
+    struct de10nano_rotary_event ev)
+{
+    if (ef->overflow) {
+        ev.flags |= DE10NANO_ROTARY_EV_OVERFLOW;
+    }
+    ef->overflow = !kfifo_put(&ef->events, ev);
+}
+
+/**
+* rotary_accel_gain() - Acceleration gain at a given speed.
+* @priv: Private rotary device struct; the caller holds motion_lock.
+* @speed: Speed in counts per second.
+*
+* Return: The gain, ROTARY_ACCEL_ONE being 1.
+*/
+static u32 rotary_accel_gain(struct rotary_dev *priv, u64 speed)
+{
+    u32 max = priv->accel_max * ROTARY_ACCEL_ONE / 100;
+    u32 threshold = priv->accel_threshold;
+    u64 ramp;
+
+    if (priv->accel_curve == DE10NANO_ROTARY_ACCEL_FLAT ||
+        speed <= threshold || max <= ROTARY_ACCEL_ONE) {
+        return ROTARY_ACCEL_ONE;
+    }
+    if (priv->accel_curve == DE10NANO_ROTARY_ACCEL_STEP) {
+        return max;
+    }
+
+    // How far the speed is from the threshold to twice the threshold, 0-256
+    ramp = min_t(u64, div_u64((speed - threshold) * ROTARY_ACCEL_ONE, threshold),
+                 ROTARY_ACCEL_ONE);
+    if (priv->accel_curve == DE10NANO_ROTARY_ACCEL_QUADRATIC) {
+        ramp = ramp * ramp / ROTARY_ACCEL_ONE;
+    }
+
+    return ROTARY_ACCEL_ONE + (u32)((max - ROTARY_ACCEL_ONE) * ramp / ROTARY_ACCEL_ONE);
+}
+
+/**
+* rotary_speed() - Absolute smoothed speed.
+* @priv: Private rotary device struct; the caller holds motion_lock.
+*
+* Return: The speed in counts per second.
+*/
+static u64 rotary_speed(struct rotary_dev *priv)
+{
+    s64 velocity = div_s64(priv->velocity, ROTARY_ACCEL_ONE);
+
+    return velocity < 0 ? -velocity : velocity;
+}
+
+/**
+* rotary_drain_events() - Move every event in the FIFO to the open files.
+* @priv: Private rotary device struct.
+*
+* The FIFO level is read once and that many events are popped in one go.
+* Timestamps are converted from clock cycles to CLOCK_MONOTONIC using the
+* cycle counter read just before, so they keep their cycle accuracy no
+* matter how late the drain runs. The FIFO is drained even when nobody has
+* /dev/rotary_events open, so stale events never reach a later reader.
+*/
+static void rotary_drain_events(struct rotary_dev *priv)
+{
+    struct de10nano_rotary_event ev = { 0 };
+    struct rotary_event_file *ef;
+    struct rotary_hw_event hw;
+    unsigned long flags;
+    u32 now_cycles;
+    u64 now_ns;
+    u32 level;
+    u32 gain;
+    u32 i;
+
+    spin_lock_irqsave(&priv->events_lock, flags);
+
+    level = rotary_fifo_level(priv);
+    now_cycles = rotary_cycles(priv);
+    now_ns = ktime_get_ns();
+
+    for (i = 0; i < level; i++) {
+        rotary_fifo_pop(priv, &hw);
+
+        ev.timestamp_ns = now_ns -
+            (u64)(u32)(now_cycles - hw.cycles) * ROTARY_CLK_NS;
+        ev.cycles = hw.cycles;
+        ev.count = (s16)(hw.data & EVENT_COUNT_MASK);
+        ev.flags = 0;
+        ev.velocity = 0;
+        ev.accel_delta = 0;
+        if (hw.data & EVENT_BUTTON) {
+            ev.flags |= DE10NANO_ROTARY_EV_BUTTON;
+            if (hw.data & EVENT_UP) {
+                ev.flags |= DE10NANO_ROTARY_EV_ENABLED;
+            }
+        }
+        else {
+            if (hw.data & EVENT_UP) {
+                ev.flags |= DE10NANO_ROTARY_EV_UP;
+            }
+
+            // Scale the detent's step by the acceleration at the current speed.
+            spin_lock(&priv->motion_lock);
+            ev.velocity = div_s64(priv->velocity, ROTARY_ACCEL_ONE);
+            gain = rotary_accel_gain(priv, rotary_speed(priv));
+            priv->event_accel_frac += (hw.data & EVENT_UP) ? gain : -(s64)gain;
+            ev.accel_delta = div_s64(priv->event_accel_frac, ROTARY_ACCEL_ONE);
+            priv->event_accel_frac -= (s64)ev.accel_delta * ROTARY_ACCEL_ONE;
+            spin_unlock(&priv->motion_lock);
+        }
+        if (hw.data & EVENT_OVERFLOW) {
+            ev.flags |= DE10NANO_ROTARY_EV_OVERFLOW;
+        }
+
+        list_for_each_entry(ef, &priv->event_files, node) {
+            rotary_queue_event(ef, ev);
+        }
+    }
+
+    spin_unlock_irqrestore(&priv->events_lock, flags);
+
+    if (level) {
+        wake_up_interruptible(&priv->event_wait);
+    }
+}
+
+/**
+* rotary_motion_start() - Start the sampler if it isn't running.
+* @priv: Private rotary device struct.
+*
+* The first sample is taken one sample period later and sees the whole
+* change since the sampler last stopped.
+*/
+static void rotary_motion_start(struct rotary_dev *priv)
+{
+    unsigned long flags;
+
+    spin_lock_irqsave(&priv->motion_lock, flags);
+    if (!priv->sampling) {
+        priv->sampling = true;
+        hrtimer_start(&priv->sample_timer, priv->sample_period,
+                      HRTIMER_MODE_REL);
+    }
+    spin_unlock_irqrestore(&priv->motion_lock, flags);
+}
+
+/**
+* rotary_irq() - Interrupt handler for the rotary encoder.
+* @irq: Unused.
+* @dev_id: Private rotary device struct.
+*
+* Return: IRQ_HANDLED, or IRQ_NONE if no IRQ status bit was set.
+*/
+static irqreturn_t rotary_irq(int irq, void *dev_id)
+{
+    struct rotary_dev *priv = dev_id;
+    u32 status;
+
+    status = ioread32(priv->base_addr + IRQ_STATUS_OFFSET);
+    if (!status) {
+        return IRQ_NONE;
+    }
+
+    // Acknowledge the events we saw; anything newer stays pending.
+    rotary_irq_ack(priv, status);
+
+    rotary_drain_events(priv);
+    rotary_notify(priv);
+    if (status & ROTARY_IRQ_COUNT) {
+        rotary_motion_start(priv);
+    }
+
+    return IRQ_HANDLED;
+}
+
+/**
+* rotary_emu_irq() - Deliver the emulated interrupt if it is raised.
+* @priv: Private rotary device struct; emulated.
+*
+* The component's irq is high while an enabled IRQ status bit is set. The
+* emulated registers have no interrupt line, so the handler is called
+* directly after anything that could have raised it: an event, or a write
+* to the IRQ status or enable register.
+*/
+static void rotary_emu_irq(struct rotary_dev *priv)
+{
+    if (ioread32(priv->base_addr + IRQ_STATUS_OFFSET) &
+        ioread32(priv->base_addr + IRQ_ENABLE_OFFSET)) {
+        rotary_irq(0, priv);
+    }
+}
+
+/**
+* rotary_emu_store() - Write an emulated register the way the component
+* takes the write.
+* @priv: Private rotary device struct; emulated.
+* @offset: Register offset.
+* @val: Value written.
+*
+* The IRQ status is write-1-to-clear, and the FIFO level and event time
+* belong to the emulated FIFO, so writes to them are dropped. A write that
+* changes the count or the enable state pushes the event the component
+* would have seen. All of it happens under events_lock, which the fake
+* steps of the sampler take too, so neither can lose the other's change.
+* The interrupt is delivered afterwards if the write raised it.
+*/
+static void rotary_emu_store(struct rotary_dev *priv, u32 offset, u32 val)
+{
+    unsigned long flags;
+    u32 old_count;
+    u32 old_enable;
+    u32 new_count;
+    u32 new_enable;
+
+    spin_lock_irqsave(&priv->events_lock, flags);
+    old_count = ioread32(priv->base_addr + OUTPUT_OFFSET);
+    old_enable = ioread32(priv->base_addr + ENABLE_OFFSET);
+    if (offset == IRQ_STATUS_OFFSET) {
+        iowrite32(ioread32(priv->base_addr + IRQ_STATUS_OFFSET) & ~val,
+                  priv->base_addr + IRQ_STATUS_OFFSET);
+    }
+    else if (offset != FIFO_LEVEL_OFFSET && offset != EVENT_TIME_OFFSET) {
+        iowrite32(val, priv->base_addr + offset);
+    }
+    new_count = ioread32(priv->base_addr + OUTPUT_OFFSET);
+    new_enable = ioread32(priv->base_addr + ENABLE_OFFSET);
+
+    if (new_count != old_count) {
+        rotary_emu_push(priv, (new_count & EVENT_COUNT_MASK) |
+                        ((s32)new_count > (s32)old_count ? EVENT_UP : 0));
+    }
+    if (new_enable != old_enable) {
+        rotary_emu_push(priv, (new_count & EVENT_COUNT_MASK) |
+                        EVENT_BUTTON | (new_enable & 1 ? EVENT_UP : 0));
+    }
+    spin_unlock_irqrestore(&priv->events_lock, flags);
+
+    rotary_emu_irq(priv);
+}
+
+/**
+* rotary_emu_xfer() - Run a DE10NANO_IOC_REG_XFER batch on the emulated
+* registers.
+* @priv: Private rotary device struct; emulated.
+* @arg: User-space pointer to a struct de10nano_reg_xfer.
+*
+* Same as de10nano_reg_xfer(), except that writes go through
+* rotary_emu_store(), so the IRQ status is write-1-to-clear and count and
+* enable changes raise their events, as on the FPGA.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static long rotary_emu_xfer(struct rotary_dev *priv, void __user *arg)
+{
+    struct de10nano_reg_xfer xfer;
+    struct de10nano_reg_op *ops;
+    u32 *results;
+    long ret;
     u32 val;
+    u32 i;
 
-    /*
-    * Get the device's private data from the file struct's private_data
-    * field. The private_data field is equal to the miscdev field in the
-    * rotary_dev struct. container_of returns the
-    * rotary_dev struct that contains the miscdev in private_data.
-    */
+    ret = de10nano_reg_xfer_begin(arg, SPAN, SPAN, &xfer, &ops, &results);
+    if (ret) {
+        return ret;
+    }
+
+    mutex_lock(&priv->lock);
+    for (i = 0; i < xfer.count && !ret; i++) {
+        void __iomem *reg = priv->base_addr + ops[i].offset;
+
+        switch (ops[i].op) {
+        case DE10NANO_REG_READ:
+            results[i] = ioread32(reg);
+            break;
+        case DE10NANO_REG_WRITE:
+            rotary_emu_store(priv, ops[i].offset, ops[i].value);
+            results[i] = ops[i].value;
+            break;
+        case DE10NANO_REG_RMW:
+            val = ioread32(reg);
+            val = (val & ~ops[i].mask) | (ops[i].value & ops[i].mask);
+            rotary_emu_store(priv, ops[i].offset, val);
+            results[i] = val;
+            break;
+        case DE10NANO_REG_WAIT:
+            ret = read_poll_timeout(ioread32, val,
+                (val & ops[i].mask) == (ops[i].value & ops[i].mask),
+                DE10NANO_REG_WAIT_SLEEP_US, xfer.timeout_us, false, reg);
+            results[i] = val;
+            break;
+        }
+    }
+    mutex_unlock(&priv->lock);
+
+    return de10nano_reg_xfer_end(&xfer, ops, results, ret);
+}
+
+/**
+* rotary_fake_steps() - Move the emulated count like a spinning knob would.
+* @priv: Private rotary device struct.
+* @steps: Counts to add; negative to count down.
+*
+* Every step is pushed into the emulated event FIFO, which flags an
+* overflow when the steps outrun it just like the component's FIFO would.
+*/
+static void rotary_fake_steps(struct rotary_dev *priv, s32 steps)
+{
+    u32 n = min_t(u32, abs(steps), ROTARY_EMU_FIFO_LEN + 1);
+    u32 count;
+    u32 i;
+
+    // Same lock as rotary_emu_store(), so neither loses the other's count.
+    spin_lock(&priv->events_lock);
+    count = ioread32(priv->base_addr + OUTPUT_OFFSET);
+    for (i = 1; i <= n; i++) {
+        rotary_emu_push(priv, ((count + (steps > 0 ? i : -i)) & EVENT_COUNT_MASK) |
+                        (steps > 0 ? EVENT_UP : 0));
+    }
+    iowrite32(count + steps, priv->base_addr + OUTPUT_OFFSET);
+    spin_unlock(&priv->events_lock);
+}
+
+/**
+* rotary_sample_timer() - Sample the count and update the knob's motion.
+* @timer: The sample timer embedded in struct rotary_dev.
+*
+* The velocity is the change in count since the last sample, scaled to
+* counts per second and smoothed with an exponential moving average. Jumps
+* across the count range in wrap mode are taken as the short way round.
+*
+* When count changes are signalled, the sampler stops once the count hasn't
+* changed for a sample and the velocity has decayed to 0, and the next
+* change starts it again. The count is read under motion_lock, so a change
+* either shows up in this sample or finds the sampler stopped and restarts
+* it. Without notifications it never stops.
+*
+* Return: HRTIMER_RESTART while the knob is moving, or the sampler can't
+* tell when it starts again, and HRTIMER_NORESTART otherwise.
+*/
+static enum hrtimer_restart rotary_sample_timer(struct hrtimer *timer)
+{
+    struct rotary_dev *priv = container_of(timer, struct rotary_dev,
+                                           sample_timer);
+    s64 range = 0;
+    s32 steps = 0;
+    s32 count;
+    s32 delta;
+    u32 gain;
+
+    if (priv->emulated) {
+        spin_lock(&priv->motion_lock);
+        priv->fake_frac += priv->fake_rate;
+        steps = div_s64(priv->fake_frac, priv->sample_hz);
+        priv->fake_frac -= (s64)steps * priv->sample_hz;
+        spin_unlock(&priv->motion_lock);
+
+        if (steps) {
+            rotary_fake_steps(priv, steps);
+            rotary_emu_irq(priv);
+        }
+    }
+
+    spin_lock(&priv->motion_lock);
+
+    count = ioread32(priv->base_addr + OUTPUT_OFFSET);
+    if (ioread32(priv->base_addr + CONTROL_OFFSET) & CONTROL_WRAP) {
+        range = (s64)(s32)ioread32(priv->base_addr + COUNT_MAX_OFFSET) -
+                (s32)ioread32(priv->base_addr + COUNT_MIN_OFFSET) + 1;
+    }
+
+    delta = count - priv->last_count;
+    if (range > 0 && delta > range / 2) {
+        delta -= range;
+    }
+    else if (range > 0 && delta < -range / 2) {
+        delta += range;
+    }
+    priv->last_count = count;
+
+    priv->velocity += ((s64)delta * priv->sample_hz * ROTARY_ACCEL_ONE -
+                       priv->velocity) >> ROTARY_VELOCITY_SHIFT;
+    gain = rotary_accel_gain(priv, rotary_speed(priv));
+    priv->accel_count += (s64)delta * gain;
+
+    if (priv->can_wait && delta == 0 && rotary_speed(priv) == 0 &&
+        priv->fake_rate == 0) {
+        priv->velocity = 0;
+        priv->sampling = false;
+        spin_unlock(&priv->motion_lock);
+        return HRTIMER_NORESTART;
+    }
+
+    hrtimer_forward_now(timer, priv->sample_period);
+
+    spin_unlock(&priv->motion_lock);
+
+    return HRTIMER_RESTART;
+}
+
+/**
+* rotary_open() - Open method for the rotary char device
+* @inode: Unused.
+* @file: Pointer to the char device file struct; misc_open() has set
+* its private_data to our miscdev.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int rotary_open(struct inode *inode, struct file *file)
+{
     struct rotary_dev *priv = container_of(file->private_data,
                                 struct rotary_dev, miscdev);
+    struct rotary_file *rf;
+
+    rf = kzalloc(sizeof(*rf), GFP_KERNEL);
+    if (!rf) {
+        return -ENOMEM;
+    }
+    rf->priv = priv;
+    rf->seen = atomic_read(&priv->events);
+    rf->fresh = true;
+
+    file->private_data = rf;
+
+    return 0;
+}
+
+/**
+* rotary_release() - Release method for the rotary char device
+* @inode: Unused.
+* @file: Pointer to the char device file struct.
+*
+* Return: 0.
+*/
+static int rotary_release(struct inode *inode, struct file *file)
+{
+    kfree(file->private_data);
+
+    return 0;
+}
+
+/**
+* rotary_read_iter() - Read method for the rotary char device
+* @iocb: I/O control block; holds the file struct and the byte offset
+* being read from.
+* @to: User-space buffer(s) to read the register values into.
+*
+* As many whole registers as fit in @to are read, up to the event data
+* register, so read(), readv() and preadv() can fetch the whole register
+* bank with one syscall and one lock acquisition. The event data register
+* is left to the driver because reading it pops the event FIFO.
+*
+* When changes are signalled, every read after a file's first one waits
+* until the encoder count or push button changes, or returns -EAGAIN if
+* the file was opened with O_NONBLOCK.
+*
+* Return: On success, the number of bytes read is returned and the
+* offset is advanced by this number. On error, a negative error
+* value is returned.
+*/
+static ssize_t rotary_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+    u32 vals[SPAN / sizeof(u32)];
+    loff_t pos = iocb->ki_pos;
+    size_t count;
+    size_t copied;
+    size_t i;
+    int ret;
+
+    // Get the device's private data from the file's per-open state.
+    struct rotary_file *rf = iocb->ki_filp->private_data;
+    struct rotary_dev *priv = rf->priv;
 
     // Check file offset to make sure we are reading from a valid location.
-    if (*offset < 0) {
+    if (pos < 0) {
         // We can't read from a negative file position.
         return -EINVAL;
     }
-    if (*offset >= SPAN) {
+    if (pos >= SPAN) {
         // We can't read from a position past the end of our device.
         return 0;
     }
-    if ((*offset % 0x4) != 0) {
+    if ((pos % 0x4) != 0) {
         // Prevent unaligned access.
         pr_warn("rotary_read: unaligned access\n");
         return -EFAULT;
     }
 
-    val = ioread32(priv->base_addr + *offset);
+    // Only move whole registers, and never past the end of our device.
+    count = min_t(size_t, iov_iter_count(to), SPAN - pos);
+    count = round_down(count, sizeof(u32));
+    if (count == 0) {
+        return -EINVAL;
+    }
+
+    if (priv->can_wait) {
+        if (!rotary_changed(rf)) {
+            if (iocb->ki_filp->f_flags & O_NONBLOCK) {
+                return -EAGAIN;
+            }
+            ret = wait_event_interruptible(priv->wait, rotary_changed(rf));
+            if (ret) {
+                return ret;
+            }
+        }
+        // Note the change before reading so one during the read isn't lost.
+        rf->fresh = false;
+        rf->seen = atomic_read(&priv->events);
+    }
+
+    mutex_lock(&priv->lock);
+    for (i = 0; i < count / sizeof(u32); i++) {
+        vals[i] = ioread32(priv->base_addr + pos + i * sizeof(u32));
+    }
+    mutex_unlock(&priv->lock);
+
+    // Copy the values to userspace.
+    copied = round_down(copy_to_iter(vals, count, to), sizeof(u32));
+    if (copied == 0) {
+        pr_warn("rotary_read: nothing copied\n");
+        return -EFAULT;
+    }
+
+    // Increment the file offset by the number of bytes we read.
+    iocb->ki_pos = pos + copied;
+
+    return copied;
+}
+
+/**
+* rotary_write_iter() - Write method for the rotary char device
+* @iocb: I/O control block; holds the file struct and the byte offset
+* being written to.
+* @from: User-space buffer(s) to read the register values from.
+*
+* As many whole registers as @from holds are written, up to the end of the
+* component's span, so write(), writev() and pwritev() can update the whole
+* register bank with one syscall and one lock acquisition.
+*
+* On the FPGA only the IRQ, control and count limit registers are writable.
+* Emulated registers take writes too, apart from the FIFO level and event
+* time, which belong to the emulated FIFO, and the IRQ status, which is
+* write-1-to-clear as on the FPGA. A write that changes the count or the
+* enable state pushes the event the component would have seen, so the
+* emulated interrupt and waiting readers can be tested without the FPGA.
+*
+* Return: On success, the number of bytes written is returned and the
+* offset is advanced by this number. On error, a negative error
+* value is returned.
+*/
+static ssize_t rotary_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+    u32 vals[SPAN / sizeof(u32)];
+    loff_t pos = iocb->ki_pos;
+    size_t count;
+    size_t copied;
+    size_t i;
+    u32 offset;
+
+    struct rotary_file *rf = iocb->ki_filp->private_data;
+    struct rotary_dev *priv = rf->priv;
+
+    if (pos < 0) {
+        return -EINVAL;
+    }
+    if (pos >= SPAN) {
+        return 0;
+    }
+    if ((pos % 0x4) != 0) {
+        pr_warn("rotary_write: unaligned access\n");
+        return -EFAULT;
+    }
+
+    count = min_t(size_t, iov_iter_count(from), SPAN - pos);
+    count = round_down(count, sizeof(u32));
+    if (count == 0) {
+        return -EINVAL;
+    }
+
+    // Get the values from userspace before taking the lock.
+    copied = round_down(copy_from_iter(vals, count, from), sizeof(u32));
+    if (copied == 0) {
+        pr_warn("rotary_write: nothing copied from user space\n");
+        return -EFAULT;
+    }
+
+    mutex_lock(&priv->lock);
+    for (i = 0; i < copied / sizeof(u32); i++) {
+        offset = pos + i * sizeof(u32);
+        if (priv->emulated) {
+            rotary_emu_store(priv, offset, vals[i]);
+        }
+        else {
+            iowrite32(vals[i], priv->base_addr + offset);
+        }
+    }
+    mutex_unlock(&priv->lock);
+
+    // Increment the file offset by the number of bytes we wrote.
+    iocb->ki_pos = pos + copied;
+
+    // Return the number of bytes we wrote.
+    return copied;
+}
+
+/**
+* rotary_ioctl() - ioctl method for the rotary char device
+* @file: Pointer to the char device file struct.
+* @cmd: The ioctl command.
+* @arg: User-space pointer to the command's argument.
+*
+* DE10NANO_IOC_REG_XFER runs a batch of read, write, read-modify-write and
+* wait-for-bit operations while holding the device lock once. Emulated
+* registers take the batch's writes like rotary_write_iter() does.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static long rotary_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    struct rotary_file *rf = file->private_data;
+    struct rotary_dev *priv = rf->priv;
+
+    switch (cmd) {
+    case DE10NANO_IOC_REG_XFER:
+        if (priv->emulated) {
+            return rotary_emu_xfer(priv, (void __user *)arg);
+        }
+        return de10nano_reg_xfer(priv->base_addr, SPAN, SPAN,
+                                 &priv->lock, (void __user *)arg);
+    default:
+        return -ENOTTY;
+    }
+}
+
+/**
+* rotary_mmap() - mmap method for the rotary char device
+* @file: Pointer to the char device file struct.
+* @vma: The user-space mapping being created.
+*
+* Maps the register window into user space so the registers can be
+* accessed with plain loads and stores instead of a syscall each.
+* The rotary encoder registers are read-only, so writable mappings are refused.
+* Only the first page is mapped; the event data register, whose reads pop
+* the event FIFO, lives in the component's second page so user space can't
+* take events away from /dev/rotary_events.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int rotary_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    struct rotary_file *rf = file->private_data;
+    struct rotary_dev *priv = rf->priv;
+
+    return de10nano_mmap_regs(vma, priv->phys_addr, SPAN, priv->emulated,
+                              true);
+}
+
+/**
+* rotary_poll() - poll method for the rotary char device
+* @file: Pointer to the char device file struct.
+* @wait: Poll table.
+*
+* Return: EPOLLIN when a read wouldn't wait. Without change notifications
+* reads never wait, so the device is always readable.
+*/
+static __poll_t rotary_poll(struct file *file, poll_table *wait)
+{
+    struct rotary_file *rf = file->private_data;
+    struct rotary_dev *priv = rf->priv;
+
+    poll_wait(file, &priv->wait, wait);
+
+    if (!priv->can_wait || rotary_changed(rf)) {
+        return EPOLLIN | EPOLLRDNORM;
+    }
+
+    return 0;
+}
+
+/**
+* rotary_fops - File operations supported by the
+* rotary driver
+* @owner: The rotary driver owns the file operations; this
+* ensures that the driver can't be removed while the
+* character device is still in use.
+* @open: Sets up the per-open change tracking.
+* @release: Frees the per-open change tracking.
+* @read_iter: The read function; also handles readv() and preadv().
+* @write_iter: The write function; also handles writev() and pwritev().
+* @poll: Reports when the encoder has changed since the last read.
+* @unlocked_ioctl: The ioctl function; see de10nano_regs.h.
+* @compat_ioctl: Our ioctl argument is the same for 32-bit callers.
+* @mmap: Maps the register window into user space.
+* @llseek: We use the kernel's default_llseek() function; this allows
+* users to change what position they are writing/reading to/from.
+*/
+static const struct file_operations rotary_fops = {
+    .owner = THIS_MODULE,
+    .open = rotary_open,
+    .release = rotary_release,
+    .read_iter = rotary_read_iter,
+    .write_iter = rotary_write_iter,
+    .poll = rotary_poll,
+    .unlocked_ioctl = rotary_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
+    .mmap = rotary_mmap,
+    .llseek = default_llseek,
+};
+
+/**
+* rotary_events_open() - Open method for /dev/rotary_events
+* @inode: Unused.
+* @file: Pointer to the char device file struct; misc_open() has set
+* its private_data to our events_miscdev.
+*
+* The new file only receives events that happen after it was opened.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int rotary_events_open(struct inode *inode, struct file *file)
+{
+    struct rotary_dev *priv = container_of(file->private_data,
+                                struct rotary_dev, events_miscdev);
+    struct rotary_event_file *ef;
+
+    ef = kzalloc(sizeof(*ef), GFP_KERNEL);
+    if (!ef) {
+        return -ENOMEM;
+    }
+    ef->priv = priv;
+    INIT_KFIFO(ef->events);
+
+    spin_lock_irq(&priv->events_lock);
+    list_add_tail(&ef->node, &priv->event_files);
+    spin_unlock_irq(&priv->events_lock);
+
+    file->private_data = ef;
+
+    return 0;
+}
+
+/**
+* rotary_events_release() - Release method for /dev/rotary_events
+* @inode: Unused.
+* @file: Pointer to the char device file struct.
+*
+* Return: 0.
+*/
+static int rotary_events_release(struct inode *inode, struct file *file)
+{
+    struct rotary_event_file *ef = file->private_data;
+    struct rotary_dev *priv = ef->priv;
+
+    spin_lock_irq(&priv->events_lock);
+    list_del(&ef->node);
+    spin_unlock_irq(&priv->events_lock);
+
+    kfree(ef);
+
+    return 0;
+}
+
+/**
+* rotary_events_read_iter() - Read method for /dev/rotary_events
+* @iocb: I/O control block; holds the file struct.
+* @to: User-space buffer(s) to read the events into.
+*
+* Reads as many whole struct de10nano_rotary_event records as fit in @to.
+* If there are none, waits for the next event, or returns -EAGAIN if the
+* file was opened with O_NONBLOCK.
+*
+* Return: The number of bytes read, or a negative error value.
+*/
+static ssize_t rotary_events_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+    struct rotary_event_file *ef = iocb->ki_filp->private_data;
+    struct rotary_dev *priv = ef->priv;
+    struct de10nano_rotary_event evs[16];
+    size_t want = iov_iter_count(to) / sizeof(evs[0]);
+    size_t copied = 0;
+    size_t done;
+    unsigned int n;
+    int ret;
+
+    if (want == 0) {
+        return -EINVAL;
+    }
+
+    if (kfifo_is_empty(&ef->events)) {
+        if (iocb->ki_filp->f_flags & O_NONBLOCK) {
+            return -EAGAIN;
+        }
+        ret = wait_event_interruptible(priv->event_wait,
+                                       !kfifo_is_empty(&ef->events));
+        if (ret) {
+            return ret;
+        }
+    }
+
+    // Copy in chunks so the lock isn't held across copy_to_iter().
+    while (want) {
+        spin_lock_irq(&priv->events_lock);
+        n = kfifo_out(&ef->events, evs, min_t(size_t, want, ARRAY_SIZE(evs)));
+        spin_unlock_irq(&priv->events_lock);
+        if (n == 0) {
+            break;
+        }
+
+        done = copy_to_iter(evs, n * sizeof(evs[0]), to);
+        copied += done;
+        if (done != n * sizeof(evs[0])) {
+            break;
+        }
+        want -= n;
+    }
+
+    if (copied == 0) {
+        return -EFAULT;
+    }
+
+    return round_down(copied, sizeof(evs[0]));
+}
+
+/**
+* rotary_events_poll() - poll method for /dev/rotary_events
+* @file: Pointer to the char device file struct.
+* @wait: Poll table.
+*
+* Return: EPOLLIN when at least one event can be read.
+*/
+static __poll_t rotary_events_poll(struct file *file, poll_table *wait)
+{
+    struct rotary_event_file *ef = file->private_data;
+
+    poll_wait(file, &ef->priv->event_wait, wait);
+
+    if (!kfifo_is_empty(&ef->events)) {
+        return EPOLLIN | EPOLLRDNORM;
+    }
+
+    return 0;
+}
+
+/**
+* rotary_events_fops - File operations supported by /dev/rotary_events
+* @owner: The rotary driver owns the file operations.
+* @open: Sets up the per-open event queue.
+* @release: Frees the per-open event queue.
+* @read_iter: Reads whole event records.
+* @poll: Reports when events can be read.
+* @llseek: The event stream has no file position.
+*/
+static const struct file_operations rotary_events_fops = {
+    .owner = THIS_MODULE,
+    .open = rotary_events_open,
+    .release = rotary_events_release,
+    .read_iter = rotary_events_read_iter,
+    .poll = rotary_events_poll,
+    .llseek = noop_llseek,
+};
+
+/**
+* rotary_bind_read_count() - Read the count for de10nano_bind.
+* @src: The device's count source.
+* @val: Where to store the count.
+*
+* Return: 0.
+*/
+static int rotary_bind_read_count(struct de10nano_bind_source *src, s32 *val)
+{
+    struct rotary_dev *priv = container_of(src, struct rotary_dev, bind_count);
+
+    *val = ioread32(priv->output);
+    return 0;
+}
+
+/**
+* rotary_bind_read_enable() - Read the enable state for de10nano_bind.
+* @src: The device's enable source.
+* @val: Where to store the enable state.
+*
+* Return: 0.
+*/
+static int rotary_bind_read_enable(struct de10nano_bind_source *src, s32 *val)
+{
+    struct rotary_dev *priv = container_of(src, struct rotary_dev, bind_enable);
+
+    *val = ioread32(priv->enable);
+    return 0;
+}
+
+/**
+* rotary_probe() - Initialize device when a match is found
+* @pdev: Platform device structure associated with our rotary encoder device;
+* pdev is automatically created by the driver core based upon our
+* rotary device tree node.
+*
+* When a device that is compatible with this rgb control driver is found, the
+* driver's probe function is called. This probe function gets called by the
+* kernel when an rgb_led device is found in the device tree.
+*/
+static int rotary_probe(struct platform_device *pdev)
+{
+    struct rotary_dev *priv;
+    struct resource *res;
+    unsigned long emu_page;
+    size_t ret;
+
+    /*
+    * Allocate kernel memory for the rotary device and set it to 0.
+    * GFP_KERNEL specifies that we are allocating normal kernel RAM;
+    * see the kmalloc documentation for more info. The allocated memory
+    * is automatically freed when the device is removed.
+    */
+    priv = devm_kzalloc(&pdev->dev, sizeof(struct rotary_dev),
+                        GFP_KERNEL);
+    if (!priv) {
+        pr_err("Failed to allocate memory\n");
+        return -ENOMEM;
+    }
+
+    /*
+    * Request and remap the device's memory region. Requesting the region
+    * make sure nobody else can use that memory. The memory is remapped
+    * into the kernel's virtual address space because we don't have access
+    * to physical memory locations.
+    */
+    if (emulate && !platform_get_resource(pdev, IORESOURCE_MEM, 0)) {
+        // Our own emulated device has no memory region; use a RAM page.
+        emu_page = devm_get_free_pages(&pdev->dev,
+                            GFP_KERNEL | __GFP_ZERO, 0);
+        if (!emu_page) {
+            pr_err("Failed to allocate emulated registers\n");
+            return -ENOMEM;
+        }
+        priv->base_addr = (void __iomem *)emu_page;
+        priv->phys_addr = virt_to_phys((void *)emu_page);
+        priv->emulated = true;
+        // Match the component's reset value of the count limit.
+        iowrite32(ROTARY_RESET_COUNT_MAX, priv->base_addr + COUNT_MAX_OFFSET);
+    }
+    else {
+        priv->base_addr = devm_platform_get_and_ioremap_resource(pdev, 0, &res);
+        if (IS_ERR(priv->base_addr)) {
+            pr_err("Failed to request/remap platform device resource\n");
+            return PTR_ERR(priv->base_addr);
+        }
+        priv->phys_addr = res->start;
+    }
+
+    mutex_init(&priv->lock);
+
+    // Set the memory addresses for each register.
+    priv->output = priv->base_addr + OUTPUT_OFFSET;
+    priv->enable = priv->base_addr + ENABLE_OFFSET;
+
+    init_waitqueue_head(&priv->wait);
+    atomic_set(&priv->events, 0);
+    spin_lock_init(&priv->events_lock);
+    INIT_LIST_HEAD(&priv->event_files);
+    init_waitqueue_head(&priv->event_wait);
+    INIT_KFIFO(priv->emu_fifo);
+    spin_lock_init(&priv->motion_lock);
+    priv->sample_hz = ROTARY_DEFAULT_SAMPLE_HZ;
+    priv->sample_period = ns_to_ktime(div_u64(NSEC_PER_SEC, priv->sample_hz));
+    priv->accel_curve = DE10NANO_ROTARY_ACCEL_FLAT;
+    priv->accel_threshold = 100;
+    priv->accel_max = 400;
+    hrtimer_init(&priv->sample_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    priv->sample_timer.function = rotary_sample_timer;
+    priv->last_count = ioread32(priv->base_addr + OUTPUT_OFFSET);
+
+    /*
+    * The IRQ is optional so the driver still works with bitstreams that
+    * predate it; reads then never wait.
+    */
+    priv->irq = platform_get_irq_optional(pdev, 0);
+    if (priv->irq < 0 && priv->irq != -ENXIO) {
+        return priv->irq;
+    }
+
+    /*
+    * Register the bind sources before the IRQ can notify them. Bindings
+    * follow the sources' change notifications when there are any and poll
+    * them otherwise.
+    */
+    priv->bind_count.name = "rotary";
+    priv->bind_count.read = rotary_bind_read_count;
+    priv->bind_count.notifies = priv->irq > 0 || priv->emulated;
+    ret = devm_de10nano_bind_add_source(&pdev->dev, &priv->bind_count);
+    if (ret) {
+        pr_err("Failed to register bind source %s\n", priv->bind_count.name);
+        return ret;
+    }
+    priv->bind_enable.name = "rotary_enable";
+    priv->bind_enable.read = rotary_bind_read_enable;
+    priv->bind_enable.notifies = priv->bind_count.notifies;
+    ret = devm_de10nano_bind_add_source(&pdev->dev, &priv->bind_enable);
+    if (ret) {
+        pr_err("Failed to register bind source %s\n", priv->bind_enable.name);
+        return ret;
+    }
+
+    if (priv->irq > 0) {
+        ret = devm_request_irq(&pdev->dev, priv->irq, rotary_irq, 0,
+                               "rotary", priv);
+        if (ret) {
+            pr_err("Failed to request IRQ %d\n", priv->irq);
+            return ret;
+        }
+    }
+    // The emulated registers call the IRQ handler themselves.
+    if (priv->irq > 0 || priv->emulated) {
+        // Clear stale events, then interrupt on count and button changes.
+        rotary_irq_ack(priv, ROTARY_IRQ_COUNT | ROTARY_IRQ_BUTTON);
+        rotary_drain_events(priv);
+        iowrite32(ROTARY_IRQ_COUNT | ROTARY_IRQ_BUTTON,
+                  priv->base_addr + IRQ_ENABLE_OFFSET);
+        priv->can_wait = true;
+    }
+
+    // Initialize the misc device parameters
+    priv->miscdev.minor = MISC_DYNAMIC_MINOR;
+    priv->miscdev.name = "rotary";
+    priv->miscdev.fops = &rotary_fops;
+    priv->miscdev.parent = &pdev->dev;
+
+    // Register the misc device; this creates a char dev at /dev/rotary
+    ret = misc_register(&priv->miscdev);
+    if (ret) {
+        pr_err("Failed to register misc device");
+        return ret;
+    }
+
+    /*
+    * The event FIFO is drained from the IRQ, so without one there is no
+    * /dev/rotary_events.
+    */
+    if (priv->can_wait) {
+        priv->events_miscdev.minor = MISC_DYNAMIC_MINOR;
+        priv->events_miscdev.name = "rotary_events";
+        priv->events_miscdev.fops = &rotary_events_fops;
+        priv->events_miscdev.parent = &pdev->dev;
+
+        ret = misc_register(&priv->events_miscdev);
+        if (ret) {
+            pr_err("Failed to register events misc device");
+            misc_deregister(&priv->miscdev);
+            return ret;
+        }
+    }
+
+    /* Attach the rotary ecoder's private data to the platform device's struct.
+    * This is so we can access our state container in the other functions.
+    */
+    platform_set_drvdata(pdev, priv);
+
+    /*
+    * With change notifications the first count change starts the motion
+    * sampler; without them it has to poll for as long as the driver is
+    * loaded.
+    */
+    if (!priv->can_wait) {
+        rotary_motion_start(priv);
+    }
+
+    pr_info("rotary_probe successful\n");
+
+    return 0;
+}
+
+/**
+*rotary_remove() - Remove an rotary encoder device.
+* @pdev: Platform device structure associated with our rotary device.
+*
+* This function is called when an rotary encoder device is removed or
+* the driver is removed.
+*/
+static int rotary_remove(struct platform_device *pdev)
+{
+    // Get the  rotary encoder's private data from the platform device.
+    struct rotary_dev *priv = platform_get_drvdata(pdev);
+
+    // Deregister the misc devices and remove the /dev/rotary* files.
+    if (priv->can_wait) {
+        misc_deregister(&priv->events_miscdev);
+    }
+    misc_deregister(&priv->miscdev);
+
+    // Stop the component from interrupting; the IRQ itself is device-managed.
+    if (priv->irq > 0) {
+        iowrite32(0, priv->base_addr + IRQ_ENABLE_OFFSET);
+        synchronize_irq(priv->irq);
+    }
+
+    // Nothing can start the sampler any more.
+    WRITE_ONCE(priv->fake_rate, 0);
+    hrtimer_cancel(&priv->sample_timer);
+
+    pr_info("rotary_remove successful\n");
+
+    return 0;
+}
+
+/*
+* Define the compatible property used for matching devices to this driver,
+* then add our device id structure to the kernel's device table. For a device
+* to be matched with this driver, its device tree node must use the same
+* compatible string as defined here.
+*/
+static const struct of_device_id rotary_of_match[] = {
+    { .compatible = "Kaiser,rotary", },
+    { }
+};
+MODULE_DEVICE_TABLE(of, rotary_of_match);
+
+/**
+* output_show() - Return the rotary encoder output state value to user-space via sysfs.
+* @dev: Device structure for the rotary component. This
+* device struct is embedded in the rotary platform
+* device struct.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t output_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    u32 output;
+
+    struct rotary_dev *priv = dev_get_drvdata(dev);
+
+    output = ioread32(priv->output);
+
+    return scnprintf(buf, PAGE_SIZE, "Output = %x\n", output);
+}
+
+/**
+* output_store() - while I shouldnt ever write to the output register, I can't figure out
+*		  how to get the sysfs code to work without it, and I can't be bothered with trying to put more time into this silly project
+* @dev: device structre for rotary component.
+* @attr: unused
+* @buf: buffer that contains value
+* @size: number of bytes being written
+* 
+* Return: number of bytes stored
+*/ 
+static ssize_t output_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
+{
+return 0;
+}
+
+/**
+* enable_show() - Return the enable value to user-space via sysfs.
+* @dev: Device structure for the rotary component. This
+* device struct is embedded in the rotary platform
+* device struct.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t enable_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    u32 enable;
+
+    struct rotary_dev *priv = dev_get_drvdata(dev);
+
+    enable = ioread32(priv->enable);
+
+    return scnprintf(buf, PAGE_SIZE, "enable = %x\n", enable);
+}
+
+/*
+* enable_store() - again, this is only here to get the sysfs to compile. 
+*		  I know there should be a way better way to do this, but I just don't care
+* @dev: device structure for component
+* @attr: unused
+* @buf: buffer that contains value being written
+* @size: number of bytes
+*
+* Return: the number of bytes stored.
+*/
+static ssize_t enable_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
+{
+	return 0;
+}
+
+/**
+* wrap_show() - Return whether the count wraps at its limits via sysfs.
+* @dev: Device structure for the rotary component. This
+* device struct is embedded in the rotary platform
+* device struct.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t wrap_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    u32 control;
+
+    struct rotary_dev *priv = dev_get_drvdata(dev);
+
+    control = ioread32(priv->base_addr + CONTROL_OFFSET);
+
+    return scnprintf(buf, PAGE_SIZE, "%u\n", !!(control & CONTROL_WRAP));
+}
+
+/**
+* wrap_store() - Choose whether the count wraps or saturates at its limits.
+* @dev: Device structure for the rotary component. This
+* device struct is embedded in the rotary platform
+* device struct.
+* @attr: Unused.
+* @buf: Buffer that contains 1 to wrap or 0 to saturate.
+* @size: The number of bytes being written.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t wrap_store(struct device *dev,
+    struct device_attribute *attr, const char *buf, size_t size)
+{
+    bool wrap;
+    int ret;
+
+    struct rotary_dev *priv = dev_get_drvdata(dev);
+
+    ret = kstrtobool(buf, &wrap);
+    if (ret < 0) {
+        return ret;
+    }
+
+    mutex_lock(&priv->lock);
+    iowrite32(wrap ? CONTROL_WRAP : 0, priv->base_addr + CONTROL_OFFSET);
+    mutex_unlock(&priv->lock);
+
+    return size;
+}
+
+/**
+* rotary_show_s32() - Show a signed register via sysfs.
+* @dev: Device structure for the rotary component.
+* @offset: Register offset.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t rotary_show_s32(struct device *dev, unsigned int offset,
+    char *buf)
+{
+    struct rotary_dev *priv = dev_get_drvdata(dev);
+
+    return scnprintf(buf, PAGE_SIZE, "%d\n",
+                     (s32)ioread32(priv->base_addr + offset));
+}
+
+/**
+* rotary_store_s32() - Write a signed register from sysfs.
+* @dev: Device structure for the rotary component.
+* @offset: Register offset.
+* @buf: Buffer that contains the value.
+* @size: The number of bytes being written.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t rotary_store_s32(struct device *dev, unsigned int offset,
+    const char *buf, size_t size)
+{
+    s32 val;
+    int ret;
+
+    struct rotary_dev *priv = dev_get_drvdata(dev);
+
+    ret = kstrtos32(buf, 0, &val);
+    if (ret < 0) {
+        return ret;
+    }
+
+    mutex_lock(&priv->lock);
+    iowrite32(val, priv->base_addr + offset);
+    mutex_unlock(&priv->lock);
+
+    return size;
+}
+
+/**
+* count_min_show() - Return the lowest count via sysfs.
+* @dev: Device structure for the rotary component.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t count_min_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    return rotary_show_s32(dev, COUNT_MIN_OFFSET, buf);
+}
+
+/**
+* count_min_store() - Set the lowest count.
+* @dev: Device structure for the rotary component.
+* @attr: Unused.
+* @buf: Buffer that contains the limit.
+* @size: The number of bytes being written.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t count_min_store(struct device *dev,
+    struct device_attribute *attr, const char *buf, size_t size)
+{
+    return rotary_store_s32(dev, COUNT_MIN_OFFSET, buf, size);
+}
+
+/**
+* count_max_show() - Return the highest count via sysfs.
+* @dev: Device structure for the rotary component.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t count_max_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    return rotary_show_s32(dev, COUNT_MAX_OFFSET, buf);
+}
 
-    // Copy the value to userspace.
-    ret = copy_to_user(buf, &val, sizeof(val));
-    if (ret == sizeof(val)) {
-        pr_warn("rotary_read: nothing copied\n");
-        return -EFAULT;
-    }
+/**
+* count_max_store() - Set the highest count.
+* @dev: Device structure for the rotary component.
+* @attr: Unused.
+* @buf: Buffer that contains the limit.
+* @size: The number of bytes being written.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t count_max_store(struct device *dev,
+    struct device_attribute *attr, const char *buf, size_t size)
+{
+    return rotary_store_s32(dev, COUNT_MAX_OFFSET, buf, size);
+}
 
-    // Increment the file offset by the number of bytes we read.
-    *offset = *offset + sizeof(val);
+/**
+* error_count_show() - Return the number of illegal transitions via sysfs.
+* @dev: Device structure for the rotary component.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* An illegal transition (A and B changing at once) means the decoder
+* missed an edge, e.g. because of a noisy encoder.
+*
+* Return: The number of bytes read.
+*/
+static ssize_t error_count_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    struct rotary_dev *priv = dev_get_drvdata(dev);
 
-    return sizeof(val);
+    return scnprintf(buf, PAGE_SIZE, "%u\n",
+                     ioread32(priv->base_addr + ERROR_COUNT_OFFSET));
 }
 
 /**
-* rotary_write() - Write method for the rotary char device even though you should never write to this device lol I don't know what I'm doing
-* @file: Pointer to the char device file struct.
-* @buf: User-space buffer to read the value from.
-* @count: The number of bytes being written.
-* @offset: The byte offset in the file being written to.
+* error_count_store() - Clear the illegal transition counter.
+* @dev: Device structure for the rotary component.
+* @attr: Unused.
+* @buf: Buffer that must contain 0.
+* @size: The number of bytes being written.
 *
-* Return: On success, the number of bytes written is returned and the
-* offset @offset is advanced by this number. On error, a negative error
-* value is returned.
+* Return: The number of bytes stored.
 */
-static ssize_t rotary_write(struct file *file, const char __user *buf,
-    size_t count, loff_t *offset)
+static ssize_t error_count_store(struct device *dev,
+    struct device_attribute *attr, const char *buf, size_t size)
 {
-    size_t ret;
     u32 val;
+    int ret;
 
-    struct rotary_dev *priv = container_of(file->private_data,
-                                struct rotary_dev, miscdev);
+    struct rotary_dev *priv = dev_get_drvdata(dev);
 
-    if (*offset < 0) {
-        return -EINVAL;
-    }
-    if (*offset >= SPAN) {
-        return 0;
+    ret = kstrtou32(buf, 0, &val);
+    if (ret < 0) {
+        return ret;
     }
-    if ((*offset % 0x4) != 0) {
-        pr_warn("rotary_write: unaligned access\n");
-        return -EFAULT;
+    if (val != 0) {
+        return -EINVAL;
     }
 
     mutex_lock(&priv->lock);
-
-    // Get the value from userspace.
-    ret = copy_from_user(&val, buf, sizeof(val));
-    if (ret != sizeof(val)) {
-        iowrite32(val, priv->base_addr + *offset);
-
-        // Increment the file offset by the number of bytes we wrote.
-        *offset = *offset + sizeof(val);
-
-        // Return the number of bytes we wrote.
-        ret = sizeof(val);
-    }
-    else {
-        pr_warn("rotary_write: nothing copied from user space\n");
-        ret = -EFAULT;
-    }
-
+    iowrite32((ioread32(priv->base_addr + CONTROL_OFFSET) & CONTROL_WRAP) |
+              CONTROL_CLEAR_ERRORS, priv->base_addr + CONTROL_OFFSET);
     mutex_unlock(&priv->lock);
-    return ret;
+
+    return size;
 }
 
 /**
-* rotary_fops - File operations supported by the
-* rotary driver
-* @owner: The rotary driver owns the file operations; this
-* ensures that the driver can't be removed while the
-* character device is still in use.
-* @read: The read function.
-* @write: The write function.
-* @llseek: We use the kernel's default_llseek() function; this allows
-* users to change what position they are writing/reading to/from.
+* sample_hz_show() - Return the motion sampling rate via sysfs.
+* @dev: Device structure for the rotary component.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
+*
+* Return: The number of bytes read.
 */
-static const struct file_operations rotary_fops = {
-    .owner = THIS_MODULE,
-    .read = rotary_read,
-    .write = rotary_write,
-    .llseek = default_llseek,
-};
+static ssize_t sample_hz_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
+{
+    struct rotary_dev *priv = dev_get_drvdata(dev);
+
+    return scnprintf(buf, PAGE_SIZE, "%u\n", READ_ONCE(priv->sample_hz));
+}
 
 /**
-* rotary_probe() - Initialize device when a match is found
-* @pdev: Platform device structure associated with our rotary encoder device;
-* pdev is automatically created by the driver core based upon our
-* rotary device tree node.
+* sample_hz_store() - Set how many times per second the count is sampled.
+* @dev: Device structure for the rotary component.
+* @attr: Unused.
+* @buf: Buffer that contains the rate, 1 to ROTARY_MAX_SAMPLE_HZ.
+* @size: The number of bytes being written.
 *
-* When a device that is compatible with this rgb control driver is found, the
-* driver's probe function is called. This probe function gets called by the
-* kernel when an rgb_led device is found in the device tree.
+* Higher rates make the velocity follow the knob more closely; lower rates
+* smooth it more.
+*
+* Return: The number of bytes stored.
 */
-static int rotary_probe(struct platform_device *pdev)
+static ssize_t sample_hz_store(struct device *dev,
+    struct device_attribute *attr, const char *buf, size_t size)
 {
-    struct rotary_dev *priv;
-    size_t ret;
-
-    /*
-    * Allocate kernel memory for the rotary device and set it to 0.
-    * GFP_KERNEL specifies that we are allocating normal kernel RAM;
-    * see the kmalloc documentation for more info. The allocated memory
-    * is automatically freed when the device is removed.
-    */
-    priv = devm_kzalloc(&pdev->dev, sizeof(struct rotary_dev),
-                        GFP_KERNEL);
-    if (!priv) {
-        pr_err("Failed to allocate memory\n");
-        return -ENOMEM;
-    }
+    unsigned int rate;
+    unsigned long flags;
+    int ret;
 
-    /*
-    * Request and remap the device's memory region. Requesting the region
-    * make sure nobody else can use that memory. The memory is remapped
-    * into the kernel's virtual address space because we don't have access
-    * to physical memory locations.
-    */
-    priv->base_addr = devm_platform_ioremap_resource(pdev, 0);
-    if (IS_ERR(priv->base_addr)) {
-        pr_err("Failed to request/remap platform device resource\n");
-        return PTR_ERR(priv->base_addr);
-    }
-
-    // Set the memory addresses for each register.
-    priv->output = priv->base_addr + OUTPUT_OFFSET;
-    priv->enable = priv->base_addr + ENABLE_OFFSET;
-
-    // Initialize the misc device parameters
-    priv->miscdev.minor = MISC_DYNAMIC_MINOR;
-    priv->miscdev.name = "rotary";
-    priv->miscdev.fops = &rotary_fops;
-    priv->miscdev.parent = &pdev->dev;
+    struct rotary_dev *priv = dev_get_drvdata(dev);
 
-    // Register the misc device; this creates a char dev at /dev/rotary
-    ret = misc_register(&priv->miscdev);
-    if (ret) {
-        pr_err("Failed to register misc device");
+    ret = kstrtouint(buf, 0, &rate);
+    if (ret < 0) {
         return ret;
     }
+    if (rate == 0 || rate > ROTARY_MAX_SAMPLE_HZ) {
+        return -EINVAL;
+    }
 
-    /* Attach the rotary ecoder's private data to the platform device's struct.
-    * This is so we can access our state container in the other functions.
-    */
-    platform_set_drvdata(pdev, priv);
-
-    pr_info("rotary_probe successful\n");
+    spin_lock_irqsave(&priv->motion_lock, flags);
+    priv->sample_hz = rate;
+    priv->sample_period = ns_to_ktime(div_u64(NSEC_PER_SEC, rate));
+    priv->fake_frac = 0;
+    spin_unlock_irqrestore(&priv->motion_lock, flags);
 
-    return 0;
+    return size;
 }
 
 /**
-*rotary_remove() - Remove an rotary encoder device.
-* @pdev: Platform device structure associated with our rotary device.
+* velocity_show() - Return the knob's smoothed speed via sysfs.
+* @dev: Device structure for the rotary component.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
 *
-* This function is called when an rotary encoder device is removed or
-* the driver is removed.
+* Return: The number of bytes read.
 */
-static int rotary_remove(struct platform_device *pdev)
+static ssize_t velocity_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
 {
-    // Get the  rotary encoder's private data from the platform device.
-    struct rotary_dev *priv = platform_get_drvdata(pdev);
+    unsigned long flags;
+    s64 velocity;
 
-    // Deregister the misc device and remove the /dev/rotary file.
-    misc_deregister(&priv->miscdev);
+    struct rotary_dev *priv = dev_get_drvdata(dev);
 
-    pr_info("rotary_remove successful\n");
+    spin_lock_irqsave(&priv->motion_lock, flags);
+    velocity = div_s64(priv->velocity, ROTARY_ACCEL_ONE);
+    spin_unlock_irqrestore(&priv->motion_lock, flags);
 
-    return 0;
+    return scnprintf(buf, PAGE_SIZE, "%lld\n", velocity);
 }
 
-/*
-* Define the compatible property used for matching devices to this driver,
-* then add our device id structure to the kernel's device table. For a device
-* to be matched with this driver, its device tree node must use the same
-* compatible string as defined here.
-*/
-static const struct of_device_id rotary_of_match[] = {
-    { .compatible = "Kaiser,rotary", },
-    { }
-};
-MODULE_DEVICE_TABLE(of, rotary_of_match);
-
 /**
-* output_show() - Return the rotary encoder output state value to user-space via sysfs.
-* @dev: Device structure for the rotary component. This
-* device struct is embedded in the rotary platform
-* device struct.
+* accel_show() - Return the acceleration settings via sysfs.
+* @dev: Device structure for the rotary component.
 * @attr: Unused.
 * @buf: Buffer that gets returned to user-space.
 *
 * Return: The number of bytes read.
 */
-static ssize_t output_show(struct device *dev,
+static ssize_t accel_show(struct device *dev,
     struct device_attribute *attr, char *buf)
 {
-    u32 output;
+    unsigned long flags;
+    u32 curve;
+    u32 threshold;
+    u32 max;
 
     struct rotary_dev *priv = dev_get_drvdata(dev);
 
-    output = ioread32(priv->output);
+    spin_lock_irqsave(&priv->motion_lock, flags);
+    curve = priv->accel_curve;
+    threshold = priv->accel_threshold;
+    max = priv->accel_max;
+    spin_unlock_irqrestore(&priv->motion_lock, flags);
 
-    return scnprintf(buf, PAGE_SIZE, "Output = %x\n", output);
+    return scnprintf(buf, PAGE_SIZE, "%s %u %u\n", rotary_accel_names[curve],
+                     threshold, max);
 }
 
 /**
-* output_store() - while I shouldnt ever write to the output register, I can't figure out
-*		  how to get the sysfs code to work without it, and I can't be bothered with trying to put more time into this silly project
-* @dev: device structre for rotary component.
-* @attr: unused
-* @buf: buffer that contains value
-* @size: number of bytes being written
-* 
-* Return: number of bytes stored
-*/ 
-static ssize_t output_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
+* accel_store() - Set the acceleration curve.
+* @dev: Device structure for the rotary component.
+* @attr: Unused.
+* @buf: "curve threshold max", where curve is one of flat, linear, quadratic
+* or step, threshold is the speed in counts per second where acceleration
+* starts and max is the highest gain in percent, e.g. "linear 100 400".
+* @size: The number of bytes being written.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t accel_store(struct device *dev,
+    struct device_attribute *attr, const char *buf, size_t size)
 {
-return 0;
+    unsigned long flags;
+    char curve[16];
+    u32 threshold;
+    u32 max;
+    int ret;
+
+    struct rotary_dev *priv = dev_get_drvdata(dev);
+
+    if (sscanf(buf, "%15s %u %u", curve, &threshold, &max) != 3) {
+        return -EINVAL;
+    }
+    ret = sysfs_match_string(rotary_accel_names, curve);
+    if (ret < 0) {
+        return ret;
+    }
+    if (threshold == 0 || max < 100 || max > 10000) {
+        return -EINVAL;
+    }
+
+    spin_lock_irqsave(&priv->motion_lock, flags);
+    priv->accel_curve = ret;
+    priv->accel_threshold = threshold;
+    priv->accel_max = max;
+    spin_unlock_irqrestore(&priv->motion_lock, flags);
+
+    return size;
 }
 
 /**
-* enable_show() - Return the enable value to user-space via sysfs.
-* @dev: Device structure for the rotary component. This
-* device struct is embedded in the rotary platform
-* device struct.
+* accel_count_show() - Return the acceleration-scaled position via sysfs.
+* @dev: Device structure for the rotary component.
 * @attr: Unused.
 * @buf: Buffer that gets returned to user-space.
 *
+* This is the sum of every sampled change in count, each scaled by the
+* acceleration gain at the time. Differences between two reads give an
+* adjustment that is fine when the knob turns slowly and coarse when it
+* spins.
+*
 * Return: The number of bytes read.
 */
-static ssize_t enable_show(struct device *dev,
+static ssize_t accel_count_show(struct device *dev,
     struct device_attribute *attr, char *buf)
 {
-    u32 enable;
+    unsigned long flags;
+    s64 count;
 
     struct rotary_dev *priv = dev_get_drvdata(dev);
 
-    enable = ioread32(priv->enable);
+    spin_lock_irqsave(&priv->motion_lock, flags);
+    count = div_s64(priv->accel_count, ROTARY_ACCEL_ONE);
+    spin_unlock_irqrestore(&priv->motion_lock, flags);
 
-    return scnprintf(buf, PAGE_SIZE, "enable = %x\n", enable);
+    return scnprintf(buf, PAGE_SIZE, "%lld\n", count);
 }
 
-/*
-* enable_store() - again, this is only here to get the sysfs to compile. 
-*		  I know there should be a way better way to do this, but I just don't care
-* @dev: device structure for component
-* @attr: unused
-* @buf: buffer that contains value being written
-* @size: number of bytes
+/**
+* fake_rate_show() - Return the fake counter rate via sysfs.
+* @dev: Device structure for the rotary component.
+* @attr: Unused.
+* @buf: Buffer that gets returned to user-space.
 *
-* Return: the number of bytes stored.
+* Return: The number of bytes read.
 */
-static ssize_t enable_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
+static ssize_t fake_rate_show(struct device *dev,
+    struct device_attribute *attr, char *buf)
 {
-	return 0;
+    struct rotary_dev *priv = dev_get_drvdata(dev);
+
+    return scnprintf(buf, PAGE_SIZE, "%d\n", READ_ONCE(priv->fake_rate));
+}
+
+/**
+* fake_rate_store() - Spin the emulated knob at a constant rate.
+* @dev: Device structure for the rotary component.
+* @attr: Unused.
+* @buf: Buffer that contains the rate in counts per second; negative counts
+* down, 0 stops.
+* @size: The number of bytes being written.
+*
+* Each sample adds exactly rate / sample_hz counts (fractions carried) to
+* the emulated count and pushes one event per count, so velocity,
+* acceleration and the event records can be tested deterministically.
+* Only available when emulated.
+*
+* Return: The number of bytes stored.
+*/
+static ssize_t fake_rate_store(struct device *dev,
+    struct device_attribute *attr, const char *buf, size_t size)
+{
+    unsigned long flags;
+    s32 rate;
+    int ret;
+
+    struct rotary_dev *priv = dev_get_drvdata(dev);
+
+    if (!priv->emulated) {
+        return -EOPNOTSUPP;
+    }
+
+    ret = kstrtos32(buf, 0, &rate);
+    if (ret < 0) {
+        return ret;
+    }
+    if (rate > ROTARY_MAX_FAKE_RATE || rate < -ROTARY_MAX_FAKE_RATE) {
+        return -EINVAL;
+    }
+
+    spin_lock_irqsave(&priv->motion_lock, flags);
+    priv->fake_rate = rate;
+    priv->fake_frac = 0;
+    spin_unlock_irqrestore(&priv->motion_lock, flags);
+
+    if (rate) {
+        rotary_motion_start(priv);
+    }
+
+    return size;
 }
 
 // Define sysfs attributes
 static DEVICE_ATTR_RW(output);
 static DEVICE_ATTR_RW(enable);
+static DEVICE_ATTR_RW(wrap);
+static DEVICE_ATTR_RW(count_min);
+static DEVICE_ATTR_RW(count_max);
+static DEVICE_ATTR_RW(error_count);
+static DEVICE_ATTR_RW(sample_hz);
+static DEVICE_ATTR_RO(velocity);
+static DEVICE_ATTR_RW(accel);
+static DEVICE_ATTR_RO(accel_count);
+static DEVICE_ATTR_RW(fake_rate);
 
 // Create an attribute group so the device core can
 // export the attributes for us.
 static struct attribute *rotary_attrs[] = {
     &dev_attr_output.attr,
     &dev_attr_enable.attr,
+    &dev_attr_wrap.attr,
+    &dev_attr_count_min.attr,
+    &dev_attr_count_max.attr,
+    &dev_attr_error_count.attr,
+    &dev_attr_sample_hz.attr,
+    &dev_attr_velocity.attr,
+    &dev_attr_accel.attr,
+    &dev_attr_accel_count.attr,
+    &dev_attr_fake_rate.attr,
     NULL,
 };
 ATTRIBUTE_GROUPS(rotary);
@@ -361,11 +2039,51 @@ static struct platform_driver rotary_driver = {
     },
 };
 
-/*
-* We don't need to do anything special in module init/exit.
-* This macro automatically handles module init/exit.
+// Emulated platform device, only registered when emulate is set.
+static struct platform_device *rotary_emu_pdev;
+
+/**
+* rotary_init() - Register the rotary platform driver.
+*
+* When the emulate module parameter is set, a RAM-backed rotary encoder device is
+* registered as well so the driver can be tested without the FPGA.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int __init rotary_init(void)
+{
+    int ret;
+
+    ret = platform_driver_register(&rotary_driver);
+    if (ret) {
+        return ret;
+    }
+
+    if (emulate) {
+        rotary_emu_pdev = platform_device_register_simple("rotary",
+                            PLATFORM_DEVID_NONE, NULL, 0);
+        if (IS_ERR(rotary_emu_pdev)) {
+            platform_driver_unregister(&rotary_driver);
+            return PTR_ERR(rotary_emu_pdev);
+        }
+    }
+
+    return 0;
+}
+
+/**
+* rotary_exit() - Remove the emulated device (if any) and the platform driver.
 */
-module_platform_driver(rotary_driver);
+static void __exit rotary_exit(void)
+{
+    if (rotary_emu_pdev) {
+        platform_device_unregister(rotary_emu_pdev);
+    }
+    platform_driver_unregister(&rotary_driver);
+}
+
+module_init(rotary_init);
+module_exit(rotary_exit);
 
 MODULE_LICENSE("Dual MIT/GPL");
 MODULE_AUTHOR("Dirk Kaiser");
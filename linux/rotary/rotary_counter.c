@@ -0,0 +1,817 @@
+#include <linux/module.h>                   // Basic kernel module definitions
+#include <linux/platform_device.h>          // Platfrom driver/device definitions
+#include <linux/mod_devicetable.h>          // of_device_id and MODULE_DEVICE_TABLE
+#include <linux/io.h>                       // iowrite32/ioread32 functions
+#include <linux/types.h>                    // data types
+#include <linux/bits.h>                     // BIT, GENMASK
+#include <linux/limits.h>                   // S32_MAX
+#include <linux/interrupt.h>                // request_irq, irqreturn_t
+#include <linux/spinlock.h>                 // spinlock for the driver state
+#include <linux/counter.h>                  // Generic counter framework
+#include <linux/ktime.h>                    // ktime_get_ns
+
+#define OUTPUT_OFFSET       0x00            // 0 byte offset for the encoder count register
+#define IRQ_STATUS_OFFSET   0x08            // 8 byte offset for the IRQ status register (write 1 to clear)
+#define IRQ_ENABLE_OFFSET   0x0C            // 12 byte offset for the IRQ enable register
+#define FIFO_LEVEL_OFFSET   0x10            // 16 byte offset for the event FIFO level register
+#define EVENT_TIME_OFFSET   0x14            // 20 byte offset for the timestamp of the last popped event
+#define CYCLE_COUNT_OFFSET  0x18            // 24 byte offset for the free-running cycle counter
+#define CONTROL_OFFSET      0x20            // 32 byte offset for the decoder control register
+#define COUNT_MIN_OFFSET    0x28            // 40 byte offset for the lowest count
+#define COUNT_MAX_OFFSET    0x2C            // 44 byte offset for the highest count
+#define INPUT_STATUS_OFFSET 0x30            // 48 byte offset for the A, B and push button levels
+#define EVENT_DATA_OFFSET   0x1000          // Event FIFO head, alone in the second page; reading it pops the event
+#define ROTARY_IRQ_COUNT    BIT(0)          // IRQ status/enable bit: the encoder count changed
+#define ROTARY_IRQ_BUTTON   BIT(1)          // IRQ status/enable bit: the push button toggled
+#define CONTROL_WRAP        BIT(0)          // Control: wrap between the count limits instead of saturating
+#define CONTROL_CLEAR_COUNT BIT(1)          // Control: set the count to 0 (self-clearing)
+#define EVENT_COUNT_MASK    GENMASK(15, 0)  // Event word: encoder count after the event
+#define EVENT_BUTTON        BIT(16)         // Event word: push button press rather than a detent
+#define EVENT_UP            BIT(17)         // Event word: counted up, or the new enable state
+#define ROTARY_RESET_COUNT_MAX 255          // Reset value of COUNT_MAX: 64 detents of 4 counts
+#define ROTARY_CLK_NS       20              // Period of the 50 MHz cycle counter
+
+// Counts, signals and event channels
+#define ROTARY_COUNTER_POSITION 0           // Count 0 / channel 0: the encoder position
+#define ROTARY_COUNTER_PRESSES  1           // Count 1 / channel 1: push button presses
+#define ROTARY_SIGNAL_A         0
+#define ROTARY_SIGNAL_B         1
+#define ROTARY_SIGNAL_BUTTON    2
+
+/**
+* struct rotary_counter_dev - Private rotary counter device struct.
+* @base_addr: Pointer to the component's base address
+* @emulated: The registers are backed by RAM instead of the FPGA
+* @irq: The component's interrupt, or a negative value if it has none
+* @lock: Protects @direction, @presses and register read-modify-writes;
+* taken from the IRQ handler
+* @direction: Direction of the last count step
+* @presses: Number of push button presses
+* @push_lock: Serialises pushing counter events, so @event_ns stays put
+* until the counter core has read it
+* @event_ns: CLOCK_MONOTONIC time of the event being pushed
+*
+* An rotary_counter_dev struct gets created for each rotary encoder component.
+*/
+struct rotary_counter_dev {
+    void __iomem *base_addr;
+    bool emulated;
+    int irq;
+    spinlock_t lock;
+    u32 direction;
+    u64 presses;
+    spinlock_t push_lock;
+    u64 event_ns;
+};
+
+/*
+* When emulate is set, the module registers its own platform device whose
+* registers are backed by a page of ordinary RAM instead of the FPGA. Writes
+* to the counts then stand in for the encoder and push counter events, so the
+* driver and its consumers can be tested without hardware.
+*/
+static bool emulate;
+module_param(emulate, bool, 0444);
+MODULE_PARM_DESC(emulate, "Back the registers with RAM instead of the FPGA");
+
+/**
+* rotary_counter_push() - Push a counter event with its own timestamp.
+* @counter: The counter device.
+* @event: The event type.
+* @channel: The event channel.
+* @timestamp_ns: CLOCK_MONOTONIC time the event happened.
+*
+* The counter core stamps every event with the time it is pushed, so events
+* drained from the FIFO in one IRQ would all carry the IRQ time. The real
+* time of the event is published through the event_timestamp extension
+* while the event is pushed; a watch on it delivers it as the event value.
+*/
+static void rotary_counter_push(struct counter_device *counter,
+    u8 event, u8 channel, u64 timestamp_ns)
+{
+    struct rotary_counter_dev *priv = counter_priv(counter);
+    unsigned long flags;
+
+    spin_lock_irqsave(&priv->push_lock, flags);
+    WRITE_ONCE(priv->event_ns, timestamp_ns);
+    counter_push_event(counter, event, channel);
+    spin_unlock_irqrestore(&priv->push_lock, flags);
+}
+
+/**
+* rotary_counter_signal_read() - Read the level of A, B or the push button.
+* @counter: The counter device.
+* @signal: The signal.
+* @level: Where to store the level.
+*
+* Return: 0.
+*/
+static int rotary_counter_signal_read(struct counter_device *counter,
+    struct counter_signal *signal, enum counter_signal_level *level)
+{
+    struct rotary_counter_dev *priv = counter_priv(counter);
+    u32 inputs = ioread32(priv->base_addr + INPUT_STATUS_OFFSET);
+
+    *level = (inputs & BIT(signal->id)) ? COUNTER_SIGNAL_LEVEL_HIGH :
+                                          COUNTER_SIGNAL_LEVEL_LOW;
+
+    return 0;
+}
+
+/**
+* rotary_counter_count_read() - Read a count.
+* @counter: The counter device.
+* @count: The count.
+* @val: Where to store the count.
+*
+* The position is signed in hardware but counts are unsigned here. Probe
+* moves the floor and ceiling to 0 or above and the floor can't be set
+* below 0, so the position is never negative; if it somehow is, the read
+* fails rather than report a wrong position.
+*
+* Return: 0, or -ERANGE if the position is negative.
+*/
+static int rotary_counter_count_read(struct counter_device *counter,
+    struct counter_count *count, u64 *val)
+{
+    struct rotary_counter_dev *priv = counter_priv(counter);
+    unsigned long flags;
+    s32 position;
+
+    if (count->id == ROTARY_COUNTER_PRESSES) {
+        spin_lock_irqsave(&priv->lock, flags);
+        *val = priv->presses;
+        spin_unlock_irqrestore(&priv->lock, flags);
+        return 0;
+    }
+
+    position = ioread32(priv->base_addr + OUTPUT_OFFSET);
+    if (position < 0) {
+        return -ERANGE;
+    }
+    *val = position;
+
+    return 0;
+}
+
+/**
+* rotary_counter_emulate_position() - Move the emulated position.
+* @counter: The counter device.
+* @val: New position; between the floor and the ceiling.
+*
+* Pushes the events the component's IRQ would have caused.
+*/
+static void rotary_counter_emulate_position(struct counter_device *counter,
+    u64 val)
+{
+    struct rotary_counter_dev *priv = counter_priv(counter);
+    unsigned long flags;
+    s32 old;
+
+    spin_lock_irqsave(&priv->lock, flags);
+    old = ioread32(priv->base_addr + OUTPUT_OFFSET);
+    iowrite32(val, priv->base_addr + OUTPUT_OFFSET);
+    if (val != old) {
+        priv->direction = (s64)val > old ? COUNTER_COUNT_DIRECTION_FORWARD :
+                                           COUNTER_COUNT_DIRECTION_BACKWARD;
+    }
+    spin_unlock_irqrestore(&priv->lock, flags);
+
+    if (val != old) {
+        rotary_counter_push(counter, COUNTER_EVENT_CHANGE_OF_STATE,
+                            ROTARY_COUNTER_POSITION, ktime_get_ns());
+    }
+}
+
+/**
+* rotary_counter_count_write() - Set a count.
+* @counter: The counter device.
+* @count: The count.
+* @val: New value.
+*
+* On the FPGA the position can only be cleared (to the floor, if the floor
+* is above 0) and the press counter only reset to 0. Emulated counts take
+* any value in range and push the matching events.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int rotary_counter_count_write(struct counter_device *counter,
+    struct counter_count *count, u64 val)
+{
+    struct rotary_counter_dev *priv = counter_priv(counter);
+    unsigned long flags;
+    s32 floor;
+    s32 ceiling;
+    u64 old;
+
+    if (count->id == ROTARY_COUNTER_PRESSES) {
+        if (val != 0 && !priv->emulated) {
+            return -EINVAL;
+        }
+        spin_lock_irqsave(&priv->lock, flags);
+        old = priv->presses;
+        priv->presses = val;
+        spin_unlock_irqrestore(&priv->lock, flags);
+        if (priv->emulated && val > old) {
+            rotary_counter_push(counter, COUNTER_EVENT_CHANGE_OF_STATE,
+                                ROTARY_COUNTER_PRESSES, ktime_get_ns());
+        }
+        return 0;
+    }
+
+    floor = ioread32(priv->base_addr + COUNT_MIN_OFFSET);
+    ceiling = ioread32(priv->base_addr + COUNT_MAX_OFFSET);
+    if (val > S32_MAX || (s64)val < floor || (s64)val > ceiling) {
+        return -EINVAL;
+    }
+
+    if (priv->emulated) {
+        rotary_counter_emulate_position(counter, val);
+        return 0;
+    }
+
+    if (val != max_t(s32, floor, 0)) {
+        return -EINVAL;
+    }
+
+    spin_lock_irqsave(&priv->lock, flags);
+    iowrite32((ioread32(priv->base_addr + CONTROL_OFFSET) & CONTROL_WRAP) |
+              CONTROL_CLEAR_COUNT, priv->base_addr + CONTROL_OFFSET);
+    spin_unlock_irqrestore(&priv->lock, flags);
+
+    return 0;
+}
+
+static const enum counter_function rotary_counter_position_functions[] = {
+    COUNTER_FUNCTION_QUADRATURE_X4,
+};
+
+static const enum counter_function rotary_counter_presses_functions[] = {
+    COUNTER_FUNCTION_INCREASE,
+};
+
+/**
+* rotary_counter_function_read() - Read a count's function.
+* @counter: The counter device.
+* @count: The count.
+* @function: Where to store the function.
+*
+* Return: 0.
+*/
+static int rotary_counter_function_read(struct counter_device *counter,
+    struct counter_count *count, enum counter_function *function)
+{
+    *function = count->functions_list[0];
+
+    return 0;
+}
+
+/**
+* rotary_counter_action_read() - Read which edges of a signal count.
+* @counter: The counter device.
+* @count: The count.
+* @synapse: The synapse between @count and a signal.
+* @action: Where to store the action.
+*
+* Return: 0.
+*/
+static int rotary_counter_action_read(struct counter_device *counter,
+    struct counter_count *count, struct counter_synapse *synapse,
+    enum counter_synapse_action *action)
+{
+    *action = synapse->actions_list[0];
+
+    return 0;
+}
+
+/**
+* rotary_counter_watch_validate() - Check that an event can be watched.
+* @counter: The counter device.
+* @watch: The watch being added.
+*
+* Return: 0 if the event is supported, or -EINVAL.
+*/
+static int rotary_counter_watch_validate(struct counter_device *counter,
+    const struct counter_watch *watch)
+{
+    switch (watch->event) {
+    case COUNTER_EVENT_CHANGE_OF_STATE:
+        return watch->channel <= ROTARY_COUNTER_PRESSES ? 0 : -EINVAL;
+    case COUNTER_EVENT_OVERFLOW:
+    case COUNTER_EVENT_UNDERFLOW:
+        return watch->channel == ROTARY_COUNTER_POSITION ? 0 : -EINVAL;
+    default:
+        return -EINVAL;
+    }
+}
+
+static const struct counter_ops rotary_counter_ops = {
+    .signal_read = rotary_counter_signal_read,
+    .count_read = rotary_counter_count_read,
+    .count_write = rotary_counter_count_write,
+    .function_read = rotary_counter_function_read,
+    .action_read = rotary_counter_action_read,
+    .watch_validate = rotary_counter_watch_validate,
+};
+
+static struct counter_signal rotary_counter_signals[] = {
+    { .id = ROTARY_SIGNAL_A, .name = "Channel A" },
+    { .id = ROTARY_SIGNAL_B, .name = "Channel B" },
+    { .id = ROTARY_SIGNAL_BUTTON, .name = "Button" },
+};
+
+static const enum counter_synapse_action rotary_counter_quadrature_actions[] = {
+    COUNTER_SYNAPSE_ACTION_BOTH_EDGES,
+};
+
+static const enum counter_synapse_action rotary_counter_button_actions[] = {
+    COUNTER_SYNAPSE_ACTION_RISING_EDGE,
+};
+
+static struct counter_synapse rotary_counter_position_synapses[] = {
+    {
+        .actions_list = rotary_counter_quadrature_actions,
+        .num_actions = ARRAY_SIZE(rotary_counter_quadrature_actions),
+        .signal = &rotary_counter_signals[ROTARY_SIGNAL_A],
+    },
+    {
+        .actions_list = rotary_counter_quadrature_actions,
+        .num_actions = ARRAY_SIZE(rotary_counter_quadrature_actions),
+        .signal = &rotary_counter_signals[ROTARY_SIGNAL_B],
+    },
+};
+
+static struct counter_synapse rotary_counter_presses_synapses[] = {
+    {
+        .actions_list = rotary_counter_button_actions,
+        .num_actions = ARRAY_SIZE(rotary_counter_button_actions),
+        .signal = &rotary_counter_signals[ROTARY_SIGNAL_BUTTON],
+    },
+};
+
+/**
+* rotary_counter_limit_read() - Read the ceiling or floor.
+* @counter: The counter device.
+* @offset: COUNT_MAX_OFFSET or COUNT_MIN_OFFSET.
+* @val: Where to store the limit.
+*
+* Both limits are 0 or above from probe on; see
+* rotary_counter_unsigned_range().
+*
+* Return: 0, or -ERANGE if the limit is negative.
+*/
+static int rotary_counter_limit_read(struct counter_device *counter,
+    unsigned int offset, u64 *val)
+{
+    struct rotary_counter_dev *priv = counter_priv(counter);
+    s32 limit = ioread32(priv->base_addr + offset);
+
+    if (limit < 0) {
+        return -ERANGE;
+    }
+    *val = limit;
+
+    return 0;
+}
+
+/**
+* rotary_counter_limit_write() - Set the ceiling or floor.
+* @counter: The counter device.
+* @offset: COUNT_MAX_OFFSET or COUNT_MIN_OFFSET.
+* @val: New limit, at most S32_MAX.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int rotary_counter_limit_write(struct counter_device *counter,
+    unsigned int offset, u64 val)
+{
+    struct rotary_counter_dev *priv = counter_priv(counter);
+
+    if (val > S32_MAX) {
+        return -ERANGE;
+    }
+
+    iowrite32(val, priv->base_addr + offset);
+
+    return 0;
+}
+
+static int rotary_counter_ceiling_read(struct counter_device *counter,
+    struct counter_count *count, u64 *val)
+{
+    return rotary_counter_limit_read(counter, COUNT_MAX_OFFSET, val);
+}
+
+static int rotary_counter_ceiling_write(struct counter_device *counter,
+    struct counter_count *count, u64 val)
+{
+    return rotary_counter_limit_write(counter, COUNT_MAX_OFFSET, val);
+}
+
+static int rotary_counter_floor_read(struct counter_device *counter,
+    struct counter_count *count, u64 *val)
+{
+    return rotary_counter_limit_read(counter, COUNT_MIN_OFFSET, val);
+}
+
+static int rotary_counter_floor_write(struct counter_device *counter,
+    struct counter_count *count, u64 val)
+{
+    return rotary_counter_limit_write(counter, COUNT_MIN_OFFSET, val);
+}
+
+/**
+* rotary_counter_direction_read() - Read the direction of the last step.
+* @counter: The counter device.
+* @count: Unused.
+* @direction: Where to store the direction.
+*
+* Return: 0.
+*/
+static int rotary_counter_direction_read(struct counter_device *counter,
+    struct counter_count *count, u32 *direction)
+{
+    struct rotary_counter_dev *priv = counter_priv(counter);
+
+    *direction = READ_ONCE(priv->direction);
+
+    return 0;
+}
+
+/**
+* rotary_counter_event_timestamp_read() - Read the time of the pushed event.
+* @counter: The counter device.
+* @count: Unused.
+* @val: Where to store the time in CLOCK_MONOTONIC nanoseconds.
+*
+* Only meaningful as a watched component, where it is read while the event
+* is pushed; read through sysfs it gives the time of the last event.
+*
+* Return: 0.
+*/
+static int rotary_counter_event_timestamp_read(struct counter_device *counter,
+    struct counter_count *count, u64 *val)
+{
+    struct rotary_counter_dev *priv = counter_priv(counter);
+
+    *val = READ_ONCE(priv->event_ns);
+
+    return 0;
+}
+
+static struct counter_comp rotary_counter_position_ext[] = {
+    COUNTER_COMP_CEILING(rotary_counter_ceiling_read,
+                         rotary_counter_ceiling_write),
+    COUNTER_COMP_FLOOR(rotary_counter_floor_read,
+                       rotary_counter_floor_write),
+    COUNTER_COMP_DIRECTION(rotary_counter_direction_read),
+    COUNTER_COMP_COUNT_U64("event_timestamp",
+                           rotary_counter_event_timestamp_read, NULL),
+};
+
+static struct counter_comp rotary_counter_presses_ext[] = {
+    COUNTER_COMP_COUNT_U64("event_timestamp",
+                           rotary_counter_event_timestamp_read, NULL),
+};
+
+static struct counter_count rotary_counter_counts[] = {
+    {
+        .id = ROTARY_COUNTER_POSITION,
+        .name = "Position",
+        .functions_list = rotary_counter_position_functions,
+        .num_functions = ARRAY_SIZE(rotary_counter_position_functions),
+        .synapses = rotary_counter_position_synapses,
+        .num_synapses = ARRAY_SIZE(rotary_counter_position_synapses),
+        .ext = rotary_counter_position_ext,
+        .num_ext = ARRAY_SIZE(rotary_counter_position_ext),
+    },
+    {
+        .id = ROTARY_COUNTER_PRESSES,
+        .name = "Button presses",
+        .functions_list = rotary_counter_presses_functions,
+        .num_functions = ARRAY_SIZE(rotary_counter_presses_functions),
+        .synapses = rotary_counter_presses_synapses,
+        .num_synapses = ARRAY_SIZE(rotary_counter_presses_synapses),
+        .ext = rotary_counter_presses_ext,
+        .num_ext = ARRAY_SIZE(rotary_counter_presses_ext),
+    },
+};
+
+/**
+* rotary_counter_irq() - Interrupt handler for the rotary encoder.
+* @irq: Unused.
+* @dev_id: The counter device.
+*
+* Drains the component's event FIFO and pushes one counter event per detent
+* or button press, so readers of /dev/counterN get every event batched in
+* their queue. Wrap-arounds additionally push an overflow or underflow
+* event. Each event's cycle stamp is converted to CLOCK_MONOTONIC using the
+* cycle counter read just before the drain and published through the
+* event_timestamp extension (see rotary_counter_push()).
+*
+* Return: IRQ_HANDLED, or IRQ_NONE if no IRQ status bit was set.
+*/
+static irqreturn_t rotary_counter_irq(int irq, void *dev_id)
+{
+    struct counter_device *counter = dev_id;
+    struct rotary_counter_dev *priv = counter_priv(counter);
+    bool wrap;
+    s32 floor = 0;
+    s32 ceiling = 0;
+    s32 position;
+    u32 status;
+    u32 now_cycles;
+    u64 now_ns;
+    u64 event_ns;
+    u32 level;
+    u32 data;
+    u32 i;
+
+    status = ioread32(priv->base_addr + IRQ_STATUS_OFFSET);
+    if (!status) {
+        return IRQ_NONE;
+    }
+
+    // Acknowledge the events we saw; anything newer stays pending.
+    iowrite32(status, priv->base_addr + IRQ_STATUS_OFFSET);
+
+    wrap = ioread32(priv->base_addr + CONTROL_OFFSET) & CONTROL_WRAP;
+    if (wrap) {
+        floor = ioread32(priv->base_addr + COUNT_MIN_OFFSET);
+        ceiling = ioread32(priv->base_addr + COUNT_MAX_OFFSET);
+    }
+
+    level = ioread32(priv->base_addr + FIFO_LEVEL_OFFSET);
+    now_cycles = ioread32(priv->base_addr + CYCLE_COUNT_OFFSET);
+    now_ns = ktime_get_ns();
+
+    for (i = 0; i < level; i++) {
+        // Reading the data pops the event and latches its timestamp.
+        data = ioread32(priv->base_addr + EVENT_DATA_OFFSET);
+        event_ns = now_ns - (u64)(u32)(now_cycles -
+            ioread32(priv->base_addr + EVENT_TIME_OFFSET)) * ROTARY_CLK_NS;
+
+        if (data & EVENT_BUTTON) {
+            spin_lock(&priv->lock);
+            priv->presses++;
+            spin_unlock(&priv->lock);
+            rotary_counter_push(counter, COUNTER_EVENT_CHANGE_OF_STATE,
+                                ROTARY_COUNTER_PRESSES, event_ns);
+            continue;
+        }
+
+        WRITE_ONCE(priv->direction, (data & EVENT_UP) ?
+                   COUNTER_COUNT_DIRECTION_FORWARD :
+                   COUNTER_COUNT_DIRECTION_BACKWARD);
+        rotary_counter_push(counter, COUNTER_EVENT_CHANGE_OF_STATE,
+                            ROTARY_COUNTER_POSITION, event_ns);
+
+        // A step up that lands on the floor wrapped from the ceiling.
+        position = (s16)(data & EVENT_COUNT_MASK);
+        if (wrap && (data & EVENT_UP) && position == (s16)floor) {
+            rotary_counter_push(counter, COUNTER_EVENT_OVERFLOW,
+                                ROTARY_COUNTER_POSITION, event_ns);
+        }
+        else if (wrap && !(data & EVENT_UP) && position == (s16)ceiling) {
+            rotary_counter_push(counter, COUNTER_EVENT_UNDERFLOW,
+                                ROTARY_COUNTER_POSITION, event_ns);
+        }
+    }
+
+    return IRQ_HANDLED;
+}
+
+/**
+* rotary_counter_unsigned_range() - Keep the position out of negative counts.
+* @priv: Private rotary counter device struct.
+*
+* The misc driver, or whatever ran before, may have left the count limits
+* or the position below 0, which an unsigned counter count can't show. The
+* floor is raised to 0 and the ceiling to the floor, and a position below
+* the floor is cleared to it, so the count can never go negative.
+*/
+static void rotary_counter_unsigned_range(struct rotary_counter_dev *priv)
+{
+    s32 floor = ioread32(priv->base_addr + COUNT_MIN_OFFSET);
+    s32 ceiling = ioread32(priv->base_addr + COUNT_MAX_OFFSET);
+    s32 position;
+
+    if (floor >= 0 && ceiling >= 0) {
+        return;
+    }
+
+    floor = max_t(s32, floor, 0);
+    ceiling = max_t(s32, ceiling, floor);
+    iowrite32(floor, priv->base_addr + COUNT_MIN_OFFSET);
+    iowrite32(ceiling, priv->base_addr + COUNT_MAX_OFFSET);
+    pr_info("rotary_counter: count range moved to %d..%d\n", floor, ceiling);
+
+    position = ioread32(priv->base_addr + OUTPUT_OFFSET);
+    if (position >= floor) {
+        return;
+    }
+    if (priv->emulated) {
+        iowrite32(floor, priv->base_addr + OUTPUT_OFFSET);
+    }
+    else {
+        iowrite32((ioread32(priv->base_addr + CONTROL_OFFSET) & CONTROL_WRAP) |
+                  CONTROL_CLEAR_COUNT, priv->base_addr + CONTROL_OFFSET);
+    }
+}
+
+/**
+* rotary_counter_probe() - Initialize device when a match is found
+* @pdev: Platform device structure associated with our rotary encoder device;
+* pdev is automatically created by the driver core based upon our
+* rotary device tree node.
+*
+* Registers a counter device with a Position count (4x quadrature, with
+* ceiling, floor and direction) and a Button presses count.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int rotary_counter_probe(struct platform_device *pdev)
+{
+    struct counter_device *counter;
+    struct rotary_counter_dev *priv;
+    unsigned long emu_page;
+    int ret;
+
+    counter = devm_counter_alloc(&pdev->dev, sizeof(*priv));
+    if (!counter) {
+        pr_err("Failed to allocate memory\n");
+        return -ENOMEM;
+    }
+    priv = counter_priv(counter);
+
+    if (emulate && !platform_get_resource(pdev, IORESOURCE_MEM, 0)) {
+        // Our own emulated device has no memory region; use a RAM page.
+        emu_page = devm_get_free_pages(&pdev->dev,
+                            GFP_KERNEL | __GFP_ZERO, 0);
+        if (!emu_page) {
+            pr_err("Failed to allocate emulated registers\n");
+            return -ENOMEM;
+        }
+        priv->base_addr = (void __iomem *)emu_page;
+        priv->emulated = true;
+        // Match the component's reset value of the count limit.
+        iowrite32(ROTARY_RESET_COUNT_MAX, priv->base_addr + COUNT_MAX_OFFSET);
+    }
+    else {
+        priv->base_addr = devm_platform_ioremap_resource(pdev, 0);
+        if (IS_ERR(priv->base_addr)) {
+            pr_err("Failed to request/remap platform device resource\n");
+            return PTR_ERR(priv->base_addr);
+        }
+    }
+
+    spin_lock_init(&priv->lock);
+    spin_lock_init(&priv->push_lock);
+    priv->direction = COUNTER_COUNT_DIRECTION_FORWARD;
+    rotary_counter_unsigned_range(priv);
+
+    counter->name = "rotary";
+    counter->parent = &pdev->dev;
+    counter->ops = &rotary_counter_ops;
+    counter->counts = rotary_counter_counts;
+    counter->num_counts = ARRAY_SIZE(rotary_counter_counts);
+    counter->signals = rotary_counter_signals;
+    counter->num_signals = ARRAY_SIZE(rotary_counter_signals);
+
+    // Without the IRQ the counts can still be read, but no events arrive.
+    priv->irq = platform_get_irq_optional(pdev, 0);
+    if (priv->irq > 0) {
+        ret = devm_request_irq(&pdev->dev, priv->irq, rotary_counter_irq, 0,
+                               "rotary_counter", counter);
+        if (ret) {
+            pr_err("Failed to request IRQ %d\n", priv->irq);
+            return ret;
+        }
+    }
+    else if (priv->irq != -ENXIO) {
+        return priv->irq;
+    }
+
+    ret = devm_counter_add(&pdev->dev, counter);
+    if (ret) {
+        pr_err("Failed to add counter device\n");
+        return ret;
+    }
+
+    if (priv->irq > 0) {
+        // Drop stale events, then interrupt on count and button changes.
+        iowrite32(ROTARY_IRQ_COUNT | ROTARY_IRQ_BUTTON,
+                  priv->base_addr + IRQ_STATUS_OFFSET);
+        while (ioread32(priv->base_addr + FIFO_LEVEL_OFFSET)) {
+            ioread32(priv->base_addr + EVENT_DATA_OFFSET);
+        }
+        iowrite32(ROTARY_IRQ_COUNT | ROTARY_IRQ_BUTTON,
+                  priv->base_addr + IRQ_ENABLE_OFFSET);
+    }
+
+    platform_set_drvdata(pdev, priv);
+
+    pr_info("rotary_counter_probe successful\n");
+
+    return 0;
+}
+
+/**
+* rotary_counter_remove() - Remove a rotary counter device.
+* @pdev: Platform device structure associated with our rotary device.
+*
+* Return: 0.
+*/
+static int rotary_counter_remove(struct platform_device *pdev)
+{
+    struct rotary_counter_dev *priv = platform_get_drvdata(pdev);
+
+    // Stop the component from interrupting; the IRQ itself is device-managed.
+    if (priv->irq > 0) {
+        iowrite32(0, priv->base_addr + IRQ_ENABLE_OFFSET);
+    }
+
+    pr_info("rotary_counter_remove successful\n");
+
+    return 0;
+}
+
+/*
+* This driver binds to the same device tree node as rotary.ko; load one or
+* the other.
+*/
+static const struct of_device_id rotary_counter_of_match[] = {
+    { .compatible = "Kaiser,rotary", },
+    { }
+};
+MODULE_DEVICE_TABLE(of, rotary_counter_of_match);
+
+/*
+* struct rotary_counter_driver - Platform driver struct for the rotary counter driver
+* @probe: Function that's called when a device is found
+* @remove: Function that's called when a device is removed
+* @driver.owner: Which module owns this driver
+* @driver.name: Name of the rotary counter driver
+* @driver.of_match_table: Device tree match table
+*/
+static struct platform_driver rotary_counter_driver = {
+    .probe = rotary_counter_probe,
+    .remove = rotary_counter_remove,
+    .driver = {
+        .owner = THIS_MODULE,
+        .name = "rotary_counter",
+        .of_match_table = rotary_counter_of_match,
+    },
+};
+
+// Emulated platform device, only registered when emulate is set.
+static struct platform_device *rotary_counter_emu_pdev;
+
+/**
+* rotary_counter_init() - Register the rotary counter platform driver.
+*
+* When the emulate module parameter is set, a RAM-backed rotary encoder device is
+* registered as well so the driver can be tested without the FPGA.
+*
+* Return: 0 on success, or a negative error value.
+*/
+static int __init rotary_counter_init(void)
+{
+    int ret;
+
+    ret = platform_driver_register(&rotary_counter_driver);
+    if (ret) {
+        return ret;
+    }
+
+    if (emulate) {
+        rotary_counter_emu_pdev = platform_device_register_simple(
+                            "rotary_counter", PLATFORM_DEVID_NONE, NULL, 0);
+        if (IS_ERR(rotary_counter_emu_pdev)) {
+            platform_driver_unregister(&rotary_counter_driver);
+            return PTR_ERR(rotary_counter_emu_pdev);
+        }
+    }
+
+    return 0;
+}
+
+/**
+* rotary_counter_exit() - Remove the emulated device (if any) and the platform driver.
+*/
+static void __exit rotary_counter_exit(void)
+{
+    if (rotary_counter_emu_pdev) {
+        platform_device_unregister(rotary_counter_emu_pdev);
+    }
+    platform_driver_unregister(&rotary_counter_driver);
+}
+
+module_init(rotary_counter_init);
+module_exit(rotary_counter_exit);
+
+MODULE_LICENSE("Dual MIT/GPL");
+MODULE_AUTHOR("Dirk Kaiser");
+MODULE_DESCRIPTION("rotary counter driver");
+MODULE_VERSION("1.0");
+MODULE_IMPORT_NS(COUNTER);
@@ -40,12 +40,29 @@ set_fileset_property QUARTUS_SYNTH TOP_LEVEL buzzer
 set_fileset_property QUARTUS_SYNTH ENABLE_RELATIVE_INCLUDE_PATHS false
 set_fileset_property QUARTUS_SYNTH ENABLE_FILE_OVERWRITE_MODE false
 add_fileset_file buzzer.vhd VHDL PATH ../hdl/buzzer/buzzer.vhd TOP_LEVEL_FILE
-add_fileset_file pwm_controller.vhd VHDL PATH ../hdl/pwm/pwm_controller.vhd
+add_fileset_file pwm_controller_pipelined.vhd VHDL PATH ../hdl/pwm/pwm_controller_pipelined.vhd
+add_fileset_file dds_tone.vhd VHDL PATH ../hdl/buzzer/dds_tone.vhd
+add_fileset_file buzzer_envelope.vhd VHDL PATH ../hdl/buzzer/buzzer_envelope.vhd
+add_fileset_file pcm_player.vhd VHDL PATH ../hdl/buzzer/pcm_player.vhd
 
 
 # 
 # parameters
 # 
+add_parameter NUM_VOICES POSITIVE 4
+set_parameter_property NUM_VOICES DEFAULT_VALUE 4
+set_parameter_property NUM_VOICES DISPLAY_NAME NUM_VOICES
+set_parameter_property NUM_VOICES TYPE POSITIVE
+set_parameter_property NUM_VOICES UNITS None
+set_parameter_property NUM_VOICES ALLOWED_RANGES 1:8
+set_parameter_property NUM_VOICES HDL_PARAMETER true
+add_parameter PCM_FIFO_DEPTH POSITIVE 1024
+set_parameter_property PCM_FIFO_DEPTH DEFAULT_VALUE 1024
+set_parameter_property PCM_FIFO_DEPTH DISPLAY_NAME PCM_FIFO_DEPTH
+set_parameter_property PCM_FIFO_DEPTH TYPE POSITIVE
+set_parameter_property PCM_FIFO_DEPTH UNITS None
+set_parameter_property PCM_FIFO_DEPTH ALLOWED_RANGES {64 128 256 512 1024 2048 4096}
+set_parameter_property PCM_FIFO_DEPTH HDL_PARAMETER true
 
 
 # 
@@ -108,7 +125,7 @@ set_interface_property buzzer_control PORT_NAME_MAP ""
 set_interface_property buzzer_control CMSIS_SVD_VARIABLES ""
 set_interface_property buzzer_control SVD_ADDRESS_GROUP ""
 
-add_interface_port buzzer_control avs_address address Input 1
+add_interface_port buzzer_control avs_address address Input 6
 add_interface_port buzzer_control avs_read read Input 1
 add_interface_port buzzer_control avs_write write Input 1
 add_interface_port buzzer_control avs_readdata readdata Output 32
@@ -119,6 +136,24 @@ set_interface_assignment buzzer_control embeddedsw.configuration.isNonVolatileSt
 set_interface_assignment buzzer_control embeddedsw.configuration.isPrintableDevice 0
 
 
+# 
+# connection point interrupt_sender
+# 
+add_interface interrupt_sender interrupt end
+set_interface_property interrupt_sender associatedAddressablePoint buzzer_control
+set_interface_property interrupt_sender associatedClock clk
+set_interface_property interrupt_sender associatedReset rst
+set_interface_property interrupt_sender bridgedReceiverOffset ""
+set_interface_property interrupt_sender bridgesToReceiver ""
+set_interface_property interrupt_sender ENABLED true
+set_interface_property interrupt_sender EXPORT_OF ""
+set_interface_property interrupt_sender PORT_NAME_MAP ""
+set_interface_property interrupt_sender CMSIS_SVD_VARIABLES ""
+set_interface_property interrupt_sender SVD_ADDRESS_GROUP ""
+
+add_interface_port interrupt_sender irq irq Output 1
+
+
 # 
 # connection point export
 # 
@@ -133,3 +168,20 @@ set_interface_property export SVD_ADDRESS_GROUP ""
 
 add_interface_port export buzzer_out buzzer_out Output 1
 
+
+# 
+# connection point route
+# 
+add_interface route conduit end
+set_interface_property route associatedClock clk
+set_interface_property route associatedReset ""
+set_interface_property route ENABLED true
+set_interface_property route EXPORT_OF ""
+set_interface_property route PORT_NAME_MAP ""
+set_interface_property route CMSIS_SVD_VARIABLES ""
+set_interface_property route SVD_ADDRESS_GROUP ""
+
+add_interface_port route route_volume volume Input 32
+add_interface_port route route_pitch pitch Input 32
+add_interface_port route route_valid valid Input 2
+
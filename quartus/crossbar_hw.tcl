@@ -0,0 +1,224 @@
+# TCL File Generated by Component Editor 23.1
+# Sat Oct 17 12:00:00 MST 2026
+# DO NOT MODIFY
+
+
+# 
+# crossbar "crossbar" v1.0
+#  2026.10.17.12:00:00
+# routes the rotary count and ADC channels to the PWM and LED sinks
+# 
+
+# 
+# request TCL package from ACDS 16.1
+# 
+package require -exact qsys 16.1
+
+
+# 
+# module crossbar
+# 
+set_module_property DESCRIPTION "routes the rotary count and ADC channels to the PWM and LED sinks"
+set_module_property NAME crossbar
+set_module_property VERSION 1.0
+set_module_property INTERNAL false
+set_module_property OPAQUE_ADDRESS_MAP true
+set_module_property AUTHOR ""
+set_module_property DISPLAY_NAME crossbar
+set_module_property INSTANTIATE_IN_SYSTEM_MODULE true
+set_module_property EDITABLE true
+set_module_property REPORT_TO_TALKBACK false
+set_module_property ALLOW_GREYBOX_GENERATION false
+set_module_property REPORT_HIERARCHY false
+
+
+# 
+# file sets
+# 
+add_fileset QUARTUS_SYNTH QUARTUS_SYNTH "" ""
+set_fileset_property QUARTUS_SYNTH TOP_LEVEL crossbar
+set_fileset_property QUARTUS_SYNTH ENABLE_RELATIVE_INCLUDE_PATHS false
+set_fileset_property QUARTUS_SYNTH ENABLE_FILE_OVERWRITE_MODE false
+add_fileset_file crossbar.vhd VHDL PATH ../hdl/crossbar/crossbar.vhd TOP_LEVEL_FILE
+
+
+# 
+# parameters
+# 
+add_parameter ADC_PERIOD_RESET NATURAL 5000
+set_parameter_property ADC_PERIOD_RESET DEFAULT_VALUE 5000
+set_parameter_property ADC_PERIOD_RESET DISPLAY_NAME ADC_PERIOD_RESET
+set_parameter_property ADC_PERIOD_RESET TYPE NATURAL
+set_parameter_property ADC_PERIOD_RESET UNITS None
+set_parameter_property ADC_PERIOD_RESET HDL_PARAMETER true
+
+
+# 
+# display items
+# 
+
+
+# 
+# connection point avalon_slave
+# 
+add_interface avalon_slave avalon end
+set_interface_property avalon_slave addressUnits WORDS
+set_interface_property avalon_slave associatedClock clock
+set_interface_property avalon_slave associatedReset reset
+set_interface_property avalon_slave bitsPerSymbol 8
+set_interface_property avalon_slave burstOnBurstBoundariesOnly false
+set_interface_property avalon_slave burstcountUnits WORDS
+set_interface_property avalon_slave explicitAddressSpan 0
+set_interface_property avalon_slave holdTime 0
+set_interface_property avalon_slave linewrapBursts false
+set_interface_property avalon_slave maximumPendingReadTransactions 0
+set_interface_property avalon_slave maximumPendingWriteTransactions 0
+set_interface_property avalon_slave readLatency 0
+set_interface_property avalon_slave readWaitTime 1
+set_interface_property avalon_slave setupTime 0
+set_interface_property avalon_slave timingUnits Cycles
+set_interface_property avalon_slave writeWaitTime 0
+set_interface_property avalon_slave ENABLED true
+set_interface_property avalon_slave EXPORT_OF ""
+set_interface_property avalon_slave PORT_NAME_MAP ""
+set_interface_property avalon_slave CMSIS_SVD_VARIABLES ""
+set_interface_property avalon_slave SVD_ADDRESS_GROUP ""
+
+add_interface_port avalon_slave avs_read read Input 1
+add_interface_port avalon_slave avs_write write Input 1
+add_interface_port avalon_slave avs_address address Input 8
+add_interface_port avalon_slave avs_readdata readdata Output 32
+add_interface_port avalon_slave avs_writedata writedata Input 32
+set_interface_assignment avalon_slave embeddedsw.configuration.isFlash 0
+set_interface_assignment avalon_slave embeddedsw.configuration.isMemoryDevice 0
+set_interface_assignment avalon_slave embeddedsw.configuration.isNonVolatileStorage 0
+set_interface_assignment avalon_slave embeddedsw.configuration.isPrintableDevice 0
+
+
+# 
+# connection point adc_master
+# 
+add_interface adc_master avalon start
+set_interface_property adc_master addressUnits SYMBOLS
+set_interface_property adc_master associatedClock clock
+set_interface_property adc_master associatedReset reset
+set_interface_property adc_master bitsPerSymbol 8
+set_interface_property adc_master burstOnBurstBoundariesOnly false
+set_interface_property adc_master burstcountUnits WORDS
+set_interface_property adc_master doStreamReads false
+set_interface_property adc_master doStreamWrites false
+set_interface_property adc_master holdTime 0
+set_interface_property adc_master linewrapBursts false
+set_interface_property adc_master maximumPendingReadTransactions 0
+set_interface_property adc_master maximumPendingWriteTransactions 0
+set_interface_property adc_master readLatency 0
+set_interface_property adc_master readWaitTime 1
+set_interface_property adc_master setupTime 0
+set_interface_property adc_master timingUnits Cycles
+set_interface_property adc_master writeWaitTime 0
+set_interface_property adc_master ENABLED true
+set_interface_property adc_master EXPORT_OF ""
+set_interface_property adc_master PORT_NAME_MAP ""
+set_interface_property adc_master CMSIS_SVD_VARIABLES ""
+set_interface_property adc_master SVD_ADDRESS_GROUP ""
+
+add_interface_port adc_master avm_address address Output 5
+add_interface_port adc_master avm_read read Output 1
+add_interface_port adc_master avm_readdata readdata Input 32
+add_interface_port adc_master avm_waitrequest waitrequest Input 1
+
+
+# 
+# connection point reset
+# 
+add_interface reset reset end
+set_interface_property reset associatedClock clock
+set_interface_property reset synchronousEdges DEASSERT
+set_interface_property reset ENABLED true
+set_interface_property reset EXPORT_OF ""
+set_interface_property reset PORT_NAME_MAP ""
+set_interface_property reset CMSIS_SVD_VARIABLES ""
+set_interface_property reset SVD_ADDRESS_GROUP ""
+
+add_interface_port reset rst reset Input 1
+
+
+# 
+# connection point clock
+# 
+add_interface clock clock end
+set_interface_property clock clockRate 0
+set_interface_property clock ENABLED true
+set_interface_property clock EXPORT_OF ""
+set_interface_property clock PORT_NAME_MAP ""
+set_interface_property clock CMSIS_SVD_VARIABLES ""
+set_interface_property clock SVD_ADDRESS_GROUP ""
+
+add_interface_port clock clk clk Input 1
+
+
+# 
+# connection point rotary
+# 
+add_interface rotary conduit end
+set_interface_property rotary associatedClock clock
+set_interface_property rotary associatedReset ""
+set_interface_property rotary ENABLED true
+set_interface_property rotary EXPORT_OF ""
+set_interface_property rotary PORT_NAME_MAP ""
+set_interface_property rotary CMSIS_SVD_VARIABLES ""
+set_interface_property rotary SVD_ADDRESS_GROUP ""
+
+add_interface_port rotary rotary_count count Input 32
+
+
+# 
+# connection point rgb
+# 
+add_interface rgb conduit end
+set_interface_property rgb associatedClock clock
+set_interface_property rgb associatedReset ""
+set_interface_property rgb ENABLED true
+set_interface_property rgb EXPORT_OF ""
+set_interface_property rgb PORT_NAME_MAP ""
+set_interface_property rgb CMSIS_SVD_VARIABLES ""
+set_interface_property rgb SVD_ADDRESS_GROUP ""
+
+add_interface_port rgb rgb_red red Output 32
+add_interface_port rgb rgb_green green Output 32
+add_interface_port rgb rgb_blue blue Output 32
+add_interface_port rgb rgb_valid valid Output 3
+
+
+# 
+# connection point buzzer
+# 
+add_interface buzzer conduit end
+set_interface_property buzzer associatedClock clock
+set_interface_property buzzer associatedReset ""
+set_interface_property buzzer ENABLED true
+set_interface_property buzzer EXPORT_OF ""
+set_interface_property buzzer PORT_NAME_MAP ""
+set_interface_property buzzer CMSIS_SVD_VARIABLES ""
+set_interface_property buzzer SVD_ADDRESS_GROUP ""
+
+add_interface_port buzzer buzzer_volume volume Output 32
+add_interface_port buzzer buzzer_pitch pitch Output 32
+add_interface_port buzzer buzzer_valid valid Output 2
+
+
+# 
+# connection point led
+# 
+add_interface led conduit end
+set_interface_property led associatedClock clock
+set_interface_property led associatedReset ""
+set_interface_property led ENABLED true
+set_interface_property led EXPORT_OF ""
+set_interface_property led PORT_NAME_MAP ""
+set_interface_property led CMSIS_SVD_VARIABLES ""
+set_interface_property led SVD_ADDRESS_GROUP ""
+
+add_interface_port led led_pattern pattern Output 32
+add_interface_port led led_valid valid Output 1
+
@@ -45,6 +45,19 @@ add_fileset_file led_array.vhd VHDL PATH ../hdl/LED-array/led_array.vhd TOP_LEVE
 # 
 # parameters
 # 
+add_parameter PWM_PRESCALE POSITIVE 12
+set_parameter_property PWM_PRESCALE DEFAULT_VALUE 12
+set_parameter_property PWM_PRESCALE DISPLAY_NAME PWM_PRESCALE
+set_parameter_property PWM_PRESCALE TYPE POSITIVE
+set_parameter_property PWM_PRESCALE UNITS None
+set_parameter_property PWM_PRESCALE HDL_PARAMETER true
+add_parameter SEQ_FRAMES POSITIVE 512
+set_parameter_property SEQ_FRAMES DEFAULT_VALUE 512
+set_parameter_property SEQ_FRAMES DISPLAY_NAME SEQ_FRAMES
+set_parameter_property SEQ_FRAMES TYPE POSITIVE
+set_parameter_property SEQ_FRAMES UNITS None
+set_parameter_property SEQ_FRAMES ALLOWED_RANGES 1:512
+set_parameter_property SEQ_FRAMES HDL_PARAMETER true
 
 
 # 
@@ -68,7 +81,7 @@ set_interface_property led_array linewrapBursts false
 set_interface_property led_array maximumPendingReadTransactions 0
 set_interface_property led_array maximumPendingWriteTransactions 0
 set_interface_property led_array readLatency 0
-set_interface_property led_array readWaitTime 1
+set_interface_property led_array readWaitTime 2
 set_interface_property led_array setupTime 0
 set_interface_property led_array timingUnits Cycles
 set_interface_property led_array writeWaitTime 0
@@ -78,7 +91,7 @@ set_interface_property led_array PORT_NAME_MAP ""
 set_interface_property led_array CMSIS_SVD_VARIABLES ""
 set_interface_property led_array SVD_ADDRESS_GROUP ""
 
-add_interface_port led_array avs_address address Input 1
+add_interface_port led_array avs_address address Input 10
 add_interface_port led_array avs_read read Input 1
 add_interface_port led_array avs_readdata readdata Output 32
 add_interface_port led_array avs_write write Input 1
@@ -132,3 +145,19 @@ set_interface_property export SVD_ADDRESS_GROUP ""
 
 add_interface_port export led led Output 8
 
+
+# 
+# connection point route
+# 
+add_interface route conduit end
+set_interface_property route associatedClock clk
+set_interface_property route associatedReset ""
+set_interface_property route ENABLED true
+set_interface_property route EXPORT_OF ""
+set_interface_property route PORT_NAME_MAP ""
+set_interface_property route CMSIS_SVD_VARIABLES ""
+set_interface_property route SVD_ADDRESS_GROUP ""
+
+add_interface_port route route_led pattern Input 32
+add_interface_port route route_valid valid Input 1
+
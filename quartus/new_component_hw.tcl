@@ -39,7 +39,7 @@ add_fileset QUARTUS_SYNTH QUARTUS_SYNTH "" ""
 set_fileset_property QUARTUS_SYNTH TOP_LEVEL RGB_LED_Control
 set_fileset_property QUARTUS_SYNTH ENABLE_RELATIVE_INCLUDE_PATHS false
 set_fileset_property QUARTUS_SYNTH ENABLE_FILE_OVERWRITE_MODE true
-add_fileset_file pwm_controller.vhd VHDL PATH ../hdl/pwm/pwm_controller.vhd
+add_fileset_file pwm_controller_pipelined.vhd VHDL PATH ../hdl/pwm/pwm_controller_pipelined.vhd
 add_fileset_file RGB_LED_Control.vhd VHDL PATH ../hdl/RGB-LED-Control/RGB_LED_Control.vhd TOP_LEVEL_FILE
 
 
@@ -108,7 +108,7 @@ set_interface_property RGB_LED_Control PORT_NAME_MAP ""
 set_interface_property RGB_LED_Control CMSIS_SVD_VARIABLES ""
 set_interface_property RGB_LED_Control SVD_ADDRESS_GROUP ""
 
-add_interface_port RGB_LED_Control avs_address address Input 2
+add_interface_port RGB_LED_Control avs_address address Input 3
 add_interface_port RGB_LED_Control avs_read read Input 1
 add_interface_port RGB_LED_Control avs_readdata readdata Output 32
 add_interface_port RGB_LED_Control avs_write write Input 1
@@ -135,3 +135,21 @@ add_interface_port export blue_out blue_out Output 1
 add_interface_port export green_out green_out Output 1
 add_interface_port export red_out red_out Output 1
 
+
+# 
+# connection point route
+# 
+add_interface route conduit end
+set_interface_property route associatedClock clk
+set_interface_property route associatedReset ""
+set_interface_property route ENABLED true
+set_interface_property route EXPORT_OF ""
+set_interface_property route PORT_NAME_MAP ""
+set_interface_property route CMSIS_SVD_VARIABLES ""
+set_interface_property route SVD_ADDRESS_GROUP ""
+
+add_interface_port route route_red red Input 32
+add_interface_port route route_green green Input 32
+add_interface_port route route_blue blue Input 32
+add_interface_port route route_valid valid Input 3
+
@@ -40,11 +40,26 @@ set_fileset_property QUARTUS_SYNTH TOP_LEVEL rotary_avalon
 set_fileset_property QUARTUS_SYNTH ENABLE_RELATIVE_INCLUDE_PATHS false
 set_fileset_property QUARTUS_SYNTH ENABLE_FILE_OVERWRITE_MODE false
 add_fileset_file rotary_avalon.vhd VHDL PATH ../hdl/rotary/rotary_avalon.vhd TOP_LEVEL_FILE
+add_fileset_file quadrature_decoder.vhd VHDL PATH ../hdl/rotary/quadrature_decoder.vhd
 
 
 # 
 # parameters
 # 
+add_parameter FIFO_DEPTH POSITIVE 64
+set_parameter_property FIFO_DEPTH DEFAULT_VALUE 64
+set_parameter_property FIFO_DEPTH DISPLAY_NAME FIFO_DEPTH
+set_parameter_property FIFO_DEPTH TYPE POSITIVE
+set_parameter_property FIFO_DEPTH UNITS None
+set_parameter_property FIFO_DEPTH ALLOWED_RANGES {2 4 8 16 32 64 128 256 512}
+set_parameter_property FIFO_DEPTH HDL_PARAMETER true
+add_parameter COUNT_WIDTH POSITIVE 32
+set_parameter_property COUNT_WIDTH DEFAULT_VALUE 32
+set_parameter_property COUNT_WIDTH DISPLAY_NAME COUNT_WIDTH
+set_parameter_property COUNT_WIDTH TYPE POSITIVE
+set_parameter_property COUNT_WIDTH UNITS None
+set_parameter_property COUNT_WIDTH ALLOWED_RANGES 16:32
+set_parameter_property COUNT_WIDTH HDL_PARAMETER true
 
 
 # 
@@ -67,8 +82,8 @@ set_interface_property avalon_slave holdTime 0
 set_interface_property avalon_slave linewrapBursts false
 set_interface_property avalon_slave maximumPendingReadTransactions 0
 set_interface_property avalon_slave maximumPendingWriteTransactions 0
-set_interface_property avalon_slave readLatency 0
-set_interface_property avalon_slave readWaitTime 1
+set_interface_property avalon_slave readLatency 1
+set_interface_property avalon_slave readWaitTime 0
 set_interface_property avalon_slave setupTime 0
 set_interface_property avalon_slave timingUnits Cycles
 set_interface_property avalon_slave writeWaitTime 0
@@ -79,8 +94,10 @@ set_interface_property avalon_slave CMSIS_SVD_VARIABLES ""
 set_interface_property avalon_slave SVD_ADDRESS_GROUP ""
 
 add_interface_port avalon_slave avs_read read Input 1
-add_interface_port avalon_slave avs_address address Input 2
+add_interface_port avalon_slave avs_write write Input 1
+add_interface_port avalon_slave avs_address address Input 11
 add_interface_port avalon_slave avs_readdata readdata Output 32
+add_interface_port avalon_slave avs_writedata writedata Input 32
 set_interface_assignment avalon_slave embeddedsw.configuration.isFlash 0
 set_interface_assignment avalon_slave embeddedsw.configuration.isMemoryDevice 0
 set_interface_assignment avalon_slave embeddedsw.configuration.isNonVolatileStorage 0
@@ -116,6 +133,24 @@ set_interface_property clock SVD_ADDRESS_GROUP ""
 add_interface_port clock clk clk Input 1
 
 
+# 
+# connection point interrupt_sender
+# 
+add_interface interrupt_sender interrupt end
+set_interface_property interrupt_sender associatedAddressablePoint avalon_slave
+set_interface_property interrupt_sender associatedClock clock
+set_interface_property interrupt_sender associatedReset reset
+set_interface_property interrupt_sender bridgedReceiverOffset ""
+set_interface_property interrupt_sender bridgesToReceiver ""
+set_interface_property interrupt_sender ENABLED true
+set_interface_property interrupt_sender EXPORT_OF ""
+set_interface_property interrupt_sender PORT_NAME_MAP ""
+set_interface_property interrupt_sender CMSIS_SVD_VARIABLES ""
+set_interface_property interrupt_sender SVD_ADDRESS_GROUP ""
+
+add_interface_port interrupt_sender irq irq Output 1
+
+
 # 
 # connection point export
 # 
@@ -132,3 +167,18 @@ add_interface_port export A a Input 1
 add_interface_port export B b Input 1
 add_interface_port export push_button push_button Input 1
 
+
+# 
+# connection point route
+# 
+add_interface route conduit end
+set_interface_property route associatedClock clock
+set_interface_property route associatedReset ""
+set_interface_property route ENABLED true
+set_interface_property route EXPORT_OF ""
+set_interface_property route PORT_NAME_MAP ""
+set_interface_property route CMSIS_SVD_VARIABLES ""
+set_interface_property route SVD_ADDRESS_GROUP ""
+
+add_interface_port route count_out count Output 32
+
@@ -0,0 +1,211 @@
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+use ieee.math_real.all;
+
+-- Testbench for led_array's per-LED brightness. Measures the high time of
+-- every LED over a whole PWM period for each of the 256 brightness levels,
+-- with and without gamma correction, and checks it against the
+-- 4096 * (level / 255)^2.2 and 4096 * level / 255 tables: level 0 must be
+-- dark, 255 always on and the steps in between must never go down. Also
+-- checks that every LED is at full brightness after reset and that an LED
+-- that is off in the pattern stays dark whatever its level.
+entity led_array_gamma_tb is
+end entity led_array_gamma_tb;
+
+architecture led_array_gamma_tb_arch of led_array_gamma_tb is
+
+	constant CLK_PERIOD : time := 20 ns;
+
+	--One PWM count per clock cycle, so a PWM period is 4096 clock cycles
+	constant PWM_PERIOD : natural := 4096;
+
+	--Register word addresses
+	constant LED_REG : natural := 0;
+	constant CONTROL_REG : natural := 1;
+	constant BRIGHTNESS_LO_REG : natural := 2;
+	constant BRIGHTNESS_HI_REG : natural := 3;
+
+	--CONTROL bits
+	constant GAMMA : natural := 1;
+
+	type count_array is array (0 to 7) of natural;
+
+	signal clk 				: std_ulogic := '0';
+	signal rst 				: std_ulogic := '1';
+	signal avs_read 		: std_ulogic := '0';
+	signal avs_write 		: std_ulogic := '0';
+	signal avs_address 	: std_ulogic_vector(9 downto 0) := (others => '0');
+	signal avs_readdata 	: std_ulogic_vector(31 downto 0);
+	signal avs_writedata : std_ulogic_vector(31 downto 0) := (others => '0');
+	signal led 				: std_ulogic_vector(7 downto 0);
+	signal done 			: boolean := false;
+
+	--PWM high time out of 4096 counts for a level, from the same formulas
+	--as led_array's tables
+	function expected_duty(level : natural; corrected : boolean) return natural is
+	begin
+		if corrected then
+			return integer(round(4096.0 * (real(level) / 255.0) ** 2.2));
+		else
+			return integer(round(4096.0 * real(level) / 255.0));
+		end if;
+	end function;
+
+begin
+
+	DUT : entity work.led_array
+		generic map (
+			PWM_PRESCALE => 1,
+			SEQ_FRAMES => 16
+			)
+		port map (
+			clk => clk,
+			rst => rst,
+			avs_read => avs_read,
+			avs_write => avs_write,
+			avs_address => avs_address,
+			avs_readdata => avs_readdata,
+			avs_writedata => avs_writedata,
+			route_led => (others => '0'),
+			route_valid => '0',
+			led => led
+			);
+
+	clk <= not clk after CLK_PERIOD / 2 when not done else '0';
+
+	STIMULUS : process
+
+		variable high 		: count_array;
+		variable previous : natural;
+		variable level 	: natural;
+		variable lo 		: std_ulogic_vector(31 downto 0);
+		variable hi 		: std_ulogic_vector(31 downto 0);
+
+		procedure bus_write(constant address : in natural; constant value : in std_ulogic_vector(31 downto 0)) is
+		begin
+			wait until falling_edge(clk);
+			avs_address <= std_ulogic_vector(to_unsigned(address, 10));
+			avs_writedata <= value;
+			avs_write <= '1';
+			wait until falling_edge(clk);
+			avs_write <= '0';
+		end procedure;
+
+		procedure bus_write(constant address : in natural; constant value : in natural) is
+		begin
+			bus_write(address, std_ulogic_vector(to_unsigned(value, 32)));
+		end procedure;
+
+		--A new level reaches every LED within 8 clock cycles; after that,
+		--count each LED's high clock cycles over one whole PWM period
+		procedure measure(high : out count_array) is
+			variable count : count_array := (others => 0);
+		begin
+			for i in 1 to 10 loop
+				wait until rising_edge(clk);
+			end loop;
+			for j in 1 to PWM_PERIOD loop
+				wait until rising_edge(clk);
+				for i in 0 to 7 loop
+					if led(i) = '1' then
+						count(i) := count(i) + 1;
+					end if;
+				end loop;
+			end loop;
+			high := count;
+		end procedure;
+
+		--Set LED i to level base + i, measure every LED and check each one
+		--against the table and against the level below it
+		procedure check_levels(constant name : in string; constant base : in natural; constant corrected : in boolean) is
+			variable high 		: count_array;
+			variable expected : natural;
+		begin
+			for i in 0 to 3 loop
+				lo(8 * i + 7 downto 8 * i) := std_ulogic_vector(to_unsigned(base + i, 8));
+				hi(8 * i + 7 downto 8 * i) := std_ulogic_vector(to_unsigned(base + 4 + i, 8));
+			end loop;
+			bus_write(BRIGHTNESS_LO_REG, lo);
+			bus_write(BRIGHTNESS_HI_REG, hi);
+			measure(high);
+			for i in 0 to 7 loop
+				level := base + i;
+				expected := expected_duty(level, corrected);
+				assert high(i) = expected
+					report name & ": level " & integer'image(level) & " on LED " & integer'image(i) &
+						" high for " & integer'image(high(i)) & " of 4096, expected " & integer'image(expected)
+					severity error;
+				assert level = 0 or high(i) >= previous
+					report name & ": level " & integer'image(level) & " dimmer than the level below it"
+					severity error;
+				previous := high(i);
+			end loop;
+		end procedure;
+
+	begin
+		wait until falling_edge(clk);
+		wait until falling_edge(clk);
+		rst <= '0';
+
+		--Every LED is at full brightness after reset, so the pattern shows
+		--as it always did
+		bus_write(LED_REG, 16#FF#);
+		measure(high);
+		for i in 0 to 7 loop
+			assert high(i) = PWM_PERIOD
+				report "after reset: LED " & integer'image(i) & " high for " & integer'image(high(i)) & " of 4096"
+				severity error;
+		end loop;
+
+		--The tables themselves: the ends are off and always on, and the
+		--middle of the range is about a fifth as bright with gamma correction
+		assert expected_duty(0, true) = 0 and expected_duty(255, true) = 4096 and expected_duty(128, true) = 899
+			report "gamma table wrong"
+			severity failure;
+		assert expected_duty(0, false) = 0 and expected_duty(255, false) = 4096 and expected_duty(128, false) = 2056
+			report "linear table wrong"
+			severity failure;
+
+		--Every level through the gamma table, eight at a time
+		bus_write(CONTROL_REG, GAMMA);
+		previous := 0;
+		for s in 0 to 31 loop
+			check_levels("gamma", 8 * s, true);
+		end loop;
+
+		--And through the linear table
+		bus_write(CONTROL_REG, 0);
+		previous := 0;
+		for s in 0 to 31 loop
+			check_levels("linear", 8 * s, false);
+		end loop;
+
+		--An LED that is off in the pattern stays dark at any level
+		bus_write(BRIGHTNESS_LO_REG, std_ulogic_vector'(x"FF80FF80"));
+		bus_write(BRIGHTNESS_HI_REG, std_ulogic_vector'(x"FF80FF80"));
+		bus_write(LED_REG, 16#5A#);
+		measure(high);
+		for i in 0 to 7 loop
+			if i = 1 or i = 3 or i = 4 or i = 6 then
+				if i mod 2 = 0 then
+					level := 128;
+				else
+					level := 255;
+				end if;
+				assert high(i) = expected_duty(level, false)
+					report "pattern 0x5A: LED " & integer'image(i) & " high for " & integer'image(high(i))
+					severity error;
+			else
+				assert high(i) = 0
+					report "pattern 0x5A: LED " & integer'image(i) & " is off in the pattern but lit"
+					severity error;
+			end if;
+		end loop;
+
+		report "led_array_gamma_tb: done";
+		done <= true;
+		wait;
+	end process;
+
+end architecture;
@@ -0,0 +1,305 @@
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+-- Testbench for led_array's pattern sequencer. Loads eight frames into the
+-- pattern RAM and reads them back, then plays them in loop, ping-pong and
+-- one-shot mode and logs every change of the LEDs. Checks that the frames
+-- show in the expected order, each for its duration to the clock cycle
+-- (a duration of 0 counts as 1 ms), that the status register follows the
+-- frame being shown, that a one-shot animation stops on its last frame,
+-- that a length of 0 plays the first frame only and one above the
+-- capacity plays every frame, and that clearing the run bit hands the LEDs
+-- back to the led register and setting it again starts from frame 0.
+entity led_array_seq_tb is
+end entity led_array_seq_tb;
+
+architecture led_array_seq_tb_arch of led_array_seq_tb is
+
+	constant CLK_PERIOD : time := 20 ns;
+
+	--Clock cycles per millisecond tick
+	constant TICK : natural := 50000;
+
+	constant SEQ_FRAMES : natural := 8;
+
+	--Register word addresses
+	constant LED_REG : natural := 16#000#;
+	constant SEQ_CONTROL_REG : natural := 16#004#;
+	constant SEQ_LENGTH_REG : natural := 16#005#;
+	constant SEQ_STATUS_REG : natural := 16#006#;
+	constant SEQ_CAPACITY_REG : natural := 16#007#;
+	constant FRAME_REG : natural := 16#200#;
+
+	--SEQ_CONTROL modes
+	constant LOOP_MODE : natural := 0;
+	constant PINGPONG : natural := 1;
+	constant ONESHOT : natural := 2;
+
+	type natural_array is array (natural range <>) of natural;
+
+	--Frame patterns are all different and none is the led register's 0,
+	--so every frame boundary changes the LEDs
+	constant PATTERNS : natural_array(0 to SEQ_FRAMES - 1) :=
+		(16#01#, 16#03#, 16#07#, 16#0F#, 16#1F#, 16#3F#, 16#7F#, 16#FF#);
+	constant DURATIONS : natural_array(0 to SEQ_FRAMES - 1) := (1, 2, 0, 3, 1, 2, 1, 1);
+
+	--Every change of the LEDs, and the clock cycle it was seen in
+	constant LOG_SIZE : natural := 256;
+	type pattern_log is array (0 to LOG_SIZE - 1) of std_ulogic_vector(7 downto 0);
+	type cycle_log is array (0 to LOG_SIZE - 1) of natural;
+
+	signal clk 				: std_ulogic := '0';
+	signal rst 				: std_ulogic := '1';
+	signal avs_read 		: std_ulogic := '0';
+	signal avs_write 		: std_ulogic := '0';
+	signal avs_address 	: std_ulogic_vector(9 downto 0) := (others => '0');
+	signal avs_readdata 	: std_ulogic_vector(31 downto 0);
+	signal avs_writedata : std_ulogic_vector(31 downto 0) := (others => '0');
+	signal led 				: std_ulogic_vector(7 downto 0);
+	signal done 			: boolean := false;
+
+	signal cycle 			: natural := 0;
+	signal shown 			: pattern_log;
+	signal shown_at 		: cycle_log;
+	signal changes 		: natural := 0;
+
+	--A duration of 0 is shown for 1 ms
+	function ms_of(frame : natural) return natural is
+	begin
+		return maximum(DURATIONS(frame), 1);
+	end function;
+
+begin
+
+	DUT : entity work.led_array
+		generic map (
+			PWM_PRESCALE => 1,
+			SEQ_FRAMES => SEQ_FRAMES
+			)
+		port map (
+			clk => clk,
+			rst => rst,
+			avs_read => avs_read,
+			avs_write => avs_write,
+			avs_address => avs_address,
+			avs_readdata => avs_readdata,
+			avs_writedata => avs_writedata,
+			route_led => (others => '0'),
+			route_valid => '0',
+			led => led
+			);
+
+	clk <= not clk after CLK_PERIOD / 2 when not done else '0';
+
+	--Every LED is at full brightness, so the LEDs show the pattern itself
+	LED_MONITOR : process(clk)
+		variable count 	: natural := 0;
+		variable n 			: natural := 0;
+		variable prev 		: std_ulogic_vector(7 downto 0) := (others => '0');
+	begin
+		if rising_edge(clk) then
+			count := count + 1;
+			cycle <= count;
+			if led /= prev and n < LOG_SIZE then
+				shown(n) <= led;
+				shown_at(n) <= count;
+				n := n + 1;
+				changes <= n;
+			end if;
+			prev := led;
+		end if;
+	end process;
+
+	STIMULUS : process
+
+		variable data 		: std_ulogic_vector(31 downto 0);
+		variable seen 		: natural := 0;
+
+		procedure bus_write(constant address : in natural; constant value : in natural) is
+		begin
+			wait until falling_edge(clk);
+			avs_address <= std_ulogic_vector(to_unsigned(address, 10));
+			avs_writedata <= std_ulogic_vector(to_unsigned(value, 32));
+			avs_write <= '1';
+			wait until falling_edge(clk);
+			avs_write <= '0';
+		end procedure;
+
+		--Pattern RAM reads have two wait states; the registers don't mind the
+		--read being held for two cycles too
+		procedure bus_read(constant address : in natural; value : out std_ulogic_vector(31 downto 0)) is
+		begin
+			wait until falling_edge(clk);
+			avs_address <= std_ulogic_vector(to_unsigned(address, 10));
+			avs_read <= '1';
+			wait until falling_edge(clk);
+			wait until falling_edge(clk);
+			avs_read <= '0';
+			value := avs_readdata;
+		end procedure;
+
+		procedure next_change(pattern : out std_ulogic_vector(7 downto 0); at : out natural) is
+		begin
+			if changes <= seen then
+				wait until changes > seen;
+			end if;
+			pattern := shown(seen);
+			at := shown_at(seen);
+			seen := seen + 1;
+		end procedure;
+
+		procedure check_status(constant name : in string; constant index : in natural; constant running : in std_ulogic) is
+		begin
+			bus_read(SEQ_STATUS_REG, data);
+			assert to_integer(unsigned(data(15 downto 0))) = index and data(16) = running
+				report name & ": status shows frame " & integer'image(to_integer(unsigned(data(15 downto 0)))) &
+					", running " & std_ulogic'image(data(16)) & ", expected frame " & integer'image(index) &
+					", running " & std_ulogic'image(running)
+				severity error;
+		end procedure;
+
+		--Play the first length frames and check the frames shown, in order,
+		--and how long each one stays up. Ticks come every millisecond
+		--whatever the sequencer is doing, so only the first frame can be up
+		--to a millisecond short. Until the first frame arrives, for a couple
+		--of clock cycles, the LEDs may still show the last frame of the
+		--previous run.
+		procedure check_order(
+			constant name 		: in string;
+			constant mode 		: in natural;
+			constant length 	: in natural;
+			constant order 	: in natural_array) is
+			variable pattern 	: std_ulogic_vector(7 downto 0);
+			variable at 		: natural;
+			variable start 	: natural;
+			variable prev_at 	: natural;
+			variable expected : natural;
+		begin
+			bus_write(SEQ_LENGTH_REG, length);
+			seen := changes;
+			bus_write(SEQ_CONTROL_REG, 2 * mode + 1);
+			start := cycle;
+			loop
+				next_change(pattern, at);
+				exit when to_integer(unsigned(pattern)) = PATTERNS(order(0));
+				assert at <= start + 4
+					report name & ": pattern " & integer'image(to_integer(unsigned(pattern))) &
+						" before the first frame"
+					severity error;
+			end loop;
+			assert at <= start + 8
+				report name & ": first frame " & integer'image(at - start) & " clock cycles after the run bit"
+				severity error;
+			for k in order'range loop
+				if k > order'low then
+					next_change(pattern, at);
+					assert to_integer(unsigned(pattern)) = PATTERNS(order(k))
+						report name & ": pattern " & integer'image(to_integer(unsigned(pattern))) &
+							" where frame " & integer'image(order(k)) & " should be"
+						severity error;
+					expected := ms_of(order(k - 1)) * TICK;
+					if k = order'low + 1 then
+						assert at - prev_at > expected - TICK and at - prev_at <= expected + 8
+							report name & ": first frame up for " & integer'image(at - prev_at) & " clock cycles"
+							severity error;
+					else
+						assert at - prev_at = expected
+							report name & ": frame " & integer'image(order(k - 1)) & " up for " &
+								integer'image(at - prev_at) & " clock cycles, expected " & integer'image(expected)
+							severity error;
+					end if;
+				end if;
+				prev_at := at;
+				check_status(name, order(k), '1');
+			end loop;
+		end procedure;
+
+		--No frame changes for ms milliseconds
+		procedure check_still(constant name : in string; constant ms : in natural) is
+		begin
+			for i in 1 to ms * TICK loop
+				wait until rising_edge(clk);
+			end loop;
+			assert changes = seen
+				report name & ": the LEDs changed"
+				severity error;
+		end procedure;
+
+		--Clearing the run bit hands the LEDs back to the led register
+		procedure stop(constant name : in string; constant index : in natural) is
+		begin
+			bus_write(SEQ_CONTROL_REG, 0);
+			for i in 1 to 4 loop
+				wait until rising_edge(clk);
+			end loop;
+			assert led = x"00"
+				report name & ": LEDs not back to the led register after stopping"
+				severity error;
+			check_status(name & " stopped", index, '0');
+			seen := changes;
+		end procedure;
+
+	begin
+		wait until falling_edge(clk);
+		wait until falling_edge(clk);
+		rst <= '0';
+
+		--Load the frames and read them back; the capacity is the generic and
+		--words past it read 0
+		bus_read(SEQ_CAPACITY_REG, data);
+		assert to_integer(unsigned(data)) = SEQ_FRAMES
+			report "capacity " & integer'image(to_integer(unsigned(data)))
+			severity error;
+		for i in 0 to SEQ_FRAMES - 1 loop
+			bus_write(FRAME_REG + i, DURATIONS(i) * 2**16 + PATTERNS(i));
+		end loop;
+		for i in 0 to SEQ_FRAMES - 1 loop
+			bus_read(FRAME_REG + i, data);
+			assert to_integer(unsigned(data)) = DURATIONS(i) * 2**16 + PATTERNS(i)
+				report "frame " & integer'image(i) & " reads back wrong"
+				severity error;
+		end loop;
+		bus_read(FRAME_REG + SEQ_FRAMES, data);
+		assert data = x"00000000"
+			report "frame past the capacity reads " & integer'image(to_integer(unsigned(data)))
+			severity error;
+		check_status("idle", 0, '0');
+
+		--Loop back to the first frame after the last; frame 2's duration of
+		--0 is shown for 1 ms
+		check_order("loop", LOOP_MODE, 4, (0, 1, 2, 3, 0, 1, 2, 3, 0));
+		stop("loop", 0);
+
+		--Ping-pong turns round at either end without showing the end frames
+		--twice; setting the run bit again starts from frame 0
+		check_order("ping-pong", PINGPONG, 4, (0, 1, 2, 3, 2, 1, 0, 1, 2, 3, 2));
+		stop("ping-pong", 2);
+		check_order("ping-pong of 2", PINGPONG, 2, (0, 1, 0, 1, 0));
+		stop("ping-pong of 2", 0);
+
+		--One-shot stops on its last frame and leaves it on the LEDs
+		check_order("one-shot", ONESHOT, 3, (0, 1, 2));
+		check_still("one-shot", 4);
+		check_status("one-shot finished", 2, '0');
+		assert to_integer(unsigned(led)) = PATTERNS(2)
+			report "one-shot: last frame not left on the LEDs"
+			severity error;
+		stop("one-shot", 2);
+
+		--A length of 0 plays the first frame only
+		check_order("length 0", LOOP_MODE, 0, (0 => 0));
+		check_still("length 0", 4);
+		check_status("length 0", 0, '1');
+		stop("length 0", 0);
+
+		--A length above the capacity plays every frame in the RAM
+		check_order("length 100", LOOP_MODE, 100, (0, 1, 2, 3, 4, 5, 6, 7, 0, 1));
+		stop("length 100", 1);
+
+		report "led_array_seq_tb: done";
+		done <= true;
+		wait;
+	end process;
+
+end architecture;
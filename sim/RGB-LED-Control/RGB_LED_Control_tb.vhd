@@ -0,0 +1,319 @@
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+-- Testbench for RGB_LED_Control's period-boundary updates. Measures every
+-- PWM period on the red output and checks that each one is entirely the old
+-- or entirely the new setting: never cut short, stretched, mixed or split
+-- into two pulses. Changes land at several points in a period, including
+-- the clock cycle in which period_end is high. Without double buffering a
+-- duty cycle write is checked the same way. With double buffering, shadow
+-- writes must not leak out without a commit, and a commit must switch over
+-- at the expected period boundary.
+entity RGB_LED_Control_tb is
+end entity RGB_LED_Control_tb;
+
+architecture RGB_LED_Control_tb_arch of RGB_LED_Control_tb is
+
+	constant CLK_PERIOD : time := 20 ns;
+
+	--Register word addresses
+	constant PERIOD_REG : natural := 0;
+	constant RED_REG : natural := 1;
+	constant GREEN_REG : natural := 2;
+	constant BLUE_REG : natural := 3;
+	constant CONTROL_REG : natural := 4;
+
+	--CONTROL bits
+	constant COMMIT : natural := 1;
+	constant DOUBLE_BUFFER : natural := 2;
+
+	--Periods (6.26 ms) of exactly 3125 and 6250 clock cycles, and duty
+	--cycles (1.19) of 1/2, 3/4 and 1/8
+	constant PERIOD_A : natural := 2**22;
+	constant PERIOD_B : natural := 2**23;
+	constant DUTY_A : natural := 2**18;
+	constant DUTY_B : natural := 3 * 2**17;
+	constant DUTY_C : natural := 2**16;
+
+	--The controller counts from 0 to the period count, and the output is
+	--high until the count passes the duty count, so both take one more
+	--clock cycle than their counts
+	function period_cycles(period : natural) return natural is
+	begin
+		return to_integer(shift_right(to_unsigned(period, 32) * to_unsigned(50000, 16), 26));
+	end function;
+
+	function length_of(period : natural) return natural is
+	begin
+		return period_cycles(period) + 1;
+	end function;
+
+	function high_of(period : natural; duty : natural) return natural is
+		variable count : natural;
+	begin
+		count := to_integer(shift_right(to_unsigned(duty, 20) * to_unsigned(period_cycles(period), 32), 19));
+		return minimum(count, period_cycles(period)) + 1;
+	end function;
+
+	constant LENGTH_A : natural := length_of(PERIOD_A);
+	constant HIGH_A : natural := high_of(PERIOD_A, DUTY_A);
+	constant LENGTH_B : natural := length_of(PERIOD_B);
+	constant HIGH_B : natural := high_of(PERIOD_B, DUTY_B);
+	constant HIGH_C : natural := high_of(PERIOD_A, DUTY_C);
+
+	--Where in a period (clock cycles after the output goes high) a change
+	--lands; LENGTH_A is the cycle in which period_end is high
+	type offset_array is array (natural range <>) of positive;
+	constant OFFSETS : offset_array := (1, HIGH_A - 1, HIGH_A, 2000, LENGTH_A - 1, LENGTH_A);
+
+	signal clk 				: std_ulogic := '0';
+	signal rst 				: std_ulogic := '1';
+	signal avs_read 		: std_ulogic := '0';
+	signal avs_write 		: std_ulogic := '0';
+	signal avs_address 	: std_ulogic_vector(2 downto 0) := (others => '0');
+	signal avs_readdata 	: std_ulogic_vector(31 downto 0);
+	signal avs_writedata : std_ulogic_vector(31 downto 0) := (others => '0');
+	signal red_out 		: std_ulogic;
+	signal green_out 		: std_ulogic;
+	signal blue_out 		: std_ulogic;
+	signal done 			: boolean := false;
+
+	--Length and high time of the last complete period on red_out, and how
+	--many periods have completed
+	signal last_length 	: natural := 0;
+	signal last_high 		: natural := 0;
+	signal periods 		: natural := 0;
+
+begin
+
+	DUT : entity work.RGB_LED_Control
+		port map (
+			clk => clk,
+			rst => rst,
+			avs_read => avs_read,
+			avs_write => avs_write,
+			avs_address => avs_address,
+			avs_readdata => avs_readdata,
+			avs_writedata => avs_writedata,
+			route_red => (others => '0'),
+			route_green => (others => '0'),
+			route_blue => (others => '0'),
+			route_valid => "000",
+			red_out => red_out,
+			blue_out => blue_out,
+			green_out => green_out
+			);
+
+	clk <= not clk after CLK_PERIOD / 2 when not done else '0';
+
+	--A period runs from one rising edge of the output to the next
+	PERIOD_MONITOR : process(clk)
+		variable prev 		: std_ulogic := '0';
+		variable length 	: natural := 0;
+		variable high 		: natural := 0;
+	begin
+		if rising_edge(clk) then
+			if red_out = '1' and prev = '0' then
+				if length > 0 then
+					last_length <= length;
+					last_high <= high;
+					periods <= periods + 1;
+				end if;
+				length := 0;
+				high := 0;
+			end if;
+			length := length + 1;
+			if red_out = '1' then
+				high := high + 1;
+			end if;
+			prev := red_out;
+		end if;
+	end process;
+
+	STIMULUS : process
+
+		variable data 		: std_ulogic_vector(31 downto 0);
+		variable length 	: natural;
+		variable high 		: natural;
+		variable old_count : natural;
+
+		procedure bus_write(constant address : in natural; constant value : in natural) is
+		begin
+			wait until falling_edge(clk);
+			avs_address <= std_ulogic_vector(to_unsigned(address, 3));
+			avs_writedata <= std_ulogic_vector(to_unsigned(value, 32));
+			avs_write <= '1';
+			wait until falling_edge(clk);
+			avs_write <= '0';
+		end procedure;
+
+		procedure bus_read(constant address : in natural; value : out std_ulogic_vector(31 downto 0)) is
+		begin
+			wait until falling_edge(clk);
+			avs_address <= std_ulogic_vector(to_unsigned(address, 3));
+			avs_read <= '1';
+			wait until falling_edge(clk);
+			avs_read <= '0';
+			value := avs_readdata;
+		end procedure;
+
+		--Write a register so the write is seen offset clock edges after the
+		--one that started the current period
+		procedure write_at(constant offset : in positive; constant address : in natural; constant value : in natural) is
+		begin
+			wait until rising_edge(red_out);
+			for i in 1 to offset loop
+				wait until falling_edge(clk);
+			end loop;
+			avs_address <= std_ulogic_vector(to_unsigned(address, 3));
+			avs_writedata <= std_ulogic_vector(to_unsigned(value, 32));
+			avs_write <= '1';
+			wait until falling_edge(clk);
+			avs_write <= '0';
+		end procedure;
+
+		procedure next_period(length : out natural; high : out natural) is
+		begin
+			wait on periods;
+			length := last_length;
+			high := last_high;
+		end procedure;
+
+		--Periods that complete after a change, starting with the one in
+		--progress: each must be the old or the new setting, the old ones all
+		--come first, and there must be exactly old_periods of them
+		procedure check_switch(
+			constant name 			: in string;
+			constant old_length 	: in natural;
+			constant old_high 	: in natural;
+			constant new_length 	: in natural;
+			constant new_high 	: in natural;
+			constant old_periods : in natural) is
+			variable length 	: natural;
+			variable high 		: natural;
+			variable old_seen : natural := 0;
+			variable new_seen : natural := 0;
+		begin
+			while new_seen < 2 loop
+				next_period(length, high);
+				if length = new_length and high = new_high then
+					new_seen := new_seen + 1;
+				elsif length = old_length and high = old_high and new_seen = 0 then
+					old_seen := old_seen + 1;
+				else
+					report name & ": period of " & integer'image(length) & " clock cycles, high for " &
+						integer'image(high) & ", after " & integer'image(old_seen) & " old and " &
+						integer'image(new_seen) & " new periods"
+						severity error;
+					new_seen := new_seen + 1;
+				end if;
+				assert old_seen <= old_periods
+					report name & ": still the old setting after " & integer'image(old_seen) & " periods"
+					severity error;
+				exit when old_seen > old_periods;
+			end loop;
+			assert old_seen = old_periods
+				report name & ": switched after " & integer'image(old_seen) & " periods, expected " &
+					integer'image(old_periods)
+				severity error;
+		end procedure;
+
+	begin
+		assert LENGTH_A = 3126 and HIGH_A = 1563 and LENGTH_B = 6251 and HIGH_B = 4688 and HIGH_C = 391
+			report "expected period lengths wrong"
+			severity failure;
+
+		wait until falling_edge(clk);
+		wait until falling_edge(clk);
+		rst <= '0';
+
+		bus_write(PERIOD_REG, PERIOD_A);
+		bus_write(RED_REG, DUTY_A);
+		bus_write(GREEN_REG, DUTY_C);
+		bus_write(BLUE_REG, DUTY_B);
+		for i in 1 to 4 loop
+			next_period(length, high);
+		end loop;
+		assert length = LENGTH_A and high = HIGH_A
+			report "setting A: period of " & integer'image(length) & " clock cycles, high for " &
+				integer'image(high)
+			severity error;
+
+		--Without double buffering a duty cycle write reaches the controller
+		--right away and never disturbs the period it lands in. The new counts
+		--take 6 clock cycles, so a write closer than that to the end of the
+		--period is used from the period after the next one.
+		for i in OFFSETS'range loop
+			if OFFSETS(i) <= LENGTH_A - 7 then
+				old_count := 1;
+			else
+				old_count := 2;
+			end if;
+			write_at(OFFSETS(i), RED_REG, DUTY_C);
+			check_switch("direct to C, offset " & integer'image(OFFSETS(i)),
+				LENGTH_A, HIGH_A, LENGTH_A, HIGH_C, old_count);
+			write_at(OFFSETS(i), RED_REG, DUTY_A);
+			check_switch("direct to A, offset " & integer'image(OFFSETS(i)),
+				LENGTH_A, HIGH_C, LENGTH_A, HIGH_A, old_count);
+		end loop;
+
+		--With double buffering, shadow writes spread over two periods change
+		--nothing until they are committed
+		bus_write(CONTROL_REG, DOUBLE_BUFFER);
+		write_at(100, PERIOD_REG, PERIOD_B);
+		write_at(LENGTH_A, RED_REG, DUTY_B);
+		for i in 1 to 3 loop
+			next_period(length, high);
+			assert length = LENGTH_A and high = HIGH_A
+				report "uncommitted shadow writes: period of " & integer'image(length) &
+					" clock cycles, high for " & integer'image(high)
+				severity error;
+		end loop;
+		bus_read(CONTROL_REG, data);
+		assert data(0) = '0' and data(1) = '1'
+			report "control register wrong before the commit"
+			severity error;
+
+		--A commit moves the period and duty cycle over together at the next
+		--period boundary, or the one after if it lands as the period ends;
+		--the controller uses them from the following period
+		for i in OFFSETS'range loop
+			write_at(OFFSETS(i), CONTROL_REG, DOUBLE_BUFFER + COMMIT);
+			--Leave the read out where it would still be running as the
+			--period in progress completes
+			if OFFSETS(i) < LENGTH_A - 2 then
+				bus_read(CONTROL_REG, data);
+				assert data(0) = '1'
+					report "commit not pending, offset " & integer'image(OFFSETS(i))
+					severity error;
+			end if;
+			if OFFSETS(i) < LENGTH_A then
+				old_count := 2;
+			else
+				old_count := 3;
+			end if;
+			check_switch("commit to B, offset " & integer'image(OFFSETS(i)),
+				LENGTH_A, HIGH_A, LENGTH_B, HIGH_B, old_count);
+			bus_read(CONTROL_REG, data);
+			assert data(0) = '0'
+				report "commit still pending, offset " & integer'image(OFFSETS(i))
+				severity error;
+
+			--Back to A; the shadow writes land in a B period and the commit at
+			--the same offset into one
+			write_at(OFFSETS(i), PERIOD_REG, PERIOD_A);
+			write_at(OFFSETS(i), RED_REG, DUTY_A);
+			write_at(OFFSETS(i), CONTROL_REG, DOUBLE_BUFFER + COMMIT);
+			check_switch("commit to A, offset " & integer'image(OFFSETS(i)),
+				LENGTH_B, HIGH_B, LENGTH_A, HIGH_A, 2);
+			bus_write(PERIOD_REG, PERIOD_B);
+			bus_write(RED_REG, DUTY_B);
+		end loop;
+
+		report "RGB_LED_Control_tb: done";
+		done <= true;
+		wait;
+	end process;
+
+end architecture;
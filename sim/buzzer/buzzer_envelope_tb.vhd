@@ -0,0 +1,417 @@
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+-- Testbench for buzzer_envelope. Checks the level step the serial divider
+-- works out for attack times that do and don't divide 2**32 - 1, then the
+-- time each envelope stage takes against attack_us, decay_us and release_us
+-- (including a decay to a high sustain level, a retrigger during the release
+-- and a release from the middle of the attack) and the sustained volume.
+-- With the envelope off and both LFO depths 0 the inputs must pass straight
+-- through; with a depth set the tremolo and vibrato must swing by the depth.
+entity buzzer_envelope_tb is
+end entity buzzer_envelope_tb;
+
+architecture buzzer_envelope_tb_arch of buzzer_envelope_tb is
+
+	constant CLK_PERIOD : time := 20 ns;
+	--Clock cycles per level step
+	constant TICK_CYCLES : natural := 50;
+
+	constant FULL : unsigned(32 downto 0) := '0' & x"FFFFFFFF";
+	constant TWO_32 : unsigned(32 downto 0) := '1' & x"00000000";
+
+	constant IDLE : std_ulogic_vector(2 downto 0) := "000";
+	constant ATTACK : std_ulogic_vector(2 downto 0) := "001";
+	constant DECAY : std_ulogic_vector(2 downto 0) := "010";
+	constant SUSTAINING : std_ulogic_vector(2 downto 0) := "011";
+	constant RELEASE : std_ulogic_vector(2 downto 0) := "100";
+
+	--Sustain levels (1.19) of 1/2 and 0.9
+	constant SUSTAIN_HALF : natural := 2**18;
+	constant SUSTAIN_HIGH : natural := 471859;
+
+	--Attack times for the divider check; 3, 255 and 65537 divide 2**32 - 1,
+	--the others don't
+	type time_array is array (natural range <>) of natural;
+	constant STEP_TIMES : time_array := (0, 1, 3, 7, 37, 255, 1000, 65537, 1000000);
+
+	--LFO at 1 kHz
+	constant LFO_FTW : natural := 85899;
+
+	signal clk 					: std_ulogic := '0';
+	signal rst 					: std_ulogic := '1';
+	signal enable 				: std_ulogic := '0';
+	signal gate 				: std_ulogic := '0';
+	signal attack_us 			: std_ulogic_vector(31 downto 0) := (others => '0');
+	signal decay_us 			: std_ulogic_vector(31 downto 0) := (others => '0');
+	signal sustain 			: std_ulogic_vector(19 downto 0) := (others => '0');
+	signal release_us 		: std_ulogic_vector(31 downto 0) := (others => '0');
+	signal lfo_ftw 			: std_ulogic_vector(31 downto 0) := (others => '0');
+	signal lfo_duty_depth 	: std_ulogic_vector(15 downto 0) := (others => '0');
+	signal lfo_pitch_depth 	: std_ulogic_vector(15 downto 0) := (others => '0');
+	signal volume_in 			: std_ulogic_vector(19 downto 0) := (others => '0');
+	signal pitch_in 			: std_ulogic_vector(31 downto 0) := (others => '0');
+	signal ftw_in 				: std_ulogic_vector(31 downto 0) := (others => '0');
+	signal volume_out 		: std_ulogic_vector(19 downto 0);
+	signal pitch_out 			: std_ulogic_vector(31 downto 0);
+	signal ftw_out 			: std_ulogic_vector(31 downto 0);
+	signal state 				: std_ulogic_vector(2 downto 0);
+	signal level 				: std_ulogic_vector(31 downto 0);
+	signal done 				: boolean := false;
+
+	--The divider's step for a time: (2**32 - 1) / time, all ones for 0
+	function step_of(t : natural) return unsigned is
+	begin
+		if t = 0 then
+			return FULL;
+		end if;
+		return resize(FULL / to_unsigned(t, 33), 33);
+	end function;
+
+	--Steps needed to cover a distance, at least one
+	function steps(distance : unsigned(32 downto 0); step : unsigned(32 downto 0)) return natural is
+		variable n : unsigned(33 downto 0);
+	begin
+		n := (resize(distance, 34) + step - 1) / resize(step, 34);
+		if n = 0 then
+			return 1;
+		end if;
+		return to_integer(n);
+	end function;
+
+	function sustain_level(s : natural) return unsigned is
+	begin
+		if s >= 2**19 then
+			return FULL;
+		end if;
+		return resize(shift_left(to_unsigned(s, 33), 13), 33);
+	end function;
+
+begin
+
+	DUT : entity work.buzzer_envelope
+		generic map (
+			CLK_PERIOD => CLK_PERIOD
+			)
+		port map (
+			clk => clk,
+			rst => rst,
+			enable => enable,
+			gate => gate,
+			attack_us => attack_us,
+			decay_us => decay_us,
+			sustain => sustain,
+			release_us => release_us,
+			lfo_ftw => lfo_ftw,
+			lfo_duty_depth => lfo_duty_depth,
+			lfo_pitch_depth => lfo_pitch_depth,
+			volume_in => volume_in,
+			pitch_in => pitch_in,
+			ftw_in => ftw_in,
+			volume_out => volume_out,
+			pitch_out => pitch_out,
+			ftw_out => ftw_out,
+			state => state,
+			level => level
+			);
+
+	clk <= not clk after CLK_PERIOD / 2 when not done else '0';
+
+	STIMULUS : process
+
+		variable t0 		: time;
+		variable cycles 	: natural;
+		variable n 			: natural;
+		variable start 	: unsigned(32 downto 0);
+		variable prev 		: unsigned(32 downto 0);
+		variable delta 	: unsigned(32 downto 0);
+		variable expected : natural;
+		variable lo 		: natural;
+		variable hi 		: natural;
+		variable vol 		: natural;
+		variable pitch 	: natural;
+		variable ftw 		: natural;
+
+		procedure wait_cycles(constant n : in natural) is
+		begin
+			for i in 1 to n loop
+				wait until falling_edge(clk);
+			end loop;
+		end procedure;
+
+		--Set the times and give the divider a full round (3 * 33 cycles)
+		procedure set_times(constant a : in natural; constant d : in natural; constant r : in natural) is
+		begin
+			wait until falling_edge(clk);
+			attack_us <= std_ulogic_vector(to_unsigned(a, 32));
+			decay_us <= std_ulogic_vector(to_unsigned(d, 32));
+			release_us <= std_ulogic_vector(to_unsigned(r, 32));
+			wait_cycles(2 * 3 * 33);
+		end procedure;
+
+		procedure set_gate(constant value : in std_ulogic) is
+		begin
+			wait until falling_edge(clk);
+			gate <= value;
+		end procedure;
+
+		--Wait for the envelope to enter a stage and return how many clock
+		--cycles that took from t0
+		procedure wait_state(constant name : in string; constant s : in std_ulogic_vector(2 downto 0);
+			constant timeout : in time; cycles : out natural) is
+		begin
+			if state /= s then
+				wait until state = s for timeout;
+			end if;
+			assert state = s
+				report name & ": stage " & integer'image(to_integer(unsigned(s))) & " not reached"
+				severity error;
+			cycles := (now - t0) / CLK_PERIOD;
+		end procedure;
+
+		--A stage that started on a gate change (not a step) takes between
+		--n - 1 and n steps' worth of clock cycles; one that started on a step
+		--takes exactly n
+		procedure check_stage(constant name : in string; constant cycles : in natural;
+			constant n : in natural; constant on_step : in boolean) is
+		begin
+			if on_step then
+				assert cycles = n * TICK_CYCLES
+					report name & ": " & integer'image(cycles) & " clock cycles, expected " &
+						integer'image(n) & " steps"
+					severity error;
+			else
+				assert cycles > (n - 1) * TICK_CYCLES and cycles <= n * TICK_CYCLES
+					report name & ": " & integer'image(cycles) & " clock cycles, expected " &
+						integer'image(n) & " steps"
+					severity error;
+			end if;
+		end procedure;
+
+		procedure check_equal(constant name : in string; constant value : in std_ulogic_vector;
+			constant expected : in std_ulogic_vector) is
+		begin
+			assert value = expected
+				report name & ": " & integer'image(to_integer(unsigned(value))) & ", expected " &
+					integer'image(to_integer(unsigned(expected)))
+				severity error;
+		end procedure;
+
+		procedure envelope_off is
+		begin
+			wait until falling_edge(clk);
+			gate <= '0';
+			enable <= '0';
+			wait until falling_edge(clk);
+			assert state = IDLE and unsigned(level) = 0
+				report "envelope didn't stop"
+				severity error;
+			enable <= '1';
+		end procedure;
+
+	begin
+		wait until falling_edge(clk);
+		wait until falling_edge(clk);
+		rst <= '0';
+
+		volume_in <= std_ulogic_vector(to_unsigned(400000, 20));
+		pitch_in <= std_ulogic_vector(to_unsigned(2**26, 32));
+		ftw_in <= std_ulogic_vector(to_unsigned(37796, 32));
+		lfo_ftw <= std_ulogic_vector(to_unsigned(LFO_FTW, 32));
+
+		--Bypass: envelope off and both depths 0, so the inputs pass straight
+		--through in the same cycle
+		wait_cycles(3);
+		for i in 1 to 5 loop
+			volume_in <= std_ulogic_vector(to_unsigned(1000 + 77777 * i, 20));
+			pitch_in <= std_ulogic_vector(to_unsigned(12345 * i, 32));
+			ftw_in <= std_ulogic_vector(to_unsigned(54321 * i, 32));
+			wait for 1 ns;
+			check_equal("bypass volume", volume_out, volume_in);
+			check_equal("bypass pitch", pitch_out, pitch_in);
+			check_equal("bypass ftw", ftw_out, ftw_in);
+			wait_cycles(i * 7);
+		end loop;
+
+		--The step the serial divider works out for each attack time
+		enable <= '1';
+		sustain <= std_ulogic_vector(to_unsigned(SUSTAIN_HALF, 20));
+		for i in STEP_TIMES'range loop
+			set_times(STEP_TIMES(i), 100, 100);
+			set_gate('1');
+			wait until state = ATTACK;
+			wait on level for 2 us;
+			prev := resize(unsigned(level), 33);
+			wait on level for 2 us;
+			delta := resize(unsigned(level), 33) - prev;
+			if STEP_TIMES(i) <= 1 then
+				--one step takes the level to full
+				assert prev = FULL
+					report "attack of " & integer'image(STEP_TIMES(i)) & " us: first step not to full"
+					severity error;
+			else
+				assert delta = step_of(STEP_TIMES(i))
+					report "attack of " & integer'image(STEP_TIMES(i)) & " us: step of " &
+						to_hstring(delta) & ", expected " & to_hstring(step_of(STEP_TIMES(i)))
+					severity error;
+			end if;
+			envelope_off;
+		end loop;
+
+		--A full envelope: attack, decay to half, sustain, release
+		set_times(200, 300, 500);
+		volume_in <= std_ulogic_vector(to_unsigned(400000, 20));
+		set_gate('1');
+		t0 := now;
+		wait_state("attack", ATTACK, 1 us, cycles);
+		t0 := now;
+		wait_state("attack", DECAY, 300 us, cycles);
+		check_stage("attack 200 us", cycles, steps(TWO_32, step_of(200)), false);
+		assert unsigned(level) = FULL(31 downto 0)
+			report "attack didn't end at full"
+			severity error;
+		t0 := now;
+		wait_state("decay", SUSTAINING, 400 us, cycles);
+		check_stage("decay 300 us to 1/2", cycles,
+			steps(FULL - sustain_level(SUSTAIN_HALF), step_of(300)), true);
+		assert unsigned(level) = sustain_level(SUSTAIN_HALF)(31 downto 0)
+			report "sustain level wrong"
+			severity error;
+
+		--The sustained volume is the volume scaled by the level
+		wait for 5 us;
+		expected := to_integer(shift_right(to_unsigned(400000, 20) * sustain_level(SUSTAIN_HALF)(31 downto 16), 16));
+		assert to_integer(unsigned(volume_out)) = expected
+			report "sustained volume " & integer'image(to_integer(unsigned(volume_out))) &
+				", expected " & integer'image(expected)
+			severity error;
+
+		set_gate('0');
+		t0 := now;
+		wait_state("release", RELEASE, 1 us, cycles);
+		start := resize(unsigned(level), 33);
+		wait_state("release", IDLE, 600 us, cycles);
+		check_stage("release 500 us from 1/2", cycles, steps(start, step_of(500)), false);
+		wait for 5 us;
+		assert unsigned(volume_out) = 0
+			report "volume not 0 after the release"
+			severity error;
+
+		--A decay to a high sustain level is shorter than the decay time
+		sustain <= std_ulogic_vector(to_unsigned(SUSTAIN_HIGH, 20));
+		set_times(37, 300, 500);
+		set_gate('1');
+		wait_state("attack 37 us", DECAY, 100 us, cycles);
+		t0 := now;
+		wait_state("decay to 0.9", SUSTAINING, 400 us, cycles);
+		n := steps(FULL - sustain_level(SUSTAIN_HIGH), step_of(300));
+		check_stage("decay 300 us to 0.9", cycles, n, true);
+		assert n < 300
+			report "decay to 0.9 not shorter than the decay time"
+			severity error;
+
+		--Retrigger in the middle of the release: the attack restarts from
+		--the current level
+		set_gate('0');
+		wait_state("release", RELEASE, 1 us, cycles);
+		wait for 100 us;
+		set_gate('1');
+		t0 := now;
+		wait_state("retrigger", ATTACK, 1 us, cycles);
+		start := resize(unsigned(level), 33);
+		assert start > 0 and start < sustain_level(SUSTAIN_HIGH)
+			report "retrigger didn't start from the release level"
+			severity error;
+		t0 := now;
+		wait_state("retrigger", DECAY, 100 us, cycles);
+		check_stage("retriggered attack", cycles, steps(TWO_32 - start, step_of(37)), false);
+
+		--Release from the middle of a slow attack
+		envelope_off;
+		set_times(1000, 300, 250);
+		set_gate('1');
+		wait for 400 us;
+		set_gate('0');
+		t0 := now;
+		wait_state("early release", RELEASE, 1 us, cycles);
+		start := resize(unsigned(level), 33);
+		wait_state("early release", IDLE, 300 us, cycles);
+		check_stage("release 250 us from the attack", cycles, steps(start, step_of(250)), false);
+
+		--Tremolo with the envelope off: the volume is no longer bypassed and
+		--swings between the volume and half of it
+		enable <= '0';
+		gate <= '0';
+		volume_in <= std_ulogic_vector(to_unsigned(400000, 20));
+		pitch_in <= std_ulogic_vector(to_unsigned(1000000, 32));
+		ftw_in <= std_ulogic_vector(to_unsigned(2000000, 32));
+		lfo_duty_depth <= x"8000";
+		wait for 5 us;
+		lo := 2**20;
+		hi := 0;
+		for i in 1 to 2000 loop
+			wait until rising_edge(clk);
+			vol := to_integer(unsigned(volume_out));
+			lo := minimum(lo, vol);
+			hi := maximum(hi, vol);
+			check_equal("tremolo pitch", pitch_out, pitch_in);
+			wait_cycles(TICK_CYCLES - 1);
+		end loop;
+		assert lo >= 196000 and lo <= 202000 and hi >= 396000 and hi <= 400000
+			report "tremolo: volume from " & integer'image(lo) & " to " & integer'image(hi) &
+				", expected 200000 to 400000"
+			severity error;
+
+		--Vibrato: a quarter depth moves the pitch and tuning word up and down
+		--by a quarter
+		lfo_duty_depth <= x"0000";
+		lfo_pitch_depth <= x"4000";
+		wait for 5 us;
+		lo := 2**30;
+		hi := 0;
+		for i in 1 to 2000 loop
+			wait until rising_edge(clk);
+			pitch := to_integer(unsigned(pitch_out));
+			ftw := to_integer(unsigned(ftw_out));
+			lo := minimum(lo, pitch);
+			hi := maximum(hi, pitch);
+			assert ftw >= 2 * pitch - 4 and ftw <= 2 * pitch + 4
+				report "vibrato: tuning word " & integer'image(ftw) & " doesn't follow pitch " &
+					integer'image(pitch)
+				severity error;
+			check_equal("vibrato volume", volume_out, volume_in);
+			wait_cycles(TICK_CYCLES - 1);
+		end loop;
+		assert lo >= 747000 and lo <= 753000 and hi >= 1247000 and hi <= 1253000
+			report "vibrato: pitch from " & integer'image(lo) & " to " & integer'image(hi) &
+				", expected 750000 to 1250000"
+			severity error;
+
+		--The modulated outputs only change once a microsecond
+		n := 0;
+		pitch := to_integer(unsigned(pitch_out));
+		for i in 1 to 20 * TICK_CYCLES loop
+			wait until falling_edge(clk);
+			if to_integer(unsigned(pitch_out)) /= pitch then
+				n := n + 1;
+				pitch := to_integer(unsigned(pitch_out));
+			end if;
+		end loop;
+		assert n >= 15 and n <= 21
+			report "vibrato: pitch changed " & integer'image(n) & " times in 20 us"
+			severity error;
+
+		--Both depths back to 0 bypasses again right away
+		lfo_pitch_depth <= x"0000";
+		pitch_in <= std_ulogic_vector(to_unsigned(3333333, 32));
+		wait for 1 ns;
+		check_equal("bypass again pitch", pitch_out, pitch_in);
+		check_equal("bypass again volume", volume_out, volume_in);
+
+		report "buzzer_envelope_tb: done";
+		done <= true;
+		wait;
+	end process;
+
+end architecture;
@@ -0,0 +1,227 @@
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+-- Testbench for buzzer's voice mixer. Plays one, two and three mixer voices
+-- and the main tone through the sigma-delta mixer and checks the density of
+-- ones on the output against the mix, and the tone content: the output is
+-- correlated with square waves (in phase and a quarter period later) at
+-- each voice's period, which must find every voice that is playing at its
+-- level and nothing at a period no voice plays. Also checks that a volume
+-- of 0 silences a voice and that with the mix bit clear the main tone plays
+-- alone.
+entity buzzer_mix_tb is
+end entity buzzer_mix_tb;
+
+architecture buzzer_mix_tb_arch of buzzer_mix_tb is
+
+	constant CLK_PERIOD : time := 20 ns;
+
+	constant NUM_VOICES : natural := 4;
+
+	--Register word addresses
+	constant VOLUME_REG : natural := 16#00#;
+	constant CONTROL_REG : natural := 16#02#;
+	constant FTW_REG : natural := 16#03#;
+
+	--CONTROL bits
+	constant DDS : natural := 16#04#;
+	constant MIX : natural := 16#20#;
+
+	--Square wave periods in clock cycles: voices 1 to 3 and the main tone
+	--play 512, 1024, 2048 and 4096; no voice plays 768 or any harmonic that
+	--a square wave at 768 correlates with
+	type natural_array is array (natural range <>) of natural;
+	constant PROBES : natural_array(0 to 4) := (512, 768, 1024, 2048, 4096);
+
+	--Clock cycles measured, a whole number of every probe's period, and
+	--cycles left for the mix to settle after a change
+	constant WINDOW : natural := 24576;
+	constant SETTLE : natural := 4096;
+
+	signal clk 				: std_ulogic := '0';
+	signal rst 				: std_ulogic := '1';
+	signal avs_read 		: std_ulogic := '0';
+	signal avs_write 		: std_ulogic := '0';
+	signal avs_address 	: std_ulogic_vector(5 downto 0) := (others => '0');
+	signal avs_readdata 	: std_ulogic_vector(31 downto 0);
+	signal avs_writedata : std_ulogic_vector(31 downto 0) := (others => '0');
+	signal irq 				: std_ulogic;
+	signal buzzer_out 	: std_ulogic;
+	signal done 			: boolean := false;
+
+	function voice_ftw_reg(v : natural) return natural is
+	begin
+		return 16#10# + 2 * v;
+	end function;
+
+	function voice_vol_reg(v : natural) return natural is
+	begin
+		return 16#11# + 2 * v;
+	end function;
+
+	--Tuning word of a square wave period that divides 2**32
+	function ftw_of(period : natural) return natural is
+	begin
+		return 2**30 / (period / 4);
+	end function;
+
+begin
+
+	DUT : entity work.buzzer
+		generic map (
+			NUM_VOICES => NUM_VOICES
+			)
+		port map (
+			clk => clk,
+			rst => rst,
+			avs_read => avs_read,
+			avs_write => avs_write,
+			avs_address => avs_address,
+			avs_readdata => avs_readdata,
+			avs_writedata => avs_writedata,
+			route_volume => (others => '0'),
+			route_pitch => (others => '0'),
+			route_valid => "00",
+			irq => irq,
+			buzzer_out => buzzer_out
+			);
+
+	clk <= not clk after CLK_PERIOD / 2 when not done else '0';
+
+	STIMULUS : process
+
+		variable ones 	: natural;
+		variable mag 	: natural_array(PROBES'range);
+
+		procedure bus_write(constant address : in natural; constant value : in natural) is
+		begin
+			wait until falling_edge(clk);
+			avs_address <= std_ulogic_vector(to_unsigned(address, 6));
+			avs_writedata <= std_ulogic_vector(to_unsigned(value, 32));
+			avs_write <= '1';
+			wait until falling_edge(clk);
+			avs_write <= '0';
+		end procedure;
+
+		--Let the mix settle, then count the ones in a window and correlate
+		--the output with a square wave at each probe period. The in phase
+		--and quarter period sums add up to half the window times the level
+		--of a voice at that period, whatever its phase.
+		procedure measure(ones : out natural; mag : out natural_array) is
+			variable i_sum : integer_vector(PROBES'range) := (others => 0);
+			variable q_sum : integer_vector(PROBES'range) := (others => 0);
+			variable n 		: natural := 0;
+			variable p 		: natural;
+		begin
+			for i in 1 to SETTLE loop
+				wait until rising_edge(clk);
+			end loop;
+			for j in 0 to WINDOW - 1 loop
+				wait until rising_edge(clk);
+				if buzzer_out = '1' then
+					n := n + 1;
+					for k in PROBES'range loop
+						p := PROBES(k);
+						if j mod p < p / 2 then
+							i_sum(k) := i_sum(k) + 1;
+						else
+							i_sum(k) := i_sum(k) - 1;
+						end if;
+						if (j + p / 4) mod p < p / 2 then
+							q_sum(k) := q_sum(k) + 1;
+						else
+							q_sum(k) := q_sum(k) - 1;
+						end if;
+					end loop;
+				end if;
+			end loop;
+			ones := n;
+			for k in PROBES'range loop
+				mag(k) := abs(i_sum(k)) + abs(q_sum(k));
+			end loop;
+		end procedure;
+
+		procedure check(
+			constant name 		: in string;
+			constant ones 		: in natural;
+			constant mag 		: in natural_array;
+			constant levels 	: in natural_array) is
+			variable expected : natural;
+			variable total 	: natural := 0;
+		begin
+			for k in PROBES'range loop
+				--levels are in 1/64ths of the full scale
+				expected := WINDOW / 2 * levels(k) / 64;
+				total := total + levels(k);
+				if levels(k) = 0 then
+					assert mag(k) <= WINDOW / 160
+						report name & ": " & integer'image(mag(k)) & " at period " &
+							integer'image(PROBES(k)) & ", expected nothing"
+						severity error;
+				else
+					assert mag(k) >= expected - expected / 10 and mag(k) <= expected + expected / 10
+						report name & ": " & integer'image(mag(k)) & " at period " &
+							integer'image(PROBES(k)) & ", expected " & integer'image(expected)
+						severity error;
+				end if;
+			end loop;
+			--each square wave is high half the time
+			expected := WINDOW / 2 * total / 64;
+			assert ones + 4 >= expected and ones <= expected + 4
+				report name & ": " & integer'image(ones) & " ones, expected " & integer'image(expected)
+				severity error;
+		end procedure;
+
+	begin
+		wait until falling_edge(clk);
+		wait until falling_edge(clk);
+		rst <= '0';
+
+		--The main tone is a DDS square wave at 4096 clock cycles, silent
+		--until its volume is set
+		bus_write(FTW_REG, ftw_of(4096));
+		bus_write(VOLUME_REG, 0);
+		bus_write(voice_ftw_reg(1), ftw_of(512));
+		bus_write(voice_ftw_reg(2), ftw_of(1024));
+		bus_write(voice_ftw_reg(3), ftw_of(2048));
+		bus_write(CONTROL_REG, DDS + MIX);
+
+		--Nothing playing
+		measure(ones, mag);
+		check("silence", ones, mag, (0, 0, 0, 0, 0));
+
+		--One voice at full volume is a quarter of the full scale
+		bus_write(voice_vol_reg(1), 2**19);
+		measure(ones, mag);
+		check("voice 1", ones, mag, (16, 0, 0, 0, 0));
+
+		--Two voices, the second at half volume
+		bus_write(voice_vol_reg(2), 2**18);
+		measure(ones, mag);
+		check("voices 1 and 2", ones, mag, (16, 0, 8, 0, 0));
+
+		--Three voices and the main tone; bit 19 of a voice volume is full
+		--volume whatever the bits below it, and the main tone plays at full
+		--level while its output is high
+		bus_write(voice_vol_reg(3), 2**19 + 5);
+		bus_write(VOLUME_REG, 2**18);
+		measure(ones, mag);
+		check("voices 1 to 3 and the main tone", ones, mag, (16, 0, 8, 16, 16));
+
+		--A volume of 0 silences a voice
+		bus_write(voice_vol_reg(1), 0);
+		measure(ones, mag);
+		check("voice 1 silenced", ones, mag, (0, 0, 8, 16, 16));
+
+		--With the mix bit clear the main tone plays alone at full level
+		bus_write(CONTROL_REG, DDS);
+		measure(ones, mag);
+		check("mix off", ones, mag, (0, 0, 0, 0, 64));
+
+		report "buzzer_mix_tb: done";
+		done <= true;
+		wait;
+	end process;
+
+end architecture;
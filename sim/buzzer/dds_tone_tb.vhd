@@ -0,0 +1,164 @@
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+-- Testbench for dds_tone. Checks the tone cycle length and high time against
+-- the tuning word and duty cycle, including a tuning word that doesn't divide
+-- the accumulator evenly and the 440 Hz word the driver computes, that a new
+-- tuning word keeps the accumulator's phase, and that a tuning word of 0
+-- stops the tone.
+entity dds_tone_tb is
+end entity dds_tone_tb;
+
+architecture dds_tone_tb_arch of dds_tone_tb is
+
+	constant CLK_PERIOD : time := 20 ns;
+
+	-- de10nano_buzzer_mhz_to_ftw(440000)
+	constant FTW_440_HZ : natural := 37796;
+
+	signal clk 			: std_ulogic := '0';
+	signal rst 			: std_ulogic := '1';
+	signal ftw 			: std_ulogic_vector(32 - 1 downto 0) := (others => '0');
+	signal duty_cycle 	: std_ulogic_vector(20 - 1 downto 0) := (others => '0');
+	signal output 		: std_ulogic;
+	signal cycle_end	: std_ulogic;
+	signal done 		: boolean := false;
+
+begin
+
+	DUT : entity work.dds_tone
+		port map (
+			clk => clk,
+			rst => rst,
+			ftw => ftw,
+			duty_cycle => duty_cycle,
+			output => output,
+			cycle_end => cycle_end
+			);
+
+	clk <= not clk after CLK_PERIOD / 2 when not done else '0';
+
+	STIMULUS : process
+
+		variable cycles 	: natural;
+		variable high 		: natural;
+		variable total 	: natural;
+		variable level 	: std_ulogic;
+
+		--Clock edges up to and including the next one that ends a tone cycle,
+		--and how many of them saw the output high
+		procedure next_cycle_end(cycles : out natural; high : out natural) is
+			variable n : natural := 0;
+			variable h : natural := 0;
+		begin
+			loop
+				wait until rising_edge(clk);
+				n := n + 1;
+				if output = '1' then
+					h := h + 1;
+				end if;
+				exit when cycle_end = '1';
+			end loop;
+			cycles := n;
+			high := h;
+		end procedure;
+
+		procedure reset is
+		begin
+			rst <= '1';
+			wait until rising_edge(clk);
+			wait until rising_edge(clk);
+			rst <= '0';
+		end procedure;
+
+		--Play a tone and check the length and high time of several tone cycles
+		procedure check_tone(
+			constant name 			: in string;
+			constant tone_ftw 	: in natural;
+			constant duty 			: in std_ulogic_vector(20 - 1 downto 0);
+			constant periods 		: in positive;
+			constant cycles_min 	: in natural;
+			constant cycles_max 	: in natural;
+			constant high_min 	: in natural;
+			constant high_max 	: in natural) is
+		begin
+			ftw <= std_ulogic_vector(to_unsigned(tone_ftw, 32));
+			duty_cycle <= duty;
+			--Skip the tone cycle the settings changed in
+			next_cycle_end(cycles, high);
+			next_cycle_end(cycles, high);
+			for i in 1 to periods loop
+				next_cycle_end(cycles, high);
+				assert cycles >= cycles_min and cycles <= cycles_max
+					report name & ": tone cycle of " & integer'image(cycles) & " clock cycles"
+					severity error;
+				assert high >= high_min and high <= high_max
+					report name & ": high for " & integer'image(high) & " clock cycles"
+					severity error;
+			end loop;
+		end procedure;
+
+	begin
+		reset;
+
+		--2^26 steps through the accumulator in exactly 64 clock cycles
+		check_tone("ftw 2^26, duty 1/2", 2**26, x"40000", 4, 64, 64, 32, 32);
+		check_tone("ftw 2^26, duty 1/8", 2**26, x"10000", 4, 64, 64, 8, 8);
+		check_tone("ftw 2^26, duty 0", 2**26, x"00000", 4, 64, 64, 0, 0);
+		check_tone("ftw 2^26, duty 1", 2**26, x"80000", 4, 64, 64, 64, 64);
+		check_tone("ftw 2^26, duty > 1", 2**26, x"FFFFF", 4, 64, 64, 64, 64);
+
+		--3 * 2^24 takes 85 1/3 clock cycles: every three tone cycles take 256
+		check_tone("ftw 3 * 2^24", 3 * 2**24, x"40000", 6, 85, 86, 42, 43);
+		total := 0;
+		for i in 1 to 3 loop
+			next_cycle_end(cycles, high);
+			total := total + cycles;
+		end loop;
+		assert total = 256
+			report "ftw 3 * 2^24: three tone cycles took " & integer'image(total) & " clock cycles"
+			severity error;
+
+		--440 Hz: 2^32 / 37796 = 113635.4 clock cycles at 50 MHz
+		check_tone("440 Hz", FTW_440_HZ, x"40000", 2, 113635, 113636, 56816, 56819);
+
+		--A new tuning word keeps the phase: halfway through a 64 cycle tone at
+		--2^26, the other half at 2^27 takes 24 clock cycles, not 32
+		ftw <= std_ulogic_vector(to_unsigned(2**26, 32));
+		reset;
+		next_cycle_end(cycles, high);
+		for i in 1 to 16 loop
+			wait until rising_edge(clk);
+		end loop;
+		ftw <= std_ulogic_vector(to_unsigned(2**27, 32));
+		next_cycle_end(cycles, high);
+		assert cycles = 24
+			report "phase continuity: " & integer'image(cycles) & " clock cycles after the change"
+			severity error;
+		next_cycle_end(cycles, high);
+		assert cycles = 32
+			report "ftw 2^27: tone cycle of " & integer'image(cycles) & " clock cycles"
+			severity error;
+
+		--A tuning word of 0 holds the accumulator and the output
+		ftw <= (others => '0');
+		wait until rising_edge(clk);
+		wait until rising_edge(clk);
+		level := output;
+		for i in 1 to 200 loop
+			wait until rising_edge(clk);
+			assert cycle_end = '1'
+				report "ftw 0: cycle_end low"
+				severity error;
+			assert output = level
+				report "ftw 0: output changed"
+				severity error;
+		end loop;
+
+		report "dds_tone_tb: done";
+		done <= true;
+		wait;
+	end process;
+
+end architecture;
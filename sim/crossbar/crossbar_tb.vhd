@@ -0,0 +1,433 @@
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+-- Testbench for crossbar. Sets routes up over the Avalon slave and drives
+-- the rotary count through them to their sinks: linear routes with an input
+-- offset, positive and negative scale, shift, output offset and clamping, and
+-- LUT routes including indexes below and above the table. Checks the
+-- pipeline latency of both modes and that routes that are off, have no
+-- source, or are disabled don't drive their sinks. A model of the ADC's slave
+-- with wait states checks that the ADC master stays off the bus without an
+-- ADC route, reads the channels in order every sweep with the programmed
+-- period between sweeps, keeps the 12 bits of each result, and stops once
+-- the last ADC route is switched off.
+entity crossbar_tb is
+end entity crossbar_tb;
+
+architecture crossbar_tb_arch of crossbar_tb is
+
+	constant CLK_PERIOD : time := 20 ns;
+
+	--Wait states the ADC model adds to every read
+	constant ADC_WAIT : natural := 2;
+	constant ADC_PERIOD : natural := 100;
+
+	--Clock cycles from a source change to its sink
+	constant LINEAR_LATENCY : positive := 5;
+	constant LUT_LATENCY : positive := 6;
+
+	--Word addresses of the global registers
+	constant CONTROL_REG : natural := 16#00#;
+	constant INFO_REG : natural := 16#01#;
+	constant ADC_PERIOD_REG : natural := 16#02#;
+	constant ACTIVE_REG : natural := 16#03#;
+	constant SOURCE_REG : natural := 16#10#;
+	constant OUTPUT_REG : natural := 16#20#;
+
+	--Route register offsets from 16#40# + 8r
+	constant ROUTE_CTRL : natural := 0;
+	constant IN_OFFSET : natural := 1;
+	constant SCALE : natural := 2;
+	constant OUT_OFFSET : natural := 3;
+	constant OUT_MIN : natural := 4;
+	constant OUT_MAX : natural := 5;
+
+	--Route control modes, bits 5:4
+	constant LINEAR : natural := 16#10#;
+	constant LUT : natural := 16#20#;
+
+	subtype word is std_ulogic_vector(31 downto 0);
+	type word_array is array(natural range <>) of word;
+
+	signal clk 				: std_ulogic := '0';
+	signal rst 				: std_ulogic := '1';
+	signal avs_read 		: std_ulogic := '0';
+	signal avs_write 		: std_ulogic := '0';
+	signal avs_address 	: std_ulogic_vector(7 downto 0) := (others => '0');
+	signal avs_readdata 	: std_ulogic_vector(31 downto 0);
+	signal avs_writedata : std_ulogic_vector(31 downto 0) := (others => '0');
+	signal avm_address 	: std_ulogic_vector(4 downto 0);
+	signal avm_read 		: std_ulogic;
+	signal avm_readdata 	: std_ulogic_vector(31 downto 0);
+	signal avm_waitrequest : std_ulogic;
+	signal rotary_count 	: std_ulogic_vector(31 downto 0) := (others => '0');
+	signal rgb_red 		: std_ulogic_vector(31 downto 0);
+	signal rgb_green 		: std_ulogic_vector(31 downto 0);
+	signal rgb_blue 		: std_ulogic_vector(31 downto 0);
+	signal rgb_valid 		: std_ulogic_vector(2 downto 0);
+	signal buzzer_volume : std_ulogic_vector(31 downto 0);
+	signal buzzer_pitch 	: std_ulogic_vector(31 downto 0);
+	signal buzzer_valid 	: std_ulogic_vector(1 downto 0);
+	signal led_pattern 	: std_ulogic_vector(31 downto 0);
+	signal led_valid 		: std_ulogic;
+	signal done 			: boolean := false;
+
+	--The sinks by route number
+	signal sinks 			: word_array(0 to 5);
+	signal valid 			: std_ulogic_vector(5 downto 0);
+
+	--ADC model state
+	signal adc_wait_count : natural := 0;
+	signal adc_channel 	: natural range 0 to 7 := 0;
+	signal adc_reads 		: natural := 0;
+	signal adc_sweeps 	: natural := 0;
+	signal adc_cycle 		: natural := 0;
+	signal adc_start 		: natural := 0;
+	--Clock cycles from the start of one sweep to the start of the next
+	signal adc_interval 	: natural := 0;
+	signal avm_read_prev : std_ulogic := '0';
+
+	--The conversion the ADC model returns for a channel in a sweep
+	function adc_value(sweep : natural; channel : natural) return natural is
+	begin
+		return (sweep * 256 + channel * 17 + 5) mod 4096;
+	end function;
+
+	function route_reg(route : natural; reg : natural) return natural is
+	begin
+		return 16#40# + 8 * route + reg;
+	end function;
+
+	function lut_reg(route : natural; index : natural) return natural is
+	begin
+		return 16#80# + 16 * route + index;
+	end function;
+
+	--Entry i of the tables the testbench loads into route r
+	function lut_entry(route : natural; index : natural) return word is
+	begin
+		return std_ulogic_vector(to_unsigned(16#A0000# + route * 16#1000# + index * 16#11#, 32));
+	end function;
+
+begin
+
+	DUT : entity work.crossbar
+		generic map (
+			ADC_PERIOD_RESET => 0
+			)
+		port map (
+			clk => clk,
+			rst => rst,
+			avs_read => avs_read,
+			avs_write => avs_write,
+			avs_address => avs_address,
+			avs_readdata => avs_readdata,
+			avs_writedata => avs_writedata,
+			avm_address => avm_address,
+			avm_read => avm_read,
+			avm_readdata => avm_readdata,
+			avm_waitrequest => avm_waitrequest,
+			rotary_count => rotary_count,
+			rgb_red => rgb_red,
+			rgb_green => rgb_green,
+			rgb_blue => rgb_blue,
+			rgb_valid => rgb_valid,
+			buzzer_volume => buzzer_volume,
+			buzzer_pitch => buzzer_pitch,
+			buzzer_valid => buzzer_valid,
+			led_pattern => led_pattern,
+			led_valid => led_valid
+			);
+
+	clk <= not clk after CLK_PERIOD / 2 when not done else '0';
+
+	sinks <= (rgb_red, rgb_green, rgb_blue, buzzer_volume, buzzer_pitch, led_pattern);
+	valid <= led_valid & buzzer_valid & rgb_valid;
+
+	--The ADC's slave: ADC_WAIT wait states per read, then the channel's
+	--conversion with the unused upper bits set
+	avm_waitrequest <= '1' when avm_read = '1' and adc_wait_count < ADC_WAIT else '0';
+	avm_readdata <= x"FFFFF" & std_ulogic_vector(to_unsigned(
+		adc_value(adc_sweeps, to_integer(unsigned(avm_address(4 downto 2)))), 12));
+
+	ADC_SLAVE : process(clk)
+	begin
+		if rising_edge(clk) then
+			adc_cycle <= adc_cycle + 1;
+			avm_read_prev <= avm_read;
+			if avm_read = '1' and avm_read_prev = '0' then
+				adc_interval <= adc_cycle - adc_start;
+				adc_start <= adc_cycle;
+			end if;
+			if avm_read = '1' and avm_waitrequest = '1' then
+				adc_wait_count <= adc_wait_count + 1;
+			elsif avm_read = '1' then
+				assert to_integer(unsigned(avm_address)) = adc_channel * 4
+					report "ADC read of address " & integer'image(to_integer(unsigned(avm_address))) &
+						", expected channel " & integer'image(adc_channel)
+					severity error;
+				adc_wait_count <= 0;
+				adc_reads <= adc_reads + 1;
+				if adc_channel = 7 then
+					adc_channel <= 0;
+					adc_sweeps <= adc_sweeps + 1;
+				else
+					adc_channel <= adc_channel + 1;
+				end if;
+			end if;
+		end if;
+	end process;
+
+	STIMULUS : process
+
+		variable data 		: word;
+		variable reads 	: natural;
+		variable sweep 	: natural;
+		variable index 	: natural;
+
+		procedure bus_write(constant address : in natural; constant value : in integer) is
+		begin
+			wait until falling_edge(clk);
+			avs_address <= std_ulogic_vector(to_unsigned(address, 8));
+			avs_writedata <= std_ulogic_vector(to_signed(value, 32));
+			avs_write <= '1';
+			wait until falling_edge(clk);
+			avs_write <= '0';
+		end procedure;
+
+		procedure bus_write_word(constant address : in natural; constant value : in word) is
+		begin
+			wait until falling_edge(clk);
+			avs_address <= std_ulogic_vector(to_unsigned(address, 8));
+			avs_writedata <= value;
+			avs_write <= '1';
+			wait until falling_edge(clk);
+			avs_write <= '0';
+		end procedure;
+
+		procedure bus_read(constant address : in natural; value : out word) is
+		begin
+			wait until falling_edge(clk);
+			avs_address <= std_ulogic_vector(to_unsigned(address, 8));
+			avs_read <= '1';
+			wait until falling_edge(clk);
+			avs_read <= '0';
+			value := avs_readdata;
+		end procedure;
+
+		procedure cycles(constant n : in natural) is
+		begin
+			for i in 1 to n loop
+				wait until falling_edge(clk);
+			end loop;
+		end procedure;
+
+		procedure setup_route(
+			constant route 		: in natural;
+			constant in_off 		: in integer;
+			constant scale_val 	: in integer;
+			constant out_off 		: in integer;
+			constant lo 			: in integer;
+			constant hi 			: in integer;
+			constant ctrl 			: in natural) is
+		begin
+			bus_write(route_reg(route, IN_OFFSET), in_off);
+			bus_write(route_reg(route, SCALE), scale_val);
+			bus_write(route_reg(route, OUT_OFFSET), out_off);
+			bus_write(route_reg(route, OUT_MIN), lo);
+			bus_write(route_reg(route, OUT_MAX), hi);
+			bus_write(route_reg(route, ROUTE_CTRL), ctrl);
+		end procedure;
+
+		--Change the rotary count and check that the route's sink takes the
+		--expected value exactly latency clock cycles later
+		procedure check_route(
+			constant name 		: in string;
+			constant route 	: in natural;
+			constant count 	: in integer;
+			constant expected : in word;
+			constant latency 	: in positive) is
+			variable n : natural := 0;
+		begin
+			wait until falling_edge(clk);
+			rotary_count <= std_ulogic_vector(to_signed(count, 32));
+			loop
+				wait until falling_edge(clk);
+				n := n + 1;
+				exit when sinks(route) = expected or n > 2 * latency;
+			end loop;
+			assert sinks(route) = expected
+				report name & ": sink " & integer'image(route) & " is " &
+					integer'image(to_integer(signed(sinks(route)))) & ", expected " &
+					integer'image(to_integer(signed(expected)))
+				severity error;
+			assert n = latency
+				report name & ": sink " & integer'image(route) & " changed after " &
+					integer'image(n) & " clock cycles"
+				severity error;
+			assert valid(route) = '1'
+				report name & ": route " & integer'image(route) & " not valid"
+				severity error;
+		end procedure;
+
+		procedure check_active(constant name : in string; constant expected : in std_ulogic_vector(5 downto 0)) is
+		begin
+			cycles(2);
+			assert valid = expected
+				report name & ": valid bits wrong"
+				severity error;
+			bus_read(ACTIVE_REG, data);
+			assert data(5 downto 0) = expected and unsigned(data(31 downto 6)) = 0
+				report name & ": active register wrong"
+				severity error;
+		end procedure;
+
+	begin
+		wait until falling_edge(clk);
+		wait until falling_edge(clk);
+		rst <= '0';
+
+		bus_read(INFO_REG, data);
+		assert unsigned(data) = 6 * 256 + 9
+			report "info register wrong"
+			severity error;
+		check_active("reset", "000000");
+
+		bus_write(ADC_PERIOD_REG, ADC_PERIOD);
+		bus_write(CONTROL_REG, 1);
+
+		--Linear route from the rotary count to red:
+		--clamp(((count - 10) * 3 >> 1) + 100, 0, 1000)
+		setup_route(0, 10, 3, 100, 0, 1000, LINEAR + 1 * 256 + 0);
+		check_active("red linear", "000001");
+		check_route("red linear", 0, 50, x"000000A0", LINEAR_LATENCY);
+		check_route("red linear", 0, 11, x"00000065", LINEAR_LATENCY);
+		check_route("red above max", 0, 1000, x"000003E8", LINEAR_LATENCY);
+		check_route("red below min", 0, -100, x"00000000", LINEAR_LATENCY);
+		--The shift is arithmetic: (-7 * 3) >> 1 = -11
+		check_route("red negative", 0, 3, x"00000059", LINEAR_LATENCY);
+
+		--Negative scale (18-bit) on green: ((count - 10) * -2 >> 1) + 100
+		setup_route(1, 10, -2, 100, 0, 1000, LINEAR + 1 * 256 + 0);
+		check_active("green linear", "000011");
+		check_route("green negative scale", 1, 30, x"00000050", LINEAR_LATENCY);
+		check_route("green negative scale", 1, -40, x"00000096", LINEAR_LATENCY);
+		--Scale bits above 17 are ignored: 0xC0003 is 3
+		bus_write(route_reg(1, SCALE), 16#C0003#);
+		check_route("green scale bits", 1, 20, x"00000073", LINEAR_LATENCY);
+
+		--LUT route from the rotary count to the LED array; the index is
+		--clamped to the table
+		for i in 0 to 15 loop
+			bus_write_word(lut_reg(5, i), lut_entry(5, i));
+		end loop;
+		setup_route(5, 0, 1, 0, 0, -1, LUT + 0 * 256 + 0);
+		check_active("LED LUT", "100011");
+		for i in 0 to 15 loop
+			check_route("LED LUT", 5, i, lut_entry(5, i), LUT_LATENCY);
+		end loop;
+		check_route("LED LUT below", 5, -5, lut_entry(5, 0), LUT_LATENCY);
+		check_route("LED LUT above", 5, 1000, lut_entry(5, 15), LUT_LATENCY);
+		check_route("LED LUT", 5, 7, lut_entry(5, 7), LUT_LATENCY);
+		--A shift before the lookup: 4 steps per entry
+		bus_write(route_reg(5, ROUTE_CTRL), LUT + 2 * 256 + 0);
+		check_route("LED LUT shift", 5, 45, lut_entry(5, 11), LUT_LATENCY);
+
+		--The LUT is write-only
+		bus_read(lut_reg(5, 3), data);
+		assert unsigned(data) = 0
+			report "LUT read returned data"
+			severity error;
+
+		--Routes that are off or have no source don't drive their sinks
+		bus_write(route_reg(1, ROUTE_CTRL), 0);
+		bus_write(route_reg(2, ROUTE_CTRL), LINEAR + 9);
+		check_active("off and bad source", "100001");
+
+		--Disabling the crossbar releases every sink and enabling it again
+		--brings the routes back
+		bus_write(CONTROL_REG, 0);
+		check_active("disabled", "000000");
+		bus_write(CONTROL_REG, 1);
+		check_active("enabled", "100001");
+
+		--Without an ADC route the master never reads the ADC
+		assert adc_reads = 0
+			report "ADC read without an ADC route"
+			severity error;
+
+		--The output registers read back what the sinks see
+		bus_read(OUTPUT_REG + 5, data);
+		assert data = led_pattern
+			report "output register 5 differs from the LED pattern"
+			severity error;
+
+		--ADC channel 3 straight to the volume, and ADC channel 7 through a
+		--table to the pitch, 256 counts per entry
+		for i in 0 to 15 loop
+			bus_write_word(lut_reg(4, i), lut_entry(4, i));
+		end loop;
+		setup_route(3, 0, 1, 0, 0, -1, LINEAR + 0 * 256 + 4);
+		setup_route(4, 0, 1, 0, 0, -1, LUT + 8 * 256 + 8);
+		check_active("ADC routes", "111001");
+
+		wait until adc_sweeps = 3 for 100 us;
+		assert adc_sweeps = 3
+			report "ADC master didn't sweep"
+			severity error;
+		cycles(2 * LUT_LATENCY);
+		--The master keeps the low 12 bits of each read
+		sweep := adc_sweeps - 1;
+		assert unsigned(buzzer_volume) = adc_value(sweep, 3)
+			report "volume " & integer'image(to_integer(unsigned(buzzer_volume))) &
+				", expected ADC channel 3 " & integer'image(adc_value(sweep, 3))
+			severity error;
+		index := adc_value(sweep, 7) / 256;
+		assert buzzer_pitch = lut_entry(4, index)
+			report "pitch isn't LUT entry " & integer'image(index)
+			severity error;
+		for i in 0 to 7 loop
+			bus_read(SOURCE_REG + 1 + i, data);
+			assert unsigned(data) = adc_value(sweep, i)
+				report "source " & integer'image(i + 1) & " is " &
+					integer'image(to_integer(unsigned(data))) & ", expected " &
+					integer'image(adc_value(sweep, i))
+				severity error;
+		end loop;
+		--Eight reads with ADC_WAIT wait states each, then adc_period idle
+		--cycles and one to start the next sweep
+		assert adc_interval = 8 * (ADC_WAIT + 1) + ADC_PERIOD + 1
+			report "ADC sweeps " & integer'image(adc_interval) & " clock cycles apart"
+			severity error;
+
+		--A later sweep reaches the sinks too
+		wait until adc_sweeps = 5 for 100 us;
+		cycles(2 * LUT_LATENCY);
+		sweep := adc_sweeps - 1;
+		assert unsigned(buzzer_volume) = adc_value(sweep, 3)
+			report "volume didn't follow ADC sweep " & integer'image(sweep)
+			severity error;
+		assert buzzer_pitch = lut_entry(4, adc_value(sweep, 7) / 256)
+			report "pitch didn't follow ADC sweep " & integer'image(sweep)
+			severity error;
+
+		--Once no route reads the ADC, the master finishes its sweep and stops
+		bus_write(route_reg(3, ROUTE_CTRL), 0);
+		bus_write(route_reg(4, ROUTE_CTRL), 0);
+		cycles(8 * (ADC_WAIT + 1) + ADC_PERIOD + 10);
+		reads := adc_reads;
+		assert reads mod 8 = 0
+			report "ADC master stopped in the middle of a sweep"
+			severity error;
+		cycles(4 * ADC_PERIOD);
+		assert adc_reads = reads
+			report "ADC master still reading without an ADC route"
+			severity error;
+
+		report "crossbar_tb: done";
+		done <= true;
+		wait;
+	end process;
+
+end architecture;
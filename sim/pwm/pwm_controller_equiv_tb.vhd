@@ -0,0 +1,207 @@
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+-- Testbench comparing pwm_controller_pipelined with pwm_controller. Drives
+-- both with the same period and duty cycle inputs and measures every PWM
+-- period of each: its length and how long the output is high in it. Once a
+-- new setting has settled in both, each period must be the same length and
+-- have the same high time in both controllers, and match the clock cycle
+-- counts worked out from the inputs, which the pipelined controller's
+-- period_count and duty_count must show too. Covers periods that don't
+-- divide into whole clock cycles, a duty cycle of 0, 1 and above 1, a
+-- period of 0 and changes to a shorter and a longer period.
+entity pwm_controller_equiv_tb is
+end entity pwm_controller_equiv_tb;
+
+architecture pwm_controller_equiv_tb_arch of pwm_controller_equiv_tb is
+
+	constant CLK_PERIOD : time := 20 ns;
+
+	--Inputs to try, as 6.26 ms periods and 1.19 duty cycles
+	type natural_array is array (natural range <>) of natural;
+	constant PERIODS : natural_array := (
+		671089, 		--0.01 ms, 500 clock cycles
+		1234567, 	--not a whole number of clock cycles
+		1234567,
+		1234567,
+		1234567,
+		4027, 		--3 clock cycles
+		0,
+		671089,
+		1234567
+		);
+	constant DUTIES : natural_array := (
+		2**18, 		--1/2
+		157286, 		--about 0.3
+		0,
+		2**19, 		--1, always high
+		2**20 - 1, 	--just under 2, hard-limited to always high
+		2**18,
+		2**18,
+		3 * 2**17,
+		2**16
+		);
+
+	--Both controllers count from 0 to the period count, and the output is
+	--high until the count passes the duty count, so both take one more
+	--clock cycle than their counts
+	function period_cycles(period : natural) return natural is
+	begin
+		return to_integer(shift_right(to_unsigned(period, 32) * to_unsigned(50000, 16), 26));
+	end function;
+
+	function duty_cycles(period : natural; duty : natural) return natural is
+	begin
+		return to_integer(shift_right(to_unsigned(duty, 20) * to_unsigned(period_cycles(period), 32), 19));
+	end function;
+
+	signal clk 				: std_logic := '0';
+	signal rst 				: std_logic := '1';
+	signal period 			: unsigned(31 downto 0) := (others => '0');
+	signal duty_cycle 	: std_logic_vector(19 downto 0) := (others => '0');
+	signal output 			: std_logic;
+	signal period_end 	: std_logic;
+	signal output_p 		: std_logic;
+	signal period_end_p 	: std_logic;
+	signal period_count 	: std_logic_vector(31 downto 0);
+	signal duty_count 	: std_logic_vector(31 downto 0);
+	signal done 			: boolean := false;
+
+	--Completed periods of each controller, and the length and high time of
+	--the last one
+	signal periods 		: natural := 0;
+	signal length 			: natural := 0;
+	signal high 			: natural := 0;
+	signal periods_p 		: natural := 0;
+	signal length_p 		: natural := 0;
+	signal high_p 			: natural := 0;
+
+begin
+
+	ORIGINAL : entity work.pwm_controller
+		port map (
+			clk => clk,
+			rst => rst,
+			period => period,
+			duty_cycle => duty_cycle,
+			output => output,
+			period_end => period_end
+			);
+
+	PIPELINED : entity work.pwm_controller_pipelined
+		port map (
+			clk => clk,
+			rst => rst,
+			period => period,
+			duty_cycle => duty_cycle,
+			output => output_p,
+			period_end => period_end_p,
+			period_count => period_count,
+			duty_count => duty_count
+			);
+
+	clk <= not clk after CLK_PERIOD / 2 when not done else '0';
+
+	--A period ends with the clock cycle in which period_end is high
+	PERIOD_MONITOR : process(clk)
+		variable cycles 	: natural := 0;
+		variable on_time 	: natural := 0;
+		variable cycles_p : natural := 0;
+		variable on_time_p : natural := 0;
+	begin
+		if rising_edge(clk) and rst = '0' then
+			cycles := cycles + 1;
+			if output = '1' then
+				on_time := on_time + 1;
+			end if;
+			if period_end = '1' then
+				length <= cycles;
+				high <= on_time;
+				periods <= periods + 1;
+				cycles := 0;
+				on_time := 0;
+			end if;
+
+			cycles_p := cycles_p + 1;
+			if output_p = '1' then
+				on_time_p := on_time_p + 1;
+			end if;
+			if period_end_p = '1' then
+				length_p <= cycles_p;
+				high_p <= on_time_p;
+				periods_p <= periods_p + 1;
+				cycles_p := 0;
+				on_time_p := 0;
+			end if;
+		end if;
+	end process;
+
+	STIMULUS : process
+
+		variable expected_length 	: natural;
+		variable expected_high 		: natural;
+		variable start 				: natural;
+		variable start_p 				: natural;
+
+		--Wait until both controllers have completed n more periods
+		procedure wait_periods(constant n : in natural) is
+		begin
+			start := periods;
+			start_p := periods_p;
+			wait until periods >= start + n and periods_p >= start_p + n;
+			wait until falling_edge(clk);
+		end procedure;
+
+		procedure check_period(constant name : in string) is
+		begin
+			assert length = expected_length and high = expected_high
+				report name & ": pwm_controller period " & integer'image(length) & ", high " &
+					integer'image(high) & ", expected " & integer'image(expected_length) & ", high " &
+					integer'image(expected_high)
+				severity error;
+			assert length_p = length and high_p = high
+				report name & ": pwm_controller_pipelined period " & integer'image(length_p) & ", high " &
+					integer'image(high_p) & ", pwm_controller period " & integer'image(length) & ", high " &
+					integer'image(high)
+				severity error;
+		end procedure;
+
+	begin
+		wait until falling_edge(clk);
+		wait until falling_edge(clk);
+		rst <= '0';
+
+		for i in PERIODS'range loop
+			period <= to_unsigned(PERIODS(i), 32);
+			duty_cycle <= std_logic_vector(to_unsigned(DUTIES(i), 20));
+			expected_length := period_cycles(PERIODS(i)) + 1;
+			expected_high := minimum(duty_cycles(PERIODS(i), DUTIES(i)), period_cycles(PERIODS(i))) + 1;
+
+			--pwm_controller_pipelined's new limits take 6 clock cycles to
+			--reach the counter, so it can finish periods of the old setting
+			--until then. After that, the period running can be cut short by
+			--pwm_controller or have the old limits in
+			--pwm_controller_pipelined; every period after it has the new
+			--setting.
+			for j in 1 to 8 loop
+				wait until falling_edge(clk);
+			end loop;
+			wait_periods(3);
+			check_period("setting " & integer'image(i));
+			assert to_integer(unsigned(period_count)) = period_cycles(PERIODS(i)) and
+				to_integer(unsigned(duty_count)) = duty_cycles(PERIODS(i), DUTIES(i))
+				report "setting " & integer'image(i) & ": period_count " &
+					integer'image(to_integer(unsigned(period_count))) & ", duty_count " &
+					integer'image(to_integer(unsigned(duty_count)))
+				severity error;
+			wait_periods(1);
+			check_period("setting " & integer'image(i) & ", next period");
+		end loop;
+
+		report "pwm_controller_equiv_tb: done";
+		done <= true;
+		wait;
+	end process;
+
+end architecture;
@@ -0,0 +1,281 @@
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+-- Testbench for quadrature_decoder. Turns the encoder both ways at a sweep of
+-- speeds, up to one edge per clock cycle, and checks the count, the step
+-- pulses and the error counter. Both inputs changing in one cycle (an illegal
+-- two-bit transition) must count as an error and leave the count alone. Also
+-- covers saturation, wrapping and the clear inputs.
+entity quadrature_decoder_tb is
+end entity quadrature_decoder_tb;
+
+architecture quadrature_decoder_tb_arch of quadrature_decoder_tb is
+
+	constant CLK_PERIOD : time := 20 ns;
+
+	--A & B while counting up; counting down walks it backwards
+	type gray_array is array (0 to 3) of std_ulogic_vector(1 downto 0);
+	constant GRAY : gray_array := ("00", "01", "11", "10");
+
+	--How many clock cycles each state of a turn is held, slowest first
+	type hold_array is array (natural range <>) of positive;
+	constant HOLDS : hold_array := (64, 16, 5, 3, 2, 1);
+
+	signal clk : std_ulogic := '0';
+	signal rst : std_ulogic := '1';
+	signal a : std_ulogic := '0';
+	signal b : std_ulogic := '0';
+	signal wrap : std_ulogic := '0';
+	signal count_min : signed(31 downto 0) := to_signed(-1000, 32);
+	signal count_max : signed(31 downto 0) := to_signed(1000, 32);
+	signal clear : std_ulogic := '0';
+	signal clear_errors : std_ulogic := '0';
+	signal count : signed(31 downto 0);
+	signal step : std_ulogic;
+	signal up : std_ulogic;
+	signal error_count : unsigned(31 downto 0);
+	signal done : boolean := false;
+
+	--Step pulses seen so far, by direction
+	signal steps_up : natural := 0;
+	signal steps_down : natural := 0;
+
+begin
+
+	DUT : entity work.quadrature_decoder
+		port map (
+			clk => clk,
+			rst => rst,
+			a => a,
+			b => b,
+			wrap => wrap,
+			count_min => count_min,
+			count_max => count_max,
+			clear => clear,
+			clear_errors => clear_errors,
+			count => count,
+			step => step,
+			up => up,
+			error_count => error_count
+			);
+
+	clk <= not clk after CLK_PERIOD / 2 when not done else '0';
+
+	STEP_MONITOR : process(clk)
+	begin
+		if rising_edge(clk) then
+			if step = '1' and up = '1' then
+				steps_up <= steps_up + 1;
+			elsif step = '1' then
+				steps_down <= steps_down + 1;
+			end if;
+		end if;
+	end process;
+
+	STIMULUS : process
+		--Position of the encoder in the Gray code; only its value mod 4 is seen
+		variable phase : integer := 0;
+		variable expected : integer := 0;
+		variable errors : natural := 0;
+		variable ups : natural;
+		variable downs : natural;
+
+		--Inputs change on falling edges, away from the sampling edge.
+		procedure hold_phase(cycles : positive) is
+			variable ab : std_ulogic_vector(1 downto 0);
+		begin
+			ab := GRAY(phase mod 4);
+			wait until falling_edge(clk);
+			a <= ab(1);
+			b <= ab(0);
+			for i in 2 to cycles loop
+				wait until falling_edge(clk);
+			end loop;
+		end procedure;
+
+		--One legal edge per state, edges > 0 counting up
+		procedure turn(edges : integer; cycles : positive) is
+		begin
+			for i in 1 to abs(edges) loop
+				if edges > 0 then
+					phase := phase + 1;
+				else
+					phase := phase - 1;
+				end if;
+				hold_phase(cycles);
+			end loop;
+		end procedure;
+
+		--Skip a state, so A and B change in the same cycle
+		procedure jump(cycles : positive) is
+		begin
+			phase := phase + 2;
+			hold_phase(cycles);
+		end procedure;
+
+		procedure settle is
+		begin
+			for i in 1 to 3 loop
+				wait until rising_edge(clk);
+			end loop;
+		end procedure;
+
+		procedure check(name : string) is
+		begin
+			assert to_integer(count) = expected
+				report name & ": count " & integer'image(to_integer(count)) &
+					", expected " & integer'image(expected)
+				severity error;
+			assert to_integer(error_count) = errors
+				report name & ": error count " & integer'image(to_integer(error_count)) &
+					", expected " & integer'image(errors)
+				severity error;
+		end procedure;
+
+		procedure check_steps(name : string; up_delta : natural; down_delta : natural) is
+		begin
+			assert steps_up - ups = up_delta and steps_down - downs = down_delta
+				report name & ": " & integer'image(steps_up - ups) & " steps up and " &
+					integer'image(steps_down - downs) & " down, expected " &
+					integer'image(up_delta) & " and " & integer'image(down_delta)
+				severity error;
+		end procedure;
+
+	begin
+		wait until falling_edge(clk);
+		wait until falling_edge(clk);
+		rst <= '0';
+		settle;
+		check("reset");
+
+		--Ten detents each way at every speed, down to one edge per clock cycle
+		for i in HOLDS'range loop
+			ups := steps_up;
+			downs := steps_down;
+			turn(40, HOLDS(i));
+			settle;
+			expected := expected + 40;
+			check("up, hold " & integer'image(HOLDS(i)));
+			check_steps("up, hold " & integer'image(HOLDS(i)), 40, 0);
+			assert up = '1'
+				report "up, hold " & integer'image(HOLDS(i)) & ": direction is down"
+				severity error;
+
+			ups := steps_up;
+			downs := steps_down;
+			turn(-40, HOLDS(i));
+			settle;
+			expected := expected - 40;
+			check("down, hold " & integer'image(HOLDS(i)));
+			check_steps("down, hold " & integer'image(HOLDS(i)), 0, 40);
+			assert up = '0'
+				report "down, hold " & integer'image(HOLDS(i)) & ": direction is up"
+				severity error;
+		end loop;
+
+		--Reversing in the middle of a detent at full speed
+		ups := steps_up;
+		downs := steps_down;
+		turn(3, 1);
+		turn(-5, 1);
+		turn(2, 1);
+		settle;
+		check("reversals");
+		check_steps("reversals", 5, 5);
+
+		--Illegal two-bit transitions: each one is an error and no step
+		for i in HOLDS'range loop
+			ups := steps_up;
+			downs := steps_down;
+			for j in 1 to 8 loop
+				jump(HOLDS(i));
+			end loop;
+			settle;
+			errors := errors + 8;
+			check("illegal, hold " & integer'image(HOLDS(i)));
+			check_steps("illegal, hold " & integer'image(HOLDS(i)), 0, 0);
+		end loop;
+
+		--Spinning too fast for the clock mixes counted edges and errors;
+		--counting resumes cleanly from wherever the inputs ended up
+		ups := steps_up;
+		downs := steps_down;
+		for j in 1 to 6 loop
+			turn(1, 1);
+			jump(1);
+		end loop;
+		turn(4, 1);
+		settle;
+		expected := expected + 10;
+		errors := errors + 6;
+		check("too fast");
+		check_steps("too fast", 10, 0);
+
+		--Clearing the error counter leaves the count alone
+		wait until falling_edge(clk);
+		clear_errors <= '1';
+		wait until falling_edge(clk);
+		clear_errors <= '0';
+		settle;
+		errors := 0;
+		check("clear errors");
+
+		--Clear to 0, then saturate at the limits
+		wait until falling_edge(clk);
+		count_min <= to_signed(0, 32);
+		count_max <= to_signed(10, 32);
+		clear <= '1';
+		wait until falling_edge(clk);
+		clear <= '0';
+		settle;
+		expected := 0;
+		check("clear");
+
+		ups := steps_up;
+		downs := steps_down;
+		turn(20, 2);
+		settle;
+		expected := 10;
+		check("saturate at max");
+		check_steps("saturate at max", 10, 0);
+
+		ups := steps_up;
+		downs := steps_down;
+		turn(-20, 2);
+		settle;
+		expected := 0;
+		check("saturate at min");
+		check_steps("saturate at min", 0, 10);
+
+		--Wrap from one limit to the other
+		wrap <= '1';
+		ups := steps_up;
+		downs := steps_down;
+		turn(-1, 2);
+		settle;
+		expected := 10;
+		check("wrap down");
+		turn(1, 2);
+		settle;
+		expected := 0;
+		check("wrap up");
+		check_steps("wrap", 1, 1);
+
+		--A clear with 0 outside the range goes to the nearest limit
+		wait until falling_edge(clk);
+		count_min <= to_signed(5, 32);
+		count_max <= to_signed(9, 32);
+		clear <= '1';
+		wait until falling_edge(clk);
+		clear <= '0';
+		settle;
+		expected := 5;
+		check("clear above 0");
+
+		report "quadrature_decoder_tb: done";
+		done <= true;
+		wait;
+	end process;
+
+end architecture;
@@ -0,0 +1,389 @@
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+-- Testbench for rotary_avalon's interrupt and event FIFO. Checks that
+-- count changes and button presses set their IRQ status bits, that the bits
+-- are write-1-to-clear and that an event in the same cycle as the clearing
+-- write wins, and that irq follows the enabled status bits. Turns the knob
+-- and presses the button and checks every event word and its timestamp to
+-- the clock cycle, that each single-cycle read of EVENT_DATA pops exactly
+-- one event and latches its time into EVENT_TIME, that an empty FIFO reads
+-- 0 without popping, that a button press colliding with a count change is
+-- pushed in the next free cycle, and that the event after a full FIFO is
+-- flagged.
+entity rotary_avalon_tb is
+end entity rotary_avalon_tb;
+
+architecture rotary_avalon_tb_arch of rotary_avalon_tb is
+
+	constant CLK_PERIOD : time := 20 ns;
+
+	constant FIFO_DEPTH : natural := 8;
+
+	--Register word addresses
+	constant COUNT_REG : natural := 0;
+	constant STATUS_REG : natural := 2;
+	constant ENABLE_REG : natural := 3;
+	constant LEVEL_REG : natural := 4;
+	constant EVENT_TIME_REG : natural := 5;
+	constant CYCLES_REG : natural := 6;
+	constant CONTROL_REG : natural := 8;
+	constant EVENT_DATA_REG : natural := 16#400#;
+
+	--IRQ status and enable bits
+	constant IRQ_COUNT : natural := 1;
+	constant IRQ_BUTTON : natural := 2;
+
+	--CONTROL bits
+	constant CLEAR_COUNT : natural := 2;
+
+	--A & B while counting up
+	type gray_array is array (0 to 3) of std_ulogic_vector(1 downto 0);
+	constant GRAY : gray_array := ("00", "01", "11", "10");
+
+	--Clock cycles from driving an input to its event being pushed, counted
+	--from the last edge before it: two synchronizer flops and the decoder
+	--for a count change; the synchronizer, debouncer, one-pulse and enable
+	--registers for a button press
+	constant COUNT_DELAY : natural := 4;
+	constant BUTTON_DELAY : natural := 6;
+
+	--Long enough for the debouncer to settle after a press or a release
+	constant DEBOUNCE_CYCLES : natural := 60;
+
+	signal clk 				: std_ulogic := '0';
+	signal rst 				: std_ulogic := '1';
+	signal avs_read 		: std_ulogic := '0';
+	signal avs_write 		: std_ulogic := '0';
+	signal avs_address 	: std_ulogic_vector(10 downto 0) := (others => '0');
+	signal avs_readdata 	: std_ulogic_vector(31 downto 0);
+	signal avs_writedata : std_ulogic_vector(31 downto 0) := (others => '0');
+	signal irq 				: std_ulogic;
+	signal count_out 		: std_ulogic_vector(31 downto 0);
+	signal a 				: std_ulogic := '0';
+	signal b 				: std_ulogic := '0';
+	signal push_button 	: std_ulogic := '0';
+	signal done 			: boolean := false;
+
+begin
+
+	DUT : entity work.rotary_avalon
+		generic map (
+			FIFO_DEPTH => FIFO_DEPTH
+			)
+		port map (
+			clk => clk,
+			rst => rst,
+			avs_read => avs_read,
+			avs_write => avs_write,
+			avs_address => avs_address,
+			avs_readdata => avs_readdata,
+			avs_writedata => avs_writedata,
+			irq => irq,
+			count_out => count_out,
+			A => a,
+			B => b,
+			push_button => push_button
+			);
+
+	clk <= not clk after CLK_PERIOD / 2 when not done else '0';
+
+	STIMULUS : process
+
+		variable data 		: std_ulogic_vector(31 downto 0);
+		--Position of the knob in the Gray code
+		variable phase 	: natural := 0;
+		--The count and enable state the events should carry
+		variable count 	: natural := 0;
+		variable en 		: std_ulogic := '0';
+		--CYCLES read just before an input was driven
+		variable t0 		: natural;
+		variable t1 		: natural;
+		--When the colliding count and button events should be pushed
+		variable tc 		: natural;
+		variable tp 		: natural;
+
+		procedure wait_cycles(constant n : in natural) is
+		begin
+			for i in 1 to n loop
+				wait until falling_edge(clk);
+			end loop;
+		end procedure;
+
+		procedure bus_write(constant address : in natural; constant value : in natural) is
+		begin
+			wait until falling_edge(clk);
+			avs_address <= std_ulogic_vector(to_unsigned(address, 11));
+			avs_writedata <= std_ulogic_vector(to_unsigned(value, 32));
+			avs_write <= '1';
+			wait until falling_edge(clk);
+			avs_write <= '0';
+		end procedure;
+
+		--avs_read is held for one cycle, as the bus does with readLatency 1
+		procedure bus_read(constant address : in natural; value : out std_ulogic_vector(31 downto 0)) is
+		begin
+			wait until falling_edge(clk);
+			avs_address <= std_ulogic_vector(to_unsigned(address, 11));
+			avs_read <= '1';
+			wait until falling_edge(clk);
+			avs_read <= '0';
+			value := avs_readdata;
+		end procedure;
+
+		procedure check_reg(constant name : in string; constant address : in natural; constant expected : in natural) is
+		begin
+			bus_read(address, data);
+			assert to_integer(unsigned(data)) = expected
+				report name & ": register " & integer'image(address) & " reads " &
+					integer'image(to_integer(unsigned(data))) & ", expected " & integer'image(expected)
+				severity error;
+		end procedure;
+
+		--The clock cycle the next input driven will be seen from; call it
+		--just before driving the input
+		procedure read_cycles(t : out natural) is
+		begin
+			bus_read(CYCLES_REG, data);
+			t := to_integer(unsigned(data));
+		end procedure;
+
+		--Turn the knob one step up, starting now
+		procedure step_up is
+		begin
+			phase := (phase + 1) mod 4;
+			a <= GRAY(phase)(1);
+			b <= GRAY(phase)(0);
+			count := count + 1;
+		end procedure;
+
+		--Hold the pressed button until the debouncer has taken it, then
+		--release it and let the release settle
+		procedure release_button is
+		begin
+			wait_cycles(DEBOUNCE_CYCLES);
+			push_button <= '0';
+			wait_cycles(DEBOUNCE_CYCLES);
+		end procedure;
+
+		procedure clear_count is
+		begin
+			bus_write(CONTROL_REG, CLEAR_COUNT);
+			count := 0;
+			wait_cycles(2);
+		end procedure;
+
+		--Pop an event and check its word: the count, bit 16 for the button,
+		--bit 17 for the direction or new enable state and bit 31 for overflow
+		procedure check_word(
+			constant name 		: in string;
+			constant button 	: in boolean;
+			constant value 	: in natural;
+			constant flag 		: in std_ulogic;
+			constant overflow : in std_ulogic) is
+			variable expected : std_ulogic_vector(31 downto 0) := (others => '0');
+		begin
+			expected(15 downto 0) := std_ulogic_vector(to_unsigned(value, 16));
+			if button then
+				expected(16) := '1';
+			end if;
+			expected(17) := flag;
+			expected(31) := overflow;
+			bus_read(EVENT_DATA_REG, data);
+			assert data = expected
+				report name & ": event 0x" & to_hstring(data) & ", expected 0x" & to_hstring(expected)
+				severity error;
+		end procedure;
+
+		--As check_word, and EVENT_TIME now holds the event's timestamp
+		procedure check_event(
+			constant name 		: in string;
+			constant button 	: in boolean;
+			constant value 	: in natural;
+			constant flag 		: in std_ulogic;
+			constant overflow : in std_ulogic;
+			constant at 		: in natural) is
+		begin
+			check_word(name, button, value, flag, overflow);
+			bus_read(EVENT_TIME_REG, data);
+			assert to_integer(unsigned(data)) = at
+				report name & ": event time " & integer'image(to_integer(unsigned(data))) &
+					", expected " & integer'image(at)
+				severity error;
+		end procedure;
+
+		--Pop whatever is left
+		procedure drain is
+			variable level : natural;
+		begin
+			bus_read(LEVEL_REG, data);
+			level := to_integer(unsigned(data));
+			for i in 1 to level loop
+				bus_read(EVENT_DATA_REG, data);
+			end loop;
+			check_reg("drain", LEVEL_REG, 0);
+		end procedure;
+
+	begin
+		wait until falling_edge(clk);
+		wait until falling_edge(clk);
+		rst <= '0';
+		wait_cycles(4);
+
+		--Reset state; an empty FIFO reads 0
+		check_reg("reset", COUNT_REG, 0);
+		check_reg("reset", STATUS_REG, 0);
+		check_reg("reset", ENABLE_REG, 0);
+		check_reg("reset", LEVEL_REG, 0);
+		check_reg("reset", EVENT_DATA_REG, 0);
+		check_reg("reset", EVENT_TIME_REG, 0);
+		assert irq = '0'
+			report "reset: irq raised"
+			severity error;
+
+		--A count change sets status bit 0; irq stays low until it is enabled
+		step_up;
+		wait_cycles(8);
+		check_reg("count change", STATUS_REG, IRQ_COUNT);
+		assert irq = '0'
+			report "count change: irq raised while disabled"
+			severity error;
+		bus_write(ENABLE_REG, IRQ_COUNT);
+		assert irq = '1'
+			report "count change: irq not raised once enabled"
+			severity error;
+
+		--Writing 0, or 1 to the other bit, leaves the status bit alone;
+		--writing 1 clears it and drops irq, and leaves the FIFO alone
+		bus_write(STATUS_REG, 0);
+		bus_write(STATUS_REG, IRQ_BUTTON);
+		check_reg("W1C of the other bit", STATUS_REG, IRQ_COUNT);
+		assert irq = '1'
+			report "W1C of the other bit: irq dropped"
+			severity error;
+		bus_write(STATUS_REG, IRQ_COUNT);
+		check_reg("W1C", STATUS_REG, 0);
+		assert irq = '0'
+			report "W1C: irq still raised"
+			severity error;
+		check_reg("W1C", LEVEL_REG, 1);
+
+		--A button press sets bit 1, which raises irq only once its own
+		--enable bit is set
+		push_button <= '1';
+		release_button;
+		en := not en;
+		check_reg("button", STATUS_REG, IRQ_BUTTON);
+		assert irq = '0'
+			report "button: irq raised with only the count enabled"
+			severity error;
+		bus_write(ENABLE_REG, IRQ_COUNT + IRQ_BUTTON);
+		assert irq = '1'
+			report "button: irq not raised once enabled"
+			severity error;
+		bus_write(STATUS_REG, IRQ_BUTTON);
+		check_reg("button W1C", STATUS_REG, 0);
+
+		--An event in the same cycle as the write that clears its bit wins:
+		--the step is decoded, and the write sampled, on the fourth edge
+		step_up;
+		wait_cycles(2);
+		bus_write(STATUS_REG, IRQ_COUNT);
+		check_reg("W1C race", STATUS_REG, IRQ_COUNT);
+		assert irq = '1'
+			report "W1C race: irq dropped with the event pending"
+			severity error;
+		--One cycle later the write clears it
+		step_up;
+		wait_cycles(3);
+		bus_write(STATUS_REG, IRQ_COUNT);
+		check_reg("W1C after the event", STATUS_REG, 0);
+		bus_write(ENABLE_REG, 0);
+		drain;
+		clear_count;
+
+		--Each event is pushed with the clock cycle it was decoded in, and
+		--each single-cycle read pops exactly one
+		read_cycles(t0);
+		step_up;
+		wait_cycles(6);
+		read_cycles(t1);
+		step_up;
+		wait_cycles(8);
+		check_reg("two events", LEVEL_REG, 2);
+		check_event("first event", false, 1, '1', '0', t0 + COUNT_DELAY);
+		check_reg("first event popped", LEVEL_REG, 1);
+		check_event("second event", false, 2, '1', '0', t1 + COUNT_DELAY);
+		check_reg("second event popped", LEVEL_REG, 0);
+		--An empty FIFO reads 0 and leaves the level and event time alone
+		check_reg("empty", EVENT_DATA_REG, 0);
+		check_reg("empty", LEVEL_REG, 0);
+		check_reg("empty", EVENT_TIME_REG, t1 + COUNT_DELAY);
+
+		--A button press carries the count and the new enable state
+		for i in 1 to 2 loop
+			read_cycles(t0);
+			push_button <= '1';
+			release_button;
+			en := not en;
+			check_event("button", true, count, en, '0', t0 + BUTTON_DELAY);
+		end loop;
+
+		--A button press and a count change k cycles after it: whichever is
+		--decoded first is pushed first, and a button event in the same cycle
+		--as a count event waits a cycle. The button event carries the count
+		--when it is pushed.
+		for k in 0 to 4 loop
+			read_cycles(t0);
+			push_button <= '1';
+			wait_cycles(k);
+			step_up;
+			release_button;
+			en := not en;
+			tc := t0 + k + COUNT_DELAY;
+			tp := t0 + BUTTON_DELAY;
+			if tp = tc then
+				tp := tp + 1;
+			end if;
+			check_reg("collision " & integer'image(k), LEVEL_REG, 2);
+			if tc < tp then
+				check_event("collision " & integer'image(k), false, count, '1', '0', tc);
+				check_event("collision " & integer'image(k), true, count, en, '0', tp);
+			else
+				check_event("collision " & integer'image(k), true, count - 1, en, '0', tp);
+				check_event("collision " & integer'image(k), false, count, '1', '0', tc);
+			end if;
+		end loop;
+
+		--Overfill the FIFO: the first FIFO_DEPTH events are kept, the rest
+		--dropped, and the next event pushed has bit 31 set
+		clear_count;
+		for i in 1 to FIFO_DEPTH + 2 loop
+			step_up;
+			wait_cycles(2);
+		end loop;
+		wait_cycles(6);
+		check_reg("full", LEVEL_REG, FIFO_DEPTH);
+		check_word("full", false, 1, '1', '0');
+		check_reg("full, one popped", LEVEL_REG, FIFO_DEPTH - 1);
+		read_cycles(t0);
+		step_up;
+		wait_cycles(8);
+		check_reg("after the overflow", LEVEL_REG, FIFO_DEPTH);
+		for i in 2 to FIFO_DEPTH loop
+			check_word("full", false, i, '1', '0');
+		end loop;
+		check_event("after the overflow", false, FIFO_DEPTH + 3, '1', '1', t0 + COUNT_DELAY);
+		--The flag is only on the first event after the drop
+		step_up;
+		wait_cycles(8);
+		check_word("after the flagged event", false, FIFO_DEPTH + 4, '1', '0');
+		check_reg("after the flagged event", LEVEL_REG, 0);
+
+		report "rotary_avalon_tb: done";
+		done <= true;
+		wait;
+	end process;
+
+end architecture;
@@ -9,9 +9,14 @@
 // offsets for rotary encoder
 #define ENCODER_STATE_OFFSET 0x0
 #define ENABLE_OFFSET 0x4
+// The decoder counts every quadrature edge, 4 per detent
+#define COUNTS_PER_DETENT 4
 // offsets for buzzer
 #define VOLUME_OFFSET 0x0
-#define PERIOD_OFFSET 0x4
+#define FTW_OFFSET 0xC
+// The DDS tuning word is freq * 2^32 / 50 MHz; this is 2^64 / 50 MHz so the
+// conversion is a multiply and a shift
+#define FTW_PER_HZ_Q32 368934881474ULL
 
 // vars for writing to devices
 FILE *file;
@@ -25,7 +30,7 @@ uint32_t buzzer_en;
 // vars for buzzer
 uint32_t volume;
 uint32_t freq;
-uint32_t period_b;
+uint32_t ftw;
 
 
 void INThandler(int sig)
@@ -47,7 +52,7 @@ void INThandler(int sig)
 		ret = fwrite(&val, 4, 1, file);
 		fflush(file);
 
-		ret = fseek(file, PERIOD_OFFSET, SEEK_SET);
+		ret = fseek(file, FTW_OFFSET, SEEK_SET);
 		ret = fwrite(&val, 4, 1, file);
 		fflush(file);
 
@@ -76,14 +81,13 @@ int main () {
 	// Getting frequency from user
 	printf("Please enter buzzer frequency: ");
 	scanf("%d", &freq); // I know scanf is not the best way to do this, and I know I could implement some ways to make sure this is only integer values, but I don't have the time/will power to implement this. Remeber I am uninspired and lazy...
-	if (freq < 16)
+	if (freq < 16 || freq > 20000)
 	{
-		printf("Please enter a frequency greater than 16 Hz\n");
+		printf("Please enter a frequency between 16 Hz and 20000 Hz\n");
 		exit(1);
 	}
-	// Converting the frequency to the correct 32.26 (n.f) number for the period register
-	period_b = 1000/freq; // first change frequency to period in milliseconds
-	period_b = period_b << 26; // mulitply by number of fractional bits so we get correct value for register
+	// Converting the frequency to the tuning word, rounded to the nearest step
+	ftw = ((uint64_t)freq * FTW_PER_HZ_Q32 + (1ULL << 31)) >> 32;
 	
 	//signal(SIGINT, INThandler); // allow for exit with ^C
 	while(1)
@@ -100,12 +104,12 @@ int main () {
 		printf("buzzer enable = 0x%x\n", buzzer_en);
 		fclose(file);
 
-		// now if we are enabled we should write to the period register 
+		// now if we are enabled we should write to the tuning word register 
 		if (buzzer_en == 1)
 		{
 			file = fopen("/dev/buzzer", "rb+");
-			ret = fseek(file, PERIOD_OFFSET, SEEK_SET);
-			ret = fwrite(&period_b, 4, 1, file);
+			ret = fseek(file, FTW_OFFSET, SEEK_SET);
+			ret = fwrite(&ftw, 4, 1, file);
 			fflush(file);
 			fclose(file);
 
@@ -122,8 +126,8 @@ int main () {
 			ret = fread(&volume, 4, 1, file);
 			printf("volume = %d\n",volume);
 			fclose(file);
-			// Multiply by scaling value
-			volume = volume * 8322;
+			// Convert to detents, then multiply by scaling value
+			volume = (volume / COUNTS_PER_DETENT) * 8322;
 
 			// Write to buzzer volume register
 			file = fopen("/dev/buzzer","rb+");
@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "de10nano_led_array.h"
+
+// led_array registers the test reads back
+#define LED_OFFSET          0x00
+#define SEQ_CONTROL_OFFSET  0x10
+#define SEQ_LENGTH_OFFSET   0x14
+#define FRAMES_OFFSET       0x800
+
+#define SEQ_CONTROL_RUN     0x1
+#define FRAME_DURATION_SHIFT 16
+
+// Frames the emulated pattern RAM holds: the rest of the 4 KiB span
+#define EMULATED_FRAMES     ((4096 - FRAMES_OFFSET) / 4)
+
+static int fd;
+static int failures;
+
+#define CHECK(cond, ...) check(__LINE__, (cond), __VA_ARGS__)
+
+static void check(int line, int cond, const char *fmt, ...)
+	__attribute__((format(printf, 3, 4)));
+
+static void check(int line, int cond, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (cond) {
+		return;
+	}
+	printf("line %d: ", line);
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	printf("\n");
+	failures++;
+}
+
+static uint32_t read_reg(uint32_t offset)
+{
+	uint32_t val = 0;
+
+	CHECK(pread(fd, &val, 4, offset) == 4, "pread 0x%x: %s", offset,
+		strerror(errno));
+	return val;
+}
+
+static void write_reg(uint32_t offset, uint32_t val)
+{
+	CHECK(pwrite(fd, &val, 4, offset) == 4, "pwrite 0x%x: %s", offset,
+		strerror(errno));
+}
+
+// Load an animation; returns 0 or the ioctl's errno.
+static int load(const struct de10nano_led_frame *frames, uint32_t count,
+	uint32_t mode, uint32_t flags, uint32_t reserved)
+{
+	struct de10nano_led_seq seq = {
+		.frames = (uintptr_t)frames,
+		.count = count,
+		.mode = mode,
+		.flags = flags,
+		.reserved = reserved,
+	};
+
+	if (ioctl(fd, DE10NANO_LED_IOC_SEQ_LOAD, &seq) < 0) {
+		return errno;
+	}
+	return 0;
+}
+
+static int stop(void)
+{
+	if (ioctl(fd, DE10NANO_LED_IOC_SEQ_STOP) < 0) {
+		return errno;
+	}
+	return 0;
+}
+
+// A distinct frame for every index, with a pattern wider than 8 bits
+static struct de10nano_led_frame frame(uint32_t i)
+{
+	struct de10nano_led_frame f = {
+		.pattern = 0x300 | ((i * 37 + 1) & 0xff),
+		.duration_ms = 1 + (i * 7919) % DE10NANO_LED_FRAME_MAX_MS,
+	};
+
+	return f;
+}
+
+static uint32_t frame_word(const struct de10nano_led_frame *f)
+{
+	return (f->pattern & 0xff) | (f->duration_ms << FRAME_DURATION_SHIFT);
+}
+
+/*
+* The pattern RAM holds the first count frames, each as its low pattern
+* byte and its duration, and the sequencer was started in the given mode.
+*/
+static void check_upload(const char *name, const struct de10nano_led_frame *frames,
+	uint32_t count, uint32_t mode)
+{
+	static uint32_t words[EMULATED_FRAMES];
+	uint32_t control;
+	uint32_t length;
+	uint32_t i;
+
+	CHECK(pread(fd, words, count * 4, FRAMES_OFFSET) == (ssize_t)(count * 4),
+		"%s: pread of the pattern RAM: %s", name, strerror(errno));
+	for (i = 0; i < count; i++) {
+		CHECK(words[i] == frame_word(&frames[i]), "%s: frame %u is 0x%08x, "
+			"expected 0x%08x", name, i, words[i], frame_word(&frames[i]));
+	}
+
+	length = read_reg(SEQ_LENGTH_OFFSET);
+	CHECK(length == count, "%s: length %u, expected %u", name, length, count);
+	control = read_reg(SEQ_CONTROL_OFFSET);
+	CHECK(control == ((mode << 1) | SEQ_CONTROL_RUN), "%s: control 0x%x, "
+		"expected mode %u and the run bit", name, control, mode);
+}
+
+// Every mode uploads the frames and starts the sequencer in that mode.
+static void test_modes(void)
+{
+	struct de10nano_led_frame frames[5];
+	uint32_t mode;
+	uint32_t i;
+
+	for (i = 0; i < 5; i++) {
+		frames[i] = frame(i);
+	}
+	for (mode = DE10NANO_LED_SEQ_LOOP; mode <= DE10NANO_LED_SEQ_ONESHOT; mode++) {
+		CHECK(load(frames, 5, mode, DE10NANO_LED_SEQ_FABRIC, 0) == 0,
+			"mode %u: load failed", mode);
+		check_upload("modes", frames, 5, mode);
+	}
+
+	// A shorter animation replaces the longer one.
+	frames[0] = frame(100);
+	frames[1] = frame(101);
+	CHECK(load(frames, 2, DE10NANO_LED_SEQ_LOOP, DE10NANO_LED_SEQ_FABRIC, 0) == 0,
+		"replacement load failed");
+	check_upload("replacement", frames, 2, DE10NANO_LED_SEQ_LOOP);
+}
+
+// The whole pattern RAM can be used, and one frame more is refused.
+static void test_capacity(void)
+{
+	static struct de10nano_led_frame frames[EMULATED_FRAMES + 1];
+	uint32_t i;
+
+	for (i = 0; i <= EMULATED_FRAMES; i++) {
+		frames[i] = frame(i);
+	}
+	CHECK(load(frames, EMULATED_FRAMES, DE10NANO_LED_SEQ_PINGPONG,
+		DE10NANO_LED_SEQ_FABRIC, 0) == 0, "full pattern RAM refused");
+	check_upload("full", frames, EMULATED_FRAMES, DE10NANO_LED_SEQ_PINGPONG);
+
+	CHECK(load(frames, EMULATED_FRAMES + 1, DE10NANO_LED_SEQ_LOOP,
+		DE10NANO_LED_SEQ_FABRIC, 0) == EINVAL,
+		"more frames than the pattern RAM holds accepted");
+	check_upload("after too many frames", frames, EMULATED_FRAMES,
+		DE10NANO_LED_SEQ_PINGPONG);
+}
+
+// Bad requests fail before the playing animation is touched.
+static void test_errors(void)
+{
+	struct de10nano_led_frame playing[3];
+	struct de10nano_led_frame bad[3];
+	uint32_t i;
+
+	for (i = 0; i < 3; i++) {
+		playing[i] = frame(i);
+		bad[i] = frame(200 + i);
+	}
+	CHECK(load(playing, 3, DE10NANO_LED_SEQ_ONESHOT, DE10NANO_LED_SEQ_FABRIC,
+		0) == 0, "load failed");
+
+	CHECK(load(bad, 0, DE10NANO_LED_SEQ_LOOP, DE10NANO_LED_SEQ_FABRIC, 0) ==
+		EINVAL, "empty animation accepted");
+	CHECK(load(bad, 3, DE10NANO_LED_SEQ_ONESHOT + 1, DE10NANO_LED_SEQ_FABRIC,
+		0) == EINVAL, "bad mode accepted");
+	CHECK(load(bad, 3, DE10NANO_LED_SEQ_LOOP, DE10NANO_LED_SEQ_FABRIC << 1,
+		0) == EINVAL, "unknown flag accepted");
+	CHECK(load(bad, 3, DE10NANO_LED_SEQ_LOOP, DE10NANO_LED_SEQ_FABRIC, 1) ==
+		EINVAL, "reserved field accepted");
+	CHECK(load(NULL, 3, DE10NANO_LED_SEQ_LOOP, DE10NANO_LED_SEQ_FABRIC, 0) ==
+		EFAULT, "NULL frames accepted");
+
+	bad[2].duration_ms = 0;
+	CHECK(load(bad, 3, DE10NANO_LED_SEQ_LOOP, DE10NANO_LED_SEQ_FABRIC, 0) ==
+		EINVAL, "duration of 0 accepted");
+	bad[2].duration_ms = DE10NANO_LED_FRAME_MAX_MS + 1;
+	CHECK(load(bad, 3, DE10NANO_LED_SEQ_LOOP, DE10NANO_LED_SEQ_FABRIC, 0) ==
+		EINVAL, "duration over the maximum accepted");
+
+	check_upload("after bad requests", playing, 3, DE10NANO_LED_SEQ_ONESHOT);
+}
+
+/*
+* Stopping clears the run bit and leaves the frame being shown in the LED
+* register. Nothing plays the emulated pattern RAM, so its status register
+* always reads frame 0.
+*/
+static void test_stop(void)
+{
+	struct de10nano_led_frame frames[2] = { frame(7), frame(8) };
+	uint32_t led;
+
+	CHECK(load(frames, 2, DE10NANO_LED_SEQ_LOOP, DE10NANO_LED_SEQ_FABRIC, 0) ==
+		0, "load failed");
+	CHECK(stop() == 0, "stop failed");
+	CHECK(read_reg(SEQ_CONTROL_OFFSET) == 0, "run bit still set after stop");
+	led = read_reg(LED_OFFSET);
+	CHECK(led == frames[0].pattern, "LED register 0x%x after stop, expected "
+		"frame 0's 0x%x", led, frames[0].pattern);
+	CHECK(stop() == 0, "second stop failed");
+
+	// Writing the LED register stops the sequencer too.
+	CHECK(load(frames, 2, DE10NANO_LED_SEQ_LOOP, DE10NANO_LED_SEQ_FABRIC, 0) ==
+		0, "load failed");
+	write_reg(LED_OFFSET, 0x5a);
+	CHECK(read_reg(SEQ_CONTROL_OFFSET) == 0, "run bit still set after an "
+		"LED register write");
+	CHECK(read_reg(LED_OFFSET) == 0x5a, "LED register write lost");
+
+	// Loading a timer-driven animation stops the fabric sequencer.
+	CHECK(load(frames, 2, DE10NANO_LED_SEQ_LOOP, DE10NANO_LED_SEQ_FABRIC, 0) ==
+		0, "load failed");
+	CHECK(load(frames, 2, DE10NANO_LED_SEQ_LOOP, 0, 0) == 0,
+		"timer animation load failed");
+	CHECK(read_reg(SEQ_CONTROL_OFFSET) == 0, "run bit still set with the "
+		"timer playing");
+	CHECK(stop() == 0, "stop failed");
+}
+
+int main(int argc, char **argv)
+{
+	const char *dev = argc > 1 ? argv[1] : "/dev/led_array";
+
+	fd = open(dev, O_RDWR);
+	if (fd < 0) {
+		printf("failed to open %s: %s\n", dev, strerror(errno));
+		exit(1);
+	}
+
+	test_modes();
+	test_capacity();
+	test_errors();
+	test_stop();
+
+	close(fd);
+
+	if (failures) {
+		printf("led-seq: %d failures\n", failures);
+		return 1;
+	}
+	printf("led-seq: all tests passed\n");
+	return 0;
+}
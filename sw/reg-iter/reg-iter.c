@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+// /dev/rgb_led's span; its first four registers (period and duty cycles) and
+// its last, unused one are the ones the test writes.
+#define DEFAULT_SPAN 32
+#define MAX_SPAN 4096
+
+static int fd;
+static uint32_t span;
+static int failures;
+
+#define CHECK(cond, ...) check(__LINE__, (cond), __VA_ARGS__)
+
+static void check(int line, int cond, const char *fmt, ...)
+	__attribute__((format(printf, 3, 4)));
+
+static void check(int line, int cond, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (cond) {
+		return;
+	}
+	printf("line %d: ", line);
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	printf("\n");
+	failures++;
+}
+
+static off_t pos(void)
+{
+	return lseek(fd, 0, SEEK_CUR);
+}
+
+static uint32_t read_reg(uint32_t offset)
+{
+	uint32_t val = 0;
+
+	CHECK(pread(fd, &val, 4, offset) == 4, "pread 0x%x: %s", offset,
+		strerror(errno));
+	return val;
+}
+
+static void write_reg(uint32_t offset, uint32_t val)
+{
+	CHECK(pwrite(fd, &val, 4, offset) == 4, "pwrite 0x%x: %s", offset,
+		strerror(errno));
+}
+
+// One call moves several registers, split across iovecs anywhere.
+static void test_vectors(void)
+{
+	uint32_t vals[4] = { 0x11111111, 0x22222222, 0x33333333, 0x44444444 };
+	uint32_t got[MAX_SPAN / 4];
+	uint8_t *bytes = (uint8_t *)vals;
+	struct iovec iov[3];
+	uint32_t i;
+
+	// writev() with an iovec boundary in the middle of a register
+	iov[0].iov_base = bytes;
+	iov[0].iov_len = 6;
+	iov[1].iov_base = bytes + 6;
+	iov[1].iov_len = 10;
+	CHECK(lseek(fd, 0, SEEK_SET) == 0, "lseek: %s", strerror(errno));
+	CHECK(writev(fd, iov, 2) == 16, "writev of 16 bytes: %s", strerror(errno));
+	CHECK(pos() == 16, "writev left the position at %lld", (long long)pos());
+	for (i = 0; i < 4; i++) {
+		CHECK(read_reg(i * 4) == vals[i], "reg 0x%x after writev", i * 4);
+	}
+
+	// readv() of the whole span matches one pread() per register.
+	memset(got, 0, sizeof(got));
+	iov[0].iov_base = got;
+	iov[0].iov_len = 10;
+	iov[1].iov_base = (uint8_t *)got + 10;
+	iov[1].iov_len = span - 10;
+	CHECK(lseek(fd, 0, SEEK_SET) == 0, "lseek: %s", strerror(errno));
+	CHECK(readv(fd, iov, 2) == (ssize_t)span, "readv of the span: %s",
+		strerror(errno));
+	CHECK(pos() == span, "readv left the position at %lld", (long long)pos());
+	for (i = 0; i < span / 4; i++) {
+		CHECK(got[i] == read_reg(i * 4), "reg 0x%x: readv 0x%x", i * 4, got[i]);
+	}
+
+	// pwritev() and preadv() leave the file position alone.
+	CHECK(lseek(fd, 8, SEEK_SET) == 8, "lseek: %s", strerror(errno));
+	vals[0] = 0x55555555;
+	vals[1] = 0x66666666;
+	iov[0].iov_base = &vals[0];
+	iov[0].iov_len = 4;
+	iov[1].iov_base = &vals[1];
+	iov[1].iov_len = 4;
+	CHECK(pwritev(fd, iov, 2, 4) == 8, "pwritev: %s", strerror(errno));
+	CHECK(pos() == 8, "pwritev moved the position to %lld", (long long)pos());
+	CHECK(read_reg(4) == 0x55555555 && read_reg(8) == 0x66666666,
+		"pwritev wrote the wrong registers");
+	iov[0].iov_base = &got[0];
+	iov[1].iov_base = &got[1];
+	CHECK(preadv(fd, iov, 2, 4) == 8, "preadv: %s", strerror(errno));
+	CHECK(pos() == 8, "preadv moved the position to %lld", (long long)pos());
+	CHECK(got[0] == 0x55555555 && got[1] == 0x66666666,
+		"preadv read 0x%x 0x%x", got[0], got[1]);
+
+	// read() carries on from where the last read() stopped.
+	CHECK(lseek(fd, 0, SEEK_SET) == 0, "lseek: %s", strerror(errno));
+	CHECK(read(fd, got, 8) == 8, "read of 8 bytes: %s", strerror(errno));
+	CHECK(read(fd, got, 4) == 4, "read of 4 bytes: %s", strerror(errno));
+	CHECK(got[0] == 0x66666666, "second read got 0x%x, not reg 8's value",
+		got[0]);
+	CHECK(pos() == 12, "two reads left the position at %lld",
+		(long long)pos());
+}
+
+// Counts that aren't whole registers move the whole registers in them.
+static void test_partial(void)
+{
+	uint32_t vals[2] = { 0x77777777, 0x88888888 };
+	uint32_t got[2] = { 0, 0 };
+
+	write_reg(0, 0x12345678);
+
+	CHECK(lseek(fd, 0, SEEK_SET) == 0, "lseek: %s", strerror(errno));
+	CHECK(read(fd, got, 6) == 4, "read of 6 bytes didn't return 4");
+	CHECK(got[0] == 0x12345678, "read of 6 bytes got 0x%x", got[0]);
+	CHECK(pos() == 4, "read of 6 bytes left the position at %lld",
+		(long long)pos());
+
+	CHECK(lseek(fd, 0, SEEK_SET) == 0, "lseek: %s", strerror(errno));
+	CHECK(write(fd, vals, 7) == 4, "write of 7 bytes didn't return 4");
+	CHECK(pos() == 4, "write of 7 bytes left the position at %lld",
+		(long long)pos());
+	CHECK(read_reg(0) == 0x77777777, "write of 7 bytes: reg 0 wrong");
+	CHECK(read_reg(4) != 0x88888888, "write of 7 bytes wrote reg 4");
+
+	// Less than a register, and unaligned offsets, move nothing.
+	errno = 0;
+	CHECK(pread(fd, got, 3, 0) < 0 && errno == EINVAL,
+		"read of 3 bytes: %s", strerror(errno));
+	errno = 0;
+	CHECK(pwrite(fd, vals, 3, 0) < 0 && errno == EINVAL,
+		"write of 3 bytes: %s", strerror(errno));
+	CHECK(read_reg(0) == 0x77777777, "write of 3 bytes changed reg 0");
+	errno = 0;
+	CHECK(pread(fd, got, 4, 2) < 0, "unaligned pread succeeded");
+	errno = 0;
+	CHECK(pwrite(fd, vals, 4, 2) < 0, "unaligned pwrite succeeded");
+	CHECK(read_reg(0) == 0x77777777, "unaligned pwrite changed reg 0");
+}
+
+// Transfers stop at the end of the span.
+static void test_span_end(void)
+{
+	uint32_t vals[4] = { 0x99999999, 0xaaaaaaaa, 0xbbbbbbbb, 0xcccccccc };
+	uint32_t got[4];
+	struct iovec iov[3];
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		iov[i].iov_base = &got[i];
+		iov[i].iov_len = 4;
+	}
+
+	// preadv() across the end returns what is left of the span.
+	CHECK(preadv(fd, iov, 3, span - 8) == 8, "preadv across the end: %s",
+		strerror(errno));
+	CHECK(preadv(fd, iov, 3, span - 4) == 4, "preadv of the last register: "
+		"%s", strerror(errno));
+	CHECK(preadv(fd, iov, 3, span) == 0, "preadv at the end didn't return 0");
+	CHECK(preadv(fd, iov, 3, span + 4) == 0, "preadv past the end didn't "
+		"return 0");
+
+	// pwrite() across the end only writes the last register.
+	CHECK(pwrite(fd, vals, 8, span - 4) == 4, "pwrite across the end: %s",
+		strerror(errno));
+	CHECK(read_reg(span - 4) == 0x99999999, "pwrite across the end: last "
+		"register wrong");
+	CHECK(pwrite(fd, vals, 4, span) == 0, "pwrite at the end didn't return 0");
+
+	// read() at the end returns 0 and leaves the position there.
+	CHECK(lseek(fd, span - 4, SEEK_SET) == span - 4, "lseek: %s",
+		strerror(errno));
+	CHECK(read(fd, got, sizeof(got)) == 4, "read of the last register: %s",
+		strerror(errno));
+	CHECK(pos() == span, "position %lld after the last register",
+		(long long)pos());
+	CHECK(read(fd, got, sizeof(got)) == 0, "read at the end didn't return 0");
+	CHECK(pos() == span, "read at the end moved the position to %lld",
+		(long long)pos());
+}
+
+int main(int argc, char **argv)
+{
+	const char *dev = argc > 1 ? argv[1] : "/dev/rgb_led";
+
+	span = argc > 2 ? strtoul(argv[2], NULL, 0) : DEFAULT_SPAN;
+	if (span < 32 || span > MAX_SPAN || span % 4) {
+		printf("span must be a multiple of 4 from 32 to %d\n", MAX_SPAN);
+		exit(1);
+	}
+
+	fd = open(dev, O_RDWR);
+	if (fd < 0) {
+		printf("failed to open %s: %s\n", dev, strerror(errno));
+		exit(1);
+	}
+
+	test_vectors();
+	test_partial();
+	test_span_end();
+
+	close(fd);
+
+	if (failures) {
+		printf("reg-iter: %d failures\n", failures);
+		return 1;
+	}
+	printf("reg-iter: all tests passed\n");
+	return 0;
+}
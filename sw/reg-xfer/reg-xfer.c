@@ -0,0 +1,323 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include "de10nano_regs.h"
+
+// rgb_led registers the test writes: the period and the three duty cycles.
+// The driver commits every write, so none of them have side effects.
+#define NUM_REGS 4
+#define REG(i) ((i) * 4)
+
+// Writes per timed run
+#define BENCH_WRITES 100000
+
+static int fd;
+static int failures;
+
+#define CHECK(cond, ...) check(__LINE__, (cond), __VA_ARGS__)
+
+static void check(int line, int cond, const char *fmt, ...)
+	__attribute__((format(printf, 3, 4)));
+
+static void check(int line, int cond, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (cond) {
+		return;
+	}
+	printf("line %d: ", line);
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	printf("\n");
+	failures++;
+}
+
+// Run a batch; returns 0 or the ioctl's errno.
+static int xfer(struct de10nano_reg_op *ops, uint32_t *results, uint32_t count)
+{
+	struct de10nano_reg_xfer xfer = {
+		.ops = (uintptr_t)ops,
+		.results = (uintptr_t)results,
+		.count = count,
+		.timeout_us = 1000,
+	};
+
+	if (ioctl(fd, DE10NANO_IOC_REG_XFER, &xfer) < 0) {
+		return errno;
+	}
+	return 0;
+}
+
+// The per-u32 path: one pwrite() or pread() per register
+static void write_reg(uint32_t offset, uint32_t val)
+{
+	CHECK(pwrite(fd, &val, 4, offset) == 4, "pwrite 0x%x: %s", offset,
+		strerror(errno));
+}
+
+static uint32_t read_reg(uint32_t offset)
+{
+	uint32_t val = 0;
+
+	CHECK(pread(fd, &val, 4, offset) == 4, "pread 0x%x: %s", offset,
+		strerror(errno));
+	return val;
+}
+
+static struct de10nano_reg_op op(uint32_t offset, uint32_t type,
+	uint32_t value, uint32_t mask)
+{
+	struct de10nano_reg_op o = {
+		.offset = offset,
+		.op = type,
+		.value = value,
+		.mask = mask,
+	};
+
+	return o;
+}
+
+// Every result of a batch and every register matches what write() gives.
+static void test_write_read(void)
+{
+	struct de10nano_reg_op ops[2 * NUM_REGS];
+	uint32_t results[2 * NUM_REGS];
+	uint32_t i;
+
+	// Set the registers through write(), read them back through the ioctl.
+	for (i = 0; i < NUM_REGS; i++) {
+		write_reg(REG(i), 0x1000 + i);
+		ops[i] = op(REG(i), DE10NANO_REG_READ, 0, 0);
+	}
+	CHECK(xfer(ops, results, NUM_REGS) == 0, "read batch failed");
+	for (i = 0; i < NUM_REGS; i++) {
+		CHECK(results[i] == 0x1000 + i, "reg 0x%x: ioctl read 0x%x after "
+			"write() of 0x%x", REG(i), results[i], 0x1000 + i);
+	}
+
+	// Write them through the ioctl and read them back in the same batch.
+	for (i = 0; i < NUM_REGS; i++) {
+		ops[i] = op(REG(i), DE10NANO_REG_WRITE, 0x2000 + i, 0);
+		ops[NUM_REGS + i] = op(REG(i), DE10NANO_REG_READ, 0, 0);
+	}
+	CHECK(xfer(ops, results, 2 * NUM_REGS) == 0, "write batch failed");
+	for (i = 0; i < NUM_REGS; i++) {
+		CHECK(results[i] == 0x2000 + i, "reg 0x%x: write result 0x%x",
+			REG(i), results[i]);
+		CHECK(results[NUM_REGS + i] == 0x2000 + i, "reg 0x%x: read result "
+			"0x%x", REG(i), results[NUM_REGS + i]);
+		CHECK(read_reg(REG(i)) == 0x2000 + i, "reg 0x%x: read() after ioctl "
+			"write", REG(i));
+	}
+
+	// Results are optional.
+	ops[0] = op(REG(0), DE10NANO_REG_WRITE, 0x3000, 0);
+	CHECK(xfer(ops, NULL, 1) == 0, "batch without results failed");
+	CHECK(read_reg(REG(0)) == 0x3000, "write without results lost");
+}
+
+/*
+* Writes of the value a register already holds are skipped by the register
+* cache. Skipped or not, the result and the register have to be what the
+* write() path gives.
+*/
+static void test_write_elision(void)
+{
+	struct de10nano_reg_op ops[3];
+	uint32_t results[3];
+	uint32_t ioctl_val;
+	uint32_t write_val;
+
+	// Same value twice, through both paths
+	ops[0] = op(REG(1), DE10NANO_REG_WRITE, 0x4444, 0);
+	ops[1] = op(REG(1), DE10NANO_REG_WRITE, 0x4444, 0);
+	ops[2] = op(REG(1), DE10NANO_REG_READ, 0, 0);
+	CHECK(xfer(ops, results, 3) == 0, "repeated write batch failed");
+	CHECK(results[0] == 0x4444 && results[1] == 0x4444 &&
+		results[2] == 0x4444, "repeated write results 0x%x 0x%x 0x%x",
+		results[0], results[1], results[2]);
+	ioctl_val = read_reg(REG(1));
+
+	write_reg(REG(2), 0x4444);
+	write_reg(REG(2), 0x4444);
+	write_val = read_reg(REG(2));
+	CHECK(ioctl_val == write_val, "repeated write: ioctl left 0x%x, write() "
+		"0x%x", ioctl_val, write_val);
+
+	// Writing a register back to its old value is a real write.
+	ops[0] = op(REG(1), DE10NANO_REG_WRITE, 0x5555, 0);
+	ops[1] = op(REG(1), DE10NANO_REG_WRITE, 0x4444, 0);
+	ops[2] = op(REG(1), DE10NANO_REG_READ, 0, 0);
+	CHECK(xfer(ops, results, 3) == 0, "write back batch failed");
+	CHECK(results[2] == 0x4444, "write back: read 0x%x", results[2]);
+	CHECK(read_reg(REG(1)) == 0x4444, "write back: read() disagrees");
+
+	// Read-modify-writes: one that changes nothing and one that does
+	ops[0] = op(REG(1), DE10NANO_REG_RMW, 0x4400, 0xff00);
+	ops[1] = op(REG(1), DE10NANO_REG_RMW, 0xab00, 0xff00);
+	ops[2] = op(REG(1), DE10NANO_REG_READ, 0, 0);
+	CHECK(xfer(ops, results, 3) == 0, "rmw batch failed");
+	CHECK(results[0] == 0x4444, "unchanged rmw result 0x%x", results[0]);
+	CHECK(results[1] == 0xab44, "rmw result 0x%x", results[1]);
+	CHECK(results[2] == 0xab44, "read after rmw 0x%x", results[2]);
+	CHECK(read_reg(REG(1)) == 0xab44, "read() after rmw disagrees");
+}
+
+/*
+* While the registers are mapped, stores through the mapping change them
+* behind the cache's back. A write of the value the cache last saw must still
+* reach the register then, and once the mapping goes away the cache must pick
+* up what was stored through it.
+*/
+static void test_write_elision_mapped(void)
+{
+	struct de10nano_reg_op ops[2];
+	uint32_t results[2];
+	volatile uint32_t *regs;
+	long page = sysconf(_SC_PAGESIZE);
+
+	regs = mmap(NULL, page, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (regs == MAP_FAILED) {
+		printf("mmap: %s; skipping the mapped tests\n", strerror(errno));
+		return;
+	}
+
+	// ioctl path
+	ops[0] = op(REG(2), DE10NANO_REG_WRITE, 0x6666, 0);
+	CHECK(xfer(ops, results, 1) == 0, "write batch failed");
+	regs[REG(2) / 4] = 0x7777;
+	CHECK(xfer(ops, results, 1) == 0, "write batch failed");
+	CHECK(regs[REG(2) / 4] == 0x6666, "mapped: ioctl write of the cached "
+		"value was skipped (reg 0x%x)", regs[REG(2) / 4]);
+
+	// write() path
+	write_reg(REG(3), 0x6666);
+	regs[REG(3) / 4] = 0x7777;
+	write_reg(REG(3), 0x6666);
+	CHECK(regs[REG(3) / 4] == 0x6666, "mapped: write() of the cached value "
+		"was skipped (reg 0x%x)", regs[REG(3) / 4]);
+
+	// Leave a value behind through the mapping only.
+	regs[REG(2) / 4] = 0x8888;
+	regs[REG(3) / 4] = 0x8888;
+	munmap((void *)regs, page);
+
+	ops[0] = op(REG(2), DE10NANO_REG_READ, 0, 0);
+	CHECK(xfer(ops, results, 1) == 0, "read batch failed");
+	CHECK(results[0] == 0x8888, "unmapped: ioctl read 0x%x", results[0]);
+	CHECK(read_reg(REG(3)) == 0x8888, "unmapped: read() disagrees");
+
+	// The cache holds 0x8888 now, so a write of 0x6666 must not be skipped.
+	ops[0] = op(REG(2), DE10NANO_REG_WRITE, 0x6666, 0);
+	ops[1] = op(REG(2), DE10NANO_REG_READ, 0, 0);
+	CHECK(xfer(ops, results, 2) == 0, "write batch failed");
+	CHECK(results[1] == 0x6666, "unmapped: write then read 0x%x", results[1]);
+	write_reg(REG(3), 0x6666);
+	CHECK(read_reg(REG(3)) == 0x6666, "unmapped: write() then read()");
+}
+
+// Bad batches fail as a whole, before any register is touched.
+static void test_errors(void)
+{
+	struct de10nano_reg_op ops[DE10NANO_REG_XFER_MAX + 1];
+	uint32_t results[DE10NANO_REG_XFER_MAX + 1];
+	int i;
+
+	write_reg(REG(0), 0x9999);
+
+	ops[0] = op(REG(0), DE10NANO_REG_WRITE, 0xaaaa, 0);
+	ops[1] = op(2, DE10NANO_REG_READ, 0, 0);
+	CHECK(xfer(ops, results, 2) == EINVAL, "unaligned offset accepted");
+	ops[1] = op(0x10000, DE10NANO_REG_READ, 0, 0);
+	CHECK(xfer(ops, results, 2) == EINVAL, "offset past the span accepted");
+	ops[1] = op(REG(0), 42, 0, 0);
+	CHECK(xfer(ops, results, 2) == EINVAL, "bad op accepted");
+	CHECK(read_reg(REG(0)) == 0x9999, "failed batch wrote a register");
+
+	CHECK(xfer(ops, results, 0) == EINVAL, "empty batch accepted");
+	for (i = 0; i <= DE10NANO_REG_XFER_MAX; i++) {
+		ops[i] = op(REG(0), DE10NANO_REG_READ, 0, 0);
+	}
+	CHECK(xfer(ops, results, DE10NANO_REG_XFER_MAX) == 0,
+		"full batch failed");
+	CHECK(xfer(ops, results, DE10NANO_REG_XFER_MAX + 1) == EINVAL,
+		"oversized batch accepted");
+
+	// Bit 0 of 0x9999 is set, so waiting for it to clear times out, and
+	// the failed batch doesn't copy results.
+	results[0] = 0x1234;
+	ops[0] = op(REG(0), DE10NANO_REG_WAIT, 0x0, 0x1);
+	CHECK(xfer(ops, results, 1) == ETIMEDOUT, "impossible wait succeeded");
+	CHECK(results[0] == 0x1234, "failed batch copied results");
+}
+
+static double elapsed_ns(struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1e9 + (now.tv_nsec - start->tv_nsec);
+}
+
+// Update the three duty cycles both ways and report the time per update.
+static void bench(void)
+{
+	struct de10nano_reg_op ops[3];
+	struct timespec start;
+	int i;
+	int j;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < BENCH_WRITES; i++) {
+		for (j = 1; j <= 3; j++) {
+			write_reg(REG(j), i + j);
+		}
+	}
+	printf("write(): %.0f ns per colour\n", elapsed_ns(&start) / BENCH_WRITES);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < BENCH_WRITES; i++) {
+		for (j = 1; j <= 3; j++) {
+			ops[j - 1] = op(REG(j), DE10NANO_REG_WRITE, i + j, 0);
+		}
+		CHECK(xfer(ops, NULL, 3) == 0, "bench batch failed");
+	}
+	printf("ioctl: %.0f ns per colour\n", elapsed_ns(&start) / BENCH_WRITES);
+}
+
+int main(int argc, char **argv)
+{
+	const char *dev = argc > 1 ? argv[1] : "/dev/rgb_led";
+
+	fd = open(dev, O_RDWR);
+	if (fd < 0) {
+		printf("failed to open %s: %s\n", dev, strerror(errno));
+		exit(1);
+	}
+
+	test_write_read();
+	test_write_elision();
+	test_write_elision_mapped();
+	test_errors();
+	bench();
+
+	close(fd);
+
+	if (failures) {
+		printf("reg-xfer: %d failures\n", failures);
+		return 1;
+	}
+	printf("reg-xfer: all tests passed\n");
+	return 0;
+}
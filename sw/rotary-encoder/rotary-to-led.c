@@ -5,11 +5,15 @@
 #include <string.h>
 #include <unistd.h>
 #include <signal.h>
+#include <fcntl.h>
 
 #define LED_ARRAY_OFFSET 0x0
 #define ROTARY_ENCODER_OFFSET 0x0
+// The decoder counts every quadrature edge, 4 per detent
+#define COUNTS_PER_DETENT 4
 
 FILE *file;
+int rotary_fd;
 size_t ret;	
 uint32_t encoder;   //Hold the value from the encoder state register
 uint32_t pattern;   //Hold the pattern to be written to the led array
@@ -41,16 +45,23 @@ void INThandler(int sig)
 int main () {
 
 	//signal(SIGINT, INThandler); // allow for exit with ^C
+
+    // Open the rotary encoder device driver once; we keep reading from it
+    rotary_fd = open("/dev/rotary", O_RDONLY);
+    if (rotary_fd < 0) {
+        printf("failed to open file\n");
+        exit(1);
+    }
+
     while(1)
         {
-        // Open the sysfs for the rotary encoder device driver
-        file = fopen("/dev/rotary" , "rb+" );
-        if (file == NULL) {
-            printf("failed to open file\n");
+        // The first read returns right away; after that the driver blocks
+        // the read until the encoder or push button changes.
+        if (pread(rotary_fd, &encoder, 4, ROTARY_ENCODER_OFFSET) != 4) {
+            printf("failed to read encoder: %s\n", strerror(errno));
             exit(1);
         }
-
-        ret = fread(&encoder, 4, 1, file);
+        encoder /= COUNTS_PER_DETENT;
         printf("Encoder State = 0x%x\n", encoder);
 
         // If else statement to determine the LED pattern from the encoder state
@@ -80,12 +91,6 @@ int main () {
             pattern = 0xFF;
         }
 
-        // Reset file position to 0
-        ret = fseek(file, 0, SEEK_SET);
-        printf("fseek ret = %d\n", ret);
-        printf("errno =%s\n", strerror(errno));
-        fclose(file);
-
         // Open the sysfs for the led_array device driver
         file = fopen("/dev/led_array" , "rb+" );
         if (file == NULL) {
@@ -98,7 +103,6 @@ int main () {
         ret = fwrite(&pattern, 4, 1, file);
         fflush(file);
         fclose(file);
-        sleep(1);
     }
     return 0;
 }
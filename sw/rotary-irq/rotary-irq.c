@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "de10nano_rotary.h"
+
+// rotary registers the test uses
+#define OUTPUT_OFFSET       0x00
+#define ENABLE_OFFSET       0x04
+#define IRQ_STATUS_OFFSET   0x08
+#define IRQ_ENABLE_OFFSET   0x0C
+#define FIFO_LEVEL_OFFSET   0x10
+#define EVENT_TIME_OFFSET   0x14
+#define SPAN                64
+
+#define IRQ_COUNT           0x1
+#define IRQ_BUTTON          0x2
+
+// Depth of the emulated event FIFO
+#define FIFO_DEPTH          64
+
+static int fd;
+static int events_fd;
+static int failures;
+
+#define CHECK(cond, ...) check(__LINE__, (cond), __VA_ARGS__)
+
+static void check(int line, int cond, const char *fmt, ...)
+	__attribute__((format(printf, 3, 4)));
+
+static void check(int line, int cond, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (cond) {
+		return;
+	}
+	printf("line %d: ", line);
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	printf("\n");
+	failures++;
+}
+
+static uint32_t read_reg(uint32_t offset)
+{
+	uint32_t val = 0;
+
+	CHECK(pread(fd, &val, 4, offset) == 4, "pread 0x%x: %s", offset,
+		strerror(errno));
+	return val;
+}
+
+static void write_reg(uint32_t offset, uint32_t val)
+{
+	CHECK(pwrite(fd, &val, 4, offset) == 4, "pwrite 0x%x: %s", offset,
+		strerror(errno));
+}
+
+// Every event record queued so far, up to max; never waits.
+static int read_events(struct de10nano_rotary_event *evs, int max)
+{
+	ssize_t n = read(events_fd, evs, max * sizeof(*evs));
+
+	if (n < 0) {
+		CHECK(errno == EAGAIN, "read of /dev/rotary_events: %s",
+			strerror(errno));
+		return 0;
+	}
+	return n / sizeof(*evs);
+}
+
+static void check_no_events(const char *name)
+{
+	struct de10nano_rotary_event ev;
+
+	CHECK(read_events(&ev, 1) == 0, "%s: an event was delivered", name);
+}
+
+static void check_regs(const char *name, uint32_t status, uint32_t level)
+{
+	uint32_t val;
+
+	val = read_reg(IRQ_STATUS_OFFSET);
+	CHECK(val == status, "%s: IRQ status 0x%x, expected 0x%x", name, val,
+		status);
+	val = read_reg(FIFO_LEVEL_OFFSET);
+	CHECK(val == level, "%s: FIFO level %u, expected %u", name, val, level);
+}
+
+// A detent record for count, counting up
+static void check_detent(const char *name, const struct de10nano_rotary_event *ev,
+	int32_t count, uint32_t flags)
+{
+	CHECK(ev->count == count && ev->flags == (DE10NANO_ROTARY_EV_UP | flags),
+		"%s: event count %d flags 0x%x, expected count %d flags 0x%x", name,
+		ev->count, ev->flags, count, DE10NANO_ROTARY_EV_UP | flags);
+}
+
+/*
+* IRQ status bits are set by events and cleared by writing 1 to them, and
+* the emulated interrupt is raised, and the FIFO drained, only while an
+* enabled status bit is set.
+*/
+static void test_irq(void)
+{
+	struct de10nano_rotary_event evs[4];
+	uint32_t enable;
+	uint32_t val;
+	int n;
+
+	// A count change with the interrupt off sets the status bit only.
+	write_reg(IRQ_ENABLE_OFFSET, 0);
+	write_reg(OUTPUT_OFFSET, 1);
+	check_regs("interrupt off", IRQ_COUNT, 1);
+	check_no_events("interrupt off");
+
+	// Writing 1 clears a status bit; writing 0, or 1 to another bit, doesn't.
+	write_reg(IRQ_STATUS_OFFSET, 0);
+	write_reg(IRQ_STATUS_OFFSET, IRQ_BUTTON);
+	check_regs("W1C of the other bit", IRQ_COUNT, 1);
+	write_reg(IRQ_STATUS_OFFSET, IRQ_COUNT);
+	check_regs("W1C", 0, 1);
+
+	// Enabling with nothing pending doesn't interrupt; the next event does,
+	// and the handler acknowledges it and drains both events in order.
+	write_reg(IRQ_ENABLE_OFFSET, IRQ_COUNT);
+	check_no_events("enabled, nothing pending");
+	write_reg(OUTPUT_OFFSET, 2);
+	check_regs("count interrupt", 0, 0);
+	n = read_events(evs, 4);
+	CHECK(n == 2, "count interrupt: %d events, expected 2", n);
+	if (n == 2) {
+		check_detent("count interrupt", &evs[0], 1, 0);
+		check_detent("count interrupt", &evs[1], 2, 0);
+		CHECK(evs[1].cycles - evs[0].cycles < 0x80000000u,
+			"count interrupt: events out of order");
+		// Popping the last event latched its timestamp.
+		val = read_reg(EVENT_TIME_OFFSET);
+		CHECK(val == evs[1].cycles, "count interrupt: event time 0x%x, "
+			"expected 0x%x", val, evs[1].cycles);
+	}
+
+	// A button press doesn't interrupt while only the count bit is enabled,
+	// and does as soon as its own bit is.
+	enable = read_reg(ENABLE_OFFSET) ^ 1;
+	write_reg(ENABLE_OFFSET, enable);
+	check_regs("button, count enabled", IRQ_BUTTON, 1);
+	check_no_events("button, count enabled");
+	write_reg(IRQ_ENABLE_OFFSET, IRQ_COUNT | IRQ_BUTTON);
+	check_regs("button interrupt", 0, 0);
+	n = read_events(evs, 4);
+	CHECK(n == 1, "button interrupt: %d events, expected 1", n);
+	if (n == 1) {
+		CHECK(evs[0].flags == (DE10NANO_ROTARY_EV_BUTTON |
+			((enable & 1) ? DE10NANO_ROTARY_EV_ENABLED : 0)) &&
+			evs[0].count == 2, "button interrupt: event count %d flags 0x%x",
+			evs[0].count, evs[0].flags);
+	}
+}
+
+/*
+* Reading EVENT_DATA pops one event: the driver gets every event exactly
+* once, the other registers can be read without popping, and an event
+* after a full FIFO is flagged.
+*/
+static void test_pop(void)
+{
+	struct de10nano_rotary_event evs[2 * FIFO_DEPTH];
+	uint32_t regs[SPAN / 4];
+	int n;
+	int i;
+
+	// Three events waiting; reading every register leaves them there.
+	write_reg(IRQ_ENABLE_OFFSET, 0);
+	for (i = 1; i <= 3; i++) {
+		write_reg(OUTPUT_OFFSET, 10 + i);
+	}
+	CHECK(pread(fd, regs, SPAN, 0) == SPAN, "pread of every register: %s",
+		strerror(errno));
+	CHECK(pread(fd, regs, SPAN, 0) == SPAN, "pread of every register: %s",
+		strerror(errno));
+	check_regs("registers read", IRQ_COUNT, 3);
+
+	// The level and event time belong to the FIFO.
+	write_reg(FIFO_LEVEL_OFFSET, 0);
+	write_reg(EVENT_TIME_OFFSET, 0x1234);
+	check_regs("level written", IRQ_COUNT, 3);
+	CHECK(read_reg(EVENT_TIME_OFFSET) != 0x1234, "event time written");
+
+	write_reg(IRQ_ENABLE_OFFSET, IRQ_COUNT | IRQ_BUTTON);
+	check_regs("three events drained", 0, 0);
+	n = read_events(evs, 2 * FIFO_DEPTH);
+	CHECK(n == 3, "three events: %d events", n);
+	for (i = 0; i < n && i < 3; i++) {
+		check_detent("three events", &evs[i], 11 + i, 0);
+	}
+
+	// Overfill the FIFO: the first FIFO_DEPTH events are kept, the rest
+	// dropped, and the next event pushed says so.
+	write_reg(IRQ_ENABLE_OFFSET, 0);
+	for (i = 1; i <= FIFO_DEPTH + 6; i++) {
+		write_reg(OUTPUT_OFFSET, 100 + i);
+	}
+	check_regs("full", IRQ_COUNT, FIFO_DEPTH);
+	write_reg(IRQ_ENABLE_OFFSET, IRQ_COUNT | IRQ_BUTTON);
+	check_regs("full FIFO drained", 0, 0);
+	n = read_events(evs, 2 * FIFO_DEPTH);
+	CHECK(n == FIFO_DEPTH, "full FIFO: %d events, expected %d", n,
+		FIFO_DEPTH);
+	for (i = 0; i < n && i < FIFO_DEPTH; i++) {
+		check_detent("full FIFO", &evs[i], 101 + i, 0);
+	}
+
+	write_reg(OUTPUT_OFFSET, 200);
+	n = read_events(evs, 2 * FIFO_DEPTH);
+	CHECK(n == 1, "after the overflow: %d events, expected 1", n);
+	if (n == 1) {
+		check_detent("after the overflow", &evs[0], 200,
+			DE10NANO_ROTARY_EV_OVERFLOW);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	struct de10nano_rotary_event evs[16];
+	const char *dev = argc > 1 ? argv[1] : "/dev/rotary";
+	const char *events_dev = argc > 2 ? argv[2] : "/dev/rotary_events";
+
+	fd = open(dev, O_RDWR);
+	if (fd < 0) {
+		printf("failed to open %s: %s\n", dev, strerror(errno));
+		exit(1);
+	}
+	events_fd = open(events_dev, O_RDONLY | O_NONBLOCK);
+	if (events_fd < 0) {
+		printf("failed to open %s: %s\n", events_dev, strerror(errno));
+		exit(1);
+	}
+
+	// Start from a count of 0 with nothing queued.
+	write_reg(IRQ_ENABLE_OFFSET, IRQ_COUNT | IRQ_BUTTON);
+	write_reg(OUTPUT_OFFSET, 0);
+	while (read_events(evs, 16) > 0) {
+	}
+
+	test_irq();
+	test_pop();
+
+	write_reg(IRQ_ENABLE_OFFSET, IRQ_COUNT | IRQ_BUTTON);
+	close(events_fd);
+	close(fd);
+
+	if (failures) {
+		printf("rotary-irq: %d failures\n", failures);
+		return 1;
+	}
+	printf("rotary-irq: all tests passed\n");
+	return 0;
+}